@@ -0,0 +1,369 @@
+// Parser benchmarks. Corpus sizes run from 1 KiB up to
+// DOCPARSER_BENCH_MAX_BYTES (default 64 MiB; set 1073741824 for the full
+// 1 GiB range). Every benchmark reports bytes/second and heap allocations
+// per parsed document.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <regex>
+
+#include "async_parser.h"
+#include "document_parser.h"
+#include "corpus_generator.h"
+
+// Count every heap allocation made by the process
+static std::atomic<size_t> allocationCount{0};
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// std::pmr::new_delete_resource() goes through the aligned forms
+void* operator new(size_t size, std::align_val_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    size_t align = std::max(static_cast<size_t>(alignment), sizeof(void*));
+    if (void* p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace {
+
+size_t maxCorpusBytes() {
+    if (const char* env = std::getenv("DOCPARSER_BENCH_MAX_BYTES")) {
+        return std::strtoull(env, nullptr, 10);
+    }
+    return size_t(64) << 20;
+}
+
+void corpusSizes(benchmark::internal::Benchmark* bench) {
+    for (size_t size : CorpusGenerator::standardSizes(maxCorpusBytes())) {
+        bench->Arg(static_cast<int64_t>(size));
+    }
+}
+
+std::string corpusFile(const std::string& format, size_t size) {
+    return CorpusGenerator::ensureFile(CorpusGenerator::defaultDirectory(), format, size);
+}
+
+std::string corpusText(const std::string& format, size_t size) {
+    return CorpusGenerator::generate(format, size);
+}
+
+// Shared driver: parse one corpus file per iteration
+template <typename Parser>
+void parseFile(benchmark::State& state, const std::string& format) {
+    std::string path = corpusFile(format, static_cast<size_t>(state.range(0)));
+    FileBuffer probe(path);
+    size_t bytes = probe.size();
+    Parser parser;
+
+    size_t before = allocationCount.load();
+    for (auto _ : state) {
+        Document doc = parser.parse(path);
+        benchmark::DoNotOptimize(doc.content.data());
+    }
+    size_t allocations = allocationCount.load() - before;
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.counters["allocs_per_doc"] = benchmark::Counter(
+        static_cast<double>(allocations) / static_cast<double>(state.iterations()));
+}
+
+void BM_TextParser(benchmark::State& state) { parseFile<TextParser>(state, "txt"); }
+void BM_CSVParser(benchmark::State& state) { parseFile<CSVParser>(state, "csv"); }
+void BM_JSONParser(benchmark::State& state) { parseFile<JSONParser>(state, "json"); }
+void BM_XMLParser(benchmark::State& state) { parseFile<XMLParser>(state, "html"); }
+void BM_MarkdownParser(benchmark::State& state) { parseFile<MarkdownParser>(state, "md"); }
+
+BENCHMARK(BM_TextParser)->Apply(corpusSizes);
+BENCHMARK(BM_CSVParser)->Apply(corpusSizes);
+BENCHMARK(BM_JSONParser)->Apply(corpusSizes);
+BENCHMARK(BM_XMLParser)->Apply(corpusSizes);
+BENCHMARK(BM_MarkdownParser)->Apply(corpusSizes);
+
+// Dispatch overhead: a mix of small files of every format through the
+// manager, fresh or reusing one ParseContext (second argument)
+void BM_ParseDocumentDispatch(benchmark::State& state) {
+    std::vector<std::string> paths;
+    size_t bytes = 0;
+    for (const auto& format : CorpusGenerator::formats()) {
+        paths.push_back(corpusFile(format, static_cast<size_t>(state.range(0))));
+        bytes += FileBuffer(paths.back()).size();
+    }
+    UniversalDocumentParser parser;
+    ParseContext context;
+    bool reuse = state.range(1) != 0;
+
+    size_t before = allocationCount.load();
+    for (auto _ : state) {
+        for (const auto& path : paths) {
+            if (reuse) {
+                benchmark::DoNotOptimize(parser.parseDocument(path, context).content.data());
+            } else {
+                Document doc = parser.parseDocument(path);
+                benchmark::DoNotOptimize(doc.content.data());
+            }
+        }
+    }
+    size_t allocations = allocationCount.load() - before;
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * paths.size()));
+    state.counters["allocs_per_doc"] = benchmark::Counter(
+        static_cast<double>(allocations) / static_cast<double>(state.iterations() * paths.size()));
+}
+BENCHMARK(BM_ParseDocumentDispatch)->ArgsProduct({{1024, 16 * 1024}, {0, 1}});
+
+// Many small files in one batch, with and without a shared DocumentArena
+void BM_ParseBatch(benchmark::State& state) {
+    std::vector<std::string> paths;
+    for (int i = 0; i < 64; ++i) {
+        for (const auto& format : CorpusGenerator::formats()) {
+            paths.push_back(corpusFile(format, 1024));
+        }
+    }
+    UniversalDocumentParser parser;
+    bool useArena = state.range(0) != 0;
+    state.SetLabel(useArena ? "arena" : "heap");
+
+    size_t before = allocationCount.load();
+    for (auto _ : state) {
+        DocumentArena arena;
+        BatchOptions options;
+        options.threads = 1;
+        options.arena = useArena ? &arena : nullptr;
+        std::vector<BatchResult> results = parser.parseDocuments(paths, options);
+        benchmark::DoNotOptimize(results.data());
+    }
+    size_t allocations = allocationCount.load() - before;
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * paths.size()));
+    state.counters["allocs_per_doc"] = benchmark::Counter(
+        static_cast<double>(allocations) / static_cast<double>(state.iterations() * paths.size()));
+}
+BENCHMARK(BM_ParseBatch)->Arg(0)->Arg(1);
+
+// The same number of files crawled from a nested tree by parseDirectory;
+// Arg is the number of parse threads
+void BM_ParseDirectory(benchmark::State& state) {
+    namespace fs = std::filesystem;
+    fs::path root = fs::path(CorpusGenerator::defaultDirectory()) / "tree";
+    size_t files = 0;
+    for (int i = 0; i < 64; ++i) {
+        fs::path dir = root / std::to_string(i % 8) / std::to_string(i / 8) / "a" / "b";
+        fs::create_directories(dir);
+        for (const auto& format : CorpusGenerator::formats()) {
+            fs::path target = dir / fs::path(corpusFile(format, 1024)).filename();
+            if (!fs::exists(target)) {
+                fs::copy_file(corpusFile(format, 1024), target);
+            }
+            ++files;
+        }
+    }
+    UniversalDocumentParser parser;
+    DirectoryOptions options;
+    options.parseThreads = static_cast<size_t>(state.range(0));
+
+    for (auto _ : state) {
+        size_t parsed = parser.parseDirectory(root.string(), DirectoryFilters(), options,
+                                              [](BatchResult&& result) {
+                                                  benchmark::DoNotOptimize(result.ok);
+                                                  return true;
+                                              });
+        benchmark::DoNotOptimize(parsed);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * files));
+}
+BENCHMARK(BM_ParseDirectory)->Arg(1)->Arg(4)->UseRealTime();
+
+// The same files through AsyncDocumentParser; Arg is 1 for io_uring reads,
+// 0 for the thread reader
+void BM_ParseAsync(benchmark::State& state) {
+    std::vector<std::string> paths;
+    for (int i = 0; i < 64; ++i) {
+        for (const auto& format : CorpusGenerator::formats()) {
+            paths.push_back(corpusFile(format, 1024));
+        }
+    }
+    UniversalDocumentParser parser;
+    AsyncOptions options;
+    options.useIoUring = state.range(0) != 0;
+    options.parseThreads = 1;
+    AsyncDocumentParser async(parser, options);
+    state.SetLabel(async.backend());
+
+    for (auto _ : state) {
+        for (const auto& path : paths) {
+            async.parseAsync(path, [](BatchResult&& result) { benchmark::DoNotOptimize(result.ok); });
+        }
+        async.wait();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * paths.size()));
+}
+BENCHMARK(BM_ParseAsync)->Arg(0)->Arg(1)->UseRealTime();
+
+// One large input split across cores; Arg is the thread count
+void BM_ParseParallel(benchmark::State& state, const std::string& format) {
+    std::string text = corpusText(format, size_t(256) << 20);
+    ParallelOptions options;
+    options.threads = static_cast<size_t>(state.range(0));
+    options.minChunkBytes = 1 << 20;
+    std::unique_ptr<DocumentParser> parser;
+    if (format == "csv") {
+        parser = std::make_unique<CSVParser>(options);
+    } else {
+        parser = std::make_unique<TextParser>(options);
+    }
+
+    for (auto _ : state) {
+        Document doc = parser->parseContent(text, "corpus." + format);
+        benchmark::DoNotOptimize(doc.content.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK_CAPTURE(BM_ParseParallel, csv, std::string("csv"))
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ParseParallel, txt, std::string("txt"))
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// CSV structural scanning: each SIMD level against the original per-byte loop
+void BM_CSVScan(benchmark::State& state) {
+    std::string csv = corpusText("csv", size_t(16) << 20);
+    SimdLevel level = static_cast<SimdLevel>(state.range(0));
+    if (level != SimdLevel::Scalar && CSVScanner(level).level() != level) {
+        state.SkipWithError("SIMD level not supported on this CPU");
+        return;
+    }
+    state.SetLabel(simdLevelName(level));
+
+    std::vector<std::string_view> fields;
+    for (auto _ : state) {
+        CSVRowReader reader = CSVRowReader::fromBuffer(csv, level);
+        while (reader.next(fields)) {
+            benchmark::DoNotOptimize(fields.data());
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * csv.size()));
+}
+BENCHMARK(BM_CSVScan)
+    ->Arg(static_cast<int>(SimdLevel::Scalar))
+    ->Arg(static_cast<int>(SimdLevel::SSE42))
+    ->Arg(static_cast<int>(SimdLevel::AVX2))
+    ->Arg(static_cast<int>(SimdLevel::NEON));
+
+// The pre-scanner CSV tokenizer, kept as the scalar reference
+void BM_CSVScanLegacy(benchmark::State& state) {
+    std::string csv = corpusText("csv", size_t(16) << 20);
+    for (auto _ : state) {
+        size_t pos = 0;
+        while (pos < csv.size()) {
+            size_t end = csv.find('\n', pos);
+            if (end == std::string::npos) end = csv.size();
+            std::vector<std::string> fields;
+            std::string field;
+            bool inQuotes = false;
+            for (size_t i = pos; i < end; ++i) {
+                char c = csv[i];
+                if (c == '"') {
+                    inQuotes = !inQuotes;
+                } else if (c == ',' && !inQuotes) {
+                    fields.push_back(field);
+                    field.clear();
+                } else {
+                    field += c;
+                }
+            }
+            fields.push_back(field);
+            benchmark::DoNotOptimize(fields.data());
+            pos = end + 1;
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * csv.size()));
+}
+BENCHMARK(BM_CSVScanLegacy);
+
+// The regex-based conversions replaced by the linear scanners
+std::string legacyMarkdownToText(const std::string& md) {
+    std::string result = md;
+    result = std::regex_replace(result, std::regex("^#+\\s*", std::regex_constants::ECMAScript), "");
+    result = std::regex_replace(result, std::regex("\\*\\*([^*]+)\\*\\*"), "$1");
+    result = std::regex_replace(result, std::regex("\\*([^*]+)\\*"), "$1");
+    result = std::regex_replace(result, std::regex("\\[([^\\]]+)\\]\\([^)]+\\)"), "$1");
+    result = std::regex_replace(result, std::regex("```[^`]*```"), "");
+    result = std::regex_replace(result, std::regex("`([^`]+)`"), "$1");
+    return result;
+}
+
+std::string legacyTextFromXML(const std::string& xml) {
+    std::string result;
+    bool inTag = false;
+    for (char c : xml) {
+        if (c == '<') {
+            inTag = true;
+        } else if (c == '>') {
+            inTag = false;
+            result += ' ';
+        } else if (!inTag) {
+            result += c;
+        }
+    }
+    return std::regex_replace(result, std::regex("\\s+"), " ");
+}
+
+// The scanners on the same in-memory inputs as the regex versions below
+void BM_MarkdownScanner(benchmark::State& state) {
+    std::string md = corpusText("md", static_cast<size_t>(state.range(0)));
+    MarkdownParser parser;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parser.parseContent(md, "input.md").content.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * md.size()));
+}
+BENCHMARK(BM_MarkdownScanner)->Arg(1024)->Arg(64 * 1024)->Arg(1024 * 1024);
+
+void BM_XMLScanner(benchmark::State& state) {
+    std::string html = corpusText("html", static_cast<size_t>(state.range(0)));
+    XMLParser parser;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parser.parseContent(html, "input.html").content.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * html.size()));
+}
+BENCHMARK(BM_XMLScanner)->Arg(1024)->Arg(64 * 1024)->Arg(1024 * 1024);
+
+void BM_MarkdownLegacyRegex(benchmark::State& state) {
+    std::string md = corpusText("md", static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(legacyMarkdownToText(md));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * md.size()));
+}
+BENCHMARK(BM_MarkdownLegacyRegex)->Arg(1024)->Arg(64 * 1024)->Arg(1024 * 1024);
+
+void BM_XMLLegacyRegex(benchmark::State& state) {
+    std::string html = corpusText("html", static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(legacyTextFromXML(html));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * html.size()));
+}
+BENCHMARK(BM_XMLLegacyRegex)->Arg(1024)->Arg(64 * 1024)->Arg(1024 * 1024);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,191 @@
+#ifndef CORPUS_GENERATOR_H
+#define CORPUS_GENERATOR_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Deterministic synthetic documents for benchmarks. The same (format, size)
+// pair always produces the same bytes on every platform, so numbers from
+// different machines and commits are comparable.
+class CorpusGenerator {
+public:
+    // Formats understood by generate(); also the file extensions used
+    static const std::vector<std::string>& formats() {
+        static const std::vector<std::string> list = {"txt", "csv", "json", "html", "md"};
+        return list;
+    }
+
+    // 1 KiB to 1 GiB in steps of 16x
+    static std::vector<size_t> standardSizes(size_t maxBytes = size_t(1) << 30) {
+        std::vector<size_t> sizes;
+        for (size_t size = 1024; size <= maxBytes; size *= 16) {
+            sizes.push_back(size);
+        }
+        return sizes;
+    }
+
+    // Roughly `targetBytes` of `format`, cut at a record boundary and kept
+    // well-formed (JSON arrays are closed, code fences balanced)
+    static std::string generate(const std::string& format, size_t targetBytes) {
+        CorpusGenerator gen(seedFor(format, targetBytes));
+        std::string out;
+        out.reserve(targetBytes + 4096);
+
+        if (format == "csv") {
+            out += "id,name,price,active,comment\n";
+            while (out.size() < targetBytes) gen.csvRow(out);
+        } else if (format == "json") {
+            out += "[";
+            bool first = true;
+            while (out.size() + 2 < targetBytes) {
+                if (!first) out += ",";
+                first = false;
+                gen.jsonRecord(out);
+            }
+            out += "]\n";
+        } else if (format == "html") {
+            out += "<!DOCTYPE html>\n<html><head><title>Corpus</title></head><body>\n";
+            while (out.size() + 16 < targetBytes) gen.htmlBlock(out);
+            out += "</body></html>\n";
+        } else if (format == "md") {
+            while (out.size() < targetBytes) gen.markdownSection(out);
+        } else {
+            while (out.size() < targetBytes) gen.textLine(out);
+        }
+        return out;
+    }
+
+    // Path of the corpus file, generated on first use (output is deterministic)
+    static std::string ensureFile(const std::filesystem::path& dir, const std::string& format,
+                                  size_t targetBytes) {
+        std::filesystem::create_directories(dir);
+        std::filesystem::path path = dir / ("corpus_" + std::to_string(targetBytes) + "." + format);
+        std::string content;
+        std::error_code ec;
+        auto existing = std::filesystem::file_size(path, ec);
+        if (ec || existing == 0) {
+            content = generate(format, targetBytes);
+            std::ofstream file(path, std::ios::binary);
+            file.write(content.data(), static_cast<std::streamsize>(content.size()));
+        }
+        return path.string();
+    }
+
+    // Directory used by the benchmark binaries; DOCPARSER_CORPUS_DIR overrides
+    static std::filesystem::path defaultDirectory() {
+        if (const char* dir = std::getenv("DOCPARSER_CORPUS_DIR")) {
+            return dir;
+        }
+        return std::filesystem::temp_directory_path() / "docparser_corpus";
+    }
+
+private:
+    uint64_t state;
+
+    explicit CorpusGenerator(uint64_t seed) : state(seed) {}
+
+    static uint64_t seedFor(const std::string& format, size_t size) {
+        uint64_t h = 1469598103934665603ULL;
+        for (char c : format) {
+            h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+        return h ^ (static_cast<uint64_t>(size) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    // SplitMix64
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    size_t below(size_t n) { return static_cast<size_t>(next() % n); }
+
+    const char* word() {
+        static const char* words[] = {
+            "document", "parser", "stream", "buffer", "index", "value", "record", "field",
+            "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "lorem", "ipsum",
+            "dolor", "sit", "amet", "alpha", "beta", "gamma", "delta", "throughput"};
+        return words[below(sizeof(words) / sizeof(words[0]))];
+    }
+
+    void words(std::string& out, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            if (i > 0) out += ' ';
+            out += word();
+        }
+    }
+
+    void textLine(std::string& out) {
+        words(out, 4 + below(12));
+        out += below(20) == 0 ? "\n\n" : "\n";
+    }
+
+    void csvRow(std::string& out) {
+        out += std::to_string(next() % 1000000);
+        out += ',';
+        out += word();
+        out += ',';
+        out += std::to_string(below(100000) / 100.0).substr(0, 7);
+        out += ',';
+        out += below(2) ? "true" : "false";
+        out += ",\"";
+        words(out, 1 + below(5));
+        if (below(8) == 0) out += ", with a comma";
+        out += "\"\n";
+    }
+
+    void jsonRecord(std::string& out) {
+        out += "{\"id\": ";
+        out += std::to_string(next() % 1000000);
+        out += ", \"name\": \"";
+        out += word();
+        if (below(10) == 0) out += " \\\"quoted\\\" \\\\ path";
+        out += "\", \"score\": ";
+        out += std::to_string(below(10000) / 100.0).substr(0, 5);
+        out += ", \"tags\": [\"";
+        out += word();
+        out += "\", \"";
+        out += word();
+        out += "\"], \"meta\": {\"active\": ";
+        out += below(2) ? "true" : "false";
+        out += ", \"parent\": null}}";
+    }
+
+    void htmlBlock(std::string& out) {
+        switch (below(4)) {
+            case 0: out += "<h2>"; words(out, 3); out += "</h2>\n"; break;
+            case 1: out += "<div class=\"item\"><span>"; words(out, 5); out += "</span></div>\n"; break;
+            case 2: out += "<ul><li>"; words(out, 3); out += "</li><li>"; words(out, 3); out += "</li></ul>\n"; break;
+            default: out += "<p>"; words(out, 8); out += " <b>"; out += word(); out += "</b> &amp; ";
+                     words(out, 6); out += "</p>\n"; break;
+        }
+    }
+
+    void markdownSection(std::string& out) {
+        out += below(3) == 0 ? "# " : "## ";
+        words(out, 3);
+        out += "\n\nSome **";
+        out += word();
+        out += "** text with *";
+        out += word();
+        out += "* and a [link](https://example.com/";
+        out += word();
+        out += ") plus `code`.\n";
+        if (below(3) == 0) {
+            out += "\n```\nfor (int i = 0; i < n; ++i) { sum += v[i]; }\n```\n";
+        }
+        out += "\n- ";
+        words(out, 4);
+        out += "\n- ";
+        words(out, 4);
+        out += "\n\n";
+    }
+};
+
+#endif // CORPUS_GENERATOR_H
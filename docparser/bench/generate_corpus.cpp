@@ -0,0 +1,24 @@
+// Writes the deterministic benchmark corpus to disk.
+//
+//   docparser_corpus [output_dir] [max_bytes]
+//
+// Produces corpus_<size>.<ext> for every format and every standard size up
+// to max_bytes (default 1 GiB).
+
+#include <cstdlib>
+#include <iostream>
+
+#include "corpus_generator.h"
+
+int main(int argc, char** argv) {
+    std::filesystem::path dir = argc > 1 ? std::filesystem::path(argv[1])
+                                         : CorpusGenerator::defaultDirectory();
+    size_t maxBytes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : size_t(1) << 30;
+
+    for (size_t size : CorpusGenerator::standardSizes(maxBytes)) {
+        for (const auto& format : CorpusGenerator::formats()) {
+            std::cout << CorpusGenerator::ensureFile(dir, format, size) << "\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,217 @@
+"""Binding-overhead regression test for the docparser Python module.
+
+docparser_perf times the C++ parser alone; this harness times what the
+bindings add on top of it, on the same deterministic corpus:
+
+  call_overhead_us        fixed cost of one parse_buffer() call on a tiny input
+  parse_document_mb_per_s parse_document() returning lazy Document objects
+  content_mb_per_s        converting Document.content to str
+  to_dict_mb_per_s        Document.to_dict()
+  batch_mb_per_s_<n>      parse_batch() with n threads, GIL released
+  iter_csv_rows_per_s     iter_csv() row tuples
+  peak_rss_mb             peak resident set size of the process
+
+    python docparser/bench/perf_bindings.py [--corpus DIR] [--max-bytes N]
+        [--output results.json] [--baseline baselines.json]
+        [--write-baseline FILE] [--native perf_results.json]
+
+The corpus is the one docparser_perf and docparser_corpus write; run either
+first. --native takes docparser_perf's --output and reports how much slower
+single-threaded parsing is through Python. With --baseline, a metric more
+than the baseline's tolerance worse fails the run with exit status 1.
+Multi-threaded batches are only compared on a machine with the
+baseline's CPU count, and --write-baseline leaves out batches with more
+threads than CPUs.
+"""
+
+import argparse
+import json
+import os
+import resource
+import sys
+import tempfile
+import time
+
+import docparser
+
+FORMATS = ["txt", "csv", "json", "html", "md"]
+THREADS = [1, 4, 16]
+DEFAULT_TOLERANCE = {"throughput": 0.25, "latency": 1.0, "rss": 0.25}
+
+# Metric name -> True when higher is better
+HIGHER_IS_BETTER = {
+    "call_overhead_us": False,
+    "parse_document_mb_per_s": True,
+    "content_mb_per_s": True,
+    "to_dict_mb_per_s": True,
+    "iter_csv_rows_per_s": True,
+    "peak_rss_mb": False,
+}
+HIGHER_IS_BETTER.update({"batch_mb_per_s_%d" % n: True for n in THREADS})
+
+
+def default_corpus_dir():
+    return os.environ.get("DOCPARSER_CORPUS_DIR",
+                          os.path.join(tempfile.gettempdir(), "docparser_corpus"))
+
+
+def standard_sizes(max_bytes):
+    sizes = []
+    size = 1024
+    while size <= max_bytes:
+        sizes.append(size)
+        size *= 16
+    return sizes
+
+
+def workload(corpus, max_bytes):
+    """Same mix as docparser_perf: small files repeated so every size
+    contributes about the same number of bytes."""
+    sizes = standard_sizes(max_bytes)
+    paths = []
+    for size in sizes:
+        copies = max(1, sizes[-1] // size // 16)
+        for fmt in FORMATS:
+            path = os.path.join(corpus, "corpus_%d.%s" % (size, fmt))
+            if not os.path.exists(path):
+                sys.exit("missing %s; write the corpus with docparser_corpus %s %d"
+                         % (path, corpus, max_bytes))
+            paths.extend([path] * copies)
+    return paths
+
+
+def timed(fn, repeat=3):
+    """Median wall time of `repeat` calls of fn()"""
+    times = []
+    for _ in range(repeat):
+        start = time.perf_counter()
+        fn()
+        times.append(time.perf_counter() - start)
+    return sorted(times)[len(times) // 2]
+
+
+def peak_rss_mb():
+    usage = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # kilobytes on Linux, bytes on macOS
+    return usage / (1024.0 * 1024.0) if sys.platform == "darwin" else usage / 1024.0
+
+
+def measure(paths, corpus, max_bytes):
+    total_bytes = sum(os.path.getsize(p) for p in paths)
+    mb = total_bytes / 1e6
+    parser = docparser.DocumentParser()
+    metrics = {}
+
+    calls = 20000
+    seconds = timed(lambda: [parser.parse_buffer(b"a\n", "txt") for _ in range(calls)])
+    metrics["call_overhead_us"] = seconds / calls * 1e6
+
+    docs = [parser.parse_document(p) for p in paths]   # warm the page cache
+    seconds = timed(lambda: [parser.parse_document(p) for p in paths])
+    metrics["parse_document_mb_per_s"] = mb / seconds
+    metrics["content_mb_per_s"] = mb / timed(lambda: [d.content for d in docs])
+    metrics["to_dict_mb_per_s"] = mb / timed(lambda: [d.to_dict() for d in docs])
+    del docs
+
+    for threads in THREADS:
+        seconds = timed(lambda: parser.parse_batch(paths, threads))
+        metrics["batch_mb_per_s_%d" % threads] = mb / seconds
+
+    csv = os.path.join(corpus, "corpus_%d.csv" % standard_sizes(max_bytes)[-1])
+    rows = sum(1 for _ in docparser.iter_csv(csv))
+    metrics["iter_csv_rows_per_s"] = rows / timed(lambda: sum(1 for _ in docparser.iter_csv(csv)))
+
+    metrics["peak_rss_mb"] = peak_rss_mb()
+    return metrics
+
+
+def multi_threaded(name):
+    return name.startswith("batch_mb_per_s_") and name != "batch_mb_per_s_1"
+
+
+def compare(metrics, baseline):
+    tolerance = dict(DEFAULT_TOLERANCE, **baseline.get("tolerance", {}))
+    expected = baseline.get("metrics", {})
+    # Multi-threaded numbers depend on the core count
+    same_cpus = baseline.get("machine", {}).get("cpus") == os.cpu_count()
+    if not same_cpus:
+        print("warning: baseline was recorded on %s CPUs, this machine has %d; "
+              "multi-threaded batches are not compared"
+              % (baseline.get("machine", {}).get("cpus"), os.cpu_count()), file=sys.stderr)
+    regressions = 0
+    for name, value in metrics.items():
+        if name not in expected:
+            print("  %-26s %12.3f  (no baseline)" % (name, value))
+            continue
+        if multi_threaded(name) and not same_cpus:
+            print("  %-26s %12.3f  (skipped: different CPU count)" % (name, value))
+            continue
+        base = expected[name]
+        higher = HIGHER_IS_BETTER[name]
+        if name == "peak_rss_mb":
+            allowed = tolerance["rss"]
+        elif name == "call_overhead_us":
+            allowed = tolerance["latency"]
+        else:
+            allowed = tolerance["throughput"]
+        limit = base * (1 - allowed) if higher else base * (1 + allowed)
+        failed = value < limit if higher else value > limit
+        change = (value - base) / base * 100 if base else 0.0
+        print("  %-26s %12.3f  baseline %12.3f  %+7.1f%%  %s"
+              % (name, value, base, change, "REGRESSION" if failed else "ok"))
+        regressions += failed
+    return regressions
+
+
+def main():
+    args = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    args.add_argument("--corpus", default=default_corpus_dir())
+    args.add_argument("--max-bytes", type=int, default=4 << 20)
+    args.add_argument("--output")
+    args.add_argument("--baseline")
+    args.add_argument("--write-baseline")
+    args.add_argument("--native", help="docparser_perf --output of the same build and corpus")
+    options = args.parse_args()
+
+    paths = workload(options.corpus, options.max_bytes)
+    metrics = measure(paths, options.corpus, options.max_bytes)
+    for name, value in metrics.items():
+        print("%-26s %12.3f" % (name, value))
+
+    if options.native:
+        with open(options.native) as f:
+            native = json.load(f)["runs"]["threads_1"]["mb_per_s"]
+        overhead = native / metrics["parse_document_mb_per_s"] - 1
+        print("parse_document is %.1f%% slower than the C++ parser alone" % (overhead * 100))
+
+    result = {
+        "tolerance": DEFAULT_TOLERANCE,
+        "corpus": {"max_bytes": options.max_bytes},
+        "machine": {"cpus": os.cpu_count(), "python": sys.version.split()[0]},
+        "metrics": metrics,
+    }
+    if options.output:
+        with open(options.output, "w") as f:
+            json.dump(result, f, indent=2)
+            f.write("\n")
+    if options.write_baseline:
+        # Batches with more threads than CPUs only measure time slicing
+        kept = {name: value for name, value in metrics.items()
+                if not name.startswith("batch_mb_per_s_")
+                or int(name.rsplit("_", 1)[1]) <= (os.cpu_count() or 1)}
+        with open(options.write_baseline, "w") as f:
+            json.dump(dict(result, metrics=kept), f, indent=2)
+            f.write("\n")
+
+    if options.baseline:
+        with open(options.baseline) as f:
+            regressions = compare(metrics, json.load(f))
+        if regressions:
+            print("%d metric(s) regressed beyond tolerance" % regressions)
+            return 1
+        print("no regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,401 @@
+// End-to-end throughput regression test. Parses a deterministic mixed
+// corpus through UniversalDocumentParser at several thread counts and
+// records MB/s, documents/s, p50/p99 latency per document and peak RSS.
+//
+//   docparser_perf [--corpus DIR] [--max-bytes N] [--rounds N] [--repeat N]
+//                  [--threads 1,4,16] [--output results.json]
+//                  [--baseline baselines.json] [--tolerance F]
+//                  [--write-baseline FILE]
+//
+// Each thread count runs --repeat times and the run with the median
+// throughput is kept. With --baseline it is compared against the stored
+// numbers: throughput below baseline * (1 - tolerance), or latency or RSS
+// above baseline * (1 + tolerance), fails with exit status 1. Latency must
+// also be latency_floor_ms worse, so scheduler noise on sub-millisecond
+// documents does not count. Tolerances come from the baseline file;
+// --tolerance overrides the throughput one. Baselines are only meaningful
+// for optimized builds on the machine that recorded them: a different
+// build type or SIMD level warns, and multi-threaded runs are skipped on a
+// different core count. --write-baseline records after intended changes
+// and leaves out runs with more threads than the machine has.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "corpus_generator.h"
+#include "document_parser.h"
+
+namespace {
+
+struct Options {
+    std::filesystem::path corpus = CorpusGenerator::defaultDirectory();
+    size_t maxBytes = size_t(4) << 20;
+    size_t rounds = 5;
+    size_t repeat = 3;
+    std::vector<size_t> threads = {1, 4, 16};
+    std::string output;
+    std::string baseline;
+    std::string writeBaseline;
+    double tolerance = -1;   // < 0: take it from the baseline file
+};
+
+struct RunResult {
+    size_t threads = 0;
+    size_t documents = 0;
+    size_t bytes = 0;
+    double seconds = 0;
+    double p50Ms = 0;
+    double p99Ms = 0;
+    double peakRssMb = 0;
+
+    double mbPerSecond() const { return static_cast<double>(bytes) / 1e6 / seconds; }
+    double docsPerSecond() const { return static_cast<double>(documents) / seconds; }
+};
+
+struct WorkItem {
+    std::string path;
+    size_t bytes;
+};
+
+// Every format at every standard size up to maxBytes. Smaller files are
+// repeated so that each size contributes about the same number of bytes,
+// which gives many more small documents than large ones, as in a real
+// crawl. The order is shuffled with a fixed seed.
+std::vector<WorkItem> buildWorkload(const Options& options) {
+    std::vector<size_t> sizes = CorpusGenerator::standardSizes(options.maxBytes);
+    size_t largest = sizes.empty() ? 0 : sizes.back();
+    std::vector<WorkItem> work;
+    for (size_t size : sizes) {
+        size_t copies = std::max<size_t>(1, largest / size / 16);
+        for (const auto& format : CorpusGenerator::formats()) {
+            std::string path = CorpusGenerator::ensureFile(options.corpus, format, size);
+            size_t bytes = static_cast<size_t>(std::filesystem::file_size(path));
+            for (size_t i = 0; i < copies; ++i) {
+                work.push_back({path, bytes});
+            }
+        }
+    }
+    // Fisher-Yates with mt19937, whose output is fixed by the standard
+    // (std::shuffle's use of it is not)
+    std::mt19937 random(20240601);
+    for (size_t i = work.size(); i > 1; --i) {
+        std::swap(work[i - 1], work[random() % i]);
+    }
+    return work;
+}
+
+// Start a fresh peak for VmHWM where the kernel allows it
+void resetPeakRss() {
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+double peakRssMb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtod(line.c_str() + 6, nullptr) / 1024.0;
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_maxrss) / 1024.0;
+}
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+RunResult run(const UniversalDocumentParser& parser, const std::vector<WorkItem>& work,
+              size_t rounds, size_t threads) {
+    size_t total = work.size() * rounds;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> checksum{0};
+    std::vector<std::vector<double>> latencies(threads);
+
+    resetPeakRss();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::vector<double>& mine = latencies[t];
+            mine.reserve(total / threads + 1);
+            for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < total;) {
+                auto begin = std::chrono::steady_clock::now();
+                Document doc = parser.parseDocument(work[i % work.size()].path);
+                auto end = std::chrono::steady_clock::now();
+                checksum.fetch_add(doc.content.size(), std::memory_order_relaxed);
+                mine.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    std::vector<double> all;
+    for (const auto& mine : latencies) {
+        all.insert(all.end(), mine.begin(), mine.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    RunResult result;
+    result.threads = threads;
+    result.documents = total;
+    for (const auto& item : work) {
+        result.bytes += item.bytes * rounds;
+    }
+    result.seconds = std::chrono::duration<double>(stop - start).count();
+    result.p50Ms = percentile(all, 0.50);
+    result.p99Ms = percentile(all, 0.99);
+    result.peakRssMb = peakRssMb();
+    if (checksum.load() == 0) {
+        std::cerr << "warning: every document came back empty\n";
+    }
+    return result;
+}
+
+bool optimizedBuild() {
+#ifdef NDEBUG
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Runs with more threads than the machine has cores only measure time
+// slicing, so they are left out of baselines
+std::vector<RunResult> baselineRuns(const std::vector<RunResult>& results) {
+    std::vector<RunResult> kept;
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    for (const RunResult& r : results) {
+        if (r.threads <= cores) {
+            kept.push_back(r);
+        } else {
+            std::cerr << "warning: threads_" << r.threads << " not recorded in the baseline; this machine has "
+                      << cores << " hardware thread" << (cores == 1 ? "" : "s") << "\n";
+        }
+    }
+    return kept;
+}
+
+std::string toJSON(const Options& options, const std::vector<RunResult>& results) {
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << "{\n";
+    out << "  \"tolerance\": {\"throughput\": 0.25, \"latency\": 1.00, \"latency_floor_ms\": 2.0, "
+           "\"rss\": 0.25},\n";
+    out << "  \"corpus\": {\"max_bytes\": " << options.maxBytes << ", \"rounds\": " << options.rounds
+        << ", \"repeat\": " << options.repeat << "},\n";
+    out << "  \"machine\": {\"hardware_threads\": " << std::thread::hardware_concurrency()
+        << ", \"simd\": \"" << simdLevelName(CSVScanner::detectLevel())
+        << "\", \"optimized\": " << (optimizedBuild() ? "true" : "false") << "},\n";
+    out << "  \"runs\": {\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const RunResult& r = results[i];
+        out << "    \"threads_" << r.threads << "\": {\"documents\": " << r.documents
+            << ", \"bytes\": " << r.bytes << ", \"mb_per_s\": " << r.mbPerSecond()
+            << ", \"docs_per_s\": " << r.docsPerSecond() << ", \"p50_ms\": " << r.p50Ms
+            << ", \"p99_ms\": " << r.p99Ms << ", \"peak_rss_mb\": " << r.peakRssMb << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  }\n}\n";
+    return out.str();
+}
+
+void writeFile(const std::string& path, const std::string& text) {
+    std::ofstream file(path, std::ios::binary);
+    if (!(file << text)) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+// Number at `path` in the baseline, NaN when absent
+double baselineNumber(const JSONDocument& baseline, const std::string& path) {
+    JSONValue value = baseline.at(path);
+    return value.isValid() && value.type() == JSONType::Number ? value.asDouble() : std::nan("");
+}
+
+// Compare against the baseline; returns the number of regressions
+size_t compare(const JSONDocument& baseline, const std::vector<RunResult>& results, const Options& options) {
+    double maxBytes = baselineNumber(baseline, "corpus.max_bytes");
+    double rounds = baselineNumber(baseline, "corpus.rounds");
+    if (maxBytes != static_cast<double>(options.maxBytes) || rounds != static_cast<double>(options.rounds)) {
+        std::cerr << "warning: baseline was recorded with a different corpus (--max-bytes, --rounds)\n";
+    }
+    double tolerance = options.tolerance;
+    double throughputTolerance = tolerance >= 0 ? tolerance : baselineNumber(baseline, "tolerance.throughput");
+    double latencyTolerance = baselineNumber(baseline, "tolerance.latency");
+    double latencyFloor = baselineNumber(baseline, "tolerance.latency_floor_ms");
+    double rssTolerance = baselineNumber(baseline, "tolerance.rss");
+    if (std::isnan(throughputTolerance)) throughputTolerance = 0.25;
+    if (std::isnan(latencyTolerance)) latencyTolerance = 1.00;
+    if (std::isnan(latencyFloor)) latencyFloor = 2.0;
+    if (std::isnan(rssTolerance)) rssTolerance = 0.25;
+
+    JSONValue optimized = baseline.at("machine.optimized");
+    if (optimized.isValid() && optimized.asBool() != optimizedBuild()) {
+        std::cerr << "warning: baseline was recorded with a" << (optimized.asBool() ? "n optimized" : " debug")
+                  << " build; configure with -DCMAKE_BUILD_TYPE=Release\n";
+    }
+    JSONValue simd = baseline.at("machine.simd");
+    std::string simdHere = simdLevelName(CSVScanner::detectLevel());
+    if (simd.isValid() && simd.asString() != simdHere) {
+        std::cerr << "warning: baseline was recorded with " << simd.asString() << " scanning, this machine uses "
+                  << simdHere << "\n";
+    }
+    // Multi-threaded numbers depend on the core count, so they are only
+    // compared on a machine with as many hardware threads as the baseline's
+    double baselineCores = baselineNumber(baseline, "machine.hardware_threads");
+    double cores = std::max(1u, std::thread::hardware_concurrency());
+    bool sameCores = baselineCores == cores;
+    if (!sameCores) {
+        std::cerr << "warning: baseline was recorded on " << baselineCores << " hardware threads, this machine has "
+                  << cores << "; multi-threaded runs are not compared\n";
+    }
+
+    size_t regressions = 0;
+    auto check = [&](const std::string& run, const char* metric, double measured, bool higherIsBetter,
+                     double allowed, double slack = 0) {
+        double expected = baselineNumber(baseline, "runs." + run + "." + metric);
+        if (std::isnan(expected)) {
+            std::printf("  %-11s %-12s %12.3f  (no baseline)\n", run.c_str(), metric, measured);
+            return;
+        }
+        double limit = higherIsBetter ? expected * (1 - allowed)
+                                      : std::max(expected * (1 + allowed), expected + slack);
+        bool failed = higherIsBetter ? measured < limit : measured > limit;
+        double change = expected != 0 ? (measured - expected) / expected * 100 : 0;
+        std::printf("  %-11s %-12s %12.3f  baseline %12.3f  %+7.1f%%  %s\n", run.c_str(), metric, measured,
+                    expected, change, failed ? "REGRESSION" : "ok");
+        regressions += failed;
+    };
+    for (const RunResult& r : results) {
+        std::string run = "threads_" + std::to_string(r.threads);
+        if (r.threads > 1 && !sameCores) {
+            std::printf("  %-11s (skipped: different core count)\n", run.c_str());
+            continue;
+        }
+        check(run, "mb_per_s", r.mbPerSecond(), true, throughputTolerance);
+        check(run, "docs_per_s", r.docsPerSecond(), true, throughputTolerance);
+        check(run, "p50_ms", r.p50Ms, false, latencyTolerance, latencyFloor);
+        check(run, "p99_ms", r.p99Ms, false, latencyTolerance, latencyFloor);
+        check(run, "peak_rss_mb", r.peakRssMb, false, rssTolerance);
+    }
+    return regressions;
+}
+
+std::vector<size_t> parseThreadList(const char* text) {
+    std::vector<size_t> threads;
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        size_t count = std::strtoull(item.c_str(), nullptr, 10);
+        if (count == 0) {
+            throw std::invalid_argument("--threads takes a comma-separated list of positive counts");
+        }
+        threads.push_back(count);
+    }
+    return threads;
+}
+
+Options parseArguments(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("missing value for " + flag);
+        }
+        const char* value = argv[++i];
+        if (flag == "--corpus") options.corpus = value;
+        else if (flag == "--max-bytes") options.maxBytes = std::strtoull(value, nullptr, 10);
+        else if (flag == "--rounds") options.rounds = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+        else if (flag == "--repeat") options.repeat = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+        else if (flag == "--threads") options.threads = parseThreadList(value);
+        else if (flag == "--output") options.output = value;
+        else if (flag == "--baseline") options.baseline = value;
+        else if (flag == "--write-baseline") options.writeBaseline = value;
+        else if (flag == "--tolerance") options.tolerance = std::strtod(value, nullptr);
+        else throw std::invalid_argument("unknown option " + flag);
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        Options options = parseArguments(argc, argv);
+        std::vector<WorkItem> work = buildWorkload(options);
+        UniversalDocumentParser parser;
+        if (!optimizedBuild()) {
+            std::cerr << "warning: unoptimized build; numbers are not comparable to release baselines\n";
+        }
+
+        // Warm the page cache and the allocator before timing anything
+        run(parser, work, 1, 1);
+        std::vector<RunResult> results;
+        for (size_t threads : options.threads) {
+            std::vector<RunResult> repeats;
+            for (size_t i = 0; i < options.repeat; ++i) {
+                repeats.push_back(run(parser, work, options.rounds, threads));
+            }
+            std::sort(repeats.begin(), repeats.end(), [](const RunResult& a, const RunResult& b) {
+                return a.mbPerSecond() < b.mbPerSecond();
+            });
+            results.push_back(repeats[repeats.size() / 2]);
+            const RunResult& r = results.back();
+            std::printf("threads %-3zu %9.1f MB/s %10.0f docs/s  p50 %7.3f ms  p99 %7.3f ms  peak RSS %7.1f MB\n",
+                        r.threads, r.mbPerSecond(), r.docsPerSecond(), r.p50Ms, r.p99Ms, r.peakRssMb);
+        }
+
+        std::string json = toJSON(options, results);
+        if (!options.output.empty()) {
+            writeFile(options.output, json);
+        }
+        if (!options.writeBaseline.empty()) {
+            writeFile(options.writeBaseline, toJSON(options, baselineRuns(results)));
+            std::printf("baseline written to %s\n", options.writeBaseline.c_str());
+        }
+        if (options.baseline.empty()) {
+            return 0;
+        }
+        std::ifstream file(options.baseline, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot open baseline " + options.baseline);
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+        JSONDocument baseline(text.str());
+        size_t regressions = compare(baseline, results, options);
+        if (regressions > 0) {
+            std::printf("%zu metric(s) regressed beyond tolerance\n", regressions);
+            return 1;
+        }
+        std::printf("no regressions\n");
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "docparser_perf: " << e.what() << "\n";
+        return 2;
+    }
+}
@@ -0,0 +1,504 @@
+#ifndef ASYNC_PARSER_H
+#define ASYNC_PARSER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "document_parser.h"
+
+#if defined(__linux__) && !defined(DOCPARSER_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#define DOCPARSER_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <cerrno>
+#endif
+
+// Settings for AsyncDocumentParser
+struct AsyncOptions {
+    size_t maxInFlight = 32;   // files being read or waiting to be parsed
+    size_t parseThreads = 0;   // 0 = one per hardware thread
+    bool useIoUring = true;    // false forces the thread-pool reader
+    ParseOutput outputs = ParseOutput::All;
+};
+
+// Reads whole files without blocking the caller. `done` runs on a reader
+// thread with the bytes or a non-empty error and should return quickly.
+class FileReadBackend {
+public:
+    using Done = std::function<void(std::string&& data, const std::string& error)>;
+
+    virtual ~FileReadBackend() = default;
+    virtual void read(const std::string& filename, Done done) = 0;
+    virtual const char* name() const = 0;
+
+    // Blocking read of a whole file
+    static bool readWhole(const std::string& filename, std::string& data, std::string& error) {
+        try {
+            FileBuffer input(filename, false);
+            data.assign(input.view().data(), input.size());
+            return true;
+        } catch (const std::exception& e) {
+            error = e.what();
+            return false;
+        }
+    }
+};
+
+// Portable backend: blocking reads on a small pool of I/O threads
+class ThreadFileReader : public FileReadBackend {
+public:
+    explicit ThreadFileReader(size_t threads) : pool(threads) {}
+
+    void read(const std::string& filename, Done done) override {
+        pool.submit([filename, done = std::move(done)] {
+            std::string data;
+            std::string error;
+            readWhole(filename, data, error);
+            done(std::move(data), error);
+        });
+    }
+
+    const char* name() const override { return "threads"; }
+
+private:
+    WorkStealingPool pool;
+};
+
+#ifdef DOCPARSER_HAVE_IO_URING
+// Linux backend: one thread drives an io_uring through the raw syscalls.
+// Files are opened on that thread and read with READV submissions that are
+// reissued for short reads; an eventfd read kept in the ring wakes the
+// thread when new files arrive. Pipes and files without a size (most of
+// /proc) could block that thread, so they go to a small ThreadFileReader.
+// Callers bound the number of outstanding reads (AsyncDocumentParser
+// does), which keeps the ring from filling.
+class UringFileReader : public FileReadBackend {
+public:
+    // Null when the kernel or a sandbox rejects io_uring
+    static std::unique_ptr<UringFileReader> create(size_t maxInFlight) {
+        std::unique_ptr<UringFileReader> reader(new UringFileReader());
+        if (!reader->setup(maxInFlight)) {
+            return nullptr;
+        }
+        reader->loop = std::thread([r = reader.get()] { r->run(); });
+        return reader;
+    }
+
+    ~UringFileReader() override {
+        if (loop.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            wake();
+            loop.join();
+        }
+        if (sqes) ::munmap(sqes, sqesSize);
+        if (cqRing && cqRing != sqRing) ::munmap(cqRing, cqRingSize);
+        if (sqRing) ::munmap(sqRing, sqRingSize);
+        if (ringFd >= 0) ::close(ringFd);
+        if (wakeFd >= 0) ::close(wakeFd);
+    }
+
+    void read(const std::string& filename, Done done) override {
+        auto request = std::make_unique<Request>();
+        request->filename = filename;
+        request->done = std::move(done);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            pending.push_back(std::move(request));
+        }
+        wake();
+    }
+
+    const char* name() const override { return "io_uring"; }
+
+private:
+    struct Request {
+        std::string filename;
+        Done done;
+        int fd = -1;
+        std::string data;
+        size_t offset = 0;
+        iovec iov{};
+    };
+
+    static constexpr uint64_t kWakeTag = 0;
+    static constexpr size_t kMaxReadBytes = size_t(1) << 30;
+
+    int ringFd = -1;
+    int wakeFd = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned toSubmit = 0;
+
+    uint64_t wakeValue = 0;
+    iovec wakeIov{};
+
+    std::thread loop;
+    std::mutex lock;
+    std::deque<std::unique_ptr<Request>> pending;
+    bool stopping = false;
+    size_t inFlight = 0;  // touched only by the loop thread
+    std::unique_ptr<ThreadFileReader> blockingReads;  // likewise; drained on destruction
+
+    UringFileReader() = default;
+
+    bool setup(size_t maxInFlight) {
+        unsigned entries = 2;
+        while (entries < maxInFlight + 1) {
+            entries <<= 1;
+        }
+
+        io_uring_params params{};
+        ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0) {
+            return false;
+        }
+        wakeFd = ::eventfd(0, EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            return false;
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            sqRing = nullptr;
+            return false;
+        }
+        if (singleMap) {
+            cqRing = sqRing;
+        } else {
+            cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ringFd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                cqRing = nullptr;
+                return false;
+            }
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMap = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              ringFd, IORING_OFF_SQES);
+        if (sqeMap == MAP_FAILED) {
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    void pushRead(int fd, iovec* iov, uint64_t offset, uint64_t tag) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(iov);
+        sqe->len = 1;
+        sqe->off = offset;
+        sqe->user_data = tag;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++toSubmit;
+    }
+
+    void armWake() {
+        wakeIov.iov_base = &wakeValue;
+        wakeIov.iov_len = sizeof(wakeValue);
+        pushRead(wakeFd, &wakeIov, 0, kWakeTag);
+    }
+
+    void submitChunk(Request* request) {
+        size_t remaining = request->data.size() - request->offset;
+        request->iov.iov_base = &request->data[request->offset];
+        request->iov.iov_len = std::min(remaining, kMaxReadBytes);
+        pushRead(request->fd, &request->iov, request->offset, reinterpret_cast<uint64_t>(request));
+    }
+
+    // Open and size the file; special files leave the ring here. The open
+    // is non-blocking, as opening a pipe waits for a writer.
+    void start(std::unique_ptr<Request> request) {
+        request->fd = ::open(request->filename.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+        if (request->fd < 0) {
+            std::string error = "Cannot open file: " + request->filename;
+            finish(request.release(), error);
+            return;
+        }
+        struct stat st;
+        if (::fstat(request->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+            ::fcntl(request->fd, F_SETFL, 0) != 0) {
+            ::close(request->fd);
+            --inFlight;
+            if (!blockingReads) {
+                blockingReads = std::make_unique<ThreadFileReader>(2);
+            }
+            blockingReads->read(request->filename, std::move(request->done));
+            return;
+        }
+        request->data.resize(static_cast<size_t>(st.st_size));
+        submitChunk(request.release());
+    }
+
+    void finish(Request* request, const std::string& error) {
+        std::unique_ptr<Request> owned(request);
+        if (owned->fd >= 0) {
+            ::close(owned->fd);
+        }
+        if (!error.empty()) {
+            owned->data.clear();
+        }
+        --inFlight;
+        owned->done(std::move(owned->data), error);
+    }
+
+    void complete(Request* request, int result) {
+        if (result == -EINTR || result == -EAGAIN) {
+            submitChunk(request);
+        } else if (result < 0) {
+            finish(request, "Cannot read file: " + request->filename + ": " + std::strerror(-result));
+        } else if (result == 0) {
+            // The file shrank since fstat
+            request->data.resize(request->offset);
+            finish(request, std::string());
+        } else {
+            request->offset += static_cast<size_t>(result);
+            if (request->offset < request->data.size()) {
+                submitChunk(request);
+            } else {
+                finish(request, std::string());
+            }
+        }
+    }
+
+    void run() {
+        armWake();
+        while (true) {
+            std::deque<std::unique_ptr<Request>> arrived;
+            bool exit;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                arrived.swap(pending);
+                inFlight += arrived.size();
+                exit = stopping && inFlight == 0;
+            }
+            if (exit) {
+                break;
+            }
+            for (auto& request : arrived) {
+                start(std::move(request));
+            }
+
+            int entered = static_cast<int>(::syscall(__NR_io_uring_enter, ringFd, toSubmit, 1,
+                                                     IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (entered < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                    continue;
+                }
+                break;
+            }
+            toSubmit -= static_cast<unsigned>(entered);
+
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                io_uring_cqe cqe = cqes[head & cqMask];
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                if (cqe.user_data == kWakeTag) {
+                    armWake();
+                } else {
+                    complete(reinterpret_cast<Request*>(cqe.user_data), cqe.res);
+                }
+            }
+        }
+    }
+};
+#endif
+
+// Overlaps file I/O with parsing: up to maxInFlight files are read ahead
+// (on io_uring where available, a thread pool otherwise) while earlier ones
+// are parsed on a work-stealing pool, so a worker never sits waiting on a
+// slow filesystem while another file is ready. The parser's cache, if any,
+// is bypassed. Destruction waits for everything submitted.
+class AsyncDocumentParser {
+public:
+    // Runs on a parse worker, failed reads included, so a slow callback
+    // never holds up the reader; calls for different files may overlap
+    using Callback = std::function<void(BatchResult&& result)>;
+
+    explicit AsyncDocumentParser(const UniversalDocumentParser& documentParser,
+                                 const AsyncOptions& options = AsyncOptions())
+        : parser(documentParser),
+          limit(std::max<size_t>(options.maxInFlight, 1)),
+          outputs(options.outputs),
+          parsePool(options.parseThreads),
+          reader(makeReader(options, limit)) {}
+
+    ~AsyncDocumentParser() { wait(); }
+
+    AsyncDocumentParser(const AsyncDocumentParser&) = delete;
+    AsyncDocumentParser& operator=(const AsyncDocumentParser&) = delete;
+
+    void parseAsync(const std::string& filename, Callback onDone) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            ++outstanding;
+            if (active >= limit) {
+                waiting.push_back(Job{filename, std::move(onDone)});
+                return;
+            }
+            ++active;
+        }
+        startRead(Job{filename, std::move(onDone)});
+    }
+
+    std::future<Document> parseAsync(const std::string& filename) {
+        auto promise = std::make_shared<std::promise<Document>>();
+        std::future<Document> future = promise->get_future();
+        parseAsync(filename, [promise](BatchResult&& result) {
+            if (result.ok) {
+                promise->set_value(std::move(result.document));
+            } else {
+                promise->set_exception(std::make_exception_ptr(std::runtime_error(result.error)));
+            }
+        });
+        return future;
+    }
+
+    // Block until every submitted file has been delivered
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock);
+        idle.wait(guard, [this] { return outstanding == 0; });
+    }
+
+    // "io_uring" or "threads"
+    const char* backend() const { return reader->name(); }
+
+private:
+    struct Job {
+        std::string filename;
+        Callback onDone;
+    };
+
+    const UniversalDocumentParser& parser;
+    size_t limit;
+    ParseOutput outputs;
+    WorkStealingPool parsePool;
+    std::unique_ptr<FileReadBackend> reader;  // destroyed first; may still feed parsePool
+
+    std::mutex lock;
+    std::condition_variable idle;
+    std::deque<Job> waiting;
+    size_t active = 0;       // files between read start and delivery
+    size_t outstanding = 0;  // submitted and not yet delivered
+
+    static std::unique_ptr<FileReadBackend> makeReader(const AsyncOptions& options, size_t limit) {
+#ifdef DOCPARSER_HAVE_IO_URING
+        if (options.useIoUring) {
+            if (auto uring = UringFileReader::create(limit)) {
+                return uring;
+            }
+        }
+#else
+        (void)options;
+#endif
+        return std::make_unique<ThreadFileReader>(limit);
+    }
+
+    void startRead(Job job) {
+        auto shared = std::make_shared<Job>(std::move(job));
+        reader->read(shared->filename, [this, shared](std::string&& data, const std::string& error) {
+            if (!error.empty()) {
+                parsePool.submit([this, shared, error] {
+                    BatchResult result;
+                    result.filename = shared->filename;
+                    result.error = "Failed to parse " + shared->filename + ": " + error;
+                    deliver(*shared, std::move(result));
+                });
+                return;
+            }
+            auto content = std::make_shared<std::string>(std::move(data));
+            parsePool.submit([this, shared, content] {
+                BatchResult result;
+                result.filename = shared->filename;
+                try {
+                    result.document = parser.parseContent(shared->filename, *content, outputs);
+                    result.ok = true;
+                } catch (const std::exception& e) {
+                    result.error = e.what();
+                }
+                std::string().swap(*content);  // free the bytes before the callback runs
+                deliver(*shared, std::move(result));
+            });
+        });
+    }
+
+    // Hand over the result, then pass the slot to the next waiting file
+    void deliver(Job& job, BatchResult&& result) {
+        job.onDone(std::move(result));
+
+        Job next;
+        bool haveNext = false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!waiting.empty()) {
+                next = std::move(waiting.front());
+                waiting.pop_front();
+                haveNext = true;
+            } else {
+                --active;
+            }
+        }
+        if (haveNext) {
+            startRead(std::move(next));
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--outstanding == 0) {
+            idle.notify_all();
+        }
+    }
+};
+
+#endif // ASYNC_PARSER_H
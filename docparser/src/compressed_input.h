@@ -0,0 +1,549 @@
+#ifndef COMPRESSED_INPUT_H
+#define COMPRESSED_INPUT_H
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "format_sniffer.h"
+#include "thread_pool.h"
+
+#ifdef DOCPARSER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef DOCPARSER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Transparent gzip and zstd input. Compressed data is recognised by its
+// magic bytes, so a misnamed file still decodes, and dispatch looks through
+// a trailing .gz/.zst to the inner extension. Each codec is compiled in
+// with DOCPARSER_HAVE_ZLIB / DOCPARSER_HAVE_ZSTD; without it such input
+// fails with an error naming the missing library instead of being parsed
+// as binary.
+
+enum class Compression {
+    None,
+    Gzip,
+    Zstd
+};
+
+inline const char* compressionName(Compression compression) {
+    switch (compression) {
+        case Compression::Gzip: return "gzip";
+        case Compression::Zstd: return "zstd";
+        default: return "none";
+    }
+}
+
+inline bool compressionAvailable(Compression compression) {
+    switch (compression) {
+#ifdef DOCPARSER_HAVE_ZLIB
+        case Compression::Gzip: return true;
+#endif
+#ifdef DOCPARSER_HAVE_ZSTD
+        case Compression::Zstd: return true;
+#endif
+        case Compression::None: return true;
+        default: return false;
+    }
+}
+
+// By the first bytes of the data
+inline Compression detectCompression(std::string_view head) {
+    if (head.size() >= 2 && static_cast<unsigned char>(head[0]) == 0x1f &&
+        static_cast<unsigned char>(head[1]) == 0x8b) {
+        return Compression::Gzip;
+    }
+    if (head.size() >= 4 && std::memcmp(head.data(), "\x28\xB5\x2F\xFD", 4) == 0) {
+        return Compression::Zstd;
+    }
+    return Compression::None;
+}
+
+// By a trailing .gz/.gzip or .zst/.zstd, in any case
+inline Compression compressionFromName(std::string_view filename) {
+    size_t dot = filename.find_last_of('.');
+    size_t slash = filename.find_last_of("/\\");
+    if (dot == std::string_view::npos || (slash != std::string_view::npos && slash > dot)) {
+        return Compression::None;
+    }
+    std::string ext(filename.substr(dot + 1));
+    for (auto& c : ext) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    if (ext == "gz" || ext == "gzip") {
+        return Compression::Gzip;
+    }
+    if (ext == "zst" || ext == "zstd") {
+        return Compression::Zstd;
+    }
+    return Compression::None;
+}
+
+// `filename` without a compression extension: "rows.csv.gz" -> "rows.csv"
+inline std::string_view innerName(std::string_view filename) {
+    if (compressionFromName(filename) == Compression::None) {
+        return filename;
+    }
+    return filename.substr(0, filename.find_last_of('.'));
+}
+
+[[noreturn]] inline void throwCodecMissing(Compression compression) {
+    throw std::runtime_error(compression == Compression::Gzip
+        ? "gzip input needs zlib (build with DOCPARSER_HAVE_ZLIB)"
+        : "zstd input needs libzstd (build with DOCPARSER_HAVE_ZSTD)");
+}
+
+// Sequential source of bytes for the streaming readers. Like
+// std::istream::read, a short count means the input has ended.
+class InputStream {
+public:
+    virtual ~InputStream() = default;
+    virtual size_t read(char* data, size_t size) = 0;
+};
+
+// Bytes of a file as stored, for files that are not compressed
+class FileInputStream : public InputStream {
+public:
+    explicit FileInputStream(const std::string& filename) : file(filename, std::ios::binary) {
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open file: " + filename);
+        }
+    }
+
+    size_t read(char* data, size_t size) override {
+        size_t total = std::min(size, pending.size() - pendingPos);
+        std::memcpy(data, pending.data() + pendingPos, total);
+        pendingPos += total;
+        if (total < size) {
+            file.read(data + total, static_cast<std::streamsize>(size - total));
+            total += static_cast<size_t>(file.gcount());
+        }
+        return total;
+    }
+
+    // Hand `bytes` out again before the rest of the file; used after peeking
+    void unread(std::string_view bytes) {
+        pending.assign(bytes.data(), bytes.size());
+        pendingPos = 0;
+    }
+
+private:
+    std::ifstream file;
+    std::string pending;
+    size_t pendingPos = 0;
+};
+
+// A buffer already in memory; `data` must outlive the stream
+class MemoryInputStream : public InputStream {
+public:
+    explicit MemoryInputStream(std::string_view data) : source(data) {}
+
+    size_t read(char* data, size_t size) override {
+        size_t count = std::min(size, source.size() - pos);
+        std::memcpy(data, source.data() + pos, count);
+        pos += count;
+        return count;
+    }
+
+private:
+    std::string_view source;
+    size_t pos = 0;
+};
+
+// Decodes compressed input from another stream, kBufferSize bytes at a time
+class DecompressingStream : public InputStream {
+public:
+    static constexpr size_t kBufferSize = 1 << 17;
+
+protected:
+    explicit DecompressingStream(std::unique_ptr<InputStream> compressed)
+        : source(std::move(compressed)), input(kBufferSize) {}
+
+    // Next block of compressed bytes; false at the end of the input
+    bool refillInput(const char*& data, size_t& size) {
+        if (sourceDone) {
+            return false;
+        }
+        size = source->read(input.data(), input.size());
+        data = input.data();
+        sourceDone = size < input.size();
+        return size > 0;
+    }
+
+private:
+    std::unique_ptr<InputStream> source;
+    std::vector<char> input;
+    bool sourceDone = false;
+};
+
+#ifdef DOCPARSER_HAVE_ZLIB
+// gzip, including files of several concatenated members (gzip -c a b, bgzip)
+class GzipInputStream : public DecompressingStream {
+public:
+    explicit GzipInputStream(std::unique_ptr<InputStream> compressed)
+        : DecompressingStream(std::move(compressed)) {
+        // 16 + MAX_WBITS: gzip wrapper, not raw deflate or zlib
+        if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+            throw std::runtime_error("Cannot initialise gzip decoder");
+        }
+    }
+
+    ~GzipInputStream() override { inflateEnd(&stream); }
+
+    GzipInputStream(const GzipInputStream&) = delete;
+    GzipInputStream& operator=(const GzipInputStream&) = delete;
+
+    size_t read(char* data, size_t size) override {
+        size_t total = 0;
+        while (total < size) {
+            if (stream.avail_in == 0) {
+                const char* next = nullptr;
+                size_t length = 0;
+                if (!refillInput(next, length)) {
+                    if (inMember) {
+                        throw std::runtime_error("Truncated gzip input");
+                    }
+                    break;
+                }
+                stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(next));
+                stream.avail_in = static_cast<uInt>(length);
+            }
+            if (!inMember) {
+                inflateReset(&stream);
+                inMember = true;
+            }
+            uInt room = static_cast<uInt>(std::min<size_t>(size - total, UINT_MAX));
+            stream.next_out = reinterpret_cast<Bytef*>(data + total);
+            stream.avail_out = room;
+            int status = inflate(&stream, Z_NO_FLUSH);
+            total += room - stream.avail_out;
+            if (status == Z_STREAM_END) {
+                inMember = false;
+            } else if (status != Z_OK && status != Z_BUF_ERROR) {
+                throw std::runtime_error(std::string("Corrupt gzip input: ") +
+                                         (stream.msg ? stream.msg : "inflate failed"));
+            }
+        }
+        return total;
+    }
+
+private:
+    z_stream stream{};
+    bool inMember = false;
+};
+#endif
+
+#ifdef DOCPARSER_HAVE_ZSTD
+// zstd, any number of frames, skippable frames included
+class ZstdInputStream : public DecompressingStream {
+public:
+    explicit ZstdInputStream(std::unique_ptr<InputStream> compressed)
+        : DecompressingStream(std::move(compressed)), stream(ZSTD_createDStream()) {
+        if (!stream) {
+            throw std::runtime_error("Cannot initialise zstd decoder");
+        }
+    }
+
+    ~ZstdInputStream() override { ZSTD_freeDStream(stream); }
+
+    ZstdInputStream(const ZstdInputStream&) = delete;
+    ZstdInputStream& operator=(const ZstdInputStream&) = delete;
+
+    size_t read(char* data, size_t size) override {
+        ZSTD_outBuffer out{data, size, 0};
+        while (out.pos < size) {
+            if (in.pos == in.size) {
+                const char* next = nullptr;
+                size_t length = 0;
+                if (!refillInput(next, length)) {
+                    if (frameOpen) {
+                        throw std::runtime_error("Truncated zstd input");
+                    }
+                    break;
+                }
+                in = ZSTD_inBuffer{next, length, 0};
+            }
+            size_t status = ZSTD_decompressStream(stream, &out, &in);
+            if (ZSTD_isError(status)) {
+                throw std::runtime_error(std::string("Corrupt zstd input: ") + ZSTD_getErrorName(status));
+            }
+            frameOpen = status != 0;
+        }
+        return out.pos;
+    }
+
+private:
+    ZSTD_DStream* stream;
+    ZSTD_inBuffer in{nullptr, 0, 0};
+    bool frameOpen = false;
+};
+#endif
+
+// Wrap `compressed` in the decoder for `compression`
+inline std::unique_ptr<InputStream> decodingStream(std::unique_ptr<InputStream> compressed,
+                                                   Compression compression) {
+    switch (compression) {
+        case Compression::None:
+            return compressed;
+#ifdef DOCPARSER_HAVE_ZLIB
+        case Compression::Gzip:
+            return std::make_unique<GzipInputStream>(std::move(compressed));
+#endif
+#ifdef DOCPARSER_HAVE_ZSTD
+        case Compression::Zstd:
+            return std::make_unique<ZstdInputStream>(std::move(compressed));
+#endif
+        default:
+            throwCodecMissing(compression);
+    }
+}
+
+// Open `filename` for sequential reading, decompressing on the fly when its
+// first bytes are gzip or zstd magic
+inline std::unique_ptr<InputStream> openInputStream(const std::string& filename) {
+    auto file = std::make_unique<FileInputStream>(filename);
+    char magic[4];
+    size_t length = file->read(magic, sizeof(magic));
+    file->unread(std::string_view(magic, length));
+    return decodingStream(std::move(file), detectCompression(std::string_view(magic, length)));
+}
+
+// FormatSniffer::readHead() of the decompressed bytes; compressed files
+// whose codec is not compiled in read as their raw bytes
+inline size_t readDecodedHead(const std::string& filename, char (&buffer)[FormatSniffer::kHeadBytes]) {
+    size_t length = FormatSniffer::readHead(filename.c_str(), buffer);
+    Compression compression = detectCompression(std::string_view(buffer, length));
+    if (compression == Compression::None || !compressionAvailable(compression)) {
+        return length;
+    }
+    try {
+        return openInputStream(filename)->read(buffer, FormatSniffer::kHeadBytes);
+    } catch (const std::exception&) {
+        return 0;
+    }
+}
+
+// The same for bytes already in memory, such as a mapped file
+inline size_t readDecodedHead(std::string_view stored, char (&buffer)[FormatSniffer::kHeadBytes]) {
+    Compression compression = detectCompression(stored);
+    if (compression == Compression::None || !compressionAvailable(compression)) {
+        size_t length = std::min(stored.size(), FormatSniffer::kHeadBytes);
+        std::memcpy(buffer, stored.data(), length);
+        return length;
+    }
+    try {
+        return decodingStream(std::make_unique<MemoryInputStream>(stored), compression)
+            ->read(buffer, FormatSniffer::kHeadBytes);
+    } catch (const std::exception&) {
+        return 0;
+    }
+}
+
+// Read `stream` to the end
+inline std::string readAll(InputStream& stream, size_t sizeHint = 0) {
+    std::string out;
+    out.resize(std::max<size_t>(sizeHint, 1 << 16));
+    size_t used = 0;
+    while (true) {
+        size_t got = stream.read(&out[used], out.size() - used);
+        used += got;
+        if (used < out.size()) {
+            break;
+        }
+        out.resize(out.size() * 2);
+    }
+    out.resize(used);
+    return out;
+}
+
+// Whole-buffer decompression. zstd frames that record their size and BGZF
+// blocks are independent, so large inputs made of several of them decode
+// on up to `threads` threads (0 = one per core; always one on a pool
+// worker), each straight into its place in the output; anything else goes
+// through one streaming decoder.
+class Decompressor {
+public:
+    static std::string decompress(std::string_view data, Compression compression, size_t threads = 0) {
+        if (!compressionAvailable(compression)) {
+            throwCodecMissing(compression);
+        }
+        size_t sizeHint = data.size() * 3;
+        (void)threads;  // unused when neither codec is compiled in
+#ifdef DOCPARSER_HAVE_ZSTD
+        if (compression == Compression::Zstd) {
+            std::vector<CompressedBlock> frames = zstdFrames(data);
+            if (!frames.empty()) {
+                return decodeBlocks(frames, threads, [&](size_t begin, size_t end, char* out) {
+                    std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(),
+                                                                               ZSTD_freeDCtx);
+                    for (size_t i = begin; i < end; ++i) {
+                        decodeZstdFrame(context.get(), data, frames[i], out);
+                    }
+                });
+            }
+        }
+#endif
+#ifdef DOCPARSER_HAVE_ZLIB
+        if (compression == Compression::Gzip) {
+            std::vector<CompressedBlock> blocks = bgzfBlocks(data);
+            if (!blocks.empty()) {
+                return decodeBlocks(blocks, threads, [&](size_t begin, size_t end, char* out) {
+                    for (size_t i = begin; i < end; ++i) {
+                        decodeGzipMember(data, blocks[i], out);
+                    }
+                });
+            }
+            // ISIZE of a single member: its output size modulo 4 GiB
+            if (data.size() >= 18) {
+                sizeHint = std::min(std::max<size_t>(readLE(data.data() + data.size() - 4, 4), data.size()),
+                                    outputLimit(data));
+            }
+        }
+#endif
+        auto stream = decodingStream(std::make_unique<MemoryInputStream>(data), compression);
+        return readAll(*stream, sizeHint);
+    }
+
+private:
+    // One independently decodable piece of a compressed buffer
+    struct CompressedBlock {
+        size_t offset = 0;
+        size_t length = 0;
+        size_t outputOffset = 0;
+        size_t outputLength = 0;
+    };
+
+    // Below this much output a single thread decodes faster than several start
+    static constexpr size_t kParallelDecodeBytes = size_t(4) << 20;
+
+    // Sizes in frame and block headers are untrusted: a few bytes can claim
+    // terabytes. Output claimed beyond this multiple of the input is not
+    // allocated up front; such input goes through the streaming decoder,
+    // which only grows its buffer as bytes actually come out.
+    static constexpr size_t kMaxDeclaredRatio = 256;
+
+    static size_t outputLimit(std::string_view data) {
+        return data.size() > SIZE_MAX / kMaxDeclaredRatio ? SIZE_MAX : data.size() * kMaxDeclaredRatio;
+    }
+
+#ifdef DOCPARSER_HAVE_ZSTD
+    // Frames that all record their content size; empty if any does not, or
+    // if together they claim more than outputLimit()
+    static std::vector<CompressedBlock> zstdFrames(std::string_view data) {
+        std::vector<CompressedBlock> frames;
+        size_t offset = 0;
+        size_t output = 0;
+        size_t limit = outputLimit(data);
+        while (offset < data.size()) {
+            const char* frame = data.data() + offset;
+            size_t length = ZSTD_findFrameCompressedSize(frame, data.size() - offset);
+            if (ZSTD_isError(length)) {
+                return {};
+            }
+            unsigned long long content = ZSTD_getFrameContentSize(frame, length);
+            if (content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR ||
+                content > limit - output) {
+                return {};
+            }
+            frames.push_back(CompressedBlock{offset, length, output, static_cast<size_t>(content)});
+            offset += length;
+            output += static_cast<size_t>(content);
+        }
+        return frames;
+    }
+
+    static void decodeZstdFrame(ZSTD_DCtx* context, std::string_view data, const CompressedBlock& frame,
+                                char* out) {
+        size_t written = ZSTD_decompressDCtx(context, out + frame.outputOffset, frame.outputLength,
+                                             data.data() + frame.offset, frame.length);
+        if (ZSTD_isError(written) || written != frame.outputLength) {
+            throw std::runtime_error("Corrupt zstd input");
+        }
+    }
+#endif
+
+#ifdef DOCPARSER_HAVE_ZLIB
+    static uint32_t readLE(const char* p, size_t bytes) {
+        uint32_t value = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            value |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    // BGZF (bgzip) members carry their own size in a "BC" extra field and end
+    // with the uncompressed size; empty unless every member is such a block
+    // and together they claim at most outputLimit()
+    static std::vector<CompressedBlock> bgzfBlocks(std::string_view data) {
+        std::vector<CompressedBlock> blocks;
+        size_t offset = 0;
+        size_t output = 0;
+        size_t limit = outputLimit(data);
+        while (offset < data.size()) {
+            const char* header = data.data() + offset;
+            size_t rest = data.size() - offset;
+            // ID1 ID2 CM FLG(FEXTRA) MTIME(4) XFL OS XLEN(2) SI1 SI2 SLEN(2) BSIZE(2)
+            if (rest < 18 || static_cast<unsigned char>(header[0]) != 0x1f ||
+                static_cast<unsigned char>(header[1]) != 0x8b || header[2] != 8 || !(header[3] & 4) ||
+                header[12] != 'B' || header[13] != 'C' || readLE(header + 14, 2) != 2) {
+                return {};
+            }
+            size_t length = readLE(header + 16, 2) + size_t(1);
+            if (length > rest || length < 26) {
+                return {};
+            }
+            size_t content = readLE(header + length - 4, 4);
+            if (content > limit - output) {
+                return {};
+            }
+            blocks.push_back(CompressedBlock{offset, length, output, content});
+            offset += length;
+            output += content;
+        }
+        return blocks;
+    }
+
+    static void decodeGzipMember(std::string_view data, const CompressedBlock& block, char* out) {
+        z_stream stream{};
+        if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+            throw std::runtime_error("Cannot initialise gzip decoder");
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data() + block.offset));
+        stream.avail_in = static_cast<uInt>(block.length);
+        stream.next_out = reinterpret_cast<Bytef*>(out + block.outputOffset);
+        stream.avail_out = static_cast<uInt>(block.outputLength);
+        int status = inflate(&stream, Z_FINISH);
+        inflateEnd(&stream);
+        if (status != Z_STREAM_END || stream.avail_out != 0) {
+            throw std::runtime_error("Corrupt gzip input");
+        }
+    }
+#endif
+
+    // Decode `blocks` straight into their place in one output buffer, split
+    // across up to `threads` threads in contiguous runs
+    template <typename DecodeRun>
+    static std::string decodeBlocks(const std::vector<CompressedBlock>& blocks, size_t threads,
+                                    DecodeRun decodeRun) {
+        const CompressedBlock& last = blocks.back();
+        std::string out(last.outputOffset + last.outputLength, '\0');
+        size_t workers = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+        workers = out.size() < kParallelDecodeBytes || onParallelWorker() ? 1 : std::min(workers, blocks.size());
+        parallelFor(workers, [&](size_t worker) {
+            size_t begin = blocks.size() * worker / workers;
+            size_t end = blocks.size() * (worker + 1) / workers;
+            decodeRun(begin, end, &out[0]);
+        });
+        return out;
+    }
+};
+
+#endif // COMPRESSED_INPUT_H
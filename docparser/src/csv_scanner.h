@@ -0,0 +1,248 @@
+#ifndef CSV_SCANNER_H
+#define CSV_SCANNER_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define DOCPARSER_SCANNER_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define DOCPARSER_SCANNER_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Instruction set used by the structural scanner
+enum class SimdLevel {
+    Scalar,
+    SSE42,
+    AVX2,
+    NEON
+};
+
+inline const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SSE42: return "sse4.2";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::NEON: return "neon";
+        default: return "scalar";
+    }
+}
+
+// Vectorized stage-1 CSV scanner. Input is processed in 64-byte blocks: each
+// block yields bitmasks of quote, delimiter and newline bytes, the quote mask
+// is turned into an "inside quotes" mask with a prefix XOR, and the offsets of
+// delimiters and newlines outside quotes are emitted. Callers then slice
+// fields out by offset without touching the bytes again.
+class CSVScanner {
+public:
+    static constexpr size_t kBlockSize = 64;
+
+    explicit CSVScanner(SimdLevel level = detectLevel()) : simdLevel(level) {
+        switch (level) {
+#if defined(DOCPARSER_SCANNER_X86) && defined(__GNUC__)
+            case SimdLevel::AVX2: buildMasks = &masksAVX2; break;
+            case SimdLevel::SSE42: buildMasks = &masksSSE42; break;
+#endif
+#if defined(DOCPARSER_SCANNER_NEON)
+            case SimdLevel::NEON: buildMasks = &masksNEON; break;
+#endif
+            default:
+                buildMasks = &masksScalar;
+                simdLevel = SimdLevel::Scalar;
+                break;
+        }
+    }
+
+    // Best level supported by the running CPU, probed once
+    static SimdLevel detectLevel() {
+        static const SimdLevel detected = probeCPU();
+        return detected;
+    }
+
+    SimdLevel level() const { return simdLevel; }
+
+    // Append to `out` the offsets (relative to `data`) of every delimiter and
+    // newline in data[0, length) that lies outside quotes. `inQuotes` is the
+    // quote state before the first byte and is updated to the state after the
+    // last one. `length` must be below 4 GiB. `out` is any vector of uint32_t.
+    template <typename Offsets>
+    void scan(const char* data, size_t length, char delimiter, char quote,
+              bool& inQuotes, Offsets& out) const {
+        uint64_t quoteState = inQuotes ? ~0ULL : 0ULL;
+        size_t offset = 0;
+
+        for (; offset + kBlockSize <= length; offset += kBlockSize) {
+            scanBlock(data + offset, static_cast<uint32_t>(offset), delimiter, quote, quoteState, out);
+        }
+
+        if (offset < length) {
+            // Zero padding never matches as long as neither character is NUL
+            alignas(64) char tail[kBlockSize] = {};
+            std::memcpy(tail, data + offset, length - offset);
+            scanBlock(tail, static_cast<uint32_t>(offset), delimiter, quote, quoteState, out,
+                      length - offset);
+        }
+
+        inQuotes = quoteState != 0;
+    }
+
+private:
+    struct BlockMasks {
+        uint64_t quotes;
+        uint64_t structurals;
+    };
+
+    using MaskFn = BlockMasks (*)(const char* block, char delimiter, char quote);
+
+    SimdLevel simdLevel;
+    MaskFn buildMasks;
+
+    static SimdLevel probeCPU() {
+#if defined(DOCPARSER_SCANNER_X86) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return SimdLevel::AVX2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return SimdLevel::SSE42;
+        }
+        return SimdLevel::Scalar;
+#elif defined(DOCPARSER_SCANNER_NEON)
+        return SimdLevel::NEON;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+    static int trailingZeros(uint64_t bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(bits);
+#endif
+    }
+
+    // `count` is the number of meaningful bytes in the block
+    template <typename Offsets>
+    void scanBlock(const char* block, uint32_t base, char delimiter, char quote,
+                   uint64_t& quoteState, Offsets& out,
+                   size_t count = kBlockSize) const {
+        BlockMasks masks = buildMasks(block, delimiter, quote);
+        uint64_t valid = count == kBlockSize ? ~0ULL : (1ULL << count) - 1;
+
+        // Bit i set when byte i is inside quotes; the opening quote is
+        // inside, the closing one outside, which is fine as neither is a
+        // structural character
+        uint64_t inside = prefixXor(masks.quotes & valid) ^ quoteState;
+        uint64_t structurals = masks.structurals & ~inside & valid;
+
+        // Carry the state of the last byte into the next block
+        quoteState = ((inside >> (count - 1)) & 1) ? ~0ULL : 0ULL;
+
+        while (structurals) {
+            out.push_back(base + static_cast<uint32_t>(trailingZeros(structurals)));
+            structurals &= structurals - 1;
+        }
+    }
+
+    static uint64_t prefixXor(uint64_t bits) {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+
+    static BlockMasks masksScalar(const char* block, char delimiter, char quote) {
+        BlockMasks masks = {0, 0};
+        for (size_t i = 0; i < kBlockSize; ++i) {
+            char c = block[i];
+            uint64_t bit = 1ULL << i;
+            if (c == quote) {
+                masks.quotes |= bit;
+            } else if (c == delimiter || c == '\n') {
+                masks.structurals |= bit;
+            }
+        }
+        return masks;
+    }
+
+#if defined(DOCPARSER_SCANNER_X86) && defined(__GNUC__)
+    __attribute__((target("sse4.2")))
+    static BlockMasks masksSSE42(const char* block, char delimiter, char quote) {
+        const __m128i q = _mm_set1_epi8(quote);
+        const __m128i d = _mm_set1_epi8(delimiter);
+        const __m128i nl = _mm_set1_epi8('\n');
+        BlockMasks masks = {0, 0};
+
+        for (int i = 0; i < 4; ++i) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16));
+            uint64_t qm = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, q)));
+            __m128i s = _mm_or_si128(_mm_cmpeq_epi8(v, d), _mm_cmpeq_epi8(v, nl));
+            uint64_t sm = static_cast<uint16_t>(_mm_movemask_epi8(s));
+            masks.quotes |= qm << (i * 16);
+            masks.structurals |= sm << (i * 16);
+        }
+        return masks;
+    }
+
+    __attribute__((target("avx2")))
+    static BlockMasks masksAVX2(const char* block, char delimiter, char quote) {
+        const __m256i q = _mm256_set1_epi8(quote);
+        const __m256i d = _mm256_set1_epi8(delimiter);
+        const __m256i nl = _mm256_set1_epi8('\n');
+        BlockMasks masks = {0, 0};
+
+        for (int i = 0; i < 2; ++i) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i * 32));
+            uint64_t qm = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, q)));
+            __m256i s = _mm256_or_si256(_mm256_cmpeq_epi8(v, d), _mm256_cmpeq_epi8(v, nl));
+            uint64_t sm = static_cast<uint32_t>(_mm256_movemask_epi8(s));
+            masks.quotes |= qm << (i * 32);
+            masks.structurals |= sm << (i * 32);
+        }
+        return masks;
+    }
+#endif
+
+#if defined(DOCPARSER_SCANNER_NEON)
+    static uint64_t movemaskNEON(uint8x16_t m0, uint8x16_t m1, uint8x16_t m2, uint8x16_t m3) {
+        const uint8x16_t bits = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                                 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+        uint8x16_t s0 = vpaddq_u8(vandq_u8(m0, bits), vandq_u8(m1, bits));
+        uint8x16_t s1 = vpaddq_u8(vandq_u8(m2, bits), vandq_u8(m3, bits));
+        s0 = vpaddq_u8(s0, s1);
+        s0 = vpaddq_u8(s0, s0);
+        return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+    }
+
+    static BlockMasks masksNEON(const char* block, char delimiter, char quote) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(block);
+        uint8x16_t v[4] = {vld1q_u8(p), vld1q_u8(p + 16), vld1q_u8(p + 32), vld1q_u8(p + 48)};
+        const uint8x16_t q = vdupq_n_u8(static_cast<uint8_t>(quote));
+        const uint8x16_t d = vdupq_n_u8(static_cast<uint8_t>(delimiter));
+        const uint8x16_t nl = vdupq_n_u8('\n');
+
+        BlockMasks masks;
+        masks.quotes = movemaskNEON(vceqq_u8(v[0], q), vceqq_u8(v[1], q),
+                                    vceqq_u8(v[2], q), vceqq_u8(v[3], q));
+        masks.structurals = movemaskNEON(vorrq_u8(vceqq_u8(v[0], d), vceqq_u8(v[0], nl)),
+                                         vorrq_u8(vceqq_u8(v[1], d), vceqq_u8(v[1], nl)),
+                                         vorrq_u8(vceqq_u8(v[2], d), vceqq_u8(v[2], nl)),
+                                         vorrq_u8(vceqq_u8(v[3], d), vceqq_u8(v[3], nl)));
+        return masks;
+    }
+#endif
+};
+
+#endif // CSV_SCANNER_H
@@ -0,0 +1,171 @@
+#ifndef DOCUMENT_ARENA_H
+#define DOCUMENT_ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+
+// Memory for the documents of one parse or one batch. Small blocks are
+// recycled through a pool, large ones (file contents) are carved from
+// geometrically growing chunks, and everything is returned to the heap at
+// once when the arena is destroyed. Safe to share between threads.
+//
+// Documents allocated from an arena must not outlive it.
+class DocumentArena {
+public:
+    static constexpr size_t kDefaultInitialBytes = 64 * 1024;
+
+    explicit DocumentArena(size_t initialBytes = kDefaultInitialBytes)
+        : chunks(initialBytes), lockedChunks(&chunks), pool(&lockedChunks) {}
+
+    DocumentArena(const DocumentArena&) = delete;
+    DocumentArena& operator=(const DocumentArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &pool; }
+
+    // Hand every block back to the heap and start over, e.g. between two
+    // batches. Documents allocated from the arena must be gone by now.
+    void release() {
+        pool.release();
+        chunks.release();
+    }
+
+private:
+    // monotonic_buffer_resource is not thread-safe. The pool only reaches
+    // it to refill its free lists or for oversized blocks, so a plain mutex
+    // is cheap.
+    class LockedResource : public std::pmr::memory_resource {
+    public:
+        explicit LockedResource(std::pmr::memory_resource* upstream) : upstream(upstream) {}
+
+    private:
+        std::pmr::memory_resource* upstream;
+        std::mutex lock;
+
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            std::lock_guard<std::mutex> guard(lock);
+            return upstream->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+            std::lock_guard<std::mutex> guard(lock);
+            upstream->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    std::pmr::monotonic_buffer_resource chunks;
+    LockedResource lockedChunks;
+    std::pmr::synchronized_pool_resource pool;
+};
+
+// Keeps freed blocks for reuse instead of handing them back, so a loop that
+// allocates the same shapes over and over reaches the heap only while its
+// needs still grow. Blocks are rounded up to powers of two and kept in one
+// free list per size; trim() returns cached blocks, largest first. Not
+// thread-safe.
+class RecyclingResource : public std::pmr::memory_resource {
+public:
+    explicit RecyclingResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : upstream(upstream) {}
+
+    RecyclingResource(const RecyclingResource&) = delete;
+    RecyclingResource& operator=(const RecyclingResource&) = delete;
+
+    // Blocks still in use must be gone by now
+    ~RecyclingResource() override { trim(0); }
+
+    // Bytes held in the free lists
+    size_t cachedBytes() const { return cached; }
+
+    // Free cached blocks until at most `keepBytes` remain
+    void trim(size_t keepBytes) {
+        for (size_t c = kClasses; c-- > 0 && cached > keepBytes;) {
+            while (freeLists[c] && cached > keepBytes) {
+                FreeBlock* block = freeLists[c];
+                freeLists[c] = block->next;
+                cached -= size_t(1) << c;
+                upstream->deallocate(block, size_t(1) << c, alignof(std::max_align_t));
+            }
+        }
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static constexpr size_t kMinClass = 4;  // 16-byte blocks hold a FreeBlock
+    static constexpr size_t kClasses = 64;
+
+    std::pmr::memory_resource* upstream;
+    FreeBlock* freeLists[kClasses] = {};
+    size_t cached = 0;
+
+    static size_t classOf(size_t bytes) {
+        size_t c = kMinClass;
+        while ((size_t(1) << c) < bytes) ++c;
+        return c;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        if (alignment > alignof(std::max_align_t)) {
+            return upstream->allocate(bytes, alignment);
+        }
+        size_t c = classOf(bytes);
+        if (FreeBlock* block = freeLists[c]) {
+            freeLists[c] = block->next;
+            cached -= size_t(1) << c;
+            return block;
+        }
+        return upstream->allocate(size_t(1) << c, alignof(std::max_align_t));
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if (alignment > alignof(std::max_align_t)) {
+            upstream->deallocate(p, bytes, alignment);
+            return;
+        }
+        size_t c = classOf(bytes);
+        freeLists[c] = new (p) FreeBlock{freeLists[c]};
+        cached += size_t(1) << c;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Resource for the temporaries of a parse on this thread: installed by a
+// ScratchScope (see ParseContext), otherwise the default heap. Containers
+// take it at construction, so ones built on pool workers use the heap.
+inline std::pmr::memory_resource*& activeScratchResource() {
+    thread_local std::pmr::memory_resource* resource = nullptr;
+    return resource;
+}
+
+inline std::pmr::memory_resource* scratchResource() {
+    std::pmr::memory_resource* resource = activeScratchResource();
+    return resource ? resource : std::pmr::get_default_resource();
+}
+
+// Makes `resource` this thread's scratch resource until destroyed
+class ScratchScope {
+public:
+    explicit ScratchScope(std::pmr::memory_resource* resource) : previous(activeScratchResource()) {
+        activeScratchResource() = resource;
+    }
+    ~ScratchScope() { activeScratchResource() = previous; }
+
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope& operator=(const ScratchScope&) = delete;
+
+private:
+    std::pmr::memory_resource* previous;
+};
+
+#endif // DOCUMENT_ARENA_H
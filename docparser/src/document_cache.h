@@ -0,0 +1,179 @@
+#ifndef DOCUMENT_CACHE_H
+#define DOCUMENT_CACHE_H
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// 64-bit XXH64 of a byte range. Reads are little-endian via memcpy, which
+// matches the reference implementation on every mainstream target.
+inline uint64_t xxhash64(const void* input, size_t length, uint64_t seed = 0) {
+    constexpr uint64_t P1 = 11400714785074694791ULL;
+    constexpr uint64_t P2 = 14029467366897019727ULL;
+    constexpr uint64_t P3 = 1609587929392839161ULL;
+    constexpr uint64_t P4 = 9650029242287828579ULL;
+    constexpr uint64_t P5 = 2870177450012600261ULL;
+
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto read64 = [](const unsigned char* p) { uint64_t v; std::memcpy(&v, p, 8); return v; };
+    auto read32 = [](const unsigned char* p) { uint32_t v; std::memcpy(&v, p, 4); return v; };
+    auto mix = [&](uint64_t acc, uint64_t lane) { return rotl(acc + lane * P2, 31) * P1; };
+    auto merge = [&](uint64_t acc, uint64_t v) { return (acc ^ mix(0, v)) * P1 + P4; };
+
+    const unsigned char* p = static_cast<const unsigned char*>(input);
+    const unsigned char* end = p + length;
+    uint64_t h;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + P1 + P2;
+        uint64_t v2 = seed + P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - P1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = mix(v1, read64(p));
+            v2 = mix(v2, read64(p + 8));
+            v3 = mix(v3, read64(p + 16));
+            v4 = mix(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+    } else {
+        h = seed + P5;
+    }
+
+    h += static_cast<uint64_t>(length);
+    for (; p + 8 <= end; p += 8) {
+        h = rotl(h ^ mix(0, read64(p)), 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+        h = rotl(h ^ (static_cast<uint64_t>(read32(p)) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h = rotl(h ^ (*p * P5), 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Settings for UniversalDocumentParser's parsed-document cache
+struct DocumentCacheOptions {
+    size_t capacityBytes = 0;   // 0 disables the cache
+    bool hashContent = false;   // key on an XXH64 of the bytes instead of mtime
+};
+
+struct DocumentCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Bounded LRU cache of parsed documents. Entries are immutable and shared,
+// so a hit hands out another reference instead of a copy; capacity is
+// tracked as an estimate of each document's heap footprint. Thread-safe.
+template <typename Value>
+class BasicDocumentCache {
+public:
+    // A file version: path plus size and either its mtime or content hash
+    struct Key {
+        std::string path;
+        uint64_t size = 0;
+        uint64_t stamp = 0;
+
+        bool operator==(const Key& other) const {
+            return size == other.size && stamp == other.stamp && path == other.path;
+        }
+    };
+
+    explicit BasicDocumentCache(size_t capacityBytes) : capacity(capacityBytes) {}
+
+    BasicDocumentCache(const BasicDocumentCache&) = delete;
+    BasicDocumentCache& operator=(const BasicDocumentCache&) = delete;
+
+    std::shared_ptr<const Value> find(const Key& key) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            ++counters.misses;
+            return nullptr;
+        }
+        ++counters.hits;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->value;
+    }
+
+    // Values larger than the whole capacity are not cached
+    void insert(const Key& key, std::shared_ptr<const Value> value, size_t bytes) {
+        if (bytes > capacity) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            counters.bytes -= it->second->bytes;
+            entries.erase(it->second);
+            index.erase(it);
+        }
+        entries.push_front(Entry{key, std::move(value), bytes});
+        index.emplace(key, entries.begin());
+        counters.bytes += bytes;
+
+        while (counters.bytes > capacity) {
+            Entry& victim = entries.back();
+            counters.bytes -= victim.bytes;
+            index.erase(victim.key);
+            entries.pop_back();
+            ++counters.evictions;
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock);
+        entries.clear();
+        index.clear();
+        counters.bytes = 0;
+    }
+
+    DocumentCacheStats stats() const {
+        std::lock_guard<std::mutex> guard(lock);
+        DocumentCacheStats result = counters;
+        result.entries = index.size();
+        return result;
+    }
+
+    size_t capacityBytes() const { return capacity; }
+
+private:
+    struct Entry {
+        Key key;
+        std::shared_ptr<const Value> value;
+        size_t bytes;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            uint64_t h = xxhash64(key.path.data(), key.path.size(), key.stamp);
+            return static_cast<size_t>(h ^ (key.size * 0x9E3779B97F4A7C15ULL));
+        }
+    };
+
+    size_t capacity;
+    mutable std::mutex lock;
+    std::list<Entry> entries;  // most recently used first
+    std::unordered_map<Key, typename std::list<Entry>::iterator, KeyHash> index;
+    DocumentCacheStats counters;
+};
+
+#endif // DOCUMENT_CACHE_H
@@ -0,0 +1,276 @@
+#ifndef DOCUMENT_METADATA_H
+#define DOCUMENT_METADATA_H
+
+#include <charconv>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Metadata of one Document. The keys parsers fill in for every document
+// are plain fields, with counts kept as integers; anything else goes to a
+// short flat list of string pairs. Setting a field costs no allocation
+// beyond a long string value, and reading one is a load rather than a
+// tree walk. get()/set() give the old map-style access by key name, with
+// typed fields formatted as text ("rows" -> "42", "has_tags" -> "true").
+//
+// Allocator-aware like Document: strings and the extra list allocate from
+// the resource given at construction.
+class DocumentMetadata {
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    using Entry = std::pair<std::pmr::string, std::pmr::string>;
+
+    // Well-known keys; an empty string or unset optional is absent
+    std::pmr::string parser;
+    std::pmr::string filename;
+    std::pmr::string format;
+    std::pmr::string encoding;
+    std::optional<uint64_t> lines;
+    std::optional<uint64_t> rows;
+    std::optional<uint64_t> columns;
+    std::optional<uint64_t> size;
+    std::optional<bool> hasTags;
+    // Every other key, in the order it was first set
+    std::pmr::vector<Entry> extra;
+
+    DocumentMetadata() = default;
+    explicit DocumentMetadata(const allocator_type& alloc)
+        : parser(alloc), filename(alloc), format(alloc), encoding(alloc), extra(alloc) {}
+
+    DocumentMetadata(const DocumentMetadata&) = default;
+    DocumentMetadata(DocumentMetadata&&) = default;
+    DocumentMetadata& operator=(const DocumentMetadata&) = default;
+    DocumentMetadata& operator=(DocumentMetadata&&) = default;
+
+    DocumentMetadata(const DocumentMetadata& other, const allocator_type& alloc)
+        : parser(other.parser, alloc), filename(other.filename, alloc), format(other.format, alloc),
+          encoding(other.encoding, alloc), lines(other.lines), rows(other.rows), columns(other.columns),
+          size(other.size), hasTags(other.hasTags), extra(other.extra, alloc) {}
+    DocumentMetadata(DocumentMetadata&& other, const allocator_type& alloc)
+        : parser(std::move(other.parser), alloc), filename(std::move(other.filename), alloc),
+          format(std::move(other.format), alloc), encoding(std::move(other.encoding), alloc),
+          lines(other.lines), rows(other.rows), columns(other.columns), size(other.size),
+          hasTags(other.hasTags), extra(std::move(other.extra), alloc) {}
+
+    allocator_type get_allocator() const { return parser.get_allocator(); }
+
+    // Value of `key` as text; nullopt if absent
+    std::optional<std::string> get(std::string_view key) const {
+        switch (fieldOf(key)) {
+            case Field::Extra:
+                if (const Entry* entry = findExtra(key)) {
+                    return std::string(entry->second);
+                }
+                return std::nullopt;
+            case Field::HasTags:
+                if (!hasTags) return std::nullopt;
+                return std::string(*hasTags ? "true" : "false");
+            default:
+                break;
+        }
+        if (const std::pmr::string* text = textField(key)) {
+            if (text->empty()) return std::nullopt;
+            return std::string(*text);
+        }
+        const std::optional<uint64_t>& number = *numberField(key);
+        if (!number) return std::nullopt;
+        return std::to_string(*number);
+    }
+
+    // Set `key` from text. Counts must be decimal integers and has_tags
+    // "true" or "false"; anything else throws std::invalid_argument.
+    void set(std::string_view key, std::string_view value) {
+        switch (fieldOf(key)) {
+            case Field::Extra:
+                for (auto& entry : extra) {
+                    if (entry.first == key) {
+                        entry.second.assign(value.data(), value.size());
+                        return;
+                    }
+                }
+                extra.emplace_back(key, value);
+                return;
+            case Field::HasTags:
+                if (value != "true" && value != "false") {
+                    throw std::invalid_argument("has_tags must be true or false");
+                }
+                hasTags = value == "true";
+                return;
+            default:
+                break;
+        }
+        if (std::pmr::string* text = textField(key)) {
+            text->assign(value.data(), value.size());
+            return;
+        }
+        uint64_t number = 0;
+        auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+        if (error != std::errc() || end != value.data() + value.size()) {
+            throw std::invalid_argument(std::string(key) + " must be a non-negative integer");
+        }
+        *numberField(key) = number;
+    }
+
+    bool contains(std::string_view key) const {
+        switch (fieldOf(key)) {
+            case Field::Extra:
+                return findExtra(key) != nullptr;
+            case Field::HasTags:
+                return hasTags.has_value();
+            default:
+                break;
+        }
+        if (const std::pmr::string* text = textField(key)) {
+            return !text->empty();
+        }
+        return numberField(key)->has_value();
+    }
+
+    // Returns whether `key` was present
+    bool erase(std::string_view key) {
+        bool present = contains(key);
+        switch (fieldOf(key)) {
+            case Field::Extra:
+                for (auto it = extra.begin(); it != extra.end(); ++it) {
+                    if (it->first == key) {
+                        extra.erase(it);
+                        break;
+                    }
+                }
+                return present;
+            case Field::HasTags:
+                hasTags.reset();
+                return present;
+            default:
+                break;
+        }
+        if (std::pmr::string* text = textField(key)) {
+            text->clear();
+        } else {
+            numberField(key)->reset();
+        }
+        return present;
+    }
+
+    void clear() {
+        parser.clear();
+        filename.clear();
+        format.clear();
+        encoding.clear();
+        lines.reset();
+        rows.reset();
+        columns.reset();
+        size.reset();
+        hasTags.reset();
+        extra.clear();
+    }
+
+    // Keys present: the well-known ones in a fixed order, then the extras
+    std::vector<std::string_view> keys() const {
+        std::vector<std::string_view> names;
+        for (std::string_view name : kKnownKeys) {
+            if (contains(name)) {
+                names.push_back(name);
+            }
+        }
+        for (const auto& entry : extra) {
+            names.push_back(entry.first);
+        }
+        return names;
+    }
+
+    bool empty() const {
+        return parser.empty() && filename.empty() && format.empty() && encoding.empty() && !lines &&
+               !rows && !columns && !size && !hasTags && extra.empty();
+    }
+
+    // Heap bytes held beyond sizeof(DocumentMetadata), for cache budgets
+    size_t heapBytes() const {
+        size_t bytes = extra.capacity() * sizeof(Entry);
+        for (const std::pmr::string* text : {&parser, &filename, &format, &encoding}) {
+            bytes += heapCapacity(*text);
+        }
+        for (const auto& entry : extra) {
+            bytes += heapCapacity(entry.first) + heapCapacity(entry.second);
+        }
+        return bytes;
+    }
+
+    // Same keys with the same values; the order of extras does not matter
+    friend bool operator==(const DocumentMetadata& a, const DocumentMetadata& b) {
+        if (a.parser != b.parser || a.filename != b.filename || a.format != b.format ||
+            a.encoding != b.encoding || a.lines != b.lines || a.rows != b.rows ||
+            a.columns != b.columns || a.size != b.size || a.hasTags != b.hasTags ||
+            a.extra.size() != b.extra.size()) {
+            return false;
+        }
+        for (const auto& entry : a.extra) {
+            const Entry* other = b.findExtra(entry.first);
+            if (!other || other->second != entry.second) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const DocumentMetadata& a, const DocumentMetadata& b) { return !(a == b); }
+
+private:
+    enum class Field { Text, Number, HasTags, Extra };
+
+    static constexpr std::string_view kKnownKeys[] = {
+        "parser", "filename", "format", "encoding", "lines", "rows", "columns", "size", "has_tags"};
+
+    static Field fieldOf(std::string_view key) {
+        if (key == "parser" || key == "filename" || key == "format" || key == "encoding") return Field::Text;
+        if (key == "lines" || key == "rows" || key == "columns" || key == "size") return Field::Number;
+        if (key == "has_tags") return Field::HasTags;
+        return Field::Extra;
+    }
+
+    const Entry* findExtra(std::string_view key) const {
+        for (const auto& entry : extra) {
+            if (entry.first == key) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    // The string field named `key`, or null for any other key
+    const std::pmr::string* textField(std::string_view key) const {
+        if (key == "parser") return &parser;
+        if (key == "filename") return &filename;
+        if (key == "format") return &format;
+        if (key == "encoding") return &encoding;
+        return nullptr;
+    }
+
+    std::pmr::string* textField(std::string_view key) {
+        return const_cast<std::pmr::string*>(std::as_const(*this).textField(key));
+    }
+
+    // The count field named `key`; only called for Field::Number keys
+    const std::optional<uint64_t>* numberField(std::string_view key) const {
+        if (key == "lines") return &lines;
+        if (key == "rows") return &rows;
+        if (key == "columns") return &columns;
+        return &size;
+    }
+
+    std::optional<uint64_t>* numberField(std::string_view key) {
+        return const_cast<std::optional<uint64_t>*>(std::as_const(*this).numberField(key));
+    }
+
+    // Capacity beyond the small-string buffer, which lives inline
+    static size_t heapCapacity(const std::pmr::string& text) {
+        return text.capacity() > std::pmr::string().capacity() ? text.capacity() + 1 : 0;
+    }
+};
+
+#endif // DOCUMENT_METADATA_H
@@ -2,357 +2,3283 @@
 #define DOCUMENT_PARSER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
+#include <unordered_map>
+#include <memory_resource>
 #include <memory>
+#include <functional>
 #include <fstream>
-#include <sstream>
 #include <algorithm>
 #include <cctype>
-#include <regex>
+#include <cerrno>
+#include <cmath>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <cstring>
+#include <stdexcept>
 
-// Base document structure
+#include "compressed_input.h"
+#include "csv_scanner.h"
+#include "document_arena.h"
+#include "document_cache.h"
+#include "document_metadata.h"
+#include "document_structure.h"
+#include "format_sniffer.h"
+#include "json_index.h"
+#include "markdown_tokenizer.h"
+#include "parse_stats.h"
+#include "text_encoding.h"
+#include "thread_pool.h"
+#include "xml_stream.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// One page or segment of a document, as a byte range of its content
+struct PageRange {
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+// Base document structure. Allocator-aware: content, metadata, pages and
+// structure all allocate from the memory resource given at construction (the default heap
+// otherwise), so a batch can keep its documents in one DocumentArena.
+// Moves keep the source's resource; copies go to the default heap.
 struct Document {
-    std::string content;
-    std::map<std::string, std::string> metadata;
-    std::string format;
-    std::vector<std::string> pages;
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    using Metadata = DocumentMetadata;
+    
+    std::pmr::string content;
+    Metadata metadata;
+    std::pmr::string format;
+    std::pmr::vector<std::pmr::string> pages;   // explicit page text; wins over pageRanges
+    std::pmr::vector<PageRange> pageRanges;     // pages found by the parser, as slices of content
+    DocumentStructure structure;                // headings, lists, links, ... over content
     
     Document() = default;
-    Document(const std::string& text, const std::string& fmt) 
-        : content(text), format(fmt) {}
-};
-
-// Abstract base parser class
-class DocumentParser {
-public:
-    virtual ~DocumentParser() = default;
-    virtual bool canParse(const std::string& filename) const = 0;
-    virtual Document parse(const std::string& filename) = 0;
-    virtual std::string getFormatName() const = 0;
-protected:
-    std::string readFile(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary);
-        if (!file.is_open()) {
-            throw std::runtime_error("Cannot open file: " + filename);
+    explicit Document(const allocator_type& alloc)
+        : content(alloc), metadata(alloc), format(alloc), pages(alloc), pageRanges(alloc), structure(alloc) {}
+    Document(std::string_view text, std::string_view fmt, const allocator_type& alloc = {})
+        : content(text, alloc), metadata(alloc), format(fmt, alloc), pages(alloc), pageRanges(alloc),
+          structure(alloc) {}
+    
+    Document(const Document&) = default;
+    Document(Document&&) = default;
+    Document& operator=(const Document&) = default;
+    Document& operator=(Document&&) = default;
+    
+    Document(const Document& other, const allocator_type& alloc)
+        : content(other.content, alloc), metadata(other.metadata, alloc),
+          format(other.format, alloc), pages(other.pages, alloc), pageRanges(other.pageRanges, alloc),
+          structure(other.structure, alloc) {}
+    Document(Document&& other, const allocator_type& alloc)
+        : content(std::move(other.content), alloc), metadata(std::move(other.metadata), alloc),
+          format(std::move(other.format), alloc), pages(std::move(other.pages), alloc),
+          pageRanges(std::move(other.pageRanges), alloc), structure(std::move(other.structure), alloc) {}
+    
+    allocator_type get_allocator() const { return content.get_allocator(); }
+    
+    size_t pageCount() const {
+        return pages.empty() ? pageRanges.size() : pages.size();
+    }
+    
+    // Text of one page; a view into `content` unless `pages` was filled in
+    std::string_view page(size_t index) const {
+        if (index >= pageCount()) {
+            throw std::out_of_range("Page index out of range: " + std::to_string(index));
         }
-        
-        std::ostringstream buffer;
-        buffer << file.rdbuf();
-        return buffer.str();
+        if (!pages.empty()) {
+            return pages[index];
+        }
+        const PageRange& range = pageRanges[index];
+        return std::string_view(content).substr(range.offset, range.length);
     }
     
-    std::string toLowerCase(const std::string& str) const {
-        std::string result = str;
-        std::transform(result.begin(), result.end(), result.begin(), ::tolower);
-        return result;
+    void addPage(size_t begin, size_t end) {
+        pageRanges.push_back(PageRange{begin, end - begin});
     }
     
-    std::string getFileExtension(const std::string& filename) const {
-        size_t dot = filename.find_last_of('.');
-        if (dot != std::string::npos) {
-            return toLowerCase(filename.substr(dot + 1));
-        }
-        return "";
+    // Text of one structural element, a view into `content`
+    std::string_view text(const DocumentElement& element) const {
+        return std::string_view(content).substr(element.offset, element.length);
     }
 };
 
-// Plain text parser
-class TextParser : public DocumentParser {
+// Read-only view over a file's bytes. The file is memory-mapped when possible
+// so parsers can scan it in place; pipes, special files, empty files and
+// platforms without mmap are read into a buffer instead.
+class FileBuffer {
 public:
-    bool canParse(const std::string& filename) const override {
-        std::string ext = getFileExtension(filename);
-        return ext == "txt" || ext == "text";
+    explicit FileBuffer(const std::string& filename, bool allowMapping = true) {
+#ifndef _WIN32
+        openFile(filename, allowMapping);
+#else
+        (void)allowMapping;
+        readBuffered(filename);
+#endif
     }
     
-    Document parse(const std::string& filename) override {
-        std::string content = readFile(filename);
-        Document doc(content, "text");
-        doc.metadata["encoding"] = "utf-8";
-        doc.metadata["lines"] = std::to_string(std::count(content.begin(), content.end(), '\n') + 1);
-        return doc;
+    // Own bytes produced elsewhere, such as a decompressed file
+    static FileBuffer fromBytes(std::string bytes, uint64_t fileId = 0) {
+        FileBuffer input;
+        input.buffer = std::move(bytes);
+        input.identity = fileId;
+        return input;
     }
     
-    std::string getFormatName() const override { return "Plain Text"; }
-};
-
-// CSV parser
-class CSVParser : public DocumentParser {
-public:
-    bool canParse(const std::string& filename) const override {
-        std::string ext = getFileExtension(filename);
-        return ext == "csv";
+    ~FileBuffer() { unmap(); }
+    
+    FileBuffer(const FileBuffer&) = delete;
+    FileBuffer& operator=(const FileBuffer&) = delete;
+    
+    FileBuffer(FileBuffer&& other) noexcept
+        : mappedData(other.mappedData), mappedSize(other.mappedSize),
+          buffer(std::move(other.buffer)), start(other.start), identity(other.identity) {
+        other.mappedData = nullptr;
+        other.mappedSize = 0;
     }
     
-    Document parse(const std::string& filename) override {
-        std::string content = readFile(filename);
-        Document doc(content, "csv");
-        
-        std::vector<std::vector<std::string>> rows = parseCSV(content);
-        doc.metadata["rows"] = std::to_string(rows.size());
-        if (!rows.empty()) {
-            doc.metadata["columns"] = std::to_string(rows[0].size());
+    FileBuffer& operator=(FileBuffer&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            mappedData = other.mappedData;
+            mappedSize = other.mappedSize;
+            buffer = std::move(other.buffer);
+            start = other.start;
+            identity = other.identity;
+            other.mappedData = nullptr;
+            other.mappedSize = 0;
         }
-        
-        // Store structured data as formatted text
-        std::ostringstream formatted;
-        for (const auto& row : rows) {
-            for (size_t i = 0; i < row.size(); ++i) {
-                if (i > 0) formatted << " | ";
-                formatted << row[i];
-            }
-            formatted << "\n";
+        return *this;
+    }
+    
+    std::string_view view() const {
+        if (mappedData) {
+            return std::string_view(mappedData + start, mappedSize - start);
         }
-        doc.content = formatted.str();
-        
-        return doc;
+        return std::string_view(buffer).substr(start);
     }
     
-    std::string getFormatName() const override { return "CSV"; }
+    // Drop the first `count` bytes of view(), such as a byte order mark
+    void removePrefix(size_t count) { start += std::min(count, size()); }
+    
+    size_t size() const { return view().size(); }
+    bool isMapped() const { return mappedData != nullptr; }
+    
+    // Device and inode of the opened file where available, 0 otherwise
+    uint64_t fileId() const { return identity; }
+    
+    // Start reading up to `maxBytes` of a mapping in the background so a
+    // later scan finds the pages resident; buffered reads are already in
+    void prefetch(size_t maxBytes = SIZE_MAX) const {
+#ifndef _WIN32
+        if (mappedData) {
+            ::madvise(const_cast<char*>(mappedData), std::min(mappedSize, maxBytes), MADV_WILLNEED);
+        }
+#else
+        (void)maxBytes;
+#endif
+    }
 
 private:
-    std::vector<std::vector<std::string>> parseCSV(const std::string& content) {
-        std::vector<std::vector<std::string>> result;
-        std::istringstream stream(content);
-        std::string line;
+    const char* mappedData = nullptr;
+    size_t mappedSize = 0;
+    std::string buffer;
+    size_t start = 0;
+    uint64_t identity = 0;
+    
+    FileBuffer() = default;
+    
+#ifndef _WIN32
+    // Regular files are mapped; everything else is read from the same
+    // descriptor, since a pipe or FIFO can't be opened a second time
+    void openFile(const std::string& filename, bool allowMapping) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open file: " + filename);
+        }
         
-        while (std::getline(stream, line)) {
-            result.push_back(parseCSVLine(line));
+        struct stat st;
+        size_t length = 0;
+        if (::fstat(fd, &st) == 0) {
+            identity = (static_cast<uint64_t>(st.st_dev) << 32) ^ static_cast<uint64_t>(st.st_ino);
+            length = S_ISREG(st.st_mode) ? static_cast<size_t>(st.st_size) : 0;
+        }
+        if (allowMapping && length > 0) {
+            void* addr = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                ::close(fd);
+                ::madvise(addr, length, MADV_SEQUENTIAL);
+                mappedData = static_cast<const char*>(addr);
+                mappedSize = length;
+                return;
+            }
         }
         
-        return result;
+        // Regular files are read at their size; pipes, special and /proc
+        // files report 0 and are read until end of file
+        size_t used = 0;
+        buffer.resize(length > 0 ? length : 4096);
+        while (length == 0 || used < length) {
+            if (used == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+            ssize_t n = ::read(fd, &buffer[used], buffer.size() - used);
+            if (n > 0) {
+                used += static_cast<size_t>(n);
+            } else if (n == 0) {
+                break;
+            } else if (errno != EINTR) {
+                ::close(fd);
+                throw std::runtime_error("Cannot read file: " + filename);
+            }
+        }
+        buffer.resize(used);
+        ::close(fd);
     }
-    
-    std::vector<std::string> parseCSVLine(const std::string& line) {
-        std::vector<std::string> fields;
-        std::string field;
-        bool inQuotes = false;
+#else
+    void readBuffered(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open file: " + filename);
+        }
         
-        for (size_t i = 0; i < line.length(); ++i) {
-            char c = line[i];
-            
-            if (c == '"') {
-                inQuotes = !inQuotes;
-            } else if (c == ',' && !inQuotes) {
-                fields.push_back(field);
-                field.clear();
-            } else {
-                field += c;
+        file.seekg(0, std::ios::end);
+        std::streamoff length = file.tellg();
+        file.seekg(0, std::ios::beg);
+        if (length > 0) {
+            buffer.resize(static_cast<size_t>(length));
+            file.read(&buffer[0], length);
+            buffer.resize(static_cast<size_t>(file.gcount()));
+        } else {
+            // Size unknown (pipe or special file): read until EOF
+            file.clear();
+            char chunk[65536];
+            while (file.read(chunk, sizeof(chunk)) || file.gcount() > 0) {
+                buffer.append(chunk, static_cast<size_t>(file.gcount()));
             }
         }
-        
-        fields.push_back(field);
-        return fields;
+    }
+#endif
+    
+    void unmap() {
+#ifndef _WIN32
+        if (mappedData) {
+            ::munmap(const_cast<char*>(mappedData), mappedSize);
+        }
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
     }
 };
 
-// JSON parser
-class JSONParser : public DocumentParser {
+// A FileBuffer read sequentially; the stream owns it, so compressed bytes
+// can be inflated block by block without outliving their mapping
+class MappedInputStream : public InputStream {
 public:
-    bool canParse(const std::string& filename) const override {
-        std::string ext = getFileExtension(filename);
-        return ext == "json";
+    explicit MappedInputStream(FileBuffer buffer) : input(std::move(buffer)) {}
+
+    size_t read(char* data, size_t size) override {
+        std::string_view rest = input.view().substr(pos);
+        size_t count = std::min(size, rest.size());
+        std::memcpy(data, rest.data(), count);
+        pos += count;
+        return count;
     }
+
+private:
+    FileBuffer input;
+    size_t pos = 0;
+};
+
+// Where an append-only parse of a file stopped, so the next parse only
+// reads what was appended since. Offsets count bytes of the file as
+// stored, before decoding, and only the bytes after `offset` are decoded.
+// The head of the already parsed bytes is hashed to notice a file that
+// was rewritten rather than appended to.
+struct ParseCheckpoint {
+    static constexpr size_t kPrefixBytes = 4096;
     
-    Document parse(const std::string& filename) override {
-        std::string content = readFile(filename);
-        Document doc(content, "json");
-        
-        // Basic JSON validation and formatting
-        std::string formatted = formatJSON(content);
-        doc.content = formatted;
-        
-        doc.metadata["type"] = "json";
-        doc.metadata["size"] = std::to_string(content.length());
-        
-        return doc;
+    uint64_t offset = 0;        // end of the last complete line or row
+    uint64_t count = 0;         // complete lines or rows before offset
+    size_t columns = 0;         // CSV only: fields in the first row
+    uint64_t fileId = 0;        // see FileBuffer::fileId()
+    uint64_t prefixLength = 0;  // bytes covered by prefixHash
+    uint64_t prefixHash = 0;
+    TextEncoding encoding = TextEncoding::UTF8;  // detected while offset is 0
+    
+    // Continue from `offset` if `input` is the same file, only longer.
+    // A truncated, rotated or rewritten file resets the checkpoint to the
+    // start and returns false.
+    bool resume(const FileBuffer& input) {
+        std::string_view data = input.view();
+        bool unchanged = offset == 0 ||
+            (data.size() >= offset && input.fileId() == fileId &&
+             xxhash64(data.data(), static_cast<size_t>(prefixLength)) == prefixHash);
+        if (!unchanged) {
+            *this = ParseCheckpoint();
+        }
+        fileId = input.fileId();
+        return unchanged;
     }
     
-    std::string getFormatName() const override { return "JSON"; }
-
-private:
-    std::string formatJSON(const std::string& json) {
-        std::string result;
-        int indent = 0;
-        bool inString = false;
-        
-        for (size_t i = 0; i < json.length(); ++i) {
-            char c = json[i];
-            
-            if (c == '"' && (i == 0 || json[i-1] != '\\')) {
-                inString = !inString;
+    // Everything before `end` has been parsed
+    void advance(std::string_view data, uint64_t end) {
+        offset = end;
+        if (prefixLength < kPrefixBytes) {
+            prefixLength = std::min<uint64_t>(end, kPrefixBytes);
+            prefixHash = xxhash64(data.data(), static_cast<size_t>(prefixLength));
+        }
+    }
+    
+    // The bytes of `data` after `offset` as UTF-8. Until something has been
+    // parsed the encoding is detected again, and a byte order mark is
+    // skipped. A character cut off by a writer still writing is left for
+    // the next poll rather than decoded as garbage.
+    std::string_view decodeAppended(std::string_view data, std::string& storage) {
+        if (offset == 0) {
+            size_t bom = 0;
+            encoding = detectEncoding(data, &bom, false);
+            offset = bom;
+        }
+        std::string_view raw = data.substr(static_cast<size_t>(offset));
+        if (encoding == TextEncoding::UTF8) {
+            raw = raw.substr(0, Transcoder::completeUTF8Prefix(raw));
+            if (isValidUTF8(raw)) {
+                return raw;
             }
-            
-            if (!inString) {
-                if (c == '{' || c == '[') {
-                    result += c;
-                    result += '\n';
-                    indent++;
-                    result += std::string(indent * 2, ' ');
-                } else if (c == '}' || c == ']') {
-                    result += '\n';
-                    indent--;
-                    result += std::string(indent * 2, ' ');
-                    result += c;
-                } else if (c == ',') {
-                    result += c;
-                    result += '\n';
-                    result += std::string(indent * 2, ' ');
-                } else if (c != ' ' && c != '\t' && c != '\n') {
-                    result += c;
+        }
+        storage.clear();
+        Transcoder::toUTF8(raw, encoding, storage, false);
+        return storage;
+    }
+    
+    // Offset in `data` just past the `lines`-th newline after `offset`.
+    // Decoding keeps every newline and makes none, so this is where text
+    // decoded from `offset` that ends in its `lines`-th newline came from.
+    uint64_t endAfterLines(std::string_view data, uint64_t lines) const {
+        size_t pos = static_cast<size_t>(offset);
+        if (encoding == TextEncoding::UTF16LE || encoding == TextEncoding::UTF16BE) {
+            size_t low = encoding == TextEncoding::UTF16LE ? 0 : 1;
+            for (; lines > 0 && pos + 1 < data.size(); pos += 2) {
+                if (data[pos + low] == '\n' && data[pos + 1 - low] == '\0') {
+                    --lines;
                 }
-            } else {
-                result += c;
             }
+            return pos;
+        }
+        for (; lines > 0; --lines) {
+            pos = data.find('\n', pos) + 1;
+        }
+        return pos;
+    }
+};
+
+// Memory a worker thread reuses from one parse to the next. The document of
+// the last parse and every temporary of the parse (row and field storage,
+// token and tag stacks, page offsets) allocate from a RecyclingResource, so
+// once a thread has seen its largest inputs, parsing allocates nothing.
+// Freed buffers beyond `highWaterBytes` go back to the heap after each
+// parse, so one huge file does not pin its memory for good. Streaming XML
+// with `select` and the parallel paths of TextParser and CSVParser still
+// use the heap. One context per thread.
+class ParseContext {
+public:
+    static constexpr size_t kDefaultHighWaterBytes = size_t(64) << 20;
+    
+    explicit ParseContext(size_t highWaterBytes = kDefaultHighWaterBytes)
+        : highWater(highWaterBytes), doc(&memory) {}
+    
+    ParseContext(const ParseContext&) = delete;
+    ParseContext& operator=(const ParseContext&) = delete;
+    
+    // Result of the last parse; replaced by the next one
+    Document& document() { return doc; }
+    const Document& document() const { return doc; }
+    
+    Document::allocator_type allocator() { return Document::allocator_type(&memory); }
+    
+    // Freed bytes kept for the next parse
+    size_t retainedBytes() const { return memory.cachedBytes(); }
+    
+    // For the duration of one parse: hands the previous document's buffers
+    // to the cache and routes this thread's scratch allocations to the
+    // context. Afterwards the cache is trimmed to the high-water mark.
+    class Scope {
+    public:
+        explicit Scope(ParseContext& context) : owner(context), scratch(&context.memory) {
+            // Moving out releases the buffers; assigning would keep them
+            Document previous(std::move(context.doc));
         }
+        ~Scope() { owner.memory.trim(owner.highWater); }
         
-        return result;
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        
+    private:
+        ParseContext& owner;
+        ScratchScope scratch;
+    };
+    
+private:
+    RecyclingResource memory;
+    size_t highWater;
+    Document doc;
+};
+
+// Parts of a Document a parse should produce; parsers skip the work behind
+// the parts left out. `format` and the metadata UniversalDocumentParser adds
+// (parser, filename, ...) are always filled in.
+//   Metadata    format-specific metadata: rows, columns, lines, valid, ...
+//   RawContent  content holds the input bytes as read (decompressed)
+//   Content     content holds the parser's text; wins over RawContent
+//   Pages       pageRanges over the parser's text; implies Content
+//   Structure   structure over the parser's text (Markdown); implies Content
+// A Metadata-only parse of CSV or text scans the input without allocating
+// any output.
+enum class ParseOutput : unsigned {
+    None = 0,
+    Metadata = 1u << 0,
+    RawContent = 1u << 1,
+    Content = 1u << 2,
+    Pages = 1u << 3,
+    Structure = 1u << 4,
+    All = Metadata | Content | Pages | Structure
+};
+
+constexpr ParseOutput operator|(ParseOutput a, ParseOutput b) {
+    return static_cast<ParseOutput>(static_cast<unsigned>(a) | static_cast<unsigned>(b));
+}
+
+constexpr ParseOutput operator&(ParseOutput a, ParseOutput b) {
+    return static_cast<ParseOutput>(static_cast<unsigned>(a) & static_cast<unsigned>(b));
+}
+
+// Whether `mask` asks for `part`, with Pages and Structure implying Content
+constexpr bool wants(ParseOutput mask, ParseOutput part) {
+    if ((mask & (ParseOutput::Pages | ParseOutput::Structure)) != ParseOutput::None) {
+        mask = mask | ParseOutput::Content;
     }
+    return (mask & part) == part;
+}
+
+// How one parse runs; every parse call takes it, and parsers hand it on
+// to whatever they call, including work they spread over other threads.
+// `premapped` holds the bytes of the file being parsed when the caller has
+// already opened it (the universal parser does, to hash it for the cache);
+// the parse takes them instead of reading the file a second time.
+struct ParseOptions {
+    ParseOutput outputs = ParseOutput::All;
+    FileBuffer* premapped = nullptr;
+    
+    ParseOptions() = default;
+    // Implicit, so a ParseOutput mask can be passed where options are taken
+    ParseOptions(ParseOutput parts) : outputs(parts) {}
+    
+    bool wants(ParseOutput part) const { return ::wants(outputs, part); }
 };
 
-// XML/HTML parser
-class XMLParser : public DocumentParser {
+// Abstract base parser class. Parsers are stateless: parse() keeps all
+// per-call state on the stack, so one instance may serve any number of
+// threads at once. Custom parsers registered with UniversalDocumentParser
+// must follow the same rule. Parsers may leave out what ParseOptions::outputs
+// does not ask for; UniversalDocumentParser drops it either way.
+class DocumentParser {
 public:
-    bool canParse(const std::string& filename) const override {
+    virtual ~DocumentParser() = default;
+    // Lower-case extensions (without the dot) handled by this parser.
+    // UniversalDocumentParser dispatches on these through a hash table;
+    // parsers that list none are asked through canParse() instead.
+    virtual std::vector<std::string> getExtensions() const { return {}; }
+    virtual bool canParse(const std::string& filename) const {
         std::string ext = getFileExtension(filename);
-        return ext == "xml" || ext == "html" || ext == "htm";
+        for (const auto& candidate : getExtensions()) {
+            if (candidate == ext) {
+                return true;
+            }
+        }
+        return false;
+    }
+    // The returned document allocates from `alloc`. By default the file is
+    // mapped, decompressed, decoded to UTF-8 and handed to parseContent().
+    virtual Document parse(const std::string& filename, const ParseOptions& options,
+                           const Document::allocator_type& alloc = {}) {
+        return parseDecoded(decodeFile(inflate(openFile(filename, options))), filename, options, alloc);
     }
     
-    Document parse(const std::string& filename) override {
-        std::string content = readFile(filename);
-        std::string ext = getFileExtension(filename);
-        
-        Document doc(content, ext);
-        
-        // Extract text content from tags
-        std::string textContent = extractTextFromXML(content);
-        doc.content = textContent;
-        
-        // Extract metadata
-        doc.metadata["format"] = ext;
-        doc.metadata["has_tags"] = "true";
-        
+    // Every part of the document; see ParseOutput
+    Document parse(const std::string& filename, const Document::allocator_type& alloc = {}) {
+        return parse(filename, ParseOptions(), alloc);
+    }
+    
+    // Parse reusing the memory of `context`; see ParseContext. The result
+    // is context.document() and stays valid until its next parse.
+    const Document& parse(const std::string& filename, ParseContext& context,
+                          const ParseOptions& options = ParseOptions()) {
+        ParseContext::Scope scope(context);
+        context.document() = parse(filename, options, context.allocator());
+        return context.document();
+    }
+    
+    // Parse bytes already in memory; `filename` is only a hint (e.g. for the
+    // extension) and is never opened. `content` must be UTF-8, as left by
+    // decodeText(). Parsers must override parse(), parseContent() or both.
+    virtual Document parseContent(std::string_view content, const std::string& filename,
+                                  const ParseOptions& options, const Document::allocator_type& alloc = {}) {
+        (void)content;
+        (void)options;
+        (void)alloc;
+        throw std::runtime_error(getFormatName() + " parser cannot parse in-memory content: " + filename);
+    }
+    
+    Document parseContent(std::string_view content, const std::string& filename,
+                          const Document::allocator_type& alloc = {}) {
+        return parseContent(content, filename, ParseOptions(), alloc);
+    }
+    
+    virtual std::string getFormatName() const = 0;
+protected:
+    // A file decoded to UTF-8 and the encoding it was decoded from
+    struct DecodedFile {
+        FileBuffer text;
+        TextEncoding encoding;
+    };
+    
+    // Whole file as an owned string, allocated once at its final size
+    std::string readFile(const std::string& filename) const {
+        FileBuffer input = mapFile(filename);
+        return std::string(input.view());
+    }
+    
+    // Zero-copy input: parsers scan the returned view instead of a copy.
+    // Compressed files come back decompressed, and text that is not UTF-8
+    // transcoded, from an owned buffer; see decodeText().
+    FileBuffer mapFile(const std::string& filename) const {
+        return decodeFile(mapRawFile(filename)).text;
+    }
+    
+    // `input`, already decompressed, as UTF-8. Valid UTF-8 stays mapped,
+    // minus any byte order mark.
+    static DecodedFile decodeFile(FileBuffer input) {
+        DOCPARSER_STAGE(Read);
+        DOCPARSER_COUNT_BYTES(input.size());
+        std::string storage;
+        DecodedText decoded = decodeText(input.view(), storage);
+        if (decoded.text.data() != storage.data()) {
+            input.removePrefix(input.size() - decoded.text.size());
+            return {std::move(input), decoded.encoding};
+        }
+        return {FileBuffer::fromBytes(std::move(storage), input.fileId()), decoded.encoding};
+    }
+    
+    // The file decompressed but not yet decoded, for append-only parses,
+    // which decode only the bytes they have not seen; see ParseCheckpoint
+    FileBuffer mapRawFile(const std::string& filename) const {
+        return inflate(openFile(filename));
+    }
+    
+    // `input` decompressed whole if it is compressed, as is otherwise
+    static FileBuffer inflate(FileBuffer input) {
+        DOCPARSER_STAGE(Read);
+        Compression compression = detectCompression(input.view());
+        if (compression != Compression::None) {
+            input = FileBuffer::fromBytes(Decompressor::decompress(input.view(), compression),
+                                          input.fileId());
+        }
+        return input;
+    }
+    
+    // The file's bytes as stored: options.premapped if set, which the parse
+    // takes, and a new mapping otherwise
+    static FileBuffer openFile(const std::string& filename, const ParseOptions& options = ParseOptions()) {
+        DOCPARSER_STAGE(Read);
+        if (options.premapped) {
+            return std::move(*options.premapped);
+        }
+        return FileBuffer(filename);
+    }
+    
+    // parseContent() of a decodeFile() result, recording its encoding
+    Document parseDecoded(DecodedFile input, const std::string& filename, const ParseOptions& options,
+                          const Document::allocator_type& alloc) {
+        Document doc = parseContent(input.text.view(), filename, options, alloc);
+        if (options.wants(ParseOutput::Metadata)) {
+            doc.metadata.encoding = encodingName(input.encoding);
+        }
         return doc;
     }
     
-    std::string getFormatName() const override { return "XML/HTML"; }
-
-private:
-    std::string extractTextFromXML(const std::string& xml) {
-        std::string result;
-        bool inTag = false;
-        
-        for (char c : xml) {
-            if (c == '<') {
-                inTag = true;
-            } else if (c == '>') {
-                inTag = false;
-                result += ' ';
-            } else if (!inTag) {
-                result += c;
+    // `input` as UTF-8 decoded while it is inflated, for parsers that read
+    // sequentially: a compressed file then never sits in memory whole.
+    // Mapped input that is not compressed is better scanned in place.
+    static std::unique_ptr<TextInputStream> streamFile(FileBuffer input) {
+        Compression compression = detectCompression(input.view());
+        return std::make_unique<TextInputStream>(
+            decodingStream(std::make_unique<MappedInputStream>(std::move(input)), compression));
+    }
+    
+    // Pages from ascending section start offsets: every section runs to the
+    // next one, is trimmed of surrounding whitespace and dropped if blank
+    static void addSections(Document& doc, const std::pmr::vector<size_t>& starts) {
+        std::string_view text = doc.content;
+        doc.pageRanges.reserve(starts.size() + 1);
+        size_t begin = 0;
+        for (size_t i = 0; i <= starts.size(); ++i) {
+            size_t end = i < starts.size() ? starts[i] : text.size();
+            size_t first = begin;
+            size_t last = end;
+            while (first < last && std::isspace(static_cast<unsigned char>(text[first]))) ++first;
+            while (last > first && std::isspace(static_cast<unsigned char>(text[last - 1]))) --last;
+            if (first < last) {
+                doc.addPage(first, last);
             }
+            begin = std::max(begin, end);
         }
-        
-        // Clean up whitespace
-        std::regex multiSpace("\\s+");
-        result = std::regex_replace(result, multiSpace, " ");
-        
+    }
+    
+    std::string toLowerCase(const std::string& str) const {
+        std::string result = str;
+        std::transform(result.begin(), result.end(), result.begin(), ::tolower);
         return result;
     }
+    
+    // Looks through a compression extension: "rows.CSV.gz" gives "csv"
+    std::string getFileExtension(const std::string& filename) const {
+        std::string_view name = innerName(filename);
+        size_t dot = name.find_last_of('.');
+        if (dot != std::string_view::npos) {
+            return toLowerCase(std::string(name.substr(dot + 1)));
+        }
+        return "";
+    }
 };
 
-// Markdown parser
-class MarkdownParser : public DocumentParser {
+// How TextParser and CSVParser split one large input across cores. Inputs
+// are cut into at most `threads` slices of at least `minChunkBytes`, so
+// anything under twice that is parsed on the calling thread alone, as is
+// everything parsed on a batch or pipeline worker (see onParallelWorker()).
+struct ParallelOptions {
+    size_t threads = 0;                        // 0 = one per hardware thread
+    size_t minChunkBytes = size_t(32) << 20;
+    
+    size_t chunksFor(size_t bytes) const {
+        if (onParallelWorker()) {
+            return 1;
+        }
+        size_t limit = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+        size_t bySize = minChunkBytes > 0 ? bytes / minChunkBytes : limit;
+        return std::max<size_t>(1, std::min(limit, bySize));
+    }
+    
+    // Start of slice `index` of `chunks` equal slices of `bytes`
+    static size_t sliceStart(size_t bytes, size_t index, size_t chunks) {
+        // floor(bytes * index / chunks) without overflowing
+        return bytes / chunks * index + bytes % chunks * index / chunks;
+    }
+};
+
+// Plain text parser
+class TextParser : public DocumentParser {
 public:
-    bool canParse(const std::string& filename) const override {
-        std::string ext = getFileExtension(filename);
-        return ext == "md" || ext == "markdown";
+    explicit TextParser(const ParallelOptions& options = ParallelOptions()) : parallel(options) {}
+    
+    std::vector<std::string> getExtensions() const override {
+        return {"txt", "text"};
     }
     
-    Document parse(const std::string& filename) override {
-        std::string content = readFile(filename);
-        Document doc(content, "markdown");
-        
-        // Extract headers and convert to plain text
-        std::string converted = convertMarkdownToText(content);
-        doc.content = converted;
+    // Compressed text is inflated a block at a time straight into the
+    // document, so the only whole copy is the one returned
+    using DocumentParser::parse;
+    using DocumentParser::parseContent;
+    
+    Document parse(const std::string& filename, const ParseOptions& options,
+                   const Document::allocator_type& alloc = {}) override {
+        FileBuffer input = openFile(filename, options);
+        if (detectCompression(input.view()) == Compression::None) {
+            return parseDecoded(decodeFile(std::move(input)), filename, options, alloc);
+        }
+        std::unique_ptr<TextInputStream> stream = streamFile(std::move(input));
+        Document doc(alloc);
+        doc.format = "text";
+        bool copy = options.wants(ParseOutput::Content) || options.wants(ParseOutput::RawContent);
+        bool count = options.wants(ParseOutput::Metadata);
+        bool pages = options.wants(ParseOutput::Pages);
+        if (!copy && !count && !pages) {
+            return doc;
+        }
         
-        doc.metadata["format"] = "markdown";
+        std::string scratch(copy ? 0 : TextInputStream::kBlockSize, '\0');
+        size_t total = 0;
+        size_t newlines = 0;
+        std::pmr::vector<size_t> formFeeds(scratchResource());
+        while (true) {
+            char* block = scratch.data();
+            if (copy) {
+                doc.content.resize(total + TextInputStream::kBlockSize);
+                block = &doc.content[total];
+            }
+            size_t got = stream->read(block, TextInputStream::kBlockSize);
+            if (count) newlines += std::count(block, block + got, '\n');
+            if (pages) findFormFeeds(std::string_view(block, got), total, formFeeds);
+            total += got;
+            if (got < TextInputStream::kBlockSize) {
+                break;
+            }
+        }
+        if (copy) doc.content.resize(total);
+        DOCPARSER_COUNT_BYTES(total);
         
+        if (count) {
+            doc.metadata.lines = newlines + 1;
+            doc.metadata.encoding = encodingName(stream->encoding());
+        }
+        if (pages) {
+            addFormFeedPages(doc, formFeeds);
+        }
         return doc;
     }
     
-    std::string getFormatName() const override { return "Markdown"; }
-
-private:
-    std::string convertMarkdownToText(const std::string& md) {
-        std::string result = md;
-        
-        // Remove headers
-        result = std::regex_replace(result, std::regex("^#+\\s*", std::regex_constants::ECMAScript), "");
+    Document parseContent(std::string_view content, const std::string&, const ParseOptions& options,
+                          const Document::allocator_type& alloc = {}) override {
+        Document doc(alloc);
+        doc.format = "text";
+        // Text is its own raw content
+        bool copy = options.wants(ParseOutput::Content) || options.wants(ParseOutput::RawContent);
+        bool count = options.wants(ParseOutput::Metadata);
+        bool pages = options.wants(ParseOutput::Pages);
         
-        // Remove bold/italic
-        result = std::regex_replace(result, std::regex("\\*\\*([^*]+)\\*\\*"), "$1");
-        result = std::regex_replace(result, std::regex("\\*([^*]+)\\*"), "$1");
-        
-        // Remove links
-        result = std::regex_replace(result, std::regex("\\[([^\\]]+)\\]\\([^)]+\\)"), "$1");
+        size_t chunks = parallel.chunksFor(content.size());
+        size_t newlines = 0;
+        std::pmr::vector<size_t> formFeeds(scratchResource());
+        if (chunks <= 1) {
+            if (copy) doc.content.assign(content.data(), content.size());
+            if (count) newlines = std::count(content.begin(), content.end(), '\n');
+            if (pages) findFormFeeds(content, 0, formFeeds);
+        } else if (copy || count || pages) {
+            // Copy and scan each slice on its own core; on a cold mapping
+            // this also spreads the page faults
+            if (copy) doc.content.resize(content.size());
+            std::vector<size_t> counts(chunks, 0);
+            std::vector<std::pmr::vector<size_t>> feeds(chunks);
+            parallelFor(chunks, [&](size_t i) {
+                size_t begin = ParallelOptions::sliceStart(content.size(), i, chunks);
+                size_t end = ParallelOptions::sliceStart(content.size(), i + 1, chunks);
+                if (copy) std::memcpy(&doc.content[begin], content.data() + begin, end - begin);
+                if (count) counts[i] = std::count(content.data() + begin, content.data() + end, '\n');
+                if (pages) findFormFeeds(content.substr(begin, end - begin), begin, feeds[i]);
+            });
+            for (size_t i = 0; i < chunks; ++i) {
+                newlines += counts[i];
+                formFeeds.insert(formFeeds.end(), feeds[i].begin(), feeds[i].end());
+            }
+        }
+        if (count) {
+            doc.metadata.lines = newlines + 1;
+        }
+        if (pages) {
+            addFormFeedPages(doc, formFeeds);
+        }
+        return doc;
+    }
+    
+    // Parse only what was appended since `checkpoint`. The document holds
+    // the new complete lines, `lines` counts every complete line so far and
+    // `offset` says where in the file the new text starts. The file is
+    // mapped and only the new bytes are decoded, so a poll costs what was
+    // appended rather than the size of the file (compressed files aside).
+    // The trailing partial line is left for the next call. A truncated or
+    // replaced file is parsed from the start again and flagged with
+    // reset=true.
+    Document parseIncremental(const std::string& filename, ParseCheckpoint& checkpoint,
+                              const Document::allocator_type& alloc = {}) const {
+        FileBuffer input = mapRawFile(filename);
+        std::string_view data = input.view();
+        bool reset = !checkpoint.resume(input);
+        std::string storage;
+        std::string_view appended = checkpoint.decodeAppended(data, storage);
+        size_t start = static_cast<size_t>(checkpoint.offset);
+        DOCPARSER_COUNT_BYTES(appended.size());
         
-        // Remove code blocks
-        result = std::regex_replace(result, std::regex("```[^`]*```"), "");
-        result = std::regex_replace(result, std::regex("`([^`]+)`"), "$1");
+        size_t lastNewline = appended.rfind('\n');
+        std::string_view complete = appended.substr(0, lastNewline == std::string_view::npos ? 0 : lastNewline + 1);
+        uint64_t lines = std::count(complete.begin(), complete.end(), '\n');
+        checkpoint.count += lines;
+        checkpoint.advance(data, checkpoint.endAfterLines(data, lines));
         
-        return result;
+        Document doc(alloc);
+        doc.content.assign(complete.data(), complete.size());
+        doc.format = "text";
+        doc.metadata.encoding = encodingName(checkpoint.encoding);
+        doc.metadata.lines = checkpoint.count;
+        std::pmr::vector<size_t> formFeeds(scratchResource());
+        findFormFeeds(complete, 0, formFeeds);
+        addFormFeedPages(doc, formFeeds);
+        doc.metadata.set("offset", std::to_string(start));
+        doc.metadata.set("reset", reset ? "true" : "false");
+        return doc;
     }
-};
+    
+    std::string getFormatName() const override { return "Plain Text"; }
 
-// Main document parser manager
-class UniversalDocumentParser {
 private:
-    std::vector<std::unique_ptr<DocumentParser>> parsers;
+    ParallelOptions parallel;
+    
+    static void findFormFeeds(std::string_view text, size_t base, std::pmr::vector<size_t>& out) {
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (const void* hit = std::memchr(p, '\f', static_cast<size_t>(end - p))) {
+            const char* feed = static_cast<const char*>(hit);
+            out.push_back(base + static_cast<size_t>(feed - text.data()));
+            p = feed + 1;
+        }
+    }
     
+    // Pages are separated by form feeds, which belong to neither side. Blank
+    // pages keep their place so page numbers match the source; only the
+    // empty tail after a final form feed is dropped.
+    static void addFormFeedPages(Document& doc, const std::pmr::vector<size_t>& formFeeds) {
+        doc.pageRanges.reserve(formFeeds.size() + 1);
+        size_t begin = 0;
+        for (size_t feed : formFeeds) {
+            doc.addPage(begin, feed);
+            begin = feed + 1;
+        }
+        if (begin < doc.content.size()) {
+            doc.addPage(begin, doc.content.size());
+        }
+    }
+};
+
+// A delimited-text dialect, fixed at compile time so every dialect gets its
+// own row loop with the characters folded in. `Escape` makes the byte after
+// it literal (0 for none), `CRLF` drops the '\r' of a "\r\n" row end, and
+// `Header` takes the first row as column names rather than data.
+template <char Delimiter, char Quote = '"', char Escape = '\0', bool Header = false, bool CRLF = true>
+struct CSVDialect {
+    static constexpr char delimiter = Delimiter;
+    static constexpr char quote = Quote;
+    static constexpr char escape = Escape;
+    static constexpr bool header = Header;
+    static constexpr bool crlf = CRLF;
+};
+
+using CommaDialect = CSVDialect<','>;
+using TabDialect = CSVDialect<'\t'>;
+using PipeDialect = CSVDialect<'|'>;
+using SemicolonDialect = CSVDialect<';'>;
+
+// Pull-based CSV tokenizer. Input is either an in-memory buffer (typically a
+// mapped file) or a file read in fixed-size chunks, so memory stays bounded
+// by the chunk size plus the longest row. Quoted fields may contain
+// delimiters and newlines and may span chunk boundaries, and a doubled quote
+// inside one is a literal quote (RFC 4180). Field boundaries come from
+// CSVScanner's structural index rather than a per-byte loop, except in
+// dialects with an escape character, which the scanner cannot see.
+template <typename Dialect>
+class BasicCSVRowReader {
 public:
-    UniversalDocumentParser() {
-        parsers.push_back(std::make_unique<TextParser>());
-        parsers.push_back(std::make_unique<CSVParser>());
-        parsers.push_back(std::make_unique<JSONParser>());
-        parsers.push_back(std::make_unique<XMLParser>());
-        parsers.push_back(std::make_unique<MarkdownParser>());
+    static constexpr size_t kDefaultChunkSize = 1 << 20;
+    
+    // Stream `filename` in chunks of `chunkSize` bytes, decompressing
+    // gzip or zstd input and decoding it to UTF-8 on the way
+    static BasicCSVRowReader fromFile(const std::string& filename, size_t chunkSize = kDefaultChunkSize,
+                                      SimdLevel level = CSVScanner::detectLevel()) {
+        return fromStream(openTextStream(filename), chunkSize, level);
     }
     
-    Document parseDocument(const std::string& filename) {
-        for (auto& parser : parsers) {
-            if (parser->canParse(filename)) {
-                try {
-                    Document doc = parser->parse(filename);
-                    doc.metadata["parser"] = parser->getFormatName();
-                    doc.metadata["filename"] = filename;
-                    return doc;
-                } catch (const std::exception& e) {
-                    throw std::runtime_error("Failed to parse " + filename + ": " + e.what());
-                }
-            }
+    // Stream UTF-8 from `input` in chunks of `chunkSize` bytes
+    static BasicCSVRowReader fromStream(std::unique_ptr<InputStream> input, size_t chunkSize = kDefaultChunkSize,
+                                        SimdLevel level = CSVScanner::detectLevel()) {
+        BasicCSVRowReader reader(level);
+        reader.input = std::move(input);
+        reader.chunkSize = chunkSize > 0 ? chunkSize : kDefaultChunkSize;
+        reader.streaming = true;
+        reader.eof = false;
+        return reader;
+    }
+    
+    // Scan a buffer in place; `data` must outlive the reader
+    static BasicCSVRowReader fromBuffer(std::string_view data,
+                                        SimdLevel level = CSVScanner::detectLevel()) {
+        BasicCSVRowReader reader(level);
+        reader.source = data;
+        return reader;
+    }
+    
+    // Read the next row into `fields`. The views stay valid until the next
+    // call. Returns false once the input is exhausted.
+    template <typename Fields>
+    bool next(Fields& fields) {
+        fields.clear();
+        size_t nextPos = 0;
+        if (!locateRow(nextPos)) {
+            return false;
         }
-        
-        throw std::runtime_error("No suitable parser found for: " + filename);
+        emitFields(fields);
+        pos = nextPos;
+        ++rowCount;
+        return true;
     }
     
-    std::vector<std::string> getSupportedFormats() const {
-        std::vector<std::string> formats;
-        for (const auto& parser : parsers) {
-            formats.push_back(parser->getFormatName());
+    // Step over the next row without splitting or unquoting its fields, for
+    // scans that only count. Returns false once the input is exhausted.
+    bool skip() {
+        size_t nextPos = 0;
+        if (!locateRow(nextPos)) {
+            return false;
         }
-        return formats;
+        pos = nextPos;
+        ++rowCount;
+        return true;
     }
     
-    bool canParseFile(const std::string& filename) const {
-        for (const auto& parser : parsers) {
-            if (parser->canParse(filename)) {
+    size_t rowsRead() const { return rowCount; }
+    
+    // Fields in the row last read or skipped
+    size_t fieldCount() const { return bounds.size(); }
+    
+    // Whether the last row read ended in a newline outside quotes; false for
+    // a final row cut off by the end of the input
+    bool rowTerminated() const { return terminated; }
+    
+    // Bytes of input consumed so far, i.e. where the next row starts
+    size_t offset() const { return consumed + pos; }
+
+private:
+    std::unique_ptr<InputStream> input;
+    std::string buffer;
+    std::string_view source;
+    size_t pos = 0;
+    size_t consumed = 0;          // bytes dropped from the front of `buffer`
+    size_t chunkSize = 0;
+    size_t rowCount = 0;
+    bool streaming = false;
+    bool eof = true;
+    bool terminated = true;
+    
+    // Field end offsets of the current row, and storage for fields that
+    // needed their quotes removed; both allocate from scratchResource()
+    std::pmr::vector<size_t> bounds;
+    std::pmr::string scratch;
+    
+    // Structural index over window()[indexBase, indexedEnd), built in
+    // batches so it stays small on large buffers
+    static constexpr size_t kIndexBatch = 64 * 1024;
+    CSVScanner scanner;
+    std::pmr::vector<uint32_t> structurals;
+    size_t cursor = 0;
+    size_t indexBase = 0;
+    size_t indexedEnd = 0;
+    bool indexInQuotes = false;
+    bool indexEscaped = false;
+    
+    explicit BasicCSVRowReader(SimdLevel level)
+        : bounds(scratchResource()), scratch(scratchResource()), scanner(level),
+          structurals(scratchResource()) {}
+    
+    // Bytes currently available; derived on demand so the reader stays movable
+    std::string_view window() const {
+        return streaming ? std::string_view(buffer) : source;
+    }
+    
+    // Find the end of the row at `pos`, refilling as needed, and leave its
+    // field ends in `bounds`; false at the end of the input
+    bool locateRow(size_t& nextPos) {
+        terminated = true;
+        size_t rowEnd = 0;
+        while (!findRow(rowEnd, nextPos)) {
+            if (eof) {
+                std::string_view data = window();
+                size_t size = data.size();
+                if (pos >= size) {
+                    return false;
+                }
+                // Final row without a trailing newline
+                rowEnd = size;
+                nextPos = size;
+                if (Dialect::crlf && data[size - 1] == '\r') {
+                    --rowEnd;
+                }
+                bounds.push_back(rowEnd);
+                terminated = false;
+                break;
+            }
+            refill();
+        }
+        return true;
+    }
+    
+    // Locate the row starting at `pos`; fails if the window ends first
+    bool findRow(size_t& rowEnd, size_t& nextPos) {
+        std::string_view data = window();
+        bounds.clear();
+        
+        while (true) {
+            while (cursor < structurals.size()) {
+                size_t i = indexBase + structurals[cursor++];
+                if (data[i] == '\n') {
+                    rowEnd = i;
+                    nextPos = i + 1;
+                    if (Dialect::crlf && i > pos && data[i - 1] == '\r') {
+                        rowEnd = i - 1;
+                    }
+                    bounds.push_back(rowEnd);
+                    return true;
+                }
+                bounds.push_back(i);
+            }
+            
+            if (indexedEnd >= data.size()) {
+                return false;
+            }
+            
+            structurals.clear();
+            cursor = 0;
+            indexBase = indexedEnd;
+            size_t length = std::min(kIndexBatch, data.size() - indexedEnd);
+            if constexpr (Dialect::escape != '\0') {
+                scanEscaped(data.data() + indexBase, length);
+            } else {
+                scanner.scan(data.data() + indexBase, length, Dialect::delimiter, Dialect::quote,
+                             indexInQuotes, structurals);
+            }
+            indexedEnd += length;
+        }
+    }
+    
+    // Scalar counterpart of CSVScanner::scan that also skips escaped bytes
+    void scanEscaped(const char* data, size_t length) {
+        for (size_t i = 0; i < length; ++i) {
+            char c = data[i];
+            if (indexEscaped) {
+                indexEscaped = false;
+            } else if (c == Dialect::escape) {
+                indexEscaped = true;
+            } else if (c == Dialect::quote) {
+                indexInQuotes = !indexInQuotes;
+            } else if (!indexInQuotes && (c == Dialect::delimiter || c == '\n')) {
+                structurals.push_back(static_cast<uint32_t>(i));
+            }
+        }
+    }
+    
+    // Restart indexing at `pos`, which always sits at a row start
+    void resetIndex() {
+        structurals.clear();
+        cursor = 0;
+        indexBase = pos;
+        indexedEnd = pos;
+        indexInQuotes = false;
+        indexEscaped = false;
+    }
+    
+    static bool needsUnquoting(const char* field, size_t length) {
+        if (std::memchr(field, Dialect::quote, length) != nullptr) {
+            return true;
+        }
+        return Dialect::escape != '\0' && std::memchr(field, Dialect::escape, length) != nullptr;
+    }
+    
+    template <typename Fields>
+    void emitFields(Fields& fields) {
+        std::string_view data = window();
+        scratch.clear();
+        size_t start = pos;
+        for (size_t end : bounds) {
+            if (needsUnquoting(data.data() + start, end - start)) {
+                // Reserve the whole row up front so earlier views stay valid
+                scratch.reserve(bounds.back() - pos);
+                size_t offset = scratch.size();
+                unquote(data, start, end);
+                fields.push_back(std::string_view(scratch.data() + offset, scratch.size() - offset));
+            } else {
+                fields.push_back(data.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+    }
+    
+    // Append data[start, end) to scratch without its quoting. The quote
+    // toggles as in the scanner, so "" inside quotes stands for one quote.
+    void unquote(std::string_view data, size_t start, size_t end) {
+        bool quoted = false;
+        for (size_t i = start; i < end; ++i) {
+            char c = data[i];
+            if (Dialect::escape != '\0' && c == Dialect::escape && i + 1 < end) {
+                scratch += data[++i];
+            } else if (c != Dialect::quote) {
+                scratch += c;
+            } else if (quoted && i + 1 < end && data[i + 1] == Dialect::quote) {
+                scratch += c;
+                ++i;
+            } else {
+                quoted = !quoted;
+            }
+        }
+    }
+    
+    // Keep the unfinished row and append the next chunk after it. The buffer
+    // only grows past the chunk size when a single row is longer than that.
+    void refill() {
+        size_t carried = buffer.size() - pos;
+        if (pos > 0 && carried > 0) {
+            std::memmove(&buffer[0], buffer.data() + pos, carried);
+        }
+        consumed += pos;
+        pos = 0;
+        
+        size_t capacity = std::max(chunkSize, carried * 2);
+        buffer.resize(carried + capacity);
+        size_t got = input->read(&buffer[carried], capacity);
+        buffer.resize(carried + got);
+        resetIndex();
+        
+        if (got < capacity) {
+            eof = true;
+        }
+    }
+};
+
+using CSVRowReader = BasicCSVRowReader<CommaDialect>;
+
+// Column types produced by CSV type inference
+enum class ColumnType {
+    Int64,
+    Double,
+    Bool,
+    String
+};
+
+inline const char* columnTypeName(ColumnType type) {
+    switch (type) {
+        case ColumnType::Int64: return "int64";
+        case ColumnType::Double: return "double";
+        case ColumnType::Bool: return "bool";
+        default: return "string";
+    }
+}
+
+// One CSV column stored in Arrow's memory layout: a validity bitmap (LSB
+// first, bit set = value present) and either a fixed-width value buffer
+// (int64, double, bit-packed bool) or 64-bit offsets + UTF-8 data for
+// strings (Arrow "large_utf8"). Empty fields are nulls.
+struct CSVColumn {
+    std::string name;
+    ColumnType type = ColumnType::String;
+    size_t length = 0;
+    size_t nullCount = 0;
+    std::vector<uint8_t> validity;
+    std::vector<int64_t> intValues;
+    std::vector<double> doubleValues;
+    std::vector<uint8_t> boolValues;
+    std::vector<int64_t> offsets;
+    std::string data;
+    
+    bool isValid(size_t row) const {
+        return (validity[row >> 3] >> (row & 7)) & 1;
+    }
+    
+    // Only meaningful for String columns
+    std::string_view stringAt(size_t row) const {
+        return std::string_view(data.data() + offsets[row],
+                                static_cast<size_t>(offsets[row + 1] - offsets[row]));
+    }
+};
+
+struct CSVTable {
+    std::vector<CSVColumn> columns;
+    size_t rows = 0;
+    
+    const CSVColumn* column(const std::string& name) const {
+        for (const auto& col : columns) {
+            if (col.name == name) {
+                return &col;
+            }
+        }
+        return nullptr;
+    }
+};
+
+struct CSVTableOptions {
+    bool header = true;      // first row holds column names
+    bool inferTypes = true;  // otherwise every column stays a string
+};
+
+// Accumulates rows column by column, then narrows each column to the most
+// specific type that every non-null value fits: int64, double, bool, string.
+class CSVTableBuilder {
+public:
+    explicit CSVTableBuilder(const CSVTableOptions& opts = CSVTableOptions()) : options(opts) {}
+    
+    void addRow(const std::vector<std::string_view>& fields) {
+        if (options.header && !headerSeen) {
+            headerSeen = true;
+            for (size_t i = 0; i < fields.size(); ++i) {
+                addColumn(std::string(fields[i]));
+            }
+            return;
+        }
+        
+        while (table.columns.size() < fields.size()) {
+            addColumn("column_" + std::to_string(table.columns.size()));
+        }
+        for (size_t i = 0; i < table.columns.size(); ++i) {
+            appendString(table.columns[i], i < fields.size() ? fields[i] : std::string_view());
+        }
+        ++table.rows;
+    }
+    
+    CSVTable finish() {
+        if (options.inferTypes) {
+            for (auto& col : table.columns) {
+                inferType(col);
+            }
+        }
+        return std::move(table);
+    }
+
+private:
+    CSVTableOptions options;
+    CSVTable table;
+    bool headerSeen = false;
+    
+    void addColumn(std::string name) {
+        CSVColumn col;
+        col.name = std::move(name);
+        col.offsets.push_back(0);
+        // Columns that appear late are null for the rows already read
+        for (size_t i = 0; i < table.rows; ++i) {
+            appendString(col, std::string_view());
+        }
+        table.columns.push_back(std::move(col));
+    }
+    
+    static void setValidity(CSVColumn& col, bool valid) {
+        size_t row = col.length;
+        if ((row & 7) == 0) {
+            col.validity.push_back(0);
+        }
+        if (valid) {
+            col.validity.back() |= static_cast<uint8_t>(1u << (row & 7));
+        } else {
+            ++col.nullCount;
+        }
+    }
+    
+    static void appendString(CSVColumn& col, std::string_view value) {
+        setValidity(col, !value.empty());
+        col.data.append(value.data(), value.size());
+        col.offsets.push_back(static_cast<int64_t>(col.data.size()));
+        ++col.length;
+    }
+    
+    static bool parseInt(std::string_view text, int64_t& value) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+    
+    // from_chars also reads "nan", "inf" and "infinity"; such words are
+    // text, so only finite values make a double column
+    static bool parseDouble(std::string_view text, double& value) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size() && std::isfinite(value);
+    }
+    
+    static bool parseBool(std::string_view text, bool& value) {
+        if (text == "true" || text == "True" || text == "TRUE") {
+            value = true;
+            return true;
+        }
+        if (text == "false" || text == "False" || text == "FALSE") {
+            value = false;
+            return true;
+        }
+        return false;
+    }
+    
+    // Try each narrower type in turn; the first that accepts every value wins
+    static void inferType(CSVColumn& col) {
+        if (col.nullCount == col.length) {
+            return;
+        }
+        
+        std::vector<int64_t> ints;
+        if (convertAll(col, ints, parseInt)) {
+            col.type = ColumnType::Int64;
+            col.intValues = std::move(ints);
+        } else {
+            std::vector<double> doubles;
+            if (convertAll(col, doubles, parseDouble)) {
+                col.type = ColumnType::Double;
+                col.doubleValues = std::move(doubles);
+            } else {
+                std::vector<bool> bools;
+                if (!convertAll(col, bools, parseBool)) {
+                    return;
+                }
+                col.type = ColumnType::Bool;
+                col.boolValues.assign((col.length + 7) / 8, 0);
+                for (size_t i = 0; i < col.length; ++i) {
+                    if (bools[i]) {
+                        col.boolValues[i >> 3] |= static_cast<uint8_t>(1u << (i & 7));
+                    }
+                }
+            }
+        }
+        
+        // The string buffers are no longer needed
+        std::vector<int64_t>().swap(col.offsets);
+        std::string().swap(col.data);
+    }
+    
+    template <typename T, typename Parse>
+    static bool convertAll(const CSVColumn& col, std::vector<T>& out, Parse parseValue) {
+        out.resize(col.length);
+        for (size_t i = 0; i < col.length; ++i) {
+            if (!col.isValid(i)) {
+                continue;
+            }
+            T value{};
+            if (!parseValue(col.stringAt(i), value)) {
+                return false;
+            }
+            out[i] = value;
+        }
+        return true;
+    }
+};
+
+// CSV parser for one compile-time dialect; CSVParser is the comma one
+template <typename Dialect>
+class BasicCSVParser : public DocumentParser {
+public:
+    using Reader = BasicCSVRowReader<Dialect>;
+    
+    // Return false to stop streaming early
+    using RowCallback = std::function<bool(const std::vector<std::string_view>& fields)>;
+    
+    // Rows per entry of Document::pageRanges
+    static constexpr size_t kRowsPerPage = 100;
+    
+    explicit BasicCSVParser(const ParallelOptions& options = ParallelOptions(),
+                            size_t rowsPerPage = kRowsPerPage)
+        : parallel(options), pageRows(std::max<size_t>(rowsPerPage, 1)) {}
+    
+    std::vector<std::string> getExtensions() const override {
+        if constexpr (Dialect::delimiter == ',') {
+            return {"csv"};
+        } else if constexpr (Dialect::delimiter == '\t') {
+            return {"tsv", "tab"};
+        } else if constexpr (Dialect::delimiter == '|') {
+            return {"psv"};
+        } else {
+            return {"dsv"};
+        }
+    }
+    
+    // The first extension the dialect registers: "csv", "tsv", "psv" or "dsv"
+    static const char* formatOf() {
+        switch (Dialect::delimiter) {
+            case ',': return "csv";
+            case '\t': return "tsv";
+            case '|': return "psv";
+            default: return "dsv";
+        }
+    }
+    
+    // Header dialects leave the first row out of `content` and `rows` and
+    // keep it in metadata["header"], joined like a formatted row. Without
+    // ParseOutput::Content the rows are only counted, not split into fields.
+    Document parseContent(std::string_view content, const std::string&, const ParseOptions& options,
+                          const Document::allocator_type& alloc = {}) override {
+        Document doc(alloc);
+        doc.format = formatOf();
+        bool format = options.wants(ParseOutput::Content);
+        bool pages = options.wants(ParseOutput::Pages);
+        if (!format && options.wants(ParseOutput::RawContent)) {
+            doc.content.assign(content.data(), content.size());
+        }
+        if (!format && !options.wants(ParseOutput::Metadata)) {
+            return doc;
+        }
+        
+        // Store structured data as formatted text
+        size_t rows = 0;
+        size_t columns = 0;
+        if constexpr (Dialect::header) {
+            Reader header = Reader::fromBuffer(content);
+            if (takeHeader(header, doc, columns)) {
+                content.remove_prefix(header.offset());
+            }
+        }
+        std::pmr::vector<size_t> pageStarts(scratchResource());
+        std::pmr::string* out = format ? &doc.content : nullptr;
+        // Escapes hide quotes from the parity count that cuts the slices
+        size_t chunks = Dialect::escape != '\0' ? 1 : parallel.chunksFor(content.size());
+        if (chunks <= 1) {
+            if (out) out->reserve(formattedBound(content));
+            appendRows(content, out, rows, columns, pages ? &pageStarts : nullptr, nullptr);
+        } else {
+            parseSlices(content, chunks, out, rows, columns, pages ? &pageStarts : nullptr);
+        }
+        finishRows(doc, rows, columns, pageStarts, options);
+        return doc;
+    }
+    
+    // Compressed input is inflated and split a chunk at a time, so memory
+    // follows the formatted output rather than the inflated file. Only raw
+    // content on its own still needs the whole text.
+    using DocumentParser::parse;
+    using DocumentParser::parseContent;
+    
+    Document parse(const std::string& filename, const ParseOptions& options,
+                   const Document::allocator_type& alloc = {}) override {
+        return parseFile(openFile(filename, options), filename, options, alloc);
+    }
+    
+    // parse() of a file already opened, with its bytes as stored
+    Document parseFile(FileBuffer input, const std::string& filename, const ParseOptions& options,
+                       const Document::allocator_type& alloc = {}) {
+        bool format = options.wants(ParseOutput::Content);
+        if (detectCompression(input.view()) == Compression::None ||
+            (!format && options.wants(ParseOutput::RawContent))) {
+            return parseDecoded(decodeFile(inflate(std::move(input))), filename, options, alloc);
+        }
+        Document doc(alloc);
+        doc.format = formatOf();
+        if (!format && !options.wants(ParseOutput::Metadata)) {
+            return doc;
+        }
+        
+        std::unique_ptr<TextInputStream> stream = streamFile(std::move(input));
+        TextEncoding encoding = stream->encoding();
+        Reader reader = Reader::fromStream(std::move(stream));
+        size_t rows = 0;
+        size_t columns = 0;
+        if constexpr (Dialect::header) {
+            takeHeader(reader, doc, columns);
+        }
+        std::pmr::vector<size_t> pageStarts(scratchResource());
+        appendRows(reader, format ? &doc.content : nullptr, rows, columns,
+                   options.wants(ParseOutput::Pages) ? &pageStarts : nullptr, nullptr);
+        DOCPARSER_COUNT_BYTES(reader.offset());
+        finishRows(doc, rows, columns, pageStarts, options);
+        if (options.wants(ParseOutput::Metadata)) {
+            doc.metadata.encoding = encodingName(encoding);
+        }
+        return doc;
+    }
+    
+    // Parse only the rows appended since `checkpoint`; see
+    // TextParser::parseIncremental. `rows` counts every complete row so far,
+    // and a row still missing its newline is left for the next call. In a
+    // header dialect only the poll that reads the header reports it.
+    Document parseIncremental(const std::string& filename, ParseCheckpoint& checkpoint,
+                              const Document::allocator_type& alloc = {}) const {
+        FileBuffer input = mapRawFile(filename);
+        std::string_view data = input.view();
+        bool reset = !checkpoint.resume(input);
+        std::string storage;
+        std::string_view appended = checkpoint.decodeAppended(data, storage);
+        size_t start = static_cast<size_t>(checkpoint.offset);
+        DOCPARSER_COUNT_BYTES(appended.size());
+        
+        Document doc(alloc);
+        doc.format = formatOf();
+        doc.content.reserve(formattedBound(appended));
+        Reader reader = Reader::fromBuffer(appended);
+        std::pmr::vector<std::string_view> fields(scratchResource());
+        std::pmr::vector<size_t> pageStarts(scratchResource());
+        size_t consumed = 0;
+        size_t added = 0;
+        bool needHeader = Dialect::header && checkpoint.columns == 0;
+        while (reader.next(fields) && reader.rowTerminated()) {
+            consumed = reader.offset();
+            if (needHeader) {
+                doc.metadata.set("header", joinFields(fields));
+                checkpoint.columns = fields.size();
+                needHeader = false;
+                continue;
+            }
+            if (checkpoint.count == 0 && !Dialect::header) {
+                checkpoint.columns = fields.size();
+            }
+            ++checkpoint.count;
+            if (added++ % pageRows == 0) {
+                pageStarts.push_back(doc.content.size());
+            }
+            appendRow(doc.content, fields, nullptr);
+        }
+        std::string_view rows = appended.substr(0, consumed);
+        checkpoint.advance(data, checkpoint.endAfterLines(data, std::count(rows.begin(), rows.end(), '\n')));
+        addRowPages(doc, pageStarts);
+        
+        doc.metadata.encoding = encodingName(checkpoint.encoding);
+        doc.metadata.rows = checkpoint.count;
+        if (checkpoint.count > 0 || checkpoint.columns > 0) {
+            doc.metadata.columns = checkpoint.columns;
+        }
+        doc.metadata.set("offset", std::to_string(start));
+        doc.metadata.set("reset", reset ? "true" : "false");
+        return doc;
+    }
+    
+    // Deliver rows one at a time without building a Document. Memory is
+    // bounded by `chunkSize` plus the longest row. Returns the rows delivered.
+    // The header, if the dialect has one, is delivered like any other row.
+    size_t parseStream(const std::string& filename, const RowCallback& onRow,
+                       size_t chunkSize = Reader::kDefaultChunkSize) const {
+        Reader reader = Reader::fromFile(filename, chunkSize);
+        std::vector<std::string_view> fields;
+        while (reader.next(fields)) {
+            if (!onRow(fields)) {
+                break;
+            }
+        }
+        return reader.rowsRead();
+    }
+    
+    // Columnar result with per-column typed buffers instead of a text blob
+    CSVTable parseColumnar(const std::string& filename,
+                           const CSVTableOptions& options = CSVTableOptions()) const {
+        FileBuffer input = mapFile(filename);
+        Reader reader = Reader::fromBuffer(input.view());
+        CSVTableBuilder builder(options);
+        std::vector<std::string_view> fields;
+        while (reader.next(fields)) {
+            builder.addRow(fields);
+        }
+        return builder.finish();
+    }
+    
+    std::string getFormatName() const override {
+        return Dialect::delimiter == ',' ? "CSV" : Dialect::delimiter == '\t' ? "TSV" : "DSV";
+    }
+
+private:
+    ParallelOptions parallel;
+    size_t pageRows;
+    
+    // Move the next row of `reader` into metadata["header"] and `columns`;
+    // false if the input is empty
+    static bool takeHeader(Reader& reader, Document& doc, size_t& columns) {
+        std::pmr::vector<std::string_view> fields(scratchResource());
+        if (!reader.next(fields)) {
+            return false;
+        }
+        doc.metadata.set("header", joinFields(fields));
+        columns = fields.size();
+        return true;
+    }
+    
+    // Pages and row metadata once every row is in; shared by the mapped
+    // and streamed parses
+    static void finishRows(Document& doc, size_t rows, size_t columns,
+                           const std::pmr::vector<size_t>& pageStarts, const ParseOptions& options) {
+        if (options.wants(ParseOutput::Pages)) {
+            addRowPages(doc, pageStarts);
+        }
+        if (options.wants(ParseOutput::Metadata)) {
+            doc.metadata.rows = rows;
+            if (rows > 0 || doc.metadata.contains("header")) {
+                doc.metadata.columns = columns;
+            }
+        } else {
+            doc.metadata.erase("header");
+        }
+    }
+    
+    static std::string joinFields(const std::pmr::vector<std::string_view>& fields) {
+        std::string out;
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (i > 0) out += " | ";
+            out += fields[i];
+        }
+        return out;
+    }
+    
+    // Append every row of `data`, which starts at a row boundary. With
+    // `pageStarts` the output offset of every pageRows-th row is recorded;
+    // with `embedded` the offsets of newlines inside quoted fields are.
+    // `columns` is set from the first row unless a header already set it.
+    // Without `out` the rows are only counted.
+    void appendRows(std::string_view data, std::pmr::string* out, size_t& rows, size_t& columns,
+                    std::pmr::vector<size_t>* pageStarts, std::vector<size_t>* embedded) const {
+        Reader reader = Reader::fromBuffer(data);
+        appendRows(reader, out, rows, columns, pageStarts, embedded);
+    }
+    
+    // The same for the rest of `reader`; `rows` counts only those rows
+    void appendRows(Reader& reader, std::pmr::string* out, size_t& rows, size_t& columns,
+                    std::pmr::vector<size_t>* pageStarts, std::vector<size_t>* embedded) const {
+        size_t first = reader.rowsRead();
+        if (!out) {
+            if (reader.skip() && !Dialect::header) {
+                columns = reader.fieldCount();
+            }
+            while (reader.skip()) {}
+            rows = reader.rowsRead() - first;
+            return;
+        }
+        std::pmr::vector<std::string_view> fields(scratchResource());
+        while (reader.next(fields)) {
+            size_t row = reader.rowsRead() - first;
+            if (row == 1 && !Dialect::header) {
+                columns = fields.size();
+            }
+            if (pageStarts && (row - 1) % pageRows == 0) {
+                pageStarts->push_back(out->size());
+            }
+            appendRow(*out, fields, embedded);
+        }
+        rows = reader.rowsRead() - first;
+    }
+    
+    // Page starts of one slice's output, whose first row has global index
+    // `firstRow`. Rows end at every newline except the embedded ones.
+    void findPageStarts(std::string_view part, size_t firstRow, size_t base,
+                        const std::vector<size_t>& embedded, std::vector<size_t>& pageStarts) const {
+        size_t row = firstRow;
+        size_t pos = 0;
+        size_t skip = 0;
+        while (pos < part.size()) {
+            if (row % pageRows == 0) {
+                pageStarts.push_back(base + pos);
+            }
+            size_t end = pos;
+            while (true) {
+                end = part.find('\n', end);
+                if (end == std::string_view::npos) {
+                    return;
+                }
+                if (skip < embedded.size() && embedded[skip] == end) {
+                    ++skip;
+                    ++end;
+                    continue;
+                }
+                break;
+            }
+            pos = end + 1;
+            ++row;
+        }
+    }
+    
+    // Upper bound of the formatted size, so the output is allocated once:
+    // every delimiter may become " | " and a final row may gain its newline,
+    // while dropped quotes and escapes only shrink it
+    static size_t formattedBound(std::string_view data) {
+        return data.size() + 2 * static_cast<size_t>(std::count(data.begin(), data.end(), Dialect::delimiter)) + 1;
+    }
+    
+    static void addRowPages(Document& doc, const std::pmr::vector<size_t>& pageStarts) {
+        doc.pageRanges.reserve(pageStarts.size());
+        for (size_t i = 0; i < pageStarts.size(); ++i) {
+            doc.addPage(pageStarts[i], i + 1 < pageStarts.size() ? pageStarts[i + 1] : doc.content.size());
+        }
+    }
+    
+    // Parse `chunks` slices of `data` concurrently. Quotes are counted per
+    // slice first; the running parity gives the exact quote state at each
+    // cut, from which the cut moves forward to the next row start. Counting
+    // every quote byte is enough because an escaped "" flips parity twice.
+    // Without `out` the slices are only counted.
+    void parseSlices(std::string_view data, size_t chunks, std::pmr::string* out,
+                     size_t& rows, size_t& columns, std::pmr::vector<size_t>* pageStarts) const {
+        std::vector<size_t> quotes(chunks, 0);
+        parallelFor(chunks, [&](size_t i) {
+            const char* begin = data.data() + ParallelOptions::sliceStart(data.size(), i, chunks);
+            const char* end = data.data() + ParallelOptions::sliceStart(data.size(), i + 1, chunks);
+            quotes[i] = std::count(begin, end, Dialect::quote);
+        });
+        
+        std::vector<size_t> starts(chunks + 1, 0);
+        starts[chunks] = data.size();
+        size_t quotesBefore = 0;
+        for (size_t i = 1; i < chunks; ++i) {
+            quotesBefore += quotes[i - 1];
+            size_t p = ParallelOptions::sliceStart(data.size(), i, chunks);
+            if (starts[i - 1] > p) {
+                // The previous row end already lies past this cut
+                starts[i] = starts[i - 1];
+                continue;
+            }
+            bool inQuotes = (quotesBefore & 1) != 0;
+            for (; p < data.size(); ++p) {
+                char c = data[p];
+                if (c == Dialect::quote) {
+                    inQuotes = !inQuotes;
+                } else if (c == '\n' && !inQuotes) {
+                    break;
+                }
+            }
+            starts[i] = p < data.size() ? p + 1 : data.size();
+        }
+        
+        std::vector<std::pmr::string> parts(chunks);
+        std::vector<size_t> partRows(chunks, 0);
+        std::vector<size_t> partColumns(chunks, 0);
+        std::vector<std::vector<size_t>> embedded(chunks);
+        parallelFor(chunks, [&](size_t i) {
+            std::string_view slice = data.substr(starts[i], starts[i + 1] - starts[i]);
+            if (!out) {
+                appendRows(slice, nullptr, partRows[i], partColumns[i], nullptr, nullptr);
+                return;
+            }
+            parts[i].reserve(formattedBound(slice));
+            appendRows(slice, &parts[i], partRows[i], partColumns[i], nullptr,
+                       pageStarts ? &embedded[i] : nullptr);
+        });
+        
+        // Row and byte positions of each slice are known now, so the page
+        // starts that fall inside each one can be found in parallel too
+        std::vector<size_t> firstRow(chunks, 0);
+        std::vector<size_t> base(chunks, 0);
+        for (size_t i = 1; i < chunks; ++i) {
+            firstRow[i] = firstRow[i - 1] + partRows[i - 1];
+            base[i] = base[i - 1] + parts[i - 1].size();
+        }
+        std::vector<std::vector<size_t>> partPages(chunks);
+        if (out && pageStarts) {
+            parallelFor(chunks, [&](size_t i) {
+                findPageStarts(parts[i], firstRow[i], base[i], embedded[i], partPages[i]);
+            });
+        }
+        
+        if (out) {
+            out->reserve(base[chunks - 1] + parts[chunks - 1].size());
+        }
+        bool first = true;
+        for (size_t i = 0; i < chunks; ++i) {
+            if (first && partRows[i] > 0 && !Dialect::header) {
+                columns = partColumns[i];
+                first = false;
+            }
+            rows += partRows[i];
+            if (out) {
+                *out += parts[i];
+                std::pmr::string().swap(parts[i]);
+            }
+            if (pageStarts) {
+                pageStarts->insert(pageStarts->end(), partPages[i].begin(), partPages[i].end());
+            }
+        }
+    }
+    
+    static void appendRow(std::pmr::string& out, const std::pmr::vector<std::string_view>& fields,
+                          std::vector<size_t>* embedded) {
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (i > 0) out += " | ";
+            if (embedded) {
+                const char* field = fields[i].data();
+                const char* end = field + fields[i].size();
+                for (const char* p = field; (p = static_cast<const char*>(std::memchr(p, '\n', end - p))); ++p) {
+                    embedded->push_back(out.size() + static_cast<size_t>(p - field));
+                }
+            }
+            out.append(fields[i].data(), fields[i].size());
+        }
+        out += '\n';
+    }
+};
+
+using CSVParser = BasicCSVParser<CommaDialect>;
+
+// Dialect of DelimitedTextParser, chosen at run time. Quotes are always '"'.
+struct CSVDialectOptions {
+    char delimiter = '\0';  // ',', '\t', ';' or '|'; 0 = sniff from the content
+    char escape = '\0';     // '\\' or 0 for none
+    bool header = false;    // first row holds column names
+};
+
+// Delimited text whose dialect is configured or sniffed. Every parse hands
+// off to the BasicCSVParser instantiation for that dialect, so the row loops
+// still run with the characters as constants. metadata["delimiter"] records
+// the one used.
+class DelimitedTextParser : public DocumentParser {
+public:
+    explicit DelimitedTextParser(const CSVDialectOptions& options = CSVDialectOptions(),
+                                 const ParallelOptions& parallel = ParallelOptions())
+        : dialect(options), parallel(parallel) {
+        char d = options.delimiter;
+        if (d != '\0' && d != ',' && d != '\t' && d != ';' && d != '|') {
+            throw std::runtime_error("Unsupported CSV delimiter");
+        }
+        if (options.escape != '\0' && options.escape != '\\') {
+            throw std::runtime_error("Unsupported CSV escape character");
+        }
+    }
+    
+    std::vector<std::string> getExtensions() const override {
+        return {"tsv", "tab", "psv", "dsv"};
+    }
+    
+    // Compressed files stream through the dialect's parser, sniffed from
+    // their inflated head
+    using DocumentParser::parse;
+    using DocumentParser::parseContent;
+    
+    Document parse(const std::string& filename, const ParseOptions& options,
+                   const Document::allocator_type& alloc = {}) override {
+        FileBuffer input = openFile(filename, options);
+        if (detectCompression(input.view()) == Compression::None) {
+            return parseDecoded(decodeFile(std::move(input)), filename, options, alloc);
+        }
+        CSVDialectOptions resolved = dialect;
+        if (resolved.delimiter == '\0') {
+            char head[FormatSniffer::kHeadBytes];
+            size_t length = readDecodedHead(input.view(), head);
+            resolved.delimiter = sniffDelimiter(std::string_view(head, length), length == FormatSniffer::kHeadBytes,
+                                                filename);
+        }
+        Document doc = withDialect(resolved, [&](auto tag) {
+            return BasicCSVParser<decltype(tag)>(parallel).parseFile(std::move(input), filename, options, alloc);
+        });
+        if (options.wants(ParseOutput::Metadata)) {
+            doc.metadata.set("delimiter", std::string_view(&resolved.delimiter, 1));
+        }
+        return doc;
+    }
+    
+    Document parseContent(std::string_view content, const std::string& filename, const ParseOptions& options,
+                          const Document::allocator_type& alloc = {}) override {
+        CSVDialectOptions resolved = dialect;
+        if (resolved.delimiter == '\0') {
+            size_t head = std::min(content.size(), FormatSniffer::kHeadBytes);
+            resolved.delimiter = sniffDelimiter(content.substr(0, head), head < content.size(), filename);
+        }
+        Document doc = withDialect(resolved, [&](auto tag) {
+            return BasicCSVParser<decltype(tag)>(parallel).parseContent(content, filename, options, alloc);
+        });
+        if (options.wants(ParseOutput::Metadata)) {
+            doc.metadata.set("delimiter", std::string_view(&resolved.delimiter, 1));
+        }
+        return doc;
+    }
+    
+    std::string getFormatName() const override { return "DSV"; }
+    
+    // The head of the content decides; the extension is the fallback for
+    // inputs too short to tell
+    char sniffDelimiter(std::string_view head, bool truncated, const std::string& filename) const {
+        if (char delimiter = FormatSniffer::sniffDelimiter(head, truncated, dialect.escape)) {
+            return delimiter;
+        }
+        std::string ext = getFileExtension(filename);
+        if (ext == "tsv" || ext == "tab") {
+            return '\t';
+        }
+        return ext == "psv" ? '|' : ',';
+    }
+    
+    // Call `fn` with a default-constructed CSVDialect matching `options`
+    template <typename Fn>
+    static std::invoke_result_t<Fn&, CommaDialect> withDialect(const CSVDialectOptions& options, Fn&& fn) {
+        switch (options.delimiter) {
+            case '\t': return withEscape<'\t'>(options, fn);
+            case ';': return withEscape<';'>(options, fn);
+            case '|': return withEscape<'|'>(options, fn);
+            default: return withEscape<','>(options, fn);
+        }
+    }
+
+private:
+    CSVDialectOptions dialect;
+    ParallelOptions parallel;
+    
+    template <char Delimiter, typename Fn>
+    static std::invoke_result_t<Fn&, CommaDialect> withEscape(const CSVDialectOptions& options, Fn& fn) {
+        return options.escape == '\\' ? withHeader<Delimiter, '\\'>(options, fn)
+                                      : withHeader<Delimiter, '\0'>(options, fn);
+    }
+    
+    template <char Delimiter, char Escape, typename Fn>
+    static std::invoke_result_t<Fn&, CommaDialect> withHeader(const CSVDialectOptions& options, Fn& fn) {
+        return options.header ? fn(CSVDialect<Delimiter, '"', Escape, true>())
+                              : fn(CSVDialect<Delimiter, '"', Escape, false>());
+    }
+};
+
+// JSON parser
+class JSONParser : public DocumentParser {
+public:
+    std::vector<std::string> getExtensions() const override {
+        return {"json"};
+    }
+    
+    using DocumentParser::parseContent;
+    
+    Document parseContent(std::string_view content, const std::string&, const ParseOptions& options,
+                          const Document::allocator_type& alloc = {}) override {
+        Document doc(alloc);
+        doc.format = "json";
+        bool pretty = options.wants(ParseOutput::Content);
+        bool metadata = options.wants(ParseOutput::Metadata);
+        if (!pretty && options.wants(ParseOutput::RawContent)) {
+            doc.content.assign(content.data(), content.size());
+        }
+        if (!pretty && !metadata) {
+            return doc;
+        }
+        
+        // Validate through the structural index and pretty-print from it;
+        // malformed input is kept verbatim and flagged. Metadata alone
+        // needs the index but not the printing.
+        // Pages are the elements of a root array, otherwise the whole text
+        std::pmr::vector<std::pair<size_t, size_t>> elements(scratchResource());
+        try {
+            JSONIndex index(content);
+            if (pretty) {
+                prettyPrintJSON(index, doc.content, 2, &elements);
+            }
+            if (metadata) {
+                doc.metadata.set("valid", "true");
+                doc.metadata.set("root_type", typeName(JSONValue(&index, 0).type()));
+            }
+        } catch (const std::runtime_error& e) {
+            elements.clear();
+            if (pretty) {
+                doc.content.assign(content.data(), content.size());
+            }
+            if (metadata) {
+                doc.metadata.set("valid", "false");
+                doc.metadata.set("error", e.what());
+            }
+        }
+        
+        if (metadata) {
+            doc.metadata.set("type", "json");
+            doc.metadata.size = content.length();
+        }
+        if (!options.wants(ParseOutput::Pages)) {
+            return doc;
+        }
+        doc.pageRanges.reserve(std::max<size_t>(elements.size(), 1));
+        for (const auto& element : elements) {
+            doc.addPage(element.first, element.second);
+        }
+        if (elements.empty() && !doc.content.empty()) {
+            doc.addPage(0, doc.content.size());
+        }
+        
+        return doc;
+    }
+    
+    // Index a file for lazy path lookups without building a tree. The input
+    // goes through mapFile(), so compressed and non-UTF-8 files load too.
+    std::unique_ptr<JSONDocument> load(const std::string& filename) const {
+        auto input = std::make_shared<const FileBuffer>(mapFile(filename));
+        return std::make_unique<JSONDocument>(input->view(), input);
+    }
+    
+    std::string getFormatName() const override { return "JSON"; }
+    
+    static const char* typeName(JSONType type) {
+        switch (type) {
+            case JSONType::Object: return "object";
+            case JSONType::Array: return "array";
+            case JSONType::String: return "string";
+            case JSONType::Number: return "number";
+            case JSONType::Bool: return "bool";
+            case JSONType::Null: return "null";
+            default: return "invalid";
+        }
+    }
+};
+
+// XML/HTML parser
+class XMLParser : public DocumentParser {
+public:
+    // `streamOptions.select` keeps only the text of matching subtrees; `html` is
+    // set per document from its format
+    explicit XMLParser(const XMLStreamOptions& streamOptions = {}) : xmlOptions(streamOptions) {}
+    
+    std::vector<std::string> getExtensions() const override {
+        return {"xml", "html", "htm"};
+    }
+    
+    // Without a filter a plain file is mapped and the output allocated once.
+    // With one, or when the file is compressed, it is streamed in chunks so
+    // memory follows the kept text only.
+    using DocumentParser::parse;
+    using DocumentParser::parseContent;
+    
+    Document parse(const std::string& filename, const ParseOptions& options,
+                   const Document::allocator_type& alloc = {}) override {
+        FileBuffer input = openFile(filename, options);
+        bool compressed = detectCompression(input.view()) != Compression::None;
+        if ((xmlOptions.select.empty() && !compressed) || !options.wants(ParseOutput::Content)) {
+            return parseDecoded(decodeFile(inflate(std::move(input))), filename, options, alloc);
+        }
+        std::string ext = getFileExtension(filename);
+        if (ext != "xml" && ext != "html" && ext != "htm") {
+            char head[FormatSniffer::kHeadBytes];
+            size_t length = readDecodedHead(input.view(), head);
+            ext = formatOf(std::string_view(head, length), length == FormatSniffer::kHeadBytes);
+        }
+        XMLStreamOptions streamOptions = xmlOptions;
+        streamOptions.html = ext != "xml";
+        std::unique_ptr<TextInputStream> stream = streamFile(std::move(input));
+        TextEncoding encoding = stream->encoding();
+        XMLStreamReader reader = XMLStreamReader::fromStream(std::move(stream), streamOptions);
+        Document doc = buildDocument(reader, ext, 0, options, alloc);
+        DOCPARSER_COUNT_BYTES(reader.offset());
+        if (options.wants(ParseOutput::Metadata)) {
+            doc.metadata.encoding = encodingName(encoding);
+        }
+        return doc;
+    }
+    
+    Document parseContent(std::string_view content, const std::string& filename, const ParseOptions& options,
+                          const Document::allocator_type& alloc = {}) override {
+        std::string ext = getFileExtension(filename);
+        if (ext != "xml" && ext != "html" && ext != "htm") {
+            // Routed here by content; tell HTML from XML the same way
+            std::string_view head = content.substr(0, FormatSniffer::kHeadBytes);
+            ext = formatOf(head, head.size() < content.size());
+        }
+        if (!options.wants(ParseOutput::Content)) {
+            // Nothing to extract, so nothing to tokenize
+            Document doc(alloc);
+            doc.format = ext;
+            if (options.wants(ParseOutput::RawContent)) {
+                doc.content.assign(content.data(), content.size());
+            }
+            addMetadata(doc, ext, options);
+            return doc;
+        }
+        XMLStreamOptions streamOptions = xmlOptions;
+        streamOptions.html = ext != "xml";
+        XMLStreamReader reader = XMLStreamReader::fromBuffer(content, streamOptions);
+        // Decoding never lengthens text, so the input size bounds the output
+        return buildDocument(reader, ext, xmlOptions.select.empty() ? content.size() : 0, options, alloc);
+    }
+    
+    std::string getFormatName() const override { return "XML/HTML"; }
+
+private:
+    XMLStreamOptions xmlOptions;
+    
+    static std::string formatOf(std::string_view head, bool truncated) {
+        return FormatSniffer::sniff(head, truncated) == "html" ? "html" : "xml";
+    }
+    
+    Document buildDocument(XMLStreamReader& reader, const std::string& ext, size_t reserve,
+                           const ParseOptions& options, const Document::allocator_type& alloc) {
+        Document doc(alloc);
+        doc.format = ext;
+        doc.content.reserve(reserve);
+        
+        // HTML is paged at block elements; XML has no such notion and stays
+        // one page
+        std::pmr::vector<size_t> blockStarts(scratchResource());
+        bool html = ext != "xml";
+        bool pages = options.wants(ParseOutput::Pages);
+        extractTextFromXML(reader, doc.content, html && pages ? &blockStarts : nullptr);
+        if (pages && html) {
+            addSections(doc, blockStarts);
+        } else if (pages && !doc.content.empty()) {
+            doc.addPage(0, doc.content.size());
+        }
+        
+        addMetadata(doc, ext, options);
+        return doc;
+    }
+    
+    void addMetadata(Document& doc, const std::string& ext, const ParseOptions& options) const {
+        if (!options.wants(ParseOutput::Metadata)) {
+            return;
+        }
+        doc.metadata.format = ext;
+        doc.metadata.hasTags = true;
+        if (!xmlOptions.select.empty()) {
+            doc.metadata.set("select", xmlOptions.select);
+        }
+    }
+    
+    // Tags that open or close a block of text, lower case; sorted, since
+    // this runs for every tag
+    static bool isBlockTag(std::string_view name) {
+        static const std::string_view blocks[] = {
+            "address", "article", "aside", "blockquote", "dd", "div", "dl", "dt", "fieldset",
+            "figcaption", "figure", "footer", "form", "h1", "h2", "h3", "h4", "h5", "h6",
+            "header", "hr", "li", "main", "nav", "ol", "p", "pre", "section", "table",
+            "title", "tr", "ul"};
+        if (name.empty() || name.size() > 10) {
+            return false;
+        }
+        return std::binary_search(std::begin(blocks), std::end(blocks), name);
+    }
+    
+    // Collapse the reader's text into `result`, whitespace runs becoming one
+    // space. Every tag counts as whitespace, so text on either side of it
+    // stays separated. With `blockStarts`, the output offset at each
+    // block-level tag is recorded.
+    void extractTextFromXML(XMLStreamReader& reader, std::pmr::string& result, std::pmr::vector<size_t>* blockStarts) {
+        bool pendingSpace = false;
+        reader.parse([&](const XMLEvent& event) {
+            if (event.type != XMLEventType::Text) {
+                if (blockStarts && isBlockTag(event.name) &&
+                    (blockStarts->empty() || blockStarts->back() != result.size())) {
+                    blockStarts->push_back(result.size());
+                }
+                pendingSpace = true;
+                return;
+            }
+            // Copy runs of non-space characters whole
+            std::string_view text = event.text;
+            size_t i = 0;
+            while (i < text.size()) {
+                if (isXMLSpace(text[i])) {
+                    pendingSpace = true;
+                    ++i;
+                    continue;
+                }
+                size_t end = i + 1;
+                while (end < text.size() && !isXMLSpace(text[end])) ++end;
+                if (pendingSpace) {
+                    result += ' ';
+                    pendingSpace = false;
+                }
+                result.append(text.data() + i, end - i);
+                i = end;
+            }
+        });
+        
+        if (pendingSpace) {
+            result += ' ';
+        }
+    }
+};
+
+// Markdown parser
+class MarkdownParser : public DocumentParser {
+public:
+    std::vector<std::string> getExtensions() const override {
+        return {"md", "markdown"};
+    }
+    
+    using DocumentParser::parseContent;
+    
+    Document parseContent(std::string_view content, const std::string&, const ParseOptions& options,
+                          const Document::allocator_type& alloc = {}) override {
+        Document doc(alloc);
+        doc.format = "markdown";
+        
+        // Convert to plain text, indexing the structure; each heading starts a page
+        if (options.wants(ParseOutput::Content)) {
+            bool pages = options.wants(ParseOutput::Pages);
+            bool structure = options.wants(ParseOutput::Structure);
+            // Collected in scratch memory, then copied into the document at
+            // its final size
+            DocumentStructure found(scratchResource());
+            MarkdownTokenizer(content, doc.content, pages || structure ? &found : nullptr).run();
+            if (pages) {
+                std::pmr::vector<size_t> headings(scratchResource());
+                for (const DocumentElement& element : found.elements) {
+                    if (element.kind == ElementKind::Heading) {
+                        headings.push_back(element.offset);
+                    }
+                }
+                addSections(doc, headings);
+            }
+            if (structure) {
+                doc.structure.assign(found);
+            }
+        } else if (options.wants(ParseOutput::RawContent)) {
+            doc.content.assign(content.data(), content.size());
+        }
+        
+        if (options.wants(ParseOutput::Metadata)) {
+            doc.metadata.format = "markdown";
+        }
+        
+        return doc;
+    }
+    
+    std::string getFormatName() const override { return "Markdown"; }
+};
+
+// Options for UniversalDocumentParser::parseDocuments
+struct BatchOptions {
+    size_t threads = 0;         // 0 = one per hardware thread
+    bool largestFirst = true;   // start big files first so they don't finish last
+    DocumentArena* arena = nullptr;  // allocate documents here; must outlive the results
+    ParseOutput outputs = ParseOutput::All;
+};
+
+// Outcome of one file in a batch; a failure never aborts the batch
+struct BatchResult {
+    std::string filename;
+    Document document;
+    bool ok = false;
+    std::string error;
+    
+    BatchResult() = default;
+    explicit BatchResult(const Document::allocator_type& alloc) : document(alloc) {}
+};
+
+// What UniversalDocumentParser::parseDirectory() picks up. Patterns are
+// globs (`*`, `?` and `[...]` stay within one directory, `**` spans any
+// number) and match the path relative to the root, or just the name when
+// they have no '/'. Exclude patterns also prune whole directories.
+struct DirectoryFilters {
+    std::vector<std::string> extensions;  // without the dot, any case, inside .gz/.zst; empty = any
+    std::vector<std::string> include;     // empty = everything
+    std::vector<std::string> exclude;
+    uintmax_t minBytes = 0;
+    uintmax_t maxBytes = 0;               // 0 = no limit
+    bool includeHidden = false;           // names starting with '.'
+};
+
+// Threads per stage and the depth of the queue in front of each one. The
+// queues are what bound memory: enumeration and prefetching never run
+// more than queueDepth files ahead of the stage they feed.
+struct DirectoryOptions {
+    size_t walkThreads = 2;
+    size_t filterThreads = 2;
+    size_t readThreads = 4;
+    size_t parseThreads = 0;              // 0 = one per hardware thread
+    size_t queueDepth = 256;
+    size_t prefetchBytes = 16 << 20;      // read-ahead per file; the rest streams
+    ParseOutput outputs = ParseOutput::All;
+};
+
+struct DirectoryStats {
+    size_t directories = 0;
+    size_t files = 0;                     // regular files seen
+    size_t accepted = 0;                  // passed the filters, sent to parse
+    size_t unreadable = 0;                // directories that could not be listed
+};
+
+// Streams the files under a directory through walk -> filter -> prefetch
+// -> parse stages, each on its own threads and joined by BoundedQueues, so
+// a tree of millions of files is never held in memory and a slow consumer
+// stalls the stages behind it instead of piling up documents. Directories
+// are walked from an explicit stack, depth first, so nesting depth costs
+// nothing; symlinked directories are not followed. Results come out of
+// next() in completion order; destroying the pipeline early cancels it.
+class DirectoryPipeline {
+public:
+    using Accept = std::function<bool(const std::string& path)>;
+    using Parse = std::function<Document(const std::string& path, std::string_view content)>;
+    
+    DirectoryPipeline(const std::string& root, DirectoryFilters directoryFilters,
+                      const DirectoryOptions& options, Accept acceptFile, Parse parseFile)
+        : filters(std::move(directoryFilters)), prefetchBytes(options.prefetchBytes),
+          accept(std::move(acceptFile)), parse(std::move(parseFile)),
+          candidates(options.queueDepth), admitted(options.queueDepth),
+          loaded(options.queueDepth), results(options.queueDepth) {
+        for (auto& extension : filters.extensions) {
+            if (!extension.empty() && extension.front() == '.') extension.erase(0, 1);
+            for (auto& c : extension) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        
+        std::error_code ec;
+        auto status = std::filesystem::status(root, ec);
+        if (std::filesystem::is_directory(status)) {
+            directories.push_back(root);
+            rootPrefix = root.size() + (root.back() == '/' ? 0 : 1);
+        } else if (std::filesystem::is_regular_file(status)) {
+            std::string file = root;
+            candidates.push(std::move(file));
+            rootPrefix = root.size() - std::filesystem::path(root).filename().string().size();
+            counters.files = 1;
+        } else {
+            throw std::runtime_error("Cannot open directory: " + root);
+        }
+        
+        size_t parseThreads = options.parseThreads > 0
+            ? options.parseThreads : std::max(1u, std::thread::hardware_concurrency());
+        startStage(std::max<size_t>(options.walkThreads, 1), liveWalkers, [this] { walk(); });
+        startStage(std::max<size_t>(options.filterThreads, 1), liveFilters, [this] { filter(); });
+        startStage(std::max<size_t>(options.readThreads, 1), liveReaders, [this] { prefetch(); });
+        startStage(parseThreads, liveParsers, [this, parseThreads] {
+            onParallelWorker() = parseThreads > 1;
+            parseLoaded();
+        });
+    }
+    
+    ~DirectoryPipeline() {
+        cancel();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    
+    DirectoryPipeline(const DirectoryPipeline&) = delete;
+    DirectoryPipeline& operator=(const DirectoryPipeline&) = delete;
+    
+    // Block for the next finished file; false once every file is delivered
+    // or the pipeline was cancelled
+    bool next(BatchResult& result) {
+        return results.pop(result);
+    }
+    
+    // Stop all stages; files in flight are dropped. Safe from any thread.
+    void cancel() {
+        cancelled.store(true);
+        {
+            std::lock_guard<std::mutex> guard(walkLock);
+            walkWork.notify_all();
+        }
+        candidates.close();
+        admitted.close();
+        loaded.close();
+        results.close();
+    }
+    
+    DirectoryStats stats() const {
+        DirectoryStats snapshot;
+        snapshot.directories = counters.directories.load();
+        snapshot.files = counters.files.load();
+        snapshot.accepted = counters.accepted.load();
+        snapshot.unreadable = counters.unreadable.load();
+        return snapshot;
+    }
+    
+    // Glob match as described on DirectoryFilters; also takes [a-z] classes
+    static bool globMatch(std::string_view pattern, std::string_view text) {
+        size_t p = 0;
+        size_t t = 0;
+        while (p < pattern.size()) {
+            char c = pattern[p];
+            if (c == '*') {
+                bool spansDirectories = p + 1 < pattern.size() && pattern[p + 1] == '*';
+                std::string_view rest = pattern.substr(p + (spansDirectories ? 2 : 1));
+                // "**/" may also match no directory at all
+                if (spansDirectories && !rest.empty() && rest.front() == '/' &&
+                    globMatch(rest.substr(1), text.substr(t))) {
+                    return true;
+                }
+                for (size_t i = t; i <= text.size(); ++i) {
+                    if (globMatch(rest, text.substr(i))) {
+                        return true;
+                    }
+                    if (i < text.size() && text[i] == '/' && !spansDirectories) {
+                        break;
+                    }
+                }
+                return false;
+            }
+            if (t == text.size()) {
+                return false;
+            }
+            size_t close = c == '[' ? pattern.find(']', p + 2) : std::string_view::npos;
+            if (close != std::string_view::npos) {
+                if (text[t] == '/' || !classMatch(pattern.substr(p + 1, close - p - 1), text[t])) {
+                    return false;
+                }
+                p = close + 1;
+                ++t;
+                continue;
+            }
+            if (c == '?' ? text[t] == '/' : c != text[t]) {
+                return false;
+            }
+            ++p;
+            ++t;
+        }
+        return t == text.size();
+    }
+    
+private:
+    // Body of a [...] class: ranges like a-z, a leading '!' negates
+    static bool classMatch(std::string_view set, char c) {
+        bool negate = !set.empty() && set.front() == '!';
+        if (negate) set.remove_prefix(1);
+        bool found = false;
+        for (size_t i = 0; i < set.size() && !found; ++i) {
+            if (i + 2 < set.size() && set[i + 1] == '-') {
+                found = c >= set[i] && c <= set[i + 2];
+                i += 2;
+            } else {
+                found = c == set[i];
+            }
+        }
+        return found != negate;
+    }
+    
+    struct Prefetched {
+        std::string path;
+        std::unique_ptr<FileBuffer> input;
+        std::string error;
+    };
+    
+    struct Counters {
+        std::atomic<size_t> directories{0};
+        std::atomic<size_t> files{0};
+        std::atomic<size_t> accepted{0};
+        std::atomic<size_t> unreadable{0};
+    };
+    
+    DirectoryFilters filters;
+    size_t prefetchBytes;
+    size_t rootPrefix = 0;
+    Accept accept;
+    Parse parse;
+    Counters counters;
+    std::atomic<bool> cancelled{false};
+    
+    // Directories still to list; walkers take from the back
+    std::mutex walkLock;
+    std::condition_variable walkWork;
+    std::vector<std::string> directories;
+    size_t busyWalkers = 0;
+    
+    BoundedQueue<std::string> candidates;
+    BoundedQueue<std::string> admitted;
+    BoundedQueue<Prefetched> loaded;
+    BoundedQueue<BatchResult> results;
+    
+    // The last thread of each stage to finish closes the queue it feeds
+    std::atomic<size_t> liveWalkers{0};
+    std::atomic<size_t> liveFilters{0};
+    std::atomic<size_t> liveReaders{0};
+    std::atomic<size_t> liveParsers{0};
+    std::vector<std::thread> threads;
+    
+    template <typename Body>
+    void startStage(size_t count, std::atomic<size_t>& live, Body body) {
+        live.store(count);
+        for (size_t i = 0; i < count; ++i) {
+            threads.emplace_back(body);
+        }
+    }
+    
+    std::string_view relativePath(const std::string& path) const {
+        return std::string_view(path).substr(std::min(rootPrefix, path.size()));
+    }
+    
+    bool matchesAny(const std::vector<std::string>& patterns, std::string_view relative) const {
+        std::string_view name = relative.substr(relative.rfind('/') + 1);
+        for (const auto& pattern : patterns) {
+            bool byPath = pattern.find('/') != std::string::npos;
+            if (globMatch(pattern, byPath ? relative : name)) {
                 return true;
             }
         }
         return false;
     }
+    
+    // An idle walker sleeps while others may still find subdirectories
+    bool takeDirectory(std::string& dir) {
+        std::unique_lock<std::mutex> guard(walkLock);
+        walkWork.wait(guard, [this] { return !directories.empty() || busyWalkers == 0 || cancelled.load(); });
+        if (directories.empty() || cancelled.load()) {
+            return false;
+        }
+        dir = std::move(directories.back());
+        directories.pop_back();
+        ++busyWalkers;
+        return true;
+    }
+    
+    void walk() {
+        namespace fs = std::filesystem;
+        std::string dir;
+        while (takeDirectory(dir)) {
+            counters.directories.fetch_add(1, std::memory_order_relaxed);
+            std::vector<std::string> subdirectories;
+            std::error_code ec;
+            fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+            for (; !ec && it != fs::directory_iterator() && !cancelled.load(); it.increment(ec)) {
+                std::string path = it->path().string();
+                std::string_view relative = relativePath(path);
+                if (!filters.includeHidden && it->path().filename().string().front() == '.') {
+                    continue;
+                }
+                std::error_code typeError;
+                fs::file_status status = it->symlink_status(typeError);
+                if (fs::is_symlink(status)) {
+                    status = it->status(typeError);
+                    if (fs::is_directory(status)) {
+                        continue;
+                    }
+                }
+                if (fs::is_directory(status)) {
+                    if (!matchesAny(filters.exclude, relative)) {
+                        subdirectories.push_back(std::move(path));
+                    }
+                } else if (fs::is_regular_file(status)) {
+                    counters.files.fetch_add(1, std::memory_order_relaxed);
+                    if (!candidates.push(std::move(path))) {
+                        break;
+                    }
+                }
+            }
+            if (ec) {
+                counters.unreadable.fetch_add(1, std::memory_order_relaxed);
+            }
+            
+            std::lock_guard<std::mutex> guard(walkLock);
+            for (auto& subdirectory : subdirectories) {
+                directories.push_back(std::move(subdirectory));
+            }
+            // Idle walkers pick up the new directories, or all of them
+            // stop once nothing is left to list
+            if (--busyWalkers == 0 || !subdirectories.empty()) {
+                walkWork.notify_all();
+            }
+        }
+        if (--liveWalkers == 0) {
+            candidates.close();
+        }
+    }
+    
+    bool admit(const std::string& path) const {
+        std::string_view relative = relativePath(path);
+        if (!filters.extensions.empty()) {
+            std::string_view name = innerName(relative.substr(relative.rfind('/') + 1));
+            size_t dot = name.rfind('.');
+            if (dot == std::string_view::npos) {
+                return false;
+            }
+            std::string extension(name.substr(dot + 1));
+            for (auto& c : extension) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            if (std::find(filters.extensions.begin(), filters.extensions.end(), extension) ==
+                filters.extensions.end()) {
+                return false;
+            }
+        }
+        if (!filters.include.empty() && !matchesAny(filters.include, relative)) {
+            return false;
+        }
+        if (matchesAny(filters.exclude, relative)) {
+            return false;
+        }
+        if (filters.minBytes > 0 || filters.maxBytes > 0) {
+            std::error_code ec;
+            uintmax_t size = std::filesystem::file_size(path, ec);
+            if (ec || size < filters.minBytes || (filters.maxBytes > 0 && size > filters.maxBytes)) {
+                return false;
+            }
+        }
+        try {
+            return accept(path);
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    
+    void filter() {
+        std::string path;
+        while (!cancelled.load() && candidates.pop(path)) {
+            if (admit(path)) {
+                counters.accepted.fetch_add(1, std::memory_order_relaxed);
+                if (!admitted.push(std::move(path))) {
+                    break;
+                }
+            }
+        }
+        if (--liveFilters == 0) {
+            admitted.close();
+        }
+    }
+    
+    void prefetch() {
+        std::string path;
+        while (!cancelled.load() && admitted.pop(path)) {
+            Prefetched item;
+            item.path = std::move(path);
+            try {
+                item.input = std::make_unique<FileBuffer>(item.path);
+                item.input->prefetch(prefetchBytes);
+            } catch (const std::exception& e) {
+                item.error = e.what();
+            }
+            if (!loaded.push(std::move(item))) {
+                break;
+            }
+        }
+        if (--liveReaders == 0) {
+            loaded.close();
+        }
+    }
+    
+    void parseLoaded() {
+        Prefetched item;
+        while (!cancelled.load() && loaded.pop(item)) {
+            BatchResult result;
+            result.filename = std::move(item.path);
+            if (item.input) {
+                try {
+                    result.document = parse(result.filename, item.input->view());
+                    result.ok = true;
+                } catch (const std::exception& e) {
+                    result.error = e.what();
+                }
+            } else {
+                result.error = std::move(item.error);
+            }
+            item = Prefetched();
+            if (!results.push(std::move(result))) {
+                break;
+            }
+        }
+        if (--liveParsers == 0) {
+            results.close();
+        }
+    }
+};
+
+// Maps file names and file contents to parsers. Each listed extension is
+// case-folded and packed into a 64-bit key once, at registration, so a
+// lookup hashes one integer and never allocates. Registration order breaks
+// ties: the first parser to claim an extension keeps it.
+class ParserRegistry {
+public:
+    static ParserRegistry withDefaults() {
+        ParserRegistry registry;
+        registry.add(std::make_unique<TextParser>());
+        registry.add(std::make_unique<CSVParser>());
+        registry.add(std::make_unique<DelimitedTextParser>());
+        registry.add(std::make_unique<JSONParser>());
+        registry.add(std::make_unique<XMLParser>());
+        registry.add(std::make_unique<MarkdownParser>());
+        return registry;
+    }
+    
+    void add(std::unique_ptr<DocumentParser> parser) {
+        std::vector<std::string> extensions = parser->getExtensions();
+        if (extensions.empty()) {
+            unlisted.push_back(parser.get());
+        }
+        for (const auto& ext : extensions) {
+            if (uint64_t key = extensionKey(ext)) {
+                byExtension.emplace(key, parser.get());
+            } else if (std::find(unlisted.begin(), unlisted.end(), parser.get()) == unlisted.end()) {
+                // Too long to pack; fall back to asking canParse()
+                unlisted.push_back(parser.get());
+            }
+        }
+        parsers.push_back(std::move(parser));
+    }
+    
+    // By file name alone: the extension table, then parsers without one
+    DocumentParser* findByName(const std::string& filename) const {
+        if (uint64_t key = extensionKey(extensionOf(innerName(filename)))) {
+            auto it = byExtension.find(key);
+            if (it != byExtension.end()) {
+                return it->second;
+            }
+        }
+        for (DocumentParser* parser : unlisted) {
+            if (parser->canParse(filename)) {
+                return parser;
+            }
+        }
+        return nullptr;
+    }
+    
+    // By the first bytes of the file, see FormatSniffer
+    DocumentParser* findByContent(std::string_view head, bool truncated) const {
+        uint64_t key = extensionKey(FormatSniffer::sniff(head, truncated));
+        auto it = key ? byExtension.find(key) : byExtension.end();
+        return it != byExtension.end() ? it->second : nullptr;
+    }
+    
+    // By a format hint: an extension ("csv", ".md"), a format name ("JSON")
+    // or one word of it ("text" for "Plain Text"), case-insensitively
+    DocumentParser* findByFormat(std::string_view format) const {
+        if (!format.empty() && format.front() == '.') {
+            format.remove_prefix(1);
+        }
+        if (uint64_t key = extensionKey(format)) {
+            auto it = byExtension.find(key);
+            if (it != byExtension.end()) {
+                return it->second;
+            }
+        }
+        auto equal = [](std::string_view a, std::string_view b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+                return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+            });
+        };
+        for (const auto& parser : parsers) {
+            if (equal(parser->getFormatName(), format)) {
+                return parser.get();
+            }
+        }
+        for (const auto& parser : parsers) {
+            std::string name = parser->getFormatName();
+            size_t start = 0;
+            while (start < name.size()) {
+                size_t end = name.find_first_of(" /", start);
+                if (end == std::string::npos) end = name.size();
+                if (end > start && equal(std::string_view(name).substr(start, end - start), format)) {
+                    return parser.get();
+                }
+                start = end + 1;
+            }
+        }
+        return nullptr;
+    }
+    
+    const std::vector<std::unique_ptr<DocumentParser>>& all() const { return parsers; }
+    
+    // Text after the last '.' of the last path component, or empty
+    static std::string_view extensionOf(std::string_view filename) {
+        size_t dot = filename.find_last_of('.');
+        if (dot == std::string_view::npos) {
+            return {};
+        }
+        size_t slash = filename.find_last_of("/\\");
+        if (slash != std::string_view::npos && slash > dot) {
+            return {};
+        }
+        return filename.substr(dot + 1);
+    }
+    
+    // Up to eight case-folded bytes in one integer; 0 if empty or longer
+    static uint64_t extensionKey(std::string_view ext) {
+        if (ext.empty() || ext.size() > 8) {
+            return 0;
+        }
+        uint64_t key = 0;
+        for (size_t i = 0; i < ext.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(ext[i]);
+            if (c >= 'A' && c <= 'Z') c = static_cast<unsigned char>(c - 'A' + 'a');
+            key |= static_cast<uint64_t>(c) << (8 * i);
+        }
+        return key;
+    }
+    
+private:
+    std::vector<std::unique_ptr<DocumentParser>> parsers;
+    std::unordered_map<uint64_t, DocumentParser*> byExtension;
+    std::vector<DocumentParser*> unlisted;
+};
+
+using DocumentCache = BasicDocumentCache<Document>;
+
+// Main document parser manager. The parser registry and cache settings are
+// fixed at construction and every public method other than
+// setStatsListener() is const; that one swaps the listener atomically. A
+// single instance can be shared by all threads without locking.
+class UniversalDocumentParser {
+private:
+    ParserRegistry registry;
+    DocumentCacheOptions cacheOptions;
+    std::unique_ptr<DocumentCache> cache;
+    // One per registered parser, in registry order; empty without stats
+    std::vector<std::unique_ptr<ParserStats>> parserStats = makeParserStats(registry);
+    // Read and replaced with std::atomic_load/atomic_store
+    std::shared_ptr<const DocumentStatsListener> statsListener;
+    
+public:
+    UniversalDocumentParser() : registry(ParserRegistry::withDefaults()) {}
+    explicit UniversalDocumentParser(ParserRegistry parsers) : registry(std::move(parsers)) {}
+    explicit UniversalDocumentParser(const DocumentCacheOptions& cacheSettings)
+        : UniversalDocumentParser(ParserRegistry::withDefaults(), cacheSettings) {}
+    UniversalDocumentParser(ParserRegistry parsers, const DocumentCacheOptions& cacheSettings)
+        : registry(std::move(parsers)), cacheOptions(cacheSettings) {
+        if (cacheOptions.capacityBytes > 0) {
+            cache = std::make_unique<DocumentCache>(cacheOptions.capacityBytes);
+        }
+    }
+    
+    // Dispatch on the extension, looking through .gz/.zst to the one
+    // inside; files without a known one are routed by sniffing their
+    // first few KB, decompressed if need be. Returns nullptr when nothing
+    // matches. `compression` is what the name or the sniffed bytes say.
+    DocumentParser* findParser(const std::string& filename, bool* sniffed = nullptr,
+                               Compression* compression = nullptr) const {
+        if (sniffed) *sniffed = false;
+        if (compression) *compression = compressionFromName(filename);
+        if (DocumentParser* parser = registry.findByName(filename)) {
+            return parser;
+        }
+        
+        char head[FormatSniffer::kHeadBytes];
+        size_t length = FormatSniffer::readHead(filename.c_str(), head);
+        Compression detected = detectCompression(std::string_view(head, length));
+        if (detected != Compression::None) {
+            if (compression) *compression = detected;
+            length = readDecodedHead(filename, head);
+        }
+        if (length == 0) {
+            return nullptr;
+        }
+        DocumentParser* parser = registry.findByContent(std::string_view(head, length),
+                                                        length == FormatSniffer::kHeadBytes);
+        if (parser && sniffed) *sniffed = true;
+        return parser;
+    }
+    
+    // With the cache enabled a hit skips parsing but still copies the
+    // document into `alloc`; parseShared() avoids the copy
+    Document parseDocument(const std::string& filename, const Document::allocator_type& alloc = {}) const {
+        return parseDocument(filename, ParseOutput::All, alloc);
+    }
+    
+    // Produce only `outputs`, e.g. ParseOutput::Metadata for format, size
+    // and row count. Partial documents are never cached.
+    Document parseDocument(const std::string& filename, ParseOutput outputs,
+                           const Document::allocator_type& alloc = {}) const {
+        if (!cache || outputs != ParseOutput::All) {
+            return parseUncached(filename, outputs, alloc);
+        }
+        return Document(*parseShared(filename), alloc);
+    }
+    
+    // Parse reusing the memory of `context`; see ParseContext. A cache hit
+    // is copied into the context's document.
+    const Document& parseDocument(const std::string& filename, ParseContext& context) const {
+        ParseContext::Scope scope(context);
+        context.document() = parseDocument(filename, context.allocator());
+        return context.document();
+    }
+    
+    // Cached documents are immutable and shared; a hit costs one reference
+    // count. Without a cache every call parses.
+    std::shared_ptr<const Document> parseShared(const std::string& filename) const {
+        DocumentCache::Key key;
+        std::optional<FileBuffer> hashed;
+        bool cacheable = cache && versionOf(filename, key, hashed);
+        if (cacheable) {
+            if (auto hit = cache->find(key)) {
+                return hit;
+            }
+        }
+        // A miss parses the bytes that were just hashed rather than reading
+        // the file again
+        ParseOptions options;
+        options.premapped = hashed ? &*hashed : nullptr;
+        auto doc = std::make_shared<const Document>(parseUncached(filename, options, {}));
+        if (cacheable) {
+            cache->insert(key, doc, footprint(*doc));
+        }
+        return doc;
+    }
+    
+    // Parse bytes that are already in memory, e.g. read asynchronously;
+    // `filename` picks the parser and names the document. Never cached.
+    Document parseContent(const std::string& filename, std::string_view content,
+                          const Document::allocator_type& alloc = {}) const {
+        return parseContent(filename, content, ParseOutput::All, alloc);
+    }
+    
+    Document parseContent(const std::string& filename, std::string_view content, ParseOutput outputs,
+                          const Document::allocator_type& alloc = {}) const {
+        Compression compression = detectCompression(content);
+        if (compression != Compression::None) {
+            std::string plain = decompressOrThrow(filename, content, compression);
+            Document doc = parseContent(filename, plain, outputs, alloc);
+            doc.metadata.set("compression", compressionName(compression));
+            return doc;
+        }
+        DOCPARSER_TRACE_PARSE();
+        DOCPARSER_COUNT_BYTES(content.size());
+        std::string storage;
+        DecodedText decoded = decodeInput(content, storage);
+        content = decoded.text;
+        bool sniffed = false;
+        DocumentParser* parser = nullptr;
+        {
+            DOCPARSER_STAGE(Detect);
+            parser = registry.findByName(filename);
+            if (!parser && !content.empty()) {
+                std::string_view head = content.substr(0, FormatSniffer::kHeadBytes);
+                parser = registry.findByContent(head, head.size() < content.size());
+                sniffed = parser != nullptr;
+            }
+        }
+        return runParser(parser, sniffed, filename, outputs, &decoded.encoding,
+                         [&] { return parser->parseContent(content, filename, outputs, alloc); });
+    }
+    
+    // Parse a buffer received from elsewhere (a socket, a queue) without
+    // writing it to disk. `format` is an extension or format name as
+    // accepted by ParserRegistry::findByFormat(); empty means sniff the
+    // content. The document has metadata source=memory instead of a filename.
+    Document parse(std::string_view data, const std::string& format = "",
+                   const Document::allocator_type& alloc = {}) const {
+        Compression compression = detectCompression(data);
+        if (compression != Compression::None) {
+            std::string plain = decompressOrThrow("<memory>", data, compression);
+            Document doc = parse(plain, format, alloc);
+            doc.metadata.set("compression", compressionName(compression));
+            return doc;
+        }
+        Document doc = [&] {
+            if (format.empty()) {
+                return parseContent("<memory>", data, alloc);
+            }
+            DOCPARSER_TRACE_PARSE();
+            DOCPARSER_COUNT_BYTES(data.size());
+            std::string storage;
+            DecodedText decoded = decodeInput(data, storage);
+            std::string_view text = decoded.text;
+            DocumentParser* parser = nullptr;
+            std::string hint = "<memory>";
+            {
+                DOCPARSER_STAGE(Detect);
+                parser = registry.findByFormat(format);
+                if (!parser) {
+                    throw std::runtime_error("Unknown format: " + format);
+                }
+                // Parsers that look at the name (XML vs HTML) see the
+                // extension when one was given, and sniff otherwise
+                std::string_view ext(format);
+                if (ext.front() == '.') ext.remove_prefix(1);
+                if (registry.findByName("x." + std::string(ext)) == parser) {
+                    hint += "." + std::string(ext);
+                }
+            }
+            return runParser(parser, false, hint, ParseOutput::All, &decoded.encoding,
+                             [&] { return parser->parseContent(text, hint, alloc); });
+        }();
+        doc.metadata.filename.clear();
+        doc.metadata.set("source", "memory");
+        return doc;
+    }
+    
+    DocumentCacheStats cacheStats() const {
+        return cache ? cache->stats() : DocumentCacheStats();
+    }
+    
+    void clearCache() const {
+        if (cache) {
+            cache->clear();
+        }
+    }
+    
+    // Per-parser totals since construction; empty unless built with
+    // DOCPARSER_ENABLE_STATS. Cache hits are not parses and are not counted.
+    std::vector<ParserStatsSnapshot> parseStats() const {
+        std::vector<ParserStatsSnapshot> snapshots;
+        snapshots.reserve(parserStats.size());
+        for (const auto& stats : parserStats) {
+            snapshots.push_back(stats->snapshot());
+        }
+        return snapshots;
+    }
+    
+    // Stats in Prometheus text format, ready to serve from /metrics
+    std::string parseStatsPrometheus() const {
+        return formatPrometheus(parseStats());
+    }
+    
+    // Called after every parse with that document's stats, on the parsing
+    // thread (possibly several at once). It may be replaced while other
+    // threads parse; a parse already holding the old one still calls it.
+    // This is the hook for exporting spans or events to OpenTelemetry and
+    // the like.
+    void setStatsListener(DocumentStatsListener listener) {
+        std::shared_ptr<const DocumentStatsListener> next;
+        if (listener) {
+            next = std::make_shared<const DocumentStatsListener>(std::move(listener));
+        }
+        std::atomic_store(&statsListener, std::move(next));
+    }
+    
+    // Called once per file as soon as it finishes, from a worker thread;
+    // calls are serialized so the callback needs no locking of its own
+    using BatchCallback = std::function<void(size_t index, BatchResult&& result)>;
+    
+    // Parse many files on a work-stealing pool; results in input order
+    std::vector<BatchResult> parseDocuments(const std::vector<std::string>& filenames,
+                                            const BatchOptions& options = BatchOptions()) const {
+        // Pre-built with the batch allocator so the moves below don't copy
+        Document::allocator_type alloc = batchAllocator(options);
+        std::vector<BatchResult> results;
+        results.reserve(filenames.size());
+        for (size_t i = 0; i < filenames.size(); ++i) {
+            results.emplace_back(alloc);
+        }
+        parseDocuments(filenames, options, [&results](size_t index, BatchResult&& result) {
+            results[index] = std::move(result);
+        });
+        return results;
+    }
+    
+    // Parse many files on a work-stealing pool; results in completion order
+    void parseDocuments(const std::vector<std::string>& filenames, const BatchOptions& options,
+                        const BatchCallback& onResult) const {
+        std::vector<size_t> order(filenames.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        if (options.largestFirst) {
+            std::vector<uintmax_t> sizes(filenames.size(), 0);
+            for (size_t i = 0; i < filenames.size(); ++i) {
+                std::error_code ec;
+                uintmax_t size = std::filesystem::file_size(filenames[i], ec);
+                sizes[i] = ec ? 0 : size;
+            }
+            std::stable_sort(order.begin(), order.end(),
+                             [&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+        }
+        
+        Document::allocator_type alloc = batchAllocator(options);
+        std::mutex deliverLock;
+        WorkStealingPool pool(std::min(options.threads > 0 ? options.threads
+                                                           : std::max(1u, std::thread::hardware_concurrency()),
+                                       std::max<size_t>(filenames.size(), 1)));
+        for (size_t index : order) {
+            pool.submit([this, &filenames, &onResult, &deliverLock, &options, alloc, index] {
+                BatchResult result(alloc);
+                result.filename = filenames[index];
+                try {
+                    result.document = parseDocument(filenames[index], options.outputs, alloc);
+                    result.ok = true;
+                } catch (const std::exception& e) {
+                    result.error = e.what();
+                }
+                std::lock_guard<std::mutex> guard(deliverLock);
+                onResult(index, std::move(result));
+            });
+        }
+        pool.wait();
+    }
+    
+    // Stream the files under `root` (or just `root` if it is a file)
+    // through a DirectoryPipeline and pull results from it with next().
+    // Files pass the filters and canParseFile(), are parsed from their
+    // prefetched mapping and are never cached. The pipeline must not
+    // outlive this parser.
+    std::unique_ptr<DirectoryPipeline> crawlDirectory(const std::string& root,
+                                                      const DirectoryFilters& filters = DirectoryFilters(),
+                                                      const DirectoryOptions& options = DirectoryOptions()) const {
+        return std::make_unique<DirectoryPipeline>(
+            root, filters, options,
+            [this](const std::string& path) { return canParseFile(path); },
+            [this, outputs = options.outputs](const std::string& path, std::string_view content) {
+                return parseContent(path, content, outputs);
+            });
+    }
+    
+    // Called on the thread that called parseDirectory(), in completion
+    // order; return false to stop the crawl
+    using DirectoryCallback = std::function<bool(BatchResult&& result)>;
+    
+    // Parse every matching file under `root`; returns how many were delivered
+    size_t parseDirectory(const std::string& root, const DirectoryFilters& filters,
+                          const DirectoryOptions& options, const DirectoryCallback& onResult) const {
+        auto pipeline = crawlDirectory(root, filters, options);
+        size_t delivered = 0;
+        BatchResult result;
+        while (pipeline->next(result)) {
+            ++delivered;
+            if (!onResult(std::move(result))) {
+                break;
+            }
+        }
+        return delivered;
+    }
+    
+    std::vector<BatchResult> parseDirectory(const std::string& root,
+                                            const DirectoryFilters& filters = DirectoryFilters(),
+                                            const DirectoryOptions& options = DirectoryOptions()) const {
+        std::vector<BatchResult> results;
+        parseDirectory(root, filters, options, [&results](BatchResult&& result) {
+            results.push_back(std::move(result));
+            return true;
+        });
+        return results;
+    }
+    
+    std::vector<std::string> getSupportedFormats() const {
+        std::vector<std::string> formats;
+        for (const auto& parser : registry.all()) {
+            formats.push_back(parser->getFormatName());
+        }
+        return formats;
+    }
+    
+    bool canParseFile(const std::string& filename) const {
+        return findParser(filename) != nullptr;
+    }
+    
+private:
+    Document parseUncached(const std::string& filename, const ParseOptions& options,
+                           const Document::allocator_type& alloc) const {
+        DOCPARSER_TRACE_PARSE();
+        bool sniffed = false;
+        Compression compression = Compression::None;
+        DocumentParser* parser = nullptr;
+        {
+            DOCPARSER_STAGE(Detect);
+            parser = findParser(filename, &sniffed, &compression);
+        }
+        // Parsers decode the file themselves and record its encoding
+        Document doc = runParser(parser, sniffed, filename, options.outputs, nullptr,
+                                 [&] { return parser->parse(filename, options, alloc); });
+        if (compression != Compression::None) {
+            doc.metadata.set("compression", compressionName(compression));
+        }
+        return doc;
+    }
+    
+    // Pre-parse stage of in-memory input, timed with format detection as
+    // nothing is read
+    static DecodedText decodeInput(std::string_view content, std::string& storage) {
+        DOCPARSER_STAGE(Detect);
+        return decodeText(content, storage);
+    }
+    
+    // Errors read like those of a failed parse of `filename`
+    static std::string decompressOrThrow(const std::string& filename, std::string_view data,
+                                         Compression compression) {
+        try {
+            return Decompressor::decompress(data, compression);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Failed to parse " + filename + ": " + e.what());
+        }
+    }
+    
+    // Shared tail of every parse path: error wrapping, the common metadata
+    // and, when enabled, stats. `decoded` is the encoding of input decoded
+    // before the parse; parsers that read the file report their own, and
+    // one that reports none read its bytes as UTF-8.
+    template <typename ParseFn>
+    Document runParser(const DocumentParser* parser, bool sniffed, const std::string& filename,
+                       ParseOutput outputs, const TextEncoding* decoded, ParseFn parse) const {
+        if (!parser) {
+            throw std::runtime_error("No suitable parser found for: " + filename);
+        }
+        
+        Document doc = [&] {
+            try {
+                Document parsed = [&] {
+                    DOCPARSER_STAGE(Parse);
+                    return parse();
+                }();
+                DOCPARSER_STAGE(PostProcess);
+                dropUnwanted(parsed, outputs);
+                if (wants(outputs, ParseOutput::Metadata) && (decoded || parsed.metadata.encoding.empty())) {
+                    parsed.metadata.encoding = encodingName(decoded ? *decoded : TextEncoding::UTF8);
+                }
+                parsed.metadata.parser = parser->getFormatName();
+                parsed.metadata.filename = filename;
+                if (sniffed) {
+                    parsed.metadata.set("detected_by", "content");
+                }
+                return parsed;
+            } catch (const std::exception& e) {
+                recordStats(parser, filename, nullptr);
+                throw std::runtime_error("Failed to parse " + filename + ": " + e.what());
+            }
+        }();
+        recordStats(parser, filename, &doc);
+        return doc;
+    }
+    
+    // Parsers that ignore the outputs they were given still return only
+    // what was asked for
+    static void dropUnwanted(Document& doc, ParseOutput outputs) {
+        if (outputs == ParseOutput::All) {
+            return;
+        }
+        if (!wants(outputs, ParseOutput::Pages)) {
+            doc.pages.clear();
+            doc.pageRanges.clear();
+        }
+        if (!wants(outputs, ParseOutput::Structure)) {
+            doc.structure.clear();
+        }
+        if (!wants(outputs, ParseOutput::Content) && !wants(outputs, ParseOutput::RawContent)) {
+            doc.content.clear();
+        }
+        if (!wants(outputs, ParseOutput::Metadata)) {
+            doc.metadata.clear();
+        }
+    }
+    
+    static std::vector<std::unique_ptr<ParserStats>> makeParserStats(const ParserRegistry& parsers) {
+        std::vector<std::unique_ptr<ParserStats>> stats;
+        if constexpr (kStatsEnabled) {
+            for (const auto& parser : parsers.all()) {
+                stats.push_back(std::make_unique<ParserStats>(parser->getFormatName()));
+            }
+        }
+        return stats;
+    }
+    
+    // Folds the active trace into the parser's totals; `doc` is null on failure
+    void recordStats(const DocumentParser* parser, const std::string& filename, const Document* doc) const {
+        if constexpr (kStatsEnabled) {
+            ParseTrace* trace = ParseTrace::active();
+            if (!trace) {
+                return;
+            }
+            if (doc) {
+                trace->noteBuffer(doc->content.capacity());
+            }
+            DocumentStats& stats = trace->finish(doc != nullptr);
+            const auto& parsers = registry.all();
+            for (size_t i = 0; i < parsers.size(); ++i) {
+                if (parsers[i].get() == parser) {
+                    stats.parser = parserStats[i]->parserName();
+                    parserStats[i]->record(stats);
+                    break;
+                }
+            }
+            if (auto listener = std::atomic_load(&statsListener)) {
+                stats.filename = filename;
+                (*listener)(stats);
+            }
+        } else {
+            (void)parser;
+            (void)filename;
+            (void)doc;
+        }
+    }
+    
+    // Cache key for the file as it is now; false if it can't be read, in
+    // which case the parse reports the error. With hashContent the hashed
+    // bytes are left in `input` for the parse of a miss.
+    bool versionOf(const std::string& filename, DocumentCache::Key& key,
+                   std::optional<FileBuffer>& input) const {
+        key.path = filename;
+        if (cacheOptions.hashContent) {
+            try {
+                input.emplace(filename);
+                key.size = input->size();
+                key.stamp = xxhash64(input->view().data(), input->size());
+                return true;
+            } catch (const std::exception&) {
+                return false;
+            }
+        }
+        std::error_code ec;
+        key.size = std::filesystem::file_size(filename, ec);
+        if (ec) {
+            return false;
+        }
+        auto mtime = std::filesystem::last_write_time(filename, ec);
+        if (ec) {
+            return false;
+        }
+        key.stamp = static_cast<uint64_t>(mtime.time_since_epoch().count());
+        return true;
+    }
+    
+    // Approximate heap bytes held by a document, for the cache budget
+    static size_t footprint(const Document& doc) {
+        size_t bytes = sizeof(Document) + doc.content.capacity() + doc.format.capacity();
+        bytes += doc.metadata.heapBytes();
+        for (const auto& page : doc.pages) {
+            bytes += sizeof(page) + page.capacity();
+        }
+        bytes += doc.pageRanges.capacity() * sizeof(PageRange);
+        bytes += doc.structure.heapBytes();
+        return bytes;
+    }
+    
+    static Document::allocator_type batchAllocator(const BatchOptions& options) {
+        return options.arena ? Document::allocator_type(options.arena->resource())
+                             : Document::allocator_type();
+    }
 };
 
 #endif // DOCUMENT_PARSER_H
\ No newline at end of file
@@ -0,0 +1,117 @@
+#ifndef DOCUMENT_STRUCTURE_H
+#define DOCUMENT_STRUCTURE_H
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class ElementKind : uint8_t {
+    Heading,
+    CodeBlock,
+    List,
+    ListItem,
+    BlockQuote,
+    Link,
+    Image
+};
+
+inline const char* elementKindName(ElementKind kind) {
+    switch (kind) {
+        case ElementKind::Heading: return "heading";
+        case ElementKind::CodeBlock: return "code_block";
+        case ElementKind::List: return "list";
+        case ElementKind::ListItem: return "list_item";
+        case ElementKind::BlockQuote: return "block_quote";
+        case ElementKind::Link: return "link";
+        case ElementKind::Image: return "image";
+    }
+    return "unknown";
+}
+
+// One structural element, located by offsets rather than copied out: its
+// text is a slice of the document content and its position a byte offset
+// into the parser input
+struct DocumentElement {
+    ElementKind kind = ElementKind::Heading;
+    uint8_t level = 0;            // heading level 1-6; nesting depth of lists, items and quotes
+    uint32_t attributeLength = 0;
+    size_t attributeOffset = 0;   // slice of DocumentStructure::attributes
+    size_t offset = 0;            // text: slice of Document::content
+    size_t length = 0;
+    size_t source = 0;            // where the element starts in the input
+};
+
+// Elements of a document in the order they open, so a container comes
+// before everything inside it. Attributes are kept in one shared buffer:
+// the target of a link or image, the language of a code block and the
+// start number of an ordered list. Allocator-aware like Document.
+class DocumentStructure {
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    std::pmr::vector<DocumentElement> elements;
+    std::pmr::string attributes;
+
+    DocumentStructure() = default;
+    explicit DocumentStructure(const allocator_type& alloc) : elements(alloc), attributes(alloc) {}
+
+    DocumentStructure(const DocumentStructure&) = default;
+    DocumentStructure(DocumentStructure&&) = default;
+    DocumentStructure& operator=(const DocumentStructure&) = default;
+    DocumentStructure& operator=(DocumentStructure&&) = default;
+
+    DocumentStructure(const DocumentStructure& other, const allocator_type& alloc)
+        : elements(other.elements, alloc), attributes(other.attributes, alloc) {}
+    DocumentStructure(DocumentStructure&& other, const allocator_type& alloc)
+        : elements(std::move(other.elements), alloc), attributes(std::move(other.attributes), alloc) {}
+
+    allocator_type get_allocator() const { return attributes.get_allocator(); }
+
+    bool empty() const { return elements.empty(); }
+    size_t size() const { return elements.size(); }
+
+    std::string_view attribute(const DocumentElement& element) const {
+        return std::string_view(attributes).substr(element.attributeOffset, element.attributeLength);
+    }
+
+    // Appends an element, returning its index
+    size_t add(ElementKind kind, uint8_t level, size_t offset, size_t source) {
+        DocumentElement element;
+        element.kind = kind;
+        element.level = level;
+        element.offset = offset;
+        element.source = source;
+        elements.push_back(element);
+        return elements.size() - 1;
+    }
+
+    void setAttribute(size_t index, std::string_view value) {
+        elements[index].attributeOffset = attributes.size();
+        elements[index].attributeLength = static_cast<uint32_t>(value.size());
+        attributes.append(value.data(), value.size());
+    }
+
+    // Copy of `other` allocated at its exact size
+    void assign(const DocumentStructure& other) {
+        elements.assign(other.elements.begin(), other.elements.end());
+        attributes.assign(other.attributes.data(), other.attributes.size());
+    }
+
+    void clear() {
+        elements.clear();
+        attributes.clear();
+    }
+
+    // Heap bytes held beyond sizeof(DocumentStructure), for cache budgets
+    size_t heapBytes() const {
+        size_t bytes = elements.capacity() * sizeof(DocumentElement);
+        if (attributes.capacity() > std::pmr::string().capacity()) {
+            bytes += attributes.capacity() + 1;
+        }
+        return bytes;
+    }
+};
+
+#endif // DOCUMENT_STRUCTURE_H
@@ -0,0 +1,209 @@
+#ifndef FORMAT_SNIFFER_H
+#define FORMAT_SNIFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string_view>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Content-based format detection for files whose extension is missing or
+// unknown. Only the first kHeadBytes of the file are examined, and the
+// result is the canonical extension of the detected format ("json", "xml",
+// "html", "md", "csv", "tsv", "psv", "dsv", "txt"), or an empty view for binary data.
+class FormatSniffer {
+public:
+    static constexpr size_t kHeadBytes = 4096;
+
+    // Read the head of `filename` into `buffer`; returns bytes read, 0 on error
+    static size_t readHead(const char* filename, char (&buffer)[kHeadBytes]) {
+#ifndef _WIN32
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) {
+            return 0;
+        }
+        size_t total = 0;
+        while (total < kHeadBytes) {
+            ssize_t n = ::read(fd, buffer + total, kHeadBytes - total);
+            if (n <= 0) {
+                break;
+            }
+            total += static_cast<size_t>(n);
+        }
+        ::close(fd);
+        return total;
+#else
+        std::ifstream file(filename, std::ios::binary);
+        file.read(buffer, kHeadBytes);
+        return static_cast<size_t>(file.gcount());
+#endif
+    }
+
+    // `truncated` says whether the head was cut short of the end of the file
+    static std::string_view sniff(std::string_view head, bool truncated) {
+        // UTF-16/32 text carries NULs, so route it by BOM before the binary check
+        if (startsWith(head, "\xFF\xFE") || startsWith(head, "\xFE\xFF")) {
+            return "txt";
+        }
+        if (startsWith(head, "\xEF\xBB\xBF")) {
+            head.remove_prefix(3);
+        }
+        if (std::memchr(head.data(), '\0', head.size()) != nullptr) {
+            return {};
+        }
+
+        std::string_view body = skipSpace(head);
+        if (body.empty()) {
+            return "txt";
+        }
+        if (body[0] == '{' || (body[0] == '[' && looksLikeJSONArray(body))) {
+            return "json";
+        }
+        if (body[0] == '<') {
+            return startsWithNoCase(body, "<!doctype html") || startsWithNoCase(body, "<html")
+                ? "html" : "xml";
+        }
+        if (looksLikeMarkdown(body)) {
+            return "md";
+        }
+        switch (sniffDelimiter(body, truncated)) {
+            case ',': return "csv";
+            case '\t': return "tsv";
+            case '|': return "psv";
+            case '\0': return "txt";
+            default: return "dsv";
+        }
+    }
+    
+    // The delimiter of delimited text: whichever of ',', '\t', ';' and '|'
+    // splits every line of the head into the same number of fields, the most
+    // fields winning and ties going in that order. 0 when none does. Bytes
+    // after `escape`, if given, are skipped.
+    static char sniffDelimiter(std::string_view head, bool truncated, char escape = '\0') {
+        char best = '\0';
+        size_t bestCount = 0;
+        for (char delimiter : {',', '\t', ';', '|'}) {
+            size_t count = delimitersPerLine(head, truncated, delimiter, escape);
+            if (count > bestCount) {
+                best = delimiter;
+                bestCount = count;
+            }
+        }
+        return best;
+    }
+
+private:
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    static std::string_view skipSpace(std::string_view text) {
+        size_t i = 0;
+        while (i < text.size() && isSpace(text[i])) ++i;
+        return text.substr(i);
+    }
+
+    static bool startsWith(std::string_view text, std::string_view prefix) {
+        return text.substr(0, prefix.size()) == prefix;
+    }
+
+    static bool startsWithNoCase(std::string_view text, std::string_view prefix) {
+        if (text.size() < prefix.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < prefix.size(); ++i) {
+            char c = text[i];
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+            if (c != prefix[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // "[1, 2]" or "[{" but not "[section]" or "[link](url)"
+    static bool looksLikeJSONArray(std::string_view body) {
+        std::string_view rest = skipSpace(body.substr(1));
+        if (rest.empty()) {
+            return false;
+        }
+        char c = rest[0];
+        return c == '{' || c == '[' || c == '"' || c == ']' || c == '-' ||
+               (c >= '0' && c <= '9') ||
+               startsWith(rest, "true") || startsWith(rest, "false") || startsWith(rest, "null");
+    }
+
+    // ATX headings, fences, or a setext underline near the top
+    static bool looksLikeMarkdown(std::string_view body) {
+        size_t pos = 0;
+        int lines = 0;
+        while (pos < body.size() && lines < 32) {
+            size_t end = body.find('\n', pos);
+            std::string_view line = body.substr(pos, end == std::string_view::npos ? std::string_view::npos : end - pos);
+            if (!line.empty() && line[0] == '#') {
+                size_t hashes = line.find_first_not_of('#');
+                if (hashes != std::string_view::npos && hashes <= 6 && line[hashes] == ' ') {
+                    return true;
+                }
+            }
+            if (startsWith(line, "```") || (lines > 0 && (startsWith(line, "===") || startsWith(line, "---")))) {
+                return true;
+            }
+            if (end == std::string_view::npos) {
+                break;
+            }
+            pos = end + 1;
+            ++lines;
+        }
+        return false;
+    }
+
+    // The number of `delimiter`s outside quotes on each line when at least
+    // two complete lines share the same non-zero number, otherwise 0
+    static size_t delimitersPerLine(std::string_view body, bool truncated, char delimiter, char escape) {
+        size_t expected = 0;
+        int lines = 0;
+        size_t delimiters = 0;
+        bool inQuotes = false;
+        size_t lineStart = 0;
+        for (size_t i = 0; i < body.size(); ++i) {
+            char c = body[i];
+            if (escape != '\0' && c == escape) {
+                ++i;
+            } else if (c == '"') {
+                inQuotes = !inQuotes;
+            } else if (c == delimiter && !inQuotes) {
+                ++delimiters;
+            } else if (c == '\n' && !inQuotes) {
+                bool blank = i == lineStart || (i == lineStart + 1 && body[lineStart] == '\r');
+                lineStart = i + 1;
+                if (blank) {
+                    continue;
+                }
+                if (delimiters == 0 || (lines > 0 && delimiters != expected)) {
+                    return 0;
+                }
+                expected = delimiters;
+                delimiters = 0;
+                ++lines;
+            }
+        }
+        // A final line without newline counts when the whole file was read
+        if (!truncated && !inQuotes && delimiters > 0) {
+            if (lines > 0 && delimiters != expected) {
+                return 0;
+            }
+            ++lines;
+        }
+        return lines >= 2 ? expected : 0;
+    }
+};
+
+#endif // FORMAT_SNIFFER_H
@@ -0,0 +1,974 @@
+#ifndef JSON_INDEX_H
+#define JSON_INDEX_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "csv_scanner.h"
+#include "document_arena.h"
+
+enum class JSONType {
+    Object,
+    Array,
+    String,
+    Number,
+    Bool,
+    Null,
+    Invalid
+};
+
+// Stage 1 of the JSON engine, after simdjson: a vectorized pass over
+// 64-byte blocks that finds where tokens start without interpreting them.
+// Each block yields bitmasks of quotes, backslashes, operators ({}[]:,),
+// whitespace and control bytes. A byte after an odd run of backslashes is
+// escaped; the remaining quotes give an "inside string" mask by prefix XOR.
+// Emitted are the offsets of operators outside strings, of every unescaped
+// quote (so a string's end is the offset after its start) and of the first
+// byte of each run of other bytes, i.e. numbers and literals. The backslash
+// of each escape inside a string goes to a second list, so stage 2 checks
+// escapes without searching strings for them.
+class JSONScanner {
+public:
+    static constexpr size_t kBlockSize = 64;
+
+    // Carried from one scan() to the next
+    struct State {
+        uint64_t inString = 0;  // all ones while inside a string
+        uint64_t escaped = 0;   // 1 when the next byte is escaped
+        uint64_t inScalar = 0;  // 1 when the last byte belonged to a number or literal
+    };
+
+    explicit JSONScanner(SimdLevel level = CSVScanner::detectLevel()) : simdLevel(level) {
+        switch (level) {
+#if defined(DOCPARSER_SCANNER_X86) && defined(__GNUC__)
+            case SimdLevel::AVX2: buildMasks = &masksAVX2; break;
+            case SimdLevel::SSE42: buildMasks = &masksSSE42; break;
+#endif
+#if defined(DOCPARSER_SCANNER_NEON)
+            case SimdLevel::NEON: buildMasks = &masksNEON; break;
+#endif
+            default:
+                buildMasks = &masksScalar;
+                simdLevel = SimdLevel::Scalar;
+                break;
+        }
+    }
+
+    SimdLevel level() const { return simdLevel; }
+
+    // Append to `out` the structural offsets in data[0, length) and to
+    // `escapes` those of escapes in strings, relative to `data`. Every call
+    // but the last must cover a multiple of kBlockSize. Returns the offset
+    // of the first control byte inside a string, or `length` if there is
+    // none. `length` must be below 4 GiB.
+    template <typename Offsets, typename Escapes>
+    size_t scan(const char* data, size_t length, State& state, Offsets& out, Escapes& escapes) const {
+        size_t control = length;
+        size_t offset = 0;
+        for (; offset + kBlockSize <= length; offset += kBlockSize) {
+            scanBlock(data + offset, static_cast<uint32_t>(offset), state, out, escapes, control);
+        }
+        if (offset < length) {
+            // NUL padding is masked off as past the end
+            alignas(64) char tail[kBlockSize] = {};
+            std::memcpy(tail, data + offset, length - offset);
+            scanBlock(tail, static_cast<uint32_t>(offset), state, out, escapes, control, length - offset);
+        }
+        return control;
+    }
+
+private:
+    struct BlockMasks {
+        uint64_t quotes;
+        uint64_t backslashes;
+        uint64_t operators;
+        uint64_t spaces;
+        uint64_t controls;
+    };
+
+    using MaskFn = BlockMasks (*)(const char* block);
+
+    static constexpr uint64_t kEvenBits = 0x5555555555555555ULL;
+
+    SimdLevel simdLevel;
+    MaskFn buildMasks;
+
+    template <typename Offsets, typename Escapes>
+    void scanBlock(const char* block, uint32_t base, State& state, Offsets& out, Escapes& escapes,
+                   size_t& control, size_t count = kBlockSize) const {
+        BlockMasks masks = buildMasks(block);
+        uint64_t valid = count == kBlockSize ? ~0ULL : (1ULL << count) - 1;
+
+        // Odd runs of backslashes escape the byte after them. Adding the
+        // runs that start on odd bits carries them past their end, which
+        // tells runs starting on even bits from the others.
+        uint64_t backslashes = masks.backslashes & valid & ~state.escaped;
+        uint64_t followsEscape = (backslashes << 1) | state.escaped;
+        uint64_t oddStarts = backslashes & ~kEvenBits & ~followsEscape;
+        uint64_t evenStarts = oddStarts + backslashes;
+        state.escaped = evenStarts < backslashes ? 1 : 0;
+        uint64_t escaped = (kEvenBits ^ (evenStarts << 1)) & followsEscape;
+
+        // The opening quote counts as inside, the closing one as outside
+        uint64_t quotes = masks.quotes & ~escaped & valid;
+        uint64_t inside = prefixXor(quotes) ^ state.inString;
+        state.inString = ((inside >> (count - 1)) & 1) ? ~0ULL : 0ULL;
+
+        uint64_t controls = masks.controls & inside & valid;
+        if (controls && control > base + static_cast<size_t>(trailingZeros(controls))) {
+            control = base + static_cast<size_t>(trailingZeros(controls));
+        }
+        for (uint64_t starts = masks.backslashes & ~escaped & inside & valid; starts; starts &= starts - 1) {
+            escapes.push_back(base + static_cast<uint32_t>(trailingZeros(starts)));
+        }
+
+        uint64_t operators = masks.operators & ~inside;
+        uint64_t scalars = ~(masks.operators | masks.spaces | quotes | inside) & valid;
+        uint64_t scalarStarts = scalars & ~((scalars << 1) | state.inScalar);
+        state.inScalar = (scalars >> (count - 1)) & 1;
+
+        uint64_t structurals = (operators | quotes | scalarStarts) & valid;
+        while (structurals) {
+            out.push_back(base + static_cast<uint32_t>(trailingZeros(structurals)));
+            structurals &= structurals - 1;
+        }
+    }
+
+    static int trailingZeros(uint64_t bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(bits);
+#endif
+    }
+
+    static uint64_t prefixXor(uint64_t bits) {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+
+    static BlockMasks masksScalar(const char* block) {
+        BlockMasks masks = {0, 0, 0, 0, 0};
+        for (size_t i = 0; i < kBlockSize; ++i) {
+            unsigned char c = static_cast<unsigned char>(block[i]);
+            uint64_t bit = 1ULL << i;
+            switch (c) {
+                case '"': masks.quotes |= bit; break;
+                case '\\': masks.backslashes |= bit; break;
+                case '{': case '}': case '[': case ']': case ':': case ',':
+                    masks.operators |= bit;
+                    break;
+                case ' ': masks.spaces |= bit; break;
+                case '\t': case '\n': case '\r':
+                    masks.spaces |= bit;
+                    masks.controls |= bit;
+                    break;
+                default:
+                    if (c < 0x20) {
+                        masks.controls |= bit;
+                    }
+                    break;
+            }
+        }
+        return masks;
+    }
+
+#if defined(DOCPARSER_SCANNER_X86) && defined(__GNUC__)
+    // Operators and whitespace are classified with two table lookups, by
+    // low and by high nibble, whose AND is nonzero only for those bytes:
+    // bit 0 ',', bit 1 ':', bit 2 brackets, bit 3 ' ', bit 4 '\t' '\n' '\r'
+    static constexpr uint8_t kOperatorBits = 0x07;
+    static constexpr uint8_t kSpaceBits = 0x18;
+#define DOCPARSER_JSON_LOW_NIBBLES \
+    8, 0, 0, 0, 0, 0, 0, 0, 0, 16, 18, 4, 1, 20, 0, 0
+#define DOCPARSER_JSON_HIGH_NIBBLES \
+    16, 0, 9, 2, 0, 4, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0
+
+    __attribute__((target("sse4.2")))
+    static BlockMasks masksSSE42(const char* block) {
+        const __m128i low = _mm_setr_epi8(DOCPARSER_JSON_LOW_NIBBLES);
+        const __m128i high = _mm_setr_epi8(DOCPARSER_JSON_HIGH_NIBBLES);
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        const __m128i zero = _mm_setzero_si128();
+        BlockMasks masks = {0, 0, 0, 0, 0};
+
+        for (int i = 0; i < 4; ++i) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16));
+            __m128i classes = _mm_and_si128(_mm_shuffle_epi8(low, _mm_and_si128(v, nibble)),
+                                            _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+            __m128i ops = _mm_cmpeq_epi8(_mm_and_si128(classes, _mm_set1_epi8(kOperatorBits)), zero);
+            __m128i spaces = _mm_cmpeq_epi8(_mm_and_si128(classes, _mm_set1_epi8(kSpaceBits)), zero);
+            __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v);
+            int shift = i * 16;
+            masks.quotes |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))))) << shift;
+            masks.backslashes |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))))) << shift;
+            masks.operators |= uint64_t(uint16_t(~_mm_movemask_epi8(ops))) << shift;
+            masks.spaces |= uint64_t(uint16_t(~_mm_movemask_epi8(spaces))) << shift;
+            masks.controls |= uint64_t(uint16_t(_mm_movemask_epi8(controls))) << shift;
+        }
+        return masks;
+    }
+
+    __attribute__((target("avx2")))
+    static BlockMasks masksAVX2(const char* block) {
+        const __m256i low = _mm256_setr_epi8(DOCPARSER_JSON_LOW_NIBBLES, DOCPARSER_JSON_LOW_NIBBLES);
+        const __m256i high = _mm256_setr_epi8(DOCPARSER_JSON_HIGH_NIBBLES, DOCPARSER_JSON_HIGH_NIBBLES);
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        const __m256i zero = _mm256_setzero_si256();
+        BlockMasks masks = {0, 0, 0, 0, 0};
+
+        for (int i = 0; i < 2; ++i) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i * 32));
+            __m256i classes = _mm256_and_si256(
+                _mm256_shuffle_epi8(low, _mm256_and_si256(v, nibble)),
+                _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+            __m256i ops = _mm256_cmpeq_epi8(_mm256_and_si256(classes, _mm256_set1_epi8(kOperatorBits)), zero);
+            __m256i spaces = _mm256_cmpeq_epi8(_mm256_and_si256(classes, _mm256_set1_epi8(kSpaceBits)), zero);
+            __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v);
+            int shift = i * 32;
+            masks.quotes |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))))) << shift;
+            masks.backslashes |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))))) << shift;
+            masks.operators |= uint64_t(uint32_t(~_mm256_movemask_epi8(ops))) << shift;
+            masks.spaces |= uint64_t(uint32_t(~_mm256_movemask_epi8(spaces))) << shift;
+            masks.controls |= uint64_t(uint32_t(_mm256_movemask_epi8(controls))) << shift;
+        }
+        return masks;
+    }
+#undef DOCPARSER_JSON_LOW_NIBBLES
+#undef DOCPARSER_JSON_HIGH_NIBBLES
+#endif
+
+#if defined(DOCPARSER_SCANNER_NEON)
+    static uint64_t movemaskNEON(const uint8x16_t m[4]) {
+        const uint8x16_t bits = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                                 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+        uint8x16_t s0 = vpaddq_u8(vandq_u8(m[0], bits), vandq_u8(m[1], bits));
+        uint8x16_t s1 = vpaddq_u8(vandq_u8(m[2], bits), vandq_u8(m[3], bits));
+        s0 = vpaddq_u8(s0, s1);
+        s0 = vpaddq_u8(s0, s0);
+        return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+    }
+
+    static BlockMasks masksNEON(const char* block) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(block);
+        uint8x16_t quotes[4], backslashes[4], ops[4], spaces[4], controls[4];
+        for (int i = 0; i < 4; ++i) {
+            uint8x16_t v = vld1q_u8(p + i * 16);
+            uint8x16_t folded = vorrq_u8(v, vdupq_n_u8(0x20));
+            quotes[i] = vceqq_u8(v, vdupq_n_u8('"'));
+            backslashes[i] = vceqq_u8(v, vdupq_n_u8('\\'));
+            ops[i] = vorrq_u8(vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')), vceqq_u8(folded, vdupq_n_u8('}'))),
+                              vorrq_u8(vceqq_u8(v, vdupq_n_u8(':')), vceqq_u8(v, vdupq_n_u8(','))));
+            spaces[i] = vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\t'))),
+                                 vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r'))));
+            controls[i] = vcltq_u8(v, vdupq_n_u8(0x20));
+        }
+        return {movemaskNEON(quotes), movemaskNEON(backslashes), movemaskNEON(ops),
+                movemaskNEON(spaces), movemaskNEON(controls)};
+    }
+#endif
+};
+
+// Stage 2: walks the offsets of stage 1 and checks the grammar, recording
+// every value, key and closing bracket as a token. Containers store the
+// index of the token that follows their closing bracket, so whole subtrees
+// can be skipped in O(1) without looking at their bytes again. Only numbers,
+// literals and strings with escapes are read byte by byte.
+class JSONIndex {
+public:
+    struct Token {
+        size_t start;  // offset of the first byte
+        size_t end;    // offset one past the last byte (closing bracket included)
+        size_t next;   // index of the token after this value
+    };
+
+    JSONIndex() = default;
+
+    // Throws std::runtime_error with the byte offset on malformed input. The
+    // tokens allocate from scratchResource().
+    explicit JSONIndex(std::string_view json, SimdLevel level = CSVScanner::detectLevel())
+        : text(json), tokenList(scratchResource()) {
+        build(JSONScanner(level));
+    }
+
+    std::string_view source() const { return text; }
+    const std::pmr::vector<Token>& tokens() const { return tokenList; }
+    bool empty() const { return tokenList.empty(); }
+
+private:
+    std::string_view text;
+    std::pmr::vector<Token> tokenList;
+
+    enum class Expect { Value, ValueOrClose, Key, KeyOrClose, Colon, CommaOrClose };
+
+    // Stage 1 output, scanned a window at a time just ahead of stage 2 so
+    // the offsets stay few and in cache
+    class Structurals {
+    public:
+        static constexpr size_t kWindow = 64 * 1024;
+
+        Structurals(const JSONScanner& s, std::string_view t, std::pmr::memory_resource* resource)
+            : scanner(s), text(t), offsets(resource), escapes(resource), windowEscapes(resource) {}
+
+        // The next structural offset; false at the end of the input
+        bool next(size_t& offset) {
+            if (cursor == last && !refill()) {
+                return false;
+            }
+            offset = base + *cursor++;
+            return true;
+        }
+
+        // The first control byte or unchecked escape in a string among the
+        // bytes scanned so far, SIZE_MAX when there is neither
+        size_t special() const { return std::min(firstControl, escape()); }
+
+        size_t control() const { return firstControl; }
+        size_t escape() const { return nextEscape < escapes.size() ? escapes[nextEscape] : SIZE_MAX; }
+        void skipEscape() { ++nextEscape; }
+
+    private:
+        const JSONScanner& scanner;
+        std::string_view text;
+        std::pmr::vector<uint32_t> offsets;
+        const uint32_t* cursor = nullptr;
+        const uint32_t* last = nullptr;
+        // Absolute offsets; a string can start its escapes in one window
+        // and end in the next
+        std::pmr::vector<size_t> escapes;
+        std::pmr::vector<uint32_t> windowEscapes;
+        JSONScanner::State state;
+        size_t nextEscape = 0;
+        size_t base = 0;
+        size_t scanned = 0;
+        size_t firstControl = SIZE_MAX;
+
+        bool refill() {
+            do {
+                if (scanned == text.size()) {
+                    return false;
+                }
+                size_t length = std::min(kWindow, text.size() - scanned);
+                offsets.clear();
+                windowEscapes.clear();
+                base = scanned;
+                size_t control = scanner.scan(text.data() + scanned, length, state, offsets, windowEscapes);
+                if (control < length && firstControl == SIZE_MAX) {
+                    firstControl = scanned + control;
+                }
+                if (!windowEscapes.empty()) {
+                    escapes.erase(escapes.begin(), escapes.begin() + static_cast<std::ptrdiff_t>(nextEscape));
+                    nextEscape = 0;
+                    for (uint32_t escape : windowEscapes) {
+                        escapes.push_back(base + escape);
+                    }
+                }
+                scanned += length;
+                cursor = offsets.data();
+                last = cursor + offsets.size();
+            } while (cursor == last);
+            return true;
+        }
+    };
+
+    [[noreturn]] void fail(const char* what, size_t offset) const {
+        throw std::runtime_error(std::string("Invalid JSON: ") + what + " at offset " +
+                                 std::to_string(offset));
+    }
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    // Bytes that stage 1 starts a new token at
+    static bool endsToken(char c) {
+        switch (c) {
+            case ' ': case '\t': case '\n': case '\r':
+            case '{': case '}': case '[': case ']': case ':': case ',': case '"':
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static bool isHex(char c) {
+        return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+    }
+
+    // The string opening at `pos`, whose closing quote is the next offset.
+    // Stage 1 found its control bytes and escapes; the escapes are checked
+    // here.
+    size_t closeString(Structurals& structurals, size_t pos) const {
+        size_t close;
+        if (!structurals.next(close)) {
+            fail("unterminated string", pos);
+        }
+        if (structurals.special() < close) {
+            checkSpecials(structurals, close);
+        }
+        return close + 1;
+    }
+
+    void checkSpecials(Structurals& structurals, size_t close) const {
+        if (structurals.control() < close) {
+            fail("unescaped control character in string", structurals.control());
+        }
+        for (size_t i = structurals.escape(); i < close; i = structurals.escape()) {
+            checkEscape(i, close);
+            structurals.skipEscape();
+        }
+    }
+
+    // Only the RFC 8259 escapes are accepted
+    void checkEscape(size_t i, size_t end) const {
+        switch (text[i + 1]) {
+        case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+            break;
+        case 'u':
+            if (i + 6 > end || !isHex(text[i + 2]) || !isHex(text[i + 3]) ||
+                !isHex(text[i + 4]) || !isHex(text[i + 5])) {
+                fail("invalid unicode escape", i);
+            }
+            break;
+        default:
+            fail("invalid escape", i);
+        }
+    }
+
+    // -? (0 | [1-9][0-9]*) (. [0-9]+)? ([eE] [+-]? [0-9]+)?
+    size_t skipNumber(size_t pos) const {
+        size_t i = pos;
+        if (i < text.size() && text[i] == '-') {
+            ++i;
+        }
+        if (i >= text.size() || !isDigit(text[i])) {
+            fail("invalid number", pos);
+        }
+        if (text[i] == '0') {
+            ++i;
+        } else {
+            while (i < text.size() && isDigit(text[i])) {
+                ++i;
+            }
+        }
+        if (i < text.size() && text[i] == '.') {
+            ++i;
+            if (i >= text.size() || !isDigit(text[i])) {
+                fail("invalid number", pos);
+            }
+            while (i < text.size() && isDigit(text[i])) {
+                ++i;
+            }
+        }
+        if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+            ++i;
+            if (i < text.size() && (text[i] == '+' || text[i] == '-')) {
+                ++i;
+            }
+            if (i >= text.size() || !isDigit(text[i])) {
+                fail("invalid number", pos);
+            }
+            while (i < text.size() && isDigit(text[i])) {
+                ++i;
+            }
+        }
+        // "01" or "1.2.3" would otherwise fail later as a missing separator
+        if (i < text.size() && (isDigit(text[i]) || text[i] == '.' || text[i] == 'e' ||
+                                text[i] == 'E' || text[i] == '+' || text[i] == '-')) {
+            fail("invalid number", pos);
+        }
+        return i;
+    }
+
+    size_t skipScalar(size_t pos) const {
+        char c = text[pos];
+        const char* literal = c == 't' ? "true" : c == 'f' ? "false" : c == 'n' ? "null" : nullptr;
+        if (literal) {
+            size_t length = std::strlen(literal);
+            if (text.compare(pos, length, literal) != 0) {
+                fail("invalid literal", pos);
+            }
+            return pos + length;
+        }
+
+        if (c != '-' && !isDigit(c)) {
+            fail("unexpected character", pos);
+        }
+        return skipNumber(pos);
+    }
+
+    void build(const JSONScanner& scanner) {
+        tokenList.reserve(text.size() / 8 + 1);
+        std::pmr::vector<size_t> open(tokenList.get_allocator());  // token indices of unclosed containers
+        Structurals structurals(scanner, text, tokenList.get_allocator().resource());
+        Expect expect = Expect::Value;
+        bool inObject = false;
+        bool done = false;
+
+        size_t i;
+        while (!done && structurals.next(i)) {
+            char c = text[i];
+            switch (c) {
+            case '}':
+            case ']': {
+                bool closesObject = c == '}';
+                if (open.empty() || inObject != closesObject ||
+                    (expect != Expect::CommaOrClose &&
+                     expect != (closesObject ? Expect::KeyOrClose : Expect::ValueOrClose))) {
+                    fail("unexpected closing bracket", i);
+                }
+                size_t container = open.back();
+                open.pop_back();
+                // The closing bracket gets its own token so member loops can stop on it
+                tokenList.push_back(Token{i, i + 1, tokenList.size() + 1});
+                tokenList[container].end = i + 1;
+                tokenList[container].next = tokenList.size();
+                expect = Expect::CommaOrClose;
+                done = open.empty();
+                inObject = !done && text[tokenList[open.back()].start] == '{';
+                break;
+            }
+            case ',':
+                if (expect != Expect::CommaOrClose || open.empty()) {
+                    fail("unexpected comma", i);
+                }
+                expect = inObject ? Expect::Key : Expect::Value;
+                break;
+            case ':':
+                if (expect != Expect::Colon) {
+                    fail("unexpected colon", i);
+                }
+                expect = Expect::Value;
+                break;
+            default:
+                if (expect == Expect::Key || expect == Expect::KeyOrClose) {
+                    if (c != '"') {
+                        fail("expected object key", i);
+                    }
+                    tokenList.push_back(Token{i, closeString(structurals, i), tokenList.size() + 1});
+                    expect = Expect::Colon;
+                    break;
+                }
+                if (expect != Expect::Value && expect != Expect::ValueOrClose) {
+                    fail("expected separator", i);
+                }
+                if (c == '{' || c == '[') {
+                    open.push_back(tokenList.size());
+                    tokenList.push_back(Token{i, i + 1, 0});
+                    inObject = c == '{';
+                    expect = inObject ? Expect::KeyOrClose : Expect::ValueOrClose;
+                    break;
+                }
+                size_t end;
+                if (c == '"') {
+                    end = closeString(structurals, i);
+                } else {
+                    end = skipScalar(i);
+                    // Stage 1 gives only the start of a run such as "truex"
+                    if (end < text.size() && !endsToken(text[end])) {
+                        fail("unexpected character", end);
+                    }
+                }
+                tokenList.push_back(Token{i, end, tokenList.size() + 1});
+                expect = Expect::CommaOrClose;
+                done = open.empty();
+                break;
+            }
+        }
+
+        if (done && structurals.next(i)) {
+            fail("trailing characters", i);
+        }
+        if (!open.empty()) {
+            fail("unclosed container", tokenList[open.back()].start);
+        }
+        if (tokenList.empty()) {
+            fail("empty document", 0);
+        }
+    }
+};
+
+// A cursor into the index. Nothing is decoded until asked for, so
+// looking up `a.b[3].c` touches only the tokens on the way there.
+class JSONValue {
+public:
+    JSONValue() = default;
+    JSONValue(const JSONIndex* idx, size_t tok) : index(idx), token(tok) {}
+
+    bool isValid() const { return index != nullptr; }
+
+    JSONType type() const {
+        if (!index) {
+            return JSONType::Invalid;
+        }
+        switch (firstChar()) {
+            case '{': return JSONType::Object;
+            case '[': return JSONType::Array;
+            case '"': return JSONType::String;
+            case 't':
+            case 'f': return JSONType::Bool;
+            case 'n': return JSONType::Null;
+            default: return JSONType::Number;
+        }
+    }
+
+    // Source text of the value, including quotes or brackets
+    std::string_view raw() const {
+        if (!index) {
+            return std::string_view();
+        }
+        const JSONIndex::Token& t = index->tokens()[token];
+        return index->source().substr(t.start, t.end - t.start);
+    }
+
+    // Member lookup; returns an invalid value when absent or not an object
+    JSONValue operator[](std::string_view key) const {
+        if (type() != JSONType::Object) {
+            return JSONValue();
+        }
+        const auto& tokens = index->tokens();
+        size_t i = token + 1;
+        while (index->source()[tokens[i].start] != '}') {
+            const JSONIndex::Token& k = tokens[i];
+            std::string_view name = index->source().substr(k.start + 1, k.end - k.start - 2);
+            // Keys containing escapes are compared after decoding
+            if (name == key || (name.find('\\') != std::string_view::npos && unescape(name) == key)) {
+                return JSONValue(index, i + 1);
+            }
+            i = tokens[i + 1].next;
+        }
+        return JSONValue();
+    }
+
+    // Array element; returns an invalid value when out of range
+    JSONValue operator[](size_t position) const {
+        if (type() != JSONType::Array) {
+            return JSONValue();
+        }
+        const auto& tokens = index->tokens();
+        size_t i = token + 1;
+        for (size_t n = 0; index->source()[tokens[i].start] != ']'; ++n) {
+            if (n == position) {
+                return JSONValue(index, i);
+            }
+            i = tokens[i].next;
+        }
+        return JSONValue();
+    }
+
+    // Number of members or elements of a container
+    size_t size() const {
+        JSONType t = type();
+        if (t != JSONType::Object && t != JSONType::Array) {
+            return 0;
+        }
+        const auto& tokens = index->tokens();
+        char close = t == JSONType::Object ? '}' : ']';
+        size_t count = 0;
+        for (size_t i = token + 1; index->source()[tokens[i].start] != close; ++count) {
+            i = t == JSONType::Object ? tokens[i + 1].next : tokens[i].next;
+        }
+        return count;
+    }
+
+    // Visit object members in order as (key, value)
+    template <typename Fn>
+    void forEachMember(Fn fn) const {
+        if (type() != JSONType::Object) {
+            return;
+        }
+        const auto& tokens = index->tokens();
+        for (size_t i = token + 1; index->source()[tokens[i].start] != '}'; i = tokens[i + 1].next) {
+            const JSONIndex::Token& k = tokens[i];
+            fn(unescape(index->source().substr(k.start + 1, k.end - k.start - 2)), JSONValue(index, i + 1));
+        }
+    }
+
+    template <typename Fn>
+    void forEachElement(Fn fn) const {
+        if (type() != JSONType::Array) {
+            return;
+        }
+        const auto& tokens = index->tokens();
+        for (size_t i = token + 1; index->source()[tokens[i].start] != ']'; i = tokens[i].next) {
+            fn(JSONValue(index, i));
+        }
+    }
+
+    // Resolve a path such as "a.b[3].c"; "" is the value itself
+    JSONValue at(std::string_view path) const {
+        JSONValue current = *this;
+        size_t i = 0;
+        while (i < path.size() && current.isValid()) {
+            if (path[i] == '.') {
+                ++i;
+            } else if (path[i] == '[') {
+                size_t close = path.find(']', i);
+                if (close == std::string_view::npos) {
+                    return JSONValue();
+                }
+                size_t position = 0;
+                auto result = std::from_chars(path.data() + i + 1, path.data() + close, position);
+                if (result.ec != std::errc() || result.ptr != path.data() + close) {
+                    return JSONValue();
+                }
+                current = current[position];
+                i = close + 1;
+            } else {
+                size_t end = path.find_first_of(".[", i);
+                if (end == std::string_view::npos) {
+                    end = path.size();
+                }
+                current = current[path.substr(i, end - i)];
+                i = end;
+            }
+        }
+        return current;
+    }
+
+    // Decoded string value
+    std::string asString() const {
+        std::string_view r = raw();
+        if (type() != JSONType::String) {
+            return std::string(r);
+        }
+        return unescape(r.substr(1, r.size() - 2));
+    }
+
+    double asDouble() const {
+        std::string_view r = raw();
+        double value = 0;
+        std::from_chars(r.data(), r.data() + r.size(), value);
+        return value;
+    }
+
+    int64_t asInt64() const {
+        std::string_view r = raw();
+        int64_t value = 0;
+        std::from_chars(r.data(), r.data() + r.size(), value);
+        return value;
+    }
+
+    // True when the number has no fraction or exponent
+    bool isInteger() const {
+        return type() == JSONType::Number && raw().find_first_of(".eE") == std::string_view::npos;
+    }
+
+    bool asBool() const { return firstChar() == 't'; }
+
+    // Decode JSON escapes, including \u surrogate pairs, into UTF-8
+    static std::string unescape(std::string_view s) {
+        std::string out;
+        out.reserve(s.size());
+        for (size_t i = 0; i < s.size(); ++i) {
+            char c = s[i];
+            if (c != '\\' || i + 1 >= s.size()) {
+                out += c;
+                continue;
+            }
+            char e = s[++i];
+            switch (e) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    uint32_t cp = 0;
+                    if (!readHex4(s, i + 1, cp)) {
+                        out += e;
+                        break;
+                    }
+                    i += 4;
+                    if (cp >= 0xD800 && cp <= 0xDBFF && i + 2 < s.size() &&
+                        s[i + 1] == '\\' && s[i + 2] == 'u') {
+                        uint32_t low = 0;
+                        if (readHex4(s, i + 3, low) && low >= 0xDC00 && low <= 0xDFFF) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            i += 6;
+                        }
+                    }
+                    appendUtf8(out, cp);
+                    break;
+                }
+                default: out += e; break;
+            }
+        }
+        return out;
+    }
+
+private:
+    const JSONIndex* index = nullptr;
+    size_t token = 0;
+
+    char firstChar() const {
+        return index->source()[index->tokens()[token].start];
+    }
+
+    static bool readHex4(std::string_view s, size_t pos, uint32_t& value) {
+        if (pos + 4 > s.size()) {
+            return false;
+        }
+        auto result = std::from_chars(s.data() + pos, s.data() + pos + 4, value, 16);
+        return result.ec == std::errc() && result.ptr == s.data() + pos + 4;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+};
+
+// Optional pretty-printing pass over an index, appended to `out`. The exact
+// output size is computed first so `out` grows once. When the root is an
+// array, `elements` receives the output [begin, end) of each of its elements.
+template <typename String>
+void prettyPrintJSON(const JSONIndex& index, String& out, int indentWidth = 2,
+                     std::pmr::vector<std::pair<size_t, size_t>>* elements = nullptr) {
+    const auto& tokens = index.tokens();
+    std::string_view src = index.source();
+
+    auto isClose = [&](size_t i) { char c = src[tokens[i].start]; return c == '}' || c == ']'; };
+    auto isOpen = [&](size_t i) { char c = src[tokens[i].start]; return c == '{' || c == '['; };
+
+    // Walk the tokens once to size the output, then again to write it
+    auto walk = [&](auto emit) {
+        size_t depth = 0;
+        std::pmr::vector<bool> inObject(tokens.get_allocator());
+        std::pmr::vector<bool> expectKey(tokens.get_allocator());
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            const JSONIndex::Token& t = tokens[i];
+            bool close = isClose(i);
+            bool key = !inObject.empty() && inObject.back() && expectKey.back() && !close;
+            if (depth == 1 && !inObject.front() && !close) {
+                emit.beginElement();
+            }
+
+            if (close) {
+                bool emptyContainer = i > 0 && isOpen(i - 1);
+                --depth;
+                if (!emptyContainer) {
+                    emit.newline(depth * indentWidth);
+                }
+                emit.text(src.substr(t.start, 1));
+                inObject.pop_back();
+                expectKey.pop_back();
+            } else {
+                emit.text(src.substr(t.start, isOpen(i) ? 1 : t.end - t.start));
+                if (key) {
+                    emit.text(": ");
+                    expectKey.back() = false;
+                    continue;
+                }
+                if (isOpen(i)) {
+                    ++depth;
+                    inObject.push_back(src[t.start] == '{');
+                    expectKey.push_back(true);
+                    if (!isClose(i + 1)) {
+                        emit.newline(depth * indentWidth);
+                    }
+                    continue;
+                }
+            }
+
+            // After a complete value: separator or nothing
+            if (!expectKey.empty()) {
+                expectKey.back() = true;
+            }
+            if (depth == 1 && !inObject.front()) {
+                emit.endElement();
+            }
+            if (i + 1 < tokens.size() && !isClose(i + 1)) {
+                emit.text(",");
+                emit.newline(depth * indentWidth);
+            }
+        }
+    };
+
+    struct Counter {
+        size_t& total;
+        void text(std::string_view s) { total += s.size(); }
+        void newline(size_t spaces) { total += 1 + spaces; }
+        void beginElement() {}
+        void endElement() {}
+    };
+    struct Writer {
+        String& out;
+        std::pmr::vector<std::pair<size_t, size_t>>* elements;
+        void text(std::string_view s) { out.append(s.data(), s.size()); }
+        void newline(size_t spaces) { out += '\n'; out.append(spaces, ' '); }
+        void beginElement() { if (elements) elements->emplace_back(out.size(), out.size()); }
+        void endElement() { if (elements) elements->back().second = out.size(); }
+    };
+
+    size_t total = 0;
+    walk(Counter{total});
+    out.reserve(out.size() + total);
+    walk(Writer{out, elements});
+}
+
+inline std::string prettyPrintJSON(const JSONIndex& index, int indentWidth = 2) {
+    std::string out;
+    prettyPrintJSON(index, out, indentWidth);
+    return out;
+}
+
+// Parsed JSON document: source bytes, their index and lazy access by path.
+// `owner` keeps the bytes behind `json` alive (an owned string, a mapped
+// file, ...), so documents can index input without copying it.
+class JSONDocument {
+public:
+    explicit JSONDocument(std::string json)
+        : JSONDocument(std::make_shared<const std::string>(std::move(json))) {}
+
+    JSONDocument(std::string_view json, std::shared_ptr<const void> owner)
+        : storage(std::move(owner)), index(json) {}
+
+    JSONDocument(const JSONDocument&) = delete;
+    JSONDocument& operator=(const JSONDocument&) = delete;
+
+    JSONValue root() const { return JSONValue(&index, 0); }
+    JSONValue at(std::string_view path) const { return root().at(path); }
+    std::string pretty(int indentWidth = 2) const { return prettyPrintJSON(index, indentWidth); }
+    const JSONIndex& structure() const { return index; }
+
+private:
+    std::shared_ptr<const void> storage;
+    JSONIndex index;
+
+    explicit JSONDocument(const std::shared_ptr<const std::string>& json)
+        : storage(json), index(*json) {}
+};
+
+#endif // JSON_INDEX_H
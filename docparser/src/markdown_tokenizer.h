@@ -0,0 +1,1077 @@
+#ifndef MARKDOWN_TOKENIZER_H
+#define MARKDOWN_TOKENIZER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document_arena.h"
+#include "document_structure.h"
+
+// Single-pass CommonMark-style Markdown tokenizer. Blocks are found line by
+// line with a stack of open containers (block quotes, lists, list items) and
+// one open leaf (paragraph or code block); a paragraph's inlines are tokenized
+// once it closes, into pieces that are resolved with CommonMark's delimiter
+// stack and written out in order. Nothing is re-scanned: code spans find
+// their closing backtick run through a table built up front, and failed link
+// titles are remembered so later links do not search for the quote again.
+//
+// Output is plain text: markers, fences and link targets are dropped, code
+// is kept verbatim, each block ends with a newline and blank lines are kept
+// as they were. With a DocumentStructure, every heading (ATX and setext),
+// code block, list, list item, block quote, link and image is recorded with
+// offsets into the text and the input.
+//
+// Not supported: reference links and their definitions (left as text),
+// HTML blocks and tags (kept as text), tables and other extensions.
+class MarkdownTokenizer {
+public:
+    // Appends the text of `markdown` to `text`; scratch buffers allocate
+    // from scratchResource()
+    MarkdownTokenizer(std::string_view markdown, std::pmr::string& text, DocumentStructure* structure)
+        : md(markdown), out(text), structure(structure), stack(scratchResource()),
+          paragraph(scratchResource()), lines(scratchResource()), pieces(scratchResource()),
+          delimiters(scratchResource()), brackets(scratchResource()), links(scratchResource()),
+          runs(scratchResource()), runLengths(scratchResource()) {}
+
+    void run() {
+        out.reserve(out.size() + md.size());
+        size_t begin = 0;
+        while (begin < md.size()) {
+            const void* newline = std::memchr(md.data() + begin, '\n', md.size() - begin);
+            size_t end = newline ? static_cast<const char*>(newline) - md.data() : md.size();
+            size_t next = newline ? end + 1 : end;
+            if (end > begin && md[end - 1] == '\r') {
+                --end;
+            }
+            processLine(begin, end);
+            begin = next;
+        }
+        closeLeaf();
+        closeContainers(0);
+        // Mirror the input: no newline after a last line that had none
+        if (!md.empty() && md.back() != '\n' && !out.empty() && out.back() == '\n') {
+            out.pop_back();
+            // An empty block opened on that line started after the newline
+            for (size_t i = structure ? structure->size() : 0; i > 0; --i) {
+                DocumentElement& element = structure->elements[i - 1];
+                if (element.offset <= out.size()) break;
+                element.offset = out.size();
+            }
+        }
+    }
+
+private:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    enum class Container : uint8_t { Quote, List, Item };
+    enum class Leaf : uint8_t { None, Paragraph, Fence, IndentedCode };
+
+    struct Open {
+        Container kind;
+        char marker;       // list: '-', '+', '*', or '.' / ')' after a number
+        size_t indent;     // item: columns its content is indented by
+        size_t element;    // index in structure->elements, npos without one
+        size_t quotes;     // quotes open up to and including this one
+        size_t lists;      // lists open up to and including this one
+    };
+
+    struct Cursor {
+        size_t pos;
+        size_t column;     // tabs advance to the next multiple of 4
+    };
+
+    struct ListMarker {
+        char type = 0;
+        size_t width = 0;
+        std::string_view start;  // digits of an ordered marker
+    };
+
+    // Where a line of the paragraph buffer came from
+    struct LineStart {
+        size_t text;
+        size_t source;
+    };
+
+    struct Piece {
+        enum class Type : uint8_t { Text, Code, Delimiter, LinkOpen, LinkClose };
+        Type type;
+        char marker;       // emphasis character, or '!' for an image opener
+        size_t begin;      // slice of the inline text
+        size_t length;     // delimiters: characters left unmatched
+        size_t link;       // LinkOpen/LinkClose: index in links
+    };
+
+    struct Delimiter {
+        size_t piece;
+        size_t original;
+        bool canOpen;
+        bool canClose;
+        size_t prev;
+        size_t next;
+    };
+
+    struct Bracket {
+        size_t piece;
+        size_t bottom;     // last delimiter before the bracket
+        bool image;
+    };
+
+    struct Link {
+        size_t target;
+        size_t targetLength;
+        size_t element;
+    };
+
+    std::string_view md;
+    std::pmr::string& out;
+    DocumentStructure* structure;
+
+    size_t lineEnd = 0;
+    std::pmr::vector<Open> stack;
+
+    // Where the last failed thematicBreak() scan stopped
+    struct BreakMiss {
+        size_t line = npos;  // lineEnd of the line scanned
+        size_t at = 0;
+        char marker = 0;
+    };
+    mutable BreakMiss breakMiss;
+    Leaf leaf = Leaf::None;
+    size_t leafElement = npos;
+    char fenceChar = 0;
+    size_t fenceLength = 0;
+    size_t fenceIndent = 0;
+    size_t pendingBlankLines = 0;
+
+    std::pmr::string paragraph;
+    std::pmr::vector<LineStart> lines;
+
+    // Inline state of the paragraph or heading being tokenized
+    std::pmr::vector<Piece> pieces;
+    std::pmr::vector<Delimiter> delimiters;
+    size_t firstDelimiter = npos;
+    size_t lastDelimiter = npos;
+    std::pmr::vector<Bracket> brackets;
+    size_t linkFloor = 0;  // link openers below this index are inactive
+    std::pmr::vector<Link> links;
+    std::pmr::vector<size_t> runs;        // backtick runs: start, then index of the matching run
+    std::pmr::vector<size_t> runLengths;  // last run seen of each length
+
+    static bool isSpaceOrTab(char c) { return c == ' ' || c == '\t'; }
+
+    static bool isWhitespace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    static bool isPunctuation(char c) {
+        return (c >= '!' && c <= '/') || (c >= ':' && c <= '@') || (c >= '[' && c <= '`') ||
+               (c >= '{' && c <= '~');
+    }
+
+    static bool isInlineSpecial(char c) {
+        switch (c) {
+            case '\\': case '\n': case '`': case '*': case '_':
+            case '[': case ']': case '!': case '<':
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static size_t nextColumn(char c, size_t column) {
+        return c == '\t' ? (column / 4 + 1) * 4 : column + 1;
+    }
+
+    // ---- Blocks ----
+
+    // Width of the whitespace at `c`, which is left in place
+    size_t indentOf(Cursor c) const {
+        size_t column = c.column;
+        for (size_t i = c.pos; i < lineEnd && isSpaceOrTab(md[i]); ++i) {
+            column = nextColumn(md[i], column);
+        }
+        return column - c.column;
+    }
+
+    void skipColumns(Cursor& c, size_t columns) const {
+        size_t target = c.column + columns;
+        while (c.pos < lineEnd && c.column < target && isSpaceOrTab(md[c.pos])) {
+            c.column = nextColumn(md[c.pos], c.column);
+            ++c.pos;
+        }
+    }
+
+    void skipWhitespace(Cursor& c) const {
+        while (c.pos < lineEnd && isSpaceOrTab(md[c.pos])) {
+            c.column = nextColumn(md[c.pos], c.column);
+            ++c.pos;
+        }
+    }
+
+    bool blankFrom(size_t pos) const {
+        for (size_t i = pos; i < lineEnd; ++i) {
+            if (!isSpaceOrTab(md[i])) return false;
+        }
+        return true;
+    }
+
+    // Past the '>' at `c` and one following space
+    Cursor afterQuoteMarker(Cursor c) const {
+        ++c.pos;
+        ++c.column;
+        if (c.pos < lineEnd && isSpaceOrTab(md[c.pos])) {
+            skipColumns(c, 1);
+        }
+        return c;
+    }
+
+    size_t runOf(size_t pos, char c) const {
+        size_t end = pos;
+        while (end < lineEnd && md[end] == c) ++end;
+        return end - pos;
+    }
+
+    bool thematicBreak(size_t pos) const {
+        char marker = md[pos];
+        if (marker != '-' && marker != '*' && marker != '_') return false;
+        // "- - - ... x" is tried once per nested item; any scan from before
+        // the byte that ended the last one fails there too
+        if (breakMiss.line == lineEnd && breakMiss.marker == marker && pos <= breakMiss.at) return false;
+        size_t count = 0;
+        for (size_t i = pos; i < lineEnd; ++i) {
+            if (md[i] == marker) {
+                ++count;
+            } else if (!isSpaceOrTab(md[i])) {
+                breakMiss = {lineEnd, i, marker};
+                return false;
+            }
+        }
+        return count >= 3;
+    }
+
+    // 1 for "===", 2 for "---", 0 if the line is no setext underline
+    int setextLevel(size_t pos) const {
+        char marker = md[pos];
+        if (marker != '=' && marker != '-') return 0;
+        return blankFrom(pos + runOf(pos, marker)) ? (marker == '=' ? 1 : 2) : 0;
+    }
+
+    int atxLevel(size_t pos) const {
+        size_t count = runOf(pos, '#');
+        if (count == 0 || count > 6) return 0;
+        size_t after = pos + count;
+        return after == lineEnd || isSpaceOrTab(md[after]) ? static_cast<int>(count) : 0;
+    }
+
+    size_t fenceAt(size_t pos) const {
+        char marker = md[pos];
+        if (marker != '`' && marker != '~') return 0;
+        size_t count = runOf(pos, marker);
+        if (count < 3) return 0;
+        if (marker == '`' && std::memchr(md.data() + pos + count, '`', lineEnd - pos - count)) return 0;
+        return count;
+    }
+
+    bool listMarkerAt(size_t pos, ListMarker& marker) const {
+        char c = md[pos];
+        size_t after;
+        if (c == '-' || c == '+' || c == '*') {
+            marker.type = c;
+            after = pos + 1;
+        } else {
+            size_t digits = 0;
+            while (pos + digits < lineEnd && digits < 10 && md[pos + digits] >= '0' && md[pos + digits] <= '9') {
+                ++digits;
+            }
+            after = pos + digits;
+            if (digits == 0 || digits > 9 || after == lineEnd || (md[after] != '.' && md[after] != ')')) {
+                return false;
+            }
+            marker.type = md[after];
+            marker.start = md.substr(pos, digits);
+            ++after;
+        }
+        if (after < lineEnd && !isSpaceOrTab(md[after])) return false;
+        marker.width = after - pos;
+        return true;
+    }
+
+    // A list item may start inside a paragraph only with content, and an
+    // ordered one only at 1
+    bool interruptsParagraph(size_t pos, const ListMarker& marker) const {
+        if (blankFrom(pos + marker.width)) return false;
+        return marker.start.empty() || marker.start == "1";
+    }
+
+    // Whether a line that left containers from `matched` on unmatched still
+    // continues the open paragraph
+    bool lazyContinuation(Cursor c, size_t matched) const {
+        if (blankFrom(c.pos)) return false;
+        if (indentOf(c) >= 4) return true;
+        Cursor t = c;
+        skipWhitespace(t);
+        size_t p = t.pos;
+        ListMarker marker;
+        if (listMarkerAt(p, marker)) {
+            // The next item of the list whose item ended is no interruption
+            bool sibling = stack[matched].kind == Container::Item && stack[matched - 1].marker == marker.type;
+            if (sibling || interruptsParagraph(p, marker)) return false;
+        }
+        return md[p] != '>' && !thematicBreak(p) && !atxLevel(p) && !fenceAt(p);
+    }
+
+    // Each entry carries the depth below it, so nesting a thousand markers
+    // on one line stays linear
+    void push(Container kind, char marker, size_t indent, size_t element) {
+        size_t quotes = depthOf(Container::Quote) + (kind == Container::Quote);
+        size_t lists = depthOf(Container::List) + (kind == Container::List);
+        stack.push_back(Open{kind, marker, indent, element, quotes, lists});
+    }
+
+    size_t depthOf(Container kind) const {
+        if (stack.empty()) return 0;
+        return kind == Container::Quote ? stack.back().quotes : stack.back().lists;
+    }
+
+    size_t addElement(ElementKind kind, size_t level, size_t source) {
+        if (!structure) return npos;
+        return structure->add(kind, static_cast<uint8_t>(level > 255 ? 255 : level), out.size(), source);
+    }
+
+    // The element's text runs to here, less trailing newlines
+    void finishElement(size_t index) {
+        if (index == npos) return;
+        DocumentElement& element = structure->elements[index];
+        size_t end = out.size();
+        while (end > element.offset && out[end - 1] == '\n') --end;
+        element.length = end - element.offset;
+    }
+
+    void processLine(size_t begin, size_t end) {
+        lineEnd = end;
+        Cursor c{begin, 0};
+        size_t matched = 0;
+        while (matched < stack.size()) {
+            const Open& open = stack[matched];
+            if (open.kind == Container::Quote) {
+                if (indentOf(c) > 3) break;
+                Cursor t = c;
+                skipWhitespace(t);
+                if (t.pos == lineEnd || md[t.pos] != '>') break;
+                c = afterQuoteMarker(t);
+            } else if (open.kind == Container::Item && !blankFrom(c.pos)) {
+                if (indentOf(c) < open.indent) break;
+                skipColumns(c, open.indent);
+            }
+            ++matched;
+        }
+
+        bool all = matched == stack.size();
+        if (leaf == Leaf::Fence) {
+            if (all) {
+                fenceLine(c);
+                return;
+            }
+            closeLeaf();
+        } else if (leaf == Leaf::IndentedCode && all) {
+            if (blankFrom(c.pos)) {
+                ++pendingBlankLines;
+                return;
+            }
+            if (indentOf(c) >= 4) {
+                out.append(pendingBlankLines, '\n');
+                pendingBlankLines = 0;
+                skipColumns(c, 4);
+                appendLine(c.pos);
+                return;
+            }
+            closeLeaf();
+        }
+        if (!all && leaf == Leaf::Paragraph && lazyContinuation(c, matched)) {
+            addParagraphLine(c);
+            return;
+        }
+        closeContainers(matched);
+        openBlocks(c);
+    }
+
+    void openBlocks(Cursor c) {
+        while (true) {
+            if (blankFrom(c.pos)) {
+                closeLeaf();
+                out += '\n';
+                return;
+            }
+            if (indentOf(c) >= 4) {
+                if (leaf == Leaf::Paragraph) {
+                    addParagraphLine(c);
+                    return;
+                }
+                closeLeaf();
+                closeBareList();
+                skipColumns(c, 4);
+                leaf = Leaf::IndentedCode;
+                leafElement = addElement(ElementKind::CodeBlock, 0, c.pos);
+                appendLine(c.pos);
+                return;
+            }
+
+            Cursor t = c;
+            skipWhitespace(t);
+            size_t p = t.pos;
+            if (md[p] == '>') {
+                closeLeaf();
+                closeBareList();
+                push(Container::Quote, '>', 0, npos);
+                stack.back().element = addElement(ElementKind::BlockQuote, depthOf(Container::Quote), p);
+                c = afterQuoteMarker(t);
+                continue;
+            }
+            if (leaf == Leaf::Paragraph) {
+                if (int level = setextLevel(p)) {
+                    closeParagraph(level);
+                    return;
+                }
+            }
+            if (thematicBreak(p)) {
+                closeLeaf();
+                closeBareList();
+                return;
+            }
+            if (int level = atxLevel(p)) {
+                closeLeaf();
+                closeBareList();
+                heading(p, level);
+                return;
+            }
+            if (size_t length = fenceAt(p)) {
+                closeLeaf();
+                closeBareList();
+                openFence(p, length, t.column - c.column);
+                return;
+            }
+            ListMarker marker;
+            if (listMarkerAt(p, marker) && (leaf != Leaf::Paragraph || interruptsParagraph(p, marker))) {
+                closeLeaf();
+                c = openItem(c, t, marker);
+                continue;
+            }
+
+            closeBareList();
+            if (leaf != Leaf::Paragraph) {
+                closeLeaf();
+                leaf = Leaf::Paragraph;
+                paragraph.clear();
+                lines.clear();
+            }
+            addParagraphLine(c);
+            return;
+        }
+    }
+
+    // Opens a list item at `t`, and its list unless it continues the one
+    // on top; returns the start of the item's content
+    Cursor openItem(Cursor c, Cursor t, const ListMarker& marker) {
+        if (!stack.empty() && stack.back().kind == Container::List && stack.back().marker != marker.type) {
+            closeTop();
+        }
+        if (stack.empty() || stack.back().kind != Container::List) {
+            push(Container::List, marker.type, 0, npos);
+            size_t list = addElement(ElementKind::List, depthOf(Container::List), t.pos);
+            if (list != npos && !marker.start.empty()) {
+                structure->setAttribute(list, marker.start);
+            }
+            stack.back().element = list;
+        }
+        size_t depth = depthOf(Container::List);
+        size_t item = addElement(ElementKind::ListItem, depth, t.pos);
+
+        Cursor content = t;
+        content.pos += marker.width;
+        content.column += marker.width;
+        size_t indent;
+        if (blankFrom(content.pos)) {
+            indent = content.column - c.column + 1;
+            content.pos = lineEnd;
+        } else if (indentOf(content) >= 5) {
+            // The content is an indented code block, one space in
+            indent = content.column - c.column + 1;
+            skipColumns(content, 1);
+        } else {
+            skipWhitespace(content);
+            indent = content.column - c.column;
+        }
+        push(Container::Item, marker.type, indent, item);
+        return content;
+    }
+
+    void closeTop() {
+        finishElement(stack.back().element);
+        stack.pop_back();
+    }
+
+    // A list whose last item just ended, when the line starts no new item
+    void closeBareList() {
+        if (!stack.empty() && stack.back().kind == Container::List) {
+            closeTop();
+        }
+    }
+
+    void closeContainers(size_t keep) {
+        if (stack.size() > keep) {
+            closeLeaf();
+        }
+        while (stack.size() > keep) {
+            closeTop();
+        }
+    }
+
+    void closeLeaf() {
+        switch (leaf) {
+            case Leaf::Paragraph:
+                closeParagraph(0);
+                return;
+            case Leaf::Fence:
+                finishElement(leafElement);
+                break;
+            case Leaf::IndentedCode:
+                finishElement(leafElement);
+                out.append(pendingBlankLines, '\n');
+                pendingBlankLines = 0;
+                break;
+            case Leaf::None:
+                return;
+        }
+        leaf = Leaf::None;
+    }
+
+    void appendLine(size_t pos) {
+        out.append(md.data() + pos, lineEnd - pos);
+        out += '\n';
+    }
+
+    void addParagraphLine(Cursor c) {
+        skipWhitespace(c);
+        if (!lines.empty()) {
+            paragraph += '\n';
+        }
+        lines.push_back(LineStart{paragraph.size(), c.pos});
+        paragraph.append(md.data() + c.pos, lineEnd - c.pos);
+    }
+
+    // Writes out the paragraph, as a heading of `level` if not 0
+    void closeParagraph(int level) {
+        leaf = Leaf::None;
+        size_t element = level ? addElement(ElementKind::Heading, level, lines.front().source) : npos;
+        inlines(paragraph);
+        finishElement(element);
+        out += '\n';
+    }
+
+    void heading(size_t pos, int level) {
+        Cursor c{pos + level, 0};
+        skipWhitespace(c);
+        size_t begin = c.pos;
+        size_t end = lineEnd;
+        while (end > begin && isSpaceOrTab(md[end - 1])) --end;
+        // Optional closing sequence of '#'s
+        size_t hashes = end;
+        while (hashes > begin && md[hashes - 1] == '#') --hashes;
+        if (hashes == begin) {
+            end = begin;
+        } else if (hashes < end && isSpaceOrTab(md[hashes - 1])) {
+            end = hashes;
+            while (end > begin && isSpaceOrTab(md[end - 1])) --end;
+        }
+
+        size_t element = addElement(ElementKind::Heading, level, pos);
+        lines.clear();
+        lines.push_back(LineStart{0, begin});
+        inlines(md.substr(begin, end - begin));
+        finishElement(element);
+        out += '\n';
+    }
+
+    void openFence(size_t pos, size_t length, size_t indent) {
+        leaf = Leaf::Fence;
+        fenceChar = md[pos];
+        fenceLength = length;
+        fenceIndent = indent;
+        leafElement = addElement(ElementKind::CodeBlock, 0, pos);
+        Cursor info{pos + length, 0};
+        skipWhitespace(info);
+        size_t end = info.pos;
+        while (end < lineEnd && !isSpaceOrTab(md[end])) ++end;
+        if (leafElement != npos && end > info.pos) {
+            structure->setAttribute(leafElement, md.substr(info.pos, end - info.pos));
+        }
+    }
+
+    void fenceLine(Cursor c) {
+        Cursor t = c;
+        if (indentOf(t) <= 3) {
+            skipWhitespace(t);
+            size_t length = t.pos < lineEnd && md[t.pos] == fenceChar ? runOf(t.pos, fenceChar) : 0;
+            if (length >= fenceLength && blankFrom(t.pos + length)) {
+                closeLeaf();
+                return;
+            }
+        }
+        skipColumns(c, fenceIndent);
+        appendLine(c.pos);
+    }
+
+    // ---- Inlines ----
+
+    void pushPiece(Piece::Type type, char marker, size_t begin, size_t length) {
+        pieces.push_back(Piece{type, marker, begin, length, npos});
+    }
+
+    void pushDelimiter(size_t piece, size_t length, bool canOpen, bool canClose) {
+        delimiters.push_back(Delimiter{piece, length, canOpen, canClose, lastDelimiter, npos});
+        size_t index = delimiters.size() - 1;
+        if (lastDelimiter != npos) {
+            delimiters[lastDelimiter].next = index;
+        } else {
+            firstDelimiter = index;
+        }
+        lastDelimiter = index;
+    }
+
+    void unlink(size_t index) {
+        const Delimiter& d = delimiters[index];
+        if (d.prev != npos) {
+            delimiters[d.prev].next = d.next;
+        } else {
+            firstDelimiter = d.next;
+        }
+        if (d.next != npos) {
+            delimiters[d.next].prev = d.prev;
+        } else {
+            lastDelimiter = d.prev;
+        }
+    }
+
+    char markerOf(size_t delimiter) const { return pieces[delimiters[delimiter].piece].marker; }
+    size_t& leftOf(size_t delimiter) { return pieces[delimiters[delimiter].piece].length; }
+
+    // CommonMark's process_emphasis over the delimiters after `bottom`:
+    // matched characters are taken off the runs, then those delimiters are
+    // dropped from the stack
+    void processEmphasis(size_t bottom) {
+        size_t openersBottom[2][3][2];
+        for (auto& byLength : openersBottom) {
+            for (auto& byOpen : byLength) {
+                byOpen[0] = byOpen[1] = bottom;
+            }
+        }
+        size_t closer = bottom == npos ? firstDelimiter : delimiters[bottom].next;
+        while (closer != npos) {
+            const Delimiter& d = delimiters[closer];
+            if (!d.canClose) {
+                closer = d.next;
+                continue;
+            }
+            char c = markerOf(closer);
+            size_t& openerBottom = openersBottom[c == '*' ? 0 : 1][d.original % 3][d.canOpen ? 1 : 0];
+            size_t opener = d.prev;
+            bool found = false;
+            while (opener != npos && opener != bottom && opener != openerBottom) {
+                const Delimiter& o = delimiters[opener];
+                if (markerOf(opener) == c && o.canOpen) {
+                    bool multipleOfThree = (o.canClose || d.canOpen) && (o.original + d.original) % 3 == 0 &&
+                                           !(o.original % 3 == 0 && d.original % 3 == 0);
+                    if (!multipleOfThree) {
+                        found = true;
+                        break;
+                    }
+                }
+                opener = o.prev;
+            }
+
+            if (!found) {
+                openerBottom = d.prev;
+                size_t next = d.next;
+                if (!d.canOpen) {
+                    unlink(closer);
+                }
+                closer = next;
+                continue;
+            }
+            size_t used = leftOf(opener) >= 2 && leftOf(closer) >= 2 ? 2 : 1;
+            leftOf(opener) -= used;
+            leftOf(closer) -= used;
+            delimiters[opener].next = closer;
+            delimiters[closer].prev = opener;
+            if (leftOf(opener) == 0) {
+                unlink(opener);
+            }
+            if (leftOf(closer) == 0) {
+                size_t next = delimiters[closer].next;
+                unlink(closer);
+                closer = next;
+            }
+        }
+        if (bottom == npos) {
+            firstDelimiter = lastDelimiter = npos;
+        } else {
+            delimiters[bottom].next = npos;
+            lastDelimiter = bottom;
+        }
+    }
+
+    // Backtick runs of `text`, each paired with the next run of the same
+    // length, which is where a code span opened by it closes
+    void indexBacktickRuns(std::string_view text) {
+        runs.clear();
+        for (size_t i = 0; i < text.size();) {
+            const void* hit = std::memchr(text.data() + i, '`', text.size() - i);
+            if (!hit) break;
+            size_t start = static_cast<const char*>(hit) - text.data();
+            size_t end = start;
+            while (end < text.size() && text[end] == '`') ++end;
+            runs.push_back(start);
+            runs.push_back(end - start);
+            i = end;
+        }
+        // runs holds (start, length) pairs; replace each length by the
+        // index of the matching run, walking back from the end
+        runLengths.clear();
+        for (size_t r = runs.size(); r > 0; r -= 2) {
+            size_t length = runs[r - 1];
+            if (runLengths.size() <= length) {
+                runLengths.resize(length + 1, npos);
+            }
+            runs[r - 1] = runLengths[length];
+            runLengths[length] = r - 2;
+        }
+    }
+
+    // Skips spaces and at most one line ending
+    static size_t skipLinkSpace(std::string_view text, size_t i) {
+        while (i < text.size() && isSpaceOrTab(text[i])) ++i;
+        if (i < text.size() && text[i] == '\n') ++i;
+        while (i < text.size() && isSpaceOrTab(text[i])) ++i;
+        return i;
+    }
+
+    // Parses "(destination "title")" after the ']' of an inline link, from
+    // the character after '('. `unterminated` holds, per quote character,
+    // where a title was already found to have no end.
+    bool inlineLink(std::string_view text, size_t i, size_t unterminated[3], Link& link, size_t& end) const {
+        i = skipLinkSpace(text, i);
+        if (i < text.size() && text[i] == '<') {
+            size_t k = i + 1;
+            while (k < text.size() && text[k] != '>') {
+                if (text[k] == '\n' || text[k] == '<') return false;
+                k += text[k] == '\\' && k + 1 < text.size() ? 2 : 1;
+            }
+            if (k >= text.size()) return false;
+            link.target = i + 1;
+            link.targetLength = k - i - 1;
+            i = k + 1;
+        } else {
+            size_t depth = 0;
+            size_t k = i;
+            while (k < text.size()) {
+                char c = text[k];
+                if (c == '\\' && k + 1 < text.size() && isPunctuation(text[k + 1])) {
+                    k += 2;
+                    continue;
+                }
+                if (static_cast<unsigned char>(c) <= ' ') break;
+                if (c == '(') {
+                    if (++depth > 32) return false;
+                } else if (c == ')') {
+                    if (depth == 0) break;
+                    --depth;
+                }
+                ++k;
+            }
+            if (depth != 0) return false;
+            link.target = i;
+            link.targetLength = k - i;
+            i = k;
+        }
+
+        size_t beforeTitle = i;
+        i = skipLinkSpace(text, i);
+        if (i > beforeTitle && i < text.size() && (text[i] == '"' || text[i] == '\'' || text[i] == '(')) {
+            char open = text[i];
+            char close = open == '(' ? ')' : open;
+            size_t kind = open == '"' ? 0 : open == '\'' ? 1 : 2;
+            if (i >= unterminated[kind]) return false;
+            size_t k = i + 1;
+            while (k < text.size() && text[k] != close) {
+                if (open == '(' && text[k] == '(') return false;
+                k += text[k] == '\\' && k + 1 < text.size() ? 2 : 1;
+            }
+            if (k >= text.size()) {
+                unterminated[kind] = i;
+                return false;
+            }
+            i = skipLinkSpace(text, k + 1);
+        }
+        if (i >= text.size() || text[i] != ')') return false;
+        end = i + 1;
+        return true;
+    }
+
+    // Length of the "<scheme:...>" autolink at `i`, 0 if there is none
+    static size_t autolinkAt(std::string_view text, size_t i) {
+        size_t k = i + 1;
+        size_t scheme = 0;
+        while (k < text.size() && scheme <= 32 &&
+               ((text[k] >= 'a' && text[k] <= 'z') || (text[k] >= 'A' && text[k] <= 'Z') ||
+                (scheme > 0 && ((text[k] >= '0' && text[k] <= '9') || text[k] == '+' || text[k] == '.' ||
+                                text[k] == '-')))) {
+            ++k;
+            ++scheme;
+        }
+        if (scheme < 2 || scheme > 32 || k >= text.size() || text[k] != ':') return 0;
+        while (k < text.size() && static_cast<unsigned char>(text[k]) > ' ' && text[k] != '<' && text[k] != '>') {
+            ++k;
+        }
+        return k < text.size() && text[k] == '>' ? k + 1 - i : 0;
+    }
+
+    // Tokenizes one paragraph or heading, whose lines are in `lines`, and
+    // writes its text
+    void inlines(std::string_view text) {
+        pieces.clear();
+        delimiters.clear();
+        brackets.clear();
+        links.clear();
+        firstDelimiter = lastDelimiter = npos;
+        linkFloor = 0;
+        indexBacktickRuns(text);
+        size_t nextRun = 0;
+        size_t unterminated[3] = {npos, npos, npos};
+
+        size_t textStart = 0;
+        auto flushText = [&](size_t end) {
+            if (end > textStart) {
+                pushPiece(Piece::Type::Text, 0, textStart, end - textStart);
+            }
+        };
+
+        size_t i = 0;
+        while (i < text.size()) {
+            char c = text[i];
+            if (!isInlineSpecial(c)) {
+                ++i;
+                continue;
+            }
+            switch (c) {
+                case '\\':
+                    if (i + 1 < text.size() && (isPunctuation(text[i + 1]) || text[i + 1] == '\n')) {
+                        // An escaped character, or a hard line break
+                        flushText(i);
+                        pushPiece(Piece::Type::Text, 0, i + 1, 1);
+                        i += 2;
+                        textStart = i;
+                    } else {
+                        ++i;
+                    }
+                    break;
+                case '\n': {
+                    size_t end = i;
+                    while (end > textStart && isSpaceOrTab(text[end - 1])) --end;
+                    flushText(end);
+                    pushPiece(Piece::Type::Text, 0, i, 1);
+                    textStart = ++i;
+                    break;
+                }
+                case '`': {
+                    while (nextRun < runs.size() && runs[nextRun] < i) nextRun += 2;
+                    if (nextRun >= runs.size() || runs[nextRun] != i) {
+                        ++i;  // rest of a run whose first backtick was escaped
+                        break;
+                    }
+                    size_t width = 0;
+                    while (i + width < text.size() && text[i + width] == '`') ++width;
+                    size_t close = runs[nextRun + 1];
+                    if (close == npos) {
+                        // No closing run: the backticks are literal
+                        i += width;
+                        nextRun += 2;
+                        break;
+                    }
+                    size_t begin = i + width;
+                    size_t end = runs[close];
+                    // One space is stripped from each side of padded content
+                    if (end - begin >= 2 && (text[begin] == ' ' || text[begin] == '\n') &&
+                        (text[end - 1] == ' ' || text[end - 1] == '\n')) {
+                        bool allSpace = true;
+                        for (size_t k = begin; k < end && allSpace; ++k) {
+                            allSpace = text[k] == ' ' || text[k] == '\n';
+                        }
+                        if (!allSpace) {
+                            ++begin;
+                            --end;
+                        }
+                    }
+                    flushText(i);
+                    pushPiece(Piece::Type::Code, 0, begin, end - begin);
+                    i = runs[close] + width;
+                    textStart = i;
+                    nextRun = close + 2;
+                    break;
+                }
+                case '*':
+                case '_': {
+                    size_t end = i;
+                    while (end < text.size() && text[end] == c) ++end;
+                    char before = i > 0 ? text[i - 1] : '\n';
+                    char after = end < text.size() ? text[end] : '\n';
+                    bool beforeSpace = isWhitespace(before);
+                    bool afterSpace = isWhitespace(after);
+                    bool beforePunct = isPunctuation(before);
+                    bool afterPunct = isPunctuation(after);
+                    bool left = !afterSpace && (!afterPunct || beforeSpace || beforePunct);
+                    bool right = !beforeSpace && (!beforePunct || afterSpace || afterPunct);
+                    bool canOpen = c == '*' ? left : left && (!right || beforePunct);
+                    bool canClose = c == '*' ? right : right && (!left || afterPunct);
+                    flushText(i);
+                    pushPiece(Piece::Type::Delimiter, c, i, end - i);
+                    if (canOpen || canClose) {
+                        pushDelimiter(pieces.size() - 1, end - i, canOpen, canClose);
+                    }
+                    i = end;
+                    textStart = i;
+                    break;
+                }
+                case '!':
+                    if (i + 1 < text.size() && text[i + 1] == '[') {
+                        flushText(i);
+                        pushPiece(Piece::Type::Text, '!', i, 2);
+                        brackets.push_back(Bracket{pieces.size() - 1, lastDelimiter, true});
+                        i += 2;
+                        textStart = i;
+                    } else {
+                        ++i;
+                    }
+                    break;
+                case '[':
+                    flushText(i);
+                    pushPiece(Piece::Type::Text, 0, i, 1);
+                    brackets.push_back(Bracket{pieces.size() - 1, lastDelimiter, false});
+                    textStart = ++i;
+                    break;
+                case ']': {
+                    if (brackets.empty()) {
+                        ++i;
+                        break;
+                    }
+                    Bracket opener = brackets.back();
+                    brackets.pop_back();
+                    bool active = opener.image || brackets.size() >= linkFloor;
+                    linkFloor = std::min(linkFloor, brackets.size());
+                    Link link{0, 0, npos};
+                    size_t end = 0;
+                    if (!active || i + 1 >= text.size() || text[i + 1] != '(' ||
+                        !inlineLink(text, i + 2, unterminated, link, end)) {
+                        ++i;
+                        break;
+                    }
+                    flushText(i);
+                    pieces[opener.piece].type = Piece::Type::LinkOpen;
+                    pieces[opener.piece].link = links.size();
+                    pushPiece(Piece::Type::LinkClose, 0, i, 0);
+                    pieces.back().link = links.size();
+                    links.push_back(link);
+                    processEmphasis(opener.bottom);
+                    if (!opener.image) {
+                        // No links inside links
+                        linkFloor = brackets.size();
+                    }
+                    i = end;
+                    textStart = i;
+                    break;
+                }
+                case '<': {
+                    size_t length = autolinkAt(text, i);
+                    if (length == 0) {
+                        ++i;
+                        break;
+                    }
+                    flushText(i);
+                    pushPiece(Piece::Type::LinkOpen, 0, i, 0);
+                    pieces.back().link = links.size();
+                    links.push_back(Link{i + 1, length - 2, npos});
+                    pushPiece(Piece::Type::Text, 0, i + 1, length - 2);
+                    pushPiece(Piece::Type::LinkClose, 0, i + length - 1, 0);
+                    pieces.back().link = links.size() - 1;
+                    i += length;
+                    textStart = i;
+                    break;
+                }
+            }
+        }
+        size_t end = text.size();
+        while (end > textStart && isSpaceOrTab(text[end - 1])) --end;
+        flushText(end);
+        processEmphasis(npos);
+        emitPieces(text);
+    }
+
+    void emitPieces(std::string_view text) {
+        size_t line = 0;
+        auto sourceOf = [&](size_t at) {
+            while (line + 1 < lines.size() && lines[line + 1].text <= at) ++line;
+            return lines[line].source + (at - lines[line].text);
+        };
+
+        for (const Piece& piece : pieces) {
+            switch (piece.type) {
+                case Piece::Type::Text:
+                    out.append(text.data() + piece.begin, piece.length);
+                    break;
+                case Piece::Type::Code: {
+                    size_t at = out.size();
+                    out.append(text.data() + piece.begin, piece.length);
+                    std::replace(out.begin() + at, out.end(), '\n', ' ');
+                    break;
+                }
+                case Piece::Type::Delimiter:
+                    out.append(piece.length, piece.marker);
+                    break;
+                case Piece::Type::LinkOpen: {
+                    if (!structure) break;
+                    Link& link = links[piece.link];
+                    ElementKind kind = piece.marker == '!' ? ElementKind::Image : ElementKind::Link;
+                    link.element = addElement(kind, 0, sourceOf(piece.begin));
+                    appendUnescaped(link.element, text.substr(link.target, link.targetLength));
+                    break;
+                }
+                case Piece::Type::LinkClose:
+                    if (structure) {
+                        finishElement(links[piece.link].element);
+                    }
+                    break;
+            }
+        }
+    }
+
+    // Sets the element's attribute to `value` less backslash escapes
+    void appendUnescaped(size_t element, std::string_view value) {
+        std::pmr::string& attributes = structure->attributes;
+        size_t start = attributes.size();
+        for (size_t i = 0; i < value.size(); ++i) {
+            if (value[i] == '\\' && i + 1 < value.size() && isPunctuation(value[i + 1])) {
+                ++i;
+            }
+            attributes += value[i];
+        }
+        DocumentElement& target = structure->elements[element];
+        target.attributeOffset = start;
+        target.attributeLength = static_cast<uint32_t>(attributes.size() - start);
+    }
+};
+
+#endif // MARKDOWN_TOKENIZER_H
@@ -0,0 +1,366 @@
+#ifndef PARSE_STATS_H
+#define PARSE_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Optional per-parse instrumentation. Built with DOCPARSER_ENABLE_STATS
+// (CMake option of the same name) the parse path records stage timings,
+// bytes, allocations and peak buffer size per document and folds them into
+// lock-free per-parser counters and histograms. Without it the macros below
+// expand to nothing and the stats accessors return empty results.
+
+#ifdef DOCPARSER_ENABLE_STATS
+constexpr bool kStatsEnabled = true;
+#else
+constexpr bool kStatsEnabled = false;
+#endif
+
+enum class ParseStage { Read, Detect, Parse, PostProcess };
+constexpr size_t kParseStageCount = 4;
+
+inline const char* parseStageName(ParseStage stage) {
+    switch (stage) {
+        case ParseStage::Read: return "read";
+        case ParseStage::Detect: return "detect";
+        case ParseStage::Parse: return "parse";
+        case ParseStage::PostProcess: return "post_process";
+    }
+    return "unknown";
+}
+
+// Allocations made on this thread, as reported by noteAllocation(). The
+// library never replaces operator new itself; see DOCPARSER_DEFINE_COUNTING_NEW.
+struct AllocationCounter {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t largest = 0;
+};
+
+inline AllocationCounter& threadAllocations() {
+    static thread_local AllocationCounter counter;
+    return counter;
+}
+
+// Call from a custom operator new (or allocator) to feed the allocation stats
+inline void noteAllocation(size_t bytes) {
+    AllocationCounter& counter = threadAllocations();
+    ++counter.count;
+    counter.bytes += bytes;
+    counter.largest = std::max<uint64_t>(counter.largest, bytes);
+}
+
+// What one parse cost
+struct DocumentStats {
+    std::string filename;
+    std::string parser;
+    bool ok = false;
+    uint64_t bytes = 0;                                   // input bytes
+    std::array<uint64_t, kParseStageCount> stageNanos{};  // indexed by ParseStage
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    uint64_t peakBufferBytes = 0;  // largest single buffer: input, output or allocation
+};
+
+// The parse running on this thread. Stage timers and byte counts report to
+// the innermost active trace; with none active they do nothing.
+class ParseTrace {
+public:
+    ParseTrace() : previous(current()) {
+        AllocationCounter& counter = threadAllocations();
+        startCount = counter.count;
+        startBytes = counter.bytes;
+        outerLargest = counter.largest;
+        counter.largest = 0;
+        current() = this;
+    }
+
+    ~ParseTrace() {
+        AllocationCounter& counter = threadAllocations();
+        counter.largest = std::max(outerLargest, counter.largest);
+        current() = previous;
+    }
+
+    ParseTrace(const ParseTrace&) = delete;
+    ParseTrace& operator=(const ParseTrace&) = delete;
+
+    static ParseTrace* active() { return current(); }
+
+    void addStage(ParseStage stage, uint64_t nanos) { stats.stageNanos[static_cast<size_t>(stage)] += nanos; }
+    // Time of the stages timed so far inside the current stage timer
+    uint64_t& enclosedNanos() { return enclosed; }
+    void addBytes(uint64_t bytes) { stats.bytes += bytes; }
+    void noteBuffer(uint64_t bytes) { stats.peakBufferBytes = std::max(stats.peakBufferBytes, bytes); }
+
+    // Close the books on this parse
+    DocumentStats& finish(bool ok) {
+        const AllocationCounter& counter = threadAllocations();
+        stats.ok = ok;
+        stats.allocations = counter.count - startCount;
+        stats.allocatedBytes = counter.bytes - startBytes;
+        stats.peakBufferBytes = std::max(stats.peakBufferBytes, counter.largest);
+        return stats;
+    }
+
+private:
+    DocumentStats stats;
+    ParseTrace* previous;
+    uint64_t startCount = 0;
+    uint64_t startBytes = 0;
+    uint64_t outerLargest = 0;
+    uint64_t enclosed = 0;
+
+    static ParseTrace*& current() {
+        static thread_local ParseTrace* trace = nullptr;
+        return trace;
+    }
+};
+
+// Adds the lifetime of the scope to one stage of the active trace. Time
+// spent in timers nested inside it (a read inside a parse) is counted only
+// for the inner stage.
+class StageTimer {
+public:
+    explicit StageTimer(ParseStage s) : trace(ParseTrace::active()), stage(s) {
+        if (trace) {
+            outerEnclosed = trace->enclosedNanos();
+            trace->enclosedNanos() = 0;
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~StageTimer() {
+        if (trace) {
+            auto elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+            uint64_t inner = std::min(trace->enclosedNanos(), elapsed);
+            trace->addStage(stage, elapsed - inner);
+            trace->enclosedNanos() = outerEnclosed + elapsed;
+        }
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    ParseTrace* trace;
+    ParseStage stage;
+    uint64_t outerEnclosed = 0;
+    std::chrono::steady_clock::time_point start;
+};
+
+#ifdef DOCPARSER_ENABLE_STATS
+#define DOCPARSER_STATS_CONCAT_(a, b) a##b
+#define DOCPARSER_STATS_CONCAT(a, b) DOCPARSER_STATS_CONCAT_(a, b)
+#define DOCPARSER_TRACE_PARSE() ParseTrace docparserTrace_
+#define DOCPARSER_STAGE(stage) StageTimer DOCPARSER_STATS_CONCAT(docparserStage_, __LINE__)(ParseStage::stage)
+#define DOCPARSER_COUNT_BYTES(n) \
+    do { if (ParseTrace* t_ = ParseTrace::active()) { t_->addBytes(n); t_->noteBuffer(n); } } while (0)
+#define DOCPARSER_NOTE_BUFFER(n) \
+    do { if (ParseTrace* t_ = ParseTrace::active()) t_->noteBuffer(n); } while (0)
+#else
+#define DOCPARSER_TRACE_PARSE() ((void)0)
+#define DOCPARSER_STAGE(stage) ((void)0)
+#define DOCPARSER_COUNT_BYTES(n) ((void)0)
+#define DOCPARSER_NOTE_BUFFER(n) ((void)0)
+#endif
+
+// Log2 latency histogram. Bucket 0 holds everything under 2 µs, bucket i
+// [2^i, 2^(i+1)) µs and the last one the rest. Recording is one relaxed
+// atomic increment per field.
+class LatencyHistogram {
+public:
+    static constexpr size_t kBuckets = 24;
+
+    void record(uint64_t nanos) {
+        uint64_t micros = nanos / 1000;
+        size_t bucket = 0;
+        while (bucket + 1 < kBuckets && micros >= (uint64_t(2) << bucket)) {
+            ++bucket;
+        }
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+    }
+
+    // Upper bound of bucket i in seconds; the last bucket is unbounded
+    static double upperBoundSeconds(size_t bucket) {
+        return static_cast<double>(uint64_t(2) << bucket) * 1e-6;
+    }
+
+    struct Snapshot {
+        std::array<uint64_t, kBuckets> buckets{};
+        uint64_t count = 0;
+        uint64_t sumNanos = 0;
+    };
+
+    Snapshot snapshot() const {
+        Snapshot s;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            s.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        }
+        s.count = count.load(std::memory_order_relaxed);
+        s.sumNanos = sumNanos.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sumNanos{0};
+};
+
+// Point-in-time copy of one parser's aggregate
+struct ParserStatsSnapshot {
+    std::string parser;
+    uint64_t documents = 0;
+    uint64_t failures = 0;
+    uint64_t bytes = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    uint64_t peakBufferBytes = 0;
+    std::array<LatencyHistogram::Snapshot, kParseStageCount> stages;
+};
+
+// Running totals for one parser, updated without locks from any thread
+class ParserStats {
+public:
+    explicit ParserStats(std::string parserName) : name(std::move(parserName)) {}
+
+    void record(const DocumentStats& doc) {
+        documents.fetch_add(1, std::memory_order_relaxed);
+        if (!doc.ok) {
+            failures.fetch_add(1, std::memory_order_relaxed);
+        }
+        bytes.fetch_add(doc.bytes, std::memory_order_relaxed);
+        allocations.fetch_add(doc.allocations, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(doc.allocatedBytes, std::memory_order_relaxed);
+        uint64_t peak = peakBuffer.load(std::memory_order_relaxed);
+        while (doc.peakBufferBytes > peak &&
+               !peakBuffer.compare_exchange_weak(peak, doc.peakBufferBytes, std::memory_order_relaxed)) {
+        }
+        for (size_t i = 0; i < kParseStageCount; ++i) {
+            stages[i].record(doc.stageNanos[i]);
+        }
+    }
+
+    ParserStatsSnapshot snapshot() const {
+        ParserStatsSnapshot s;
+        s.parser = name;
+        s.documents = documents.load(std::memory_order_relaxed);
+        s.failures = failures.load(std::memory_order_relaxed);
+        s.bytes = bytes.load(std::memory_order_relaxed);
+        s.allocations = allocations.load(std::memory_order_relaxed);
+        s.allocatedBytes = allocatedBytes.load(std::memory_order_relaxed);
+        s.peakBufferBytes = peakBuffer.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < kParseStageCount; ++i) {
+            s.stages[i] = stages[i].snapshot();
+        }
+        return s;
+    }
+
+    const std::string& parserName() const { return name; }
+
+private:
+    std::string name;
+    std::atomic<uint64_t> documents{0};
+    std::atomic<uint64_t> failures{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> allocatedBytes{0};
+    std::atomic<uint64_t> peakBuffer{0};
+    std::array<LatencyHistogram, kParseStageCount> stages;
+};
+
+// Called once per parsed document, e.g. to emit an OpenTelemetry span
+using DocumentStatsListener = std::function<void(const DocumentStats& stats)>;
+
+// Prometheus text exposition (version 0.0.4) of a set of snapshots
+inline std::string formatPrometheus(const std::vector<ParserStatsSnapshot>& snapshots,
+                                    const std::string& prefix = "docparser") {
+    std::string out;
+    char number[64];
+    auto label = [](const std::string& parser) {
+        std::string escaped;
+        for (char c : parser) {
+            if (c == '\\' || c == '"') escaped += '\\';
+            escaped += c;
+        }
+        return "parser=\"" + escaped + "\"";
+    };
+    auto counter = [&](const char* name, const char* help, uint64_t ParserStatsSnapshot::*field) {
+        out += "# HELP " + prefix + "_" + name + " " + help + "\n";
+        out += "# TYPE " + prefix + "_" + name + (std::string(name).find("peak") == std::string::npos
+                                                       ? " counter\n" : " gauge\n");
+        for (const auto& s : snapshots) {
+            out += prefix + "_" + name + "{" + label(s.parser) + "} " + std::to_string(s.*field) + "\n";
+        }
+    };
+    counter("documents_total", "Documents parsed", &ParserStatsSnapshot::documents);
+    counter("failures_total", "Documents that failed to parse", &ParserStatsSnapshot::failures);
+    counter("bytes_total", "Input bytes parsed", &ParserStatsSnapshot::bytes);
+    counter("allocations_total", "Heap allocations made while parsing", &ParserStatsSnapshot::allocations);
+    counter("allocated_bytes_total", "Heap bytes allocated while parsing", &ParserStatsSnapshot::allocatedBytes);
+    counter("peak_buffer_bytes", "Largest single buffer seen while parsing", &ParserStatsSnapshot::peakBufferBytes);
+
+    std::string histogram = prefix + "_stage_seconds";
+    out += "# HELP " + histogram + " Time spent per parse stage\n";
+    out += "# TYPE " + histogram + " histogram\n";
+    for (const auto& s : snapshots) {
+        for (size_t stage = 0; stage < kParseStageCount; ++stage) {
+            const LatencyHistogram::Snapshot& h = s.stages[stage];
+            std::string labels = label(s.parser) + ",stage=\"" + parseStageName(static_cast<ParseStage>(stage)) + "\"";
+            uint64_t cumulative = 0;
+            for (size_t b = 0; b + 1 < LatencyHistogram::kBuckets; ++b) {
+                cumulative += h.buckets[b];
+                std::snprintf(number, sizeof(number), "%g", LatencyHistogram::upperBoundSeconds(b));
+                out += histogram + "_bucket{" + labels + ",le=\"" + number + "\"} " + std::to_string(cumulative) + "\n";
+            }
+            out += histogram + "_bucket{" + labels + ",le=\"+Inf\"} " + std::to_string(h.count) + "\n";
+            std::snprintf(number, sizeof(number), "%.9f", static_cast<double>(h.sumNanos) * 1e-9);
+            out += histogram + "_sum{" + labels + "} " + number + "\n";
+            out += histogram + "_count{" + labels + "} " + std::to_string(h.count) + "\n";
+        }
+    }
+    return out;
+}
+
+// Defines counting global operator new/delete (plain and aligned, which
+// std::pmr::new_delete_resource() uses) that report to
+// noteAllocation(). Use in exactly one translation unit of a program (or
+// one extension module) to get allocation counts in the stats.
+#define DOCPARSER_DEFINE_COUNTING_NEW                                                          \
+    void* operator new(size_t size) {                                                         \
+        noteAllocation(size);                                                                 \
+        if (void* p = std::malloc(size ? size : 1)) return p;                                 \
+        throw std::bad_alloc();                                                               \
+    }                                                                                         \
+    void* operator new[](size_t size) { return operator new(size); }                          \
+    void operator delete(void* p) noexcept { std::free(p); }                                  \
+    void operator delete[](void* p) noexcept { std::free(p); }                                \
+    void operator delete(void* p, size_t) noexcept { std::free(p); }                          \
+    void operator delete[](void* p, size_t) noexcept { std::free(p); }                        \
+    void* operator new(size_t size, std::align_val_t align) {                                 \
+        noteAllocation(size);                                                                 \
+        size_t alignment = static_cast<size_t>(align);                                        \
+        size_t rounded = ((size ? size : 1) + alignment - 1) / alignment * alignment;         \
+        if (void* p = std::aligned_alloc(alignment, rounded)) return p;                       \
+        throw std::bad_alloc();                                                               \
+    }                                                                                         \
+    void* operator new[](size_t size, std::align_val_t align) { return operator new(size, align); } \
+    void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }                \
+    void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }              \
+    void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }        \
+    void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+#endif // PARSE_STATS_H
@@ -1,29 +1,464 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/stl_bind.h>
+#include <memory>
+#include <mutex>
+#include "async_parser.h"
 #include "document_parser.h"
 
 namespace py = pybind11;
 
-// Python wrapper class for easier use
+#ifdef DOCPARSER_ENABLE_STATS
+// Count this module's heap allocations into the parse stats
+DOCPARSER_DEFINE_COUNTING_NEW
+#endif
+
+// One dict per parser; stage times in seconds, histogram buckets as
+// (upper bound in seconds, count) pairs with None for the open-ended last one
+py::list statsToList(const std::vector<ParserStatsSnapshot>& snapshots) {
+    py::list result;
+    for (const auto& s : snapshots) {
+        py::dict entry;
+        entry["parser"] = s.parser;
+        entry["documents"] = s.documents;
+        entry["failures"] = s.failures;
+        entry["bytes"] = s.bytes;
+        entry["allocations"] = s.allocations;
+        entry["allocated_bytes"] = s.allocatedBytes;
+        entry["peak_buffer_bytes"] = s.peakBufferBytes;
+        py::dict stages;
+        for (size_t i = 0; i < kParseStageCount; ++i) {
+            const LatencyHistogram::Snapshot& h = s.stages[i];
+            py::list buckets;
+            for (size_t b = 0; b < LatencyHistogram::kBuckets; ++b) {
+                py::object bound = b + 1 < LatencyHistogram::kBuckets
+                    ? py::object(py::float_(LatencyHistogram::upperBoundSeconds(b))) : py::object(py::none());
+                buckets.append(py::make_tuple(bound, h.buckets[b]));
+            }
+            py::dict stage;
+            stage["count"] = h.count;
+            stage["seconds"] = static_cast<double>(h.sumNanos) * 1e-9;
+            stage["buckets"] = buckets;
+            stages[parseStageName(static_cast<ParseStage>(i))] = stage;
+        }
+        entry["stages"] = stages;
+        result.append(entry);
+    }
+    return result;
+}
+
+// Parser output as str. Parsed documents are UTF-8 already; bytes handed
+// in raw (a CSV or XML buffer) or a JSON string escaping a lone surrogate
+// may not be, and decode with U+FFFD in place of bad sequences instead of
+// raising UnicodeDecodeError.
+py::str utf8Str(std::string_view text) {
+    PyObject* decoded = PyUnicode_DecodeUTF8(text.data(), static_cast<py::ssize_t>(text.size()), "replace");
+    if (!decoded) {
+        throw py::error_already_set();
+    }
+    return py::reinterpret_steal<py::str>(decoded);
+}
+
+py::str pageText(const Document& doc, size_t index) {
+    std::string_view page = doc.page(index);
+    return utf8Str(page);
+}
+
+py::list pageList(const Document& doc) {
+    py::list pages;
+    for (size_t i = 0; i < doc.pageCount(); ++i) {
+        pages.append(pageText(doc, i));
+    }
+    return pages;
+}
+
+// One metadata value as Python sees it: counts as int, has_tags as bool,
+// everything else as str. Raises KeyError if absent.
+py::object metadataValue(const DocumentMetadata& metadata, const std::string& key) {
+    const std::optional<uint64_t>* count = key == "lines" ? &metadata.lines
+                                         : key == "rows" ? &metadata.rows
+                                         : key == "columns" ? &metadata.columns
+                                         : key == "size" ? &metadata.size : nullptr;
+    if (count && *count) {
+        return py::int_(**count);
+    }
+    if (key == "has_tags" && metadata.hasTags) {
+        return py::bool_(*metadata.hasTags);
+    }
+    if (!count) {
+        if (std::optional<std::string> text = metadata.get(key)) {
+            return utf8Str(*text);
+        }
+    }
+    throw py::key_error(key);
+}
+
+// Structural elements as dicts: kind, level, offset and length in the UTF-8
+// content, source offset in the input, text and attribute
+py::list structureList(const Document& doc) {
+    py::list elements;
+    for (const DocumentElement& element : doc.structure.elements) {
+        py::dict entry;
+        std::string_view text = doc.text(element);
+        std::string_view attribute = doc.structure.attribute(element);
+        entry["kind"] = elementKindName(element.kind);
+        entry["level"] = element.level;
+        entry["offset"] = element.offset;
+        entry["length"] = element.length;
+        entry["source"] = element.source;
+        entry["text"] = utf8Str(text);
+        entry["attribute"] = utf8Str(attribute);
+        elements.append(entry);
+    }
+    return elements;
+}
+
+py::dict metadataToDict(const DocumentMetadata& metadata) {
+    py::dict result;
+    for (std::string_view key : metadata.keys()) {
+        std::string name(key);
+        result[py::str(name)] = metadataValue(metadata, name);
+    }
+    return result;
+}
+
+// Set metadata from a dict of str, int or bool values
+void assignMetadata(DocumentMetadata& metadata, const py::dict& values) {
+    DocumentMetadata updated(metadata.get_allocator());
+    for (const auto& item : values) {
+        std::string key = py::cast<std::string>(item.first);
+        py::handle value = item.second;
+        if (py::isinstance<py::bool_>(value)) {
+            updated.set(key, value.cast<bool>() ? "true" : "false");
+        } else if (py::isinstance<py::int_>(value)) {
+            updated.set(key, std::to_string(value.cast<long long>()));
+        } else {
+            updated.set(key, py::cast<std::string>(value));
+        }
+    }
+    metadata = std::move(updated);
+}
+
+// Read-only mapping over a document's metadata; values are converted to
+// Python objects one key at a time, when read
+struct PyMetadata {
+    std::shared_ptr<const Document> doc;
+    
+    const DocumentMetadata& get() const { return doc->metadata; }
+};
+
+py::dict documentToDict(const Document& doc) {
+    py::dict result;
+    result["content"] = utf8Str(doc.content);
+    result["format"] = doc.format;
+    result["metadata"] = metadataToDict(doc.metadata);
+    result["pages"] = pageList(doc);
+    result["structure"] = structureList(doc);
+    return result;
+}
+
+// Read-only bytes of a Python object, valid while the guard lives: any
+// object exporting a contiguous buffer (bytes, bytearray, memoryview,
+// numpy arrays) is borrowed in place, and str through its cached UTF-8
+// form. Exported buffers cannot be resized, so the parse can run without
+// the GIL.
+class BorrowedBytes {
+public:
+    explicit BorrowedBytes(const py::object& data) {
+        if (PyUnicode_Check(data.ptr())) {
+            Py_ssize_t size = 0;
+            const char* utf8 = PyUnicode_AsUTF8AndSize(data.ptr(), &size);
+            if (!utf8) {
+                throw py::error_already_set();
+            }
+            bytes = std::string_view(utf8, static_cast<size_t>(size));
+            return;
+        }
+        if (PyObject_GetBuffer(data.ptr(), &buffer, PyBUF_SIMPLE) != 0) {
+            throw py::error_already_set();
+        }
+        held = true;
+        bytes = std::string_view(static_cast<const char*>(buffer.buf), static_cast<size_t>(buffer.len));
+    }
+    
+    ~BorrowedBytes() {
+        if (held) {
+            PyBuffer_Release(&buffer);
+        }
+    }
+    
+    BorrowedBytes(const BorrowedBytes&) = delete;
+    BorrowedBytes& operator=(const BorrowedBytes&) = delete;
+    
+    std::string_view view() const { return bytes; }
+    
+private:
+    Py_buffer buffer{};
+    bool held = false;
+    std::string_view bytes;
+};
+
+// Python handle on a native Document. Parse results are wrapped rather than
+// converted: the document may be shared with the parser's cache or with the
+// rest of its batch, `content` is decoded to str only when read, and
+// `content_view` exposes the UTF-8 bytes without copying. Setters write in
+// place only when nothing else refers to the document and copy otherwise.
+class PyDocument {
+public:
+    PyDocument() : PyDocument(std::make_shared<Document>()) {}
+    explicit PyDocument(std::shared_ptr<Document> owned) : doc(std::move(owned)), exclusive(true) {}
+    explicit PyDocument(std::shared_ptr<const Document> shared) : doc(std::move(shared)), exclusive(false) {}
+    
+    const Document& get() const { return *doc; }
+    const std::shared_ptr<const Document>& shared() const { return doc; }
+    
+    Document& mutableDocument() {
+        if (!exclusive || doc.use_count() > 1) {
+            doc = std::make_shared<Document>(*doc);
+            exclusive = true;
+        }
+        // Created non-const above or by the owning constructor
+        return const_cast<Document&>(*doc);
+    }
+    
+    py::str content() const {
+        return utf8Str(doc->content);
+    }
+    
+    // Keys understood by the dict-style accessors, for code written against
+    // the old dict results
+    static const std::vector<std::string>& keys() {
+        static const std::vector<std::string> names = {"content", "format", "metadata", "pages"};
+        return names;
+    }
+    
+    py::object item(const std::string& key) const {
+        if (key == "content") return content();
+        if (key == "format") return py::str(doc->format.data(), doc->format.size());
+        if (key == "metadata") return py::cast(PyMetadata{doc});
+        if (key == "pages") return pageList(*doc);
+        throw py::key_error(key);
+    }
+    
+private:
+    std::shared_ptr<const Document> doc;
+    bool exclusive;  // doc points at a non-const Document we may modify
+};
+
+// Read-only UTF-8 bytes of one document version; keeps it alive for as
+// long as any memoryview built on top
+struct PyContentBuffer {
+    std::shared_ptr<const Document> doc;
+};
+
+// Yields one str per page, decoding each only when it is reached
+struct PyPageIterator {
+    std::shared_ptr<const Document> doc;
+    size_t index = 0;
+    
+    py::str next() {
+        if (index >= doc->pageCount()) {
+            throw py::stop_iteration();
+        }
+        return pageText(*doc, index++);
+    }
+};
+
+// Batch and directory results as dicts with filename, ok, error and
+// document (None for failed files)
+py::dict resultToDict(const BatchResult& result, std::shared_ptr<const Document> document) {
+    py::dict entry;
+    entry["filename"] = result.filename;
+    entry["ok"] = result.ok;
+    entry["error"] = result.ok ? py::object(py::none()) : py::object(py::str(result.error));
+    entry["document"] = result.ok ? py::cast(PyDocument(std::move(document))) : py::object(py::none());
+    return entry;
+}
+
+// Yields one result dict per file as the directory pipeline finishes it;
+// waiting happens without the GIL. Dropping the iterator early cancels
+// the crawl.
+class PyDirectoryIterator {
+private:
+    std::unique_ptr<DirectoryPipeline> pipeline;
+    
+public:
+    explicit PyDirectoryIterator(std::unique_ptr<DirectoryPipeline> crawl) : pipeline(std::move(crawl)) {}
+    
+    ~PyDirectoryIterator() {
+        py::gil_scoped_release release;
+        pipeline.reset();
+    }
+    
+    py::dict next() {
+        BatchResult result;
+        bool more;
+        {
+            py::gil_scoped_release release;
+            more = pipeline->next(result);
+        }
+        if (!more) {
+            throw py::stop_iteration();
+        }
+        auto document = std::make_shared<const Document>(std::move(result.document));
+        return resultToDict(result, std::move(document));
+    }
+    
+    py::dict stats() const {
+        DirectoryStats stats = pipeline->stats();
+        py::dict result;
+        result["directories"] = stats.directories;
+        result["files"] = stats.files;
+        result["accepted"] = stats.accepted;
+        result["unreadable"] = stats.unreadable;
+        return result;
+    }
+};
+
+DirectoryFilters directoryFilters(const std::vector<std::string>& extensions,
+                                  const std::vector<std::string>& include,
+                                  const std::vector<std::string>& exclude,
+                                  uintmax_t min_size, uintmax_t max_size, bool include_hidden) {
+    DirectoryFilters filters;
+    filters.extensions = extensions;
+    filters.include = include;
+    filters.exclude = exclude;
+    filters.minBytes = min_size;
+    filters.maxBytes = max_size;
+    filters.includeHidden = include_hidden;
+    return filters;
+}
+
+// ParseOutput from names such as ["metadata"] or ["raw", "metadata"];
+// empty means everything
+ParseOutput parseOutputs(const std::vector<std::string>& names) {
+    if (names.empty()) {
+        return ParseOutput::All;
+    }
+    ParseOutput outputs = ParseOutput::None;
+    for (const auto& name : names) {
+        if (name == "metadata") {
+            outputs = outputs | ParseOutput::Metadata;
+        } else if (name == "raw") {
+            outputs = outputs | ParseOutput::RawContent;
+        } else if (name == "content") {
+            outputs = outputs | ParseOutput::Content;
+        } else if (name == "pages") {
+            outputs = outputs | ParseOutput::Pages;
+        } else if (name == "structure") {
+            outputs = outputs | ParseOutput::Structure;
+        } else {
+            throw std::runtime_error("Unknown output '" + name +
+                                     "': expected metadata, raw, content, pages or structure");
+        }
+    }
+    return outputs;
+}
+
+DirectoryOptions directoryOptions(size_t threads, size_t read_threads, size_t queue_depth) {
+    DirectoryOptions options;
+    options.parseThreads = threads;
+    options.readThreads = read_threads;
+    options.queueDepth = queue_depth;
+    return options;
+}
+
+// Python wrapper class for easier use. All file I/O and parsing runs with
+// the GIL released; UniversalDocumentParser is safe to share across threads,
+// so one instance can serve every Python thread.
 class PyDocumentParser {
 private:
     UniversalDocumentParser parser;
     
+    static DocumentCacheOptions cacheOptions(size_t cacheBytes, bool hashContent) {
+        DocumentCacheOptions options;
+        options.capacityBytes = cacheBytes;
+        options.hashContent = hashContent;
+        return options;
+    }
+    
 public:
-    py::dict parse_document(const std::string& filename) {
-        Document doc = parser.parseDocument(filename);
-        
+    PyDocumentParser() = default;
+    PyDocumentParser(size_t cacheBytes, bool hashContent)
+        : parser(cacheOptions(cacheBytes, hashContent)) {}
+    
+    // Partial parses (see parseOutputs) bypass the cache
+    PyDocument parse_document(const std::string& filename, const std::vector<std::string>& outputs = {}) const {
+        ParseOutput mask = parseOutputs(outputs);
+        py::gil_scoped_release release;
+        if (mask != ParseOutput::All) {
+            return PyDocument(std::make_shared<Document>(parser.parseDocument(filename, mask)));
+        }
+        return PyDocument(parser.parseShared(filename));
+    }
+    
+    py::dict cache_stats() const {
+        DocumentCacheStats stats = parser.cacheStats();
         py::dict result;
-        result["content"] = doc.content;
-        result["format"] = doc.format;
-        result["metadata"] = py::cast(doc.metadata);
-        result["pages"] = py::cast(doc.pages);
-        
+        result["hits"] = stats.hits;
+        result["misses"] = stats.misses;
+        result["evictions"] = stats.evictions;
+        result["entries"] = stats.entries;
+        result["bytes"] = stats.bytes;
         return result;
     }
     
-    py::list get_supported_formats() {
+    void clear_cache() const {
+        parser.clearCache();
+    }
+    
+    py::list stats() const {
+        return statsToList(parser.parseStats());
+    }
+    
+    std::string stats_prometheus() const {
+        return parser.parseStatsPrometheus();
+    }
+    
+    // One dict per file with filename, ok, error and document (None for
+    // failed files)
+    py::list parse_batch(const std::vector<std::string>& filenames, size_t threads, bool ordered,
+                         const std::vector<std::string>& outputs = {}) const {
+        // All documents of the batch live in one arena, released in one go
+        // once Python drops the last of them
+        struct Batch {
+            DocumentArena arena;
+            std::vector<BatchResult> results;
+        };
+        auto batch = std::make_shared<Batch>();
+        BatchOptions options;
+        options.threads = threads;
+        options.arena = &batch->arena;
+        options.outputs = parseOutputs(outputs);
+        
+        {
+            py::gil_scoped_release release;
+            if (ordered) {
+                batch->results = parser.parseDocuments(filenames, options);
+            } else {
+                batch->results.reserve(filenames.size());
+                parser.parseDocuments(filenames, options, [&batch](size_t, BatchResult&& result) {
+                    batch->results.push_back(std::move(result));
+                });
+            }
+        }
+        
+        py::list list;
+        for (const auto& result : batch->results) {
+            list.append(resultToDict(result, std::shared_ptr<const Document>(batch, &result.document)));
+        }
+        return list;
+    }
+    
+    // Iterator over the parsed files under `root`, see PyDirectoryIterator
+    std::unique_ptr<PyDirectoryIterator> parse_directory(const std::string& root,
+                                                         const DirectoryFilters& filters,
+                                                         const DirectoryOptions& options) const {
+        py::gil_scoped_release release;
+        return std::make_unique<PyDirectoryIterator>(parser.crawlDirectory(root, filters, options));
+    }
+    
+    py::list get_supported_formats() const {
         std::vector<std::string> formats = parser.getSupportedFormats();
         py::list result;
         for (const auto& format : formats) {
@@ -32,64 +467,711 @@ public:
         return result;
     }
     
-    bool can_parse(const std::string& filename) {
+    bool can_parse(const std::string& filename) const {
+        py::gil_scoped_release release;
         return parser.canParseFile(filename);
     }
     
-    py::dict parse_text_content(const std::string& content, const std::string& format) {
-        Document doc(content, format);
-        doc.metadata["type"] = "direct_content";
+    // Parse in-memory content without a temporary file; the bytes are
+    // borrowed, not copied, and parsed with the GIL released
+    PyDocument parse_buffer(const py::object& data, const std::string& format) const {
+        BorrowedBytes bytes(data);
+        py::gil_scoped_release release;
+        return PyDocument(std::make_shared<Document>(parser.parse(bytes.view(), format)));
+    }
+};
+
+// Python iterator over the rows of a CSV file, read in fixed-size chunks
+class PyCSVRowIterator {
+private:
+    CSVRowReader reader;
+    std::vector<std::string_view> fields;
+    std::mutex lock;  // next() runs without the GIL
+    
+public:
+    PyCSVRowIterator(const std::string& filename, size_t chunk_size)
+        : reader(CSVRowReader::fromFile(filename, chunk_size)) {}
+    
+    py::list next() {
+        std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+        bool more;
+        {
+            py::gil_scoped_release release;
+            guard.lock();
+            more = reader.next(fields);
+        }
+        if (!more) {
+            throw py::stop_iteration();
+        }
+        
+        py::list row;
+        for (const auto& field : fields) {
+            row.append(utf8Str(field));
+        }
+        return row;
+    }
+};
+
+// Streams XML/HTML events from a file in bounded memory
+class PyXMLEventIterator {
+private:
+    XMLStreamReader reader;
+    XMLEvent event;
+    std::mutex lock;  // next() runs without the GIL
+    
+public:
+    PyXMLEventIterator(const std::string& filename, const XMLStreamOptions& options)
+        : reader(XMLStreamReader::fromFile(filename, options)) {}
+    
+    // ("start", name, attributes), ("text", text) or ("end", name)
+    py::tuple next() {
+        std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+        bool more;
+        {
+            py::gil_scoped_release release;
+            guard.lock();
+            more = reader.next(event);
+        }
+        if (!more) {
+            throw py::stop_iteration();
+        }
         
-        py::dict result;
-        result["content"] = doc.content;
-        result["format"] = doc.format;
-        result["metadata"] = py::cast(doc.metadata);
-        result["pages"] = py::cast(doc.pages);
+        py::str name = utf8Str(event.name);
+        switch (event.type) {
+            case XMLEventType::StartElement: {
+                py::dict attributes;
+                forEachAttribute(event.attributes, [&](std::string_view key, std::string_view value) {
+                    std::string decoded;
+                    decodeXMLEntities(value, decoded);
+                    attributes[utf8Str(key)] = utf8Str(decoded);
+                });
+                return py::make_tuple("start", name, attributes);
+            }
+            case XMLEventType::EndElement:
+                return py::make_tuple("end", name);
+            default:
+                return py::make_tuple("text", utf8Str(event.text));
+        }
+    }
+};
+
+// Follows an append-only .txt or .csv file; each poll parses only the
+// bytes appended since the previous one
+class PyTailParser {
+private:
+    std::string filename;
+    bool csv;
+    ParseCheckpoint checkpoint;
+    std::mutex lock;  // poll() runs without the GIL
+    
+public:
+    explicit PyTailParser(const std::string& path) : filename(path) {
+        uint64_t key = ParserRegistry::extensionKey(ParserRegistry::extensionOf(filename));
+        csv = key == ParserRegistry::extensionKey("csv");
+        if (!csv && key != ParserRegistry::extensionKey("txt") && key != ParserRegistry::extensionKey("text")) {
+            throw std::runtime_error("Incremental parsing supports .txt and .csv files: " + filename);
+        }
+    }
+    
+    PyDocument poll() {
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> guard(lock);
+        auto doc = std::make_shared<Document>(csv ? CSVParser().parseIncremental(filename, checkpoint)
+                                                  : TextParser().parseIncremental(filename, checkpoint));
+        return PyDocument(std::move(doc));
+    }
+    
+    uint64_t offset() {
+        std::lock_guard<std::mutex> guard(lock);
+        return checkpoint.offset;
+    }
+    
+    uint64_t count() {
+        std::lock_guard<std::mutex> guard(lock);
+        return checkpoint.count;
+    }
+    
+    void reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        checkpoint = ParseCheckpoint();
+    }
+};
+
+// asyncio front end for AsyncDocumentParser. parse() returns a future of
+// the running loop; the worker that finishes the file schedules the result
+// onto that loop with call_soon_threadsafe, so parsing never holds the GIL.
+class PyAsyncParser {
+private:
+    // One submitted file; the Python references are only touched with the GIL
+    struct Pending {
+        py::object loop;
+        py::object future;
+        
+        ~Pending() {
+            if (future) {
+                py::gil_scoped_acquire gil;
+                future = py::object();
+                loop = py::object();
+            }
+        }
         
+        void resolve(BatchResult&& result) {
+            py::gil_scoped_acquire gil;
+            try {
+                py::object value = py::none();
+                py::object error = py::none();
+                if (result.ok) {
+                    value = py::cast(PyDocument(std::make_shared<Document>(std::move(result.document))));
+                } else {
+                    error = py::str(result.error);
+                }
+                loop.attr("call_soon_threadsafe")(settle(), future, value, error);
+            } catch (py::error_already_set&) {
+                // The loop was closed before the file finished; nobody is waiting
+            }
+            future = py::object();
+            loop = py::object();
+        }
+        
+        // Runs on the loop thread; a cancelled future is left alone
+        static py::object settle() {
+            return py::cpp_function([](py::object future, py::object value, py::object error) {
+                if (future.attr("done")().cast<bool>()) {
+                    return;
+                }
+                if (error.is_none()) {
+                    future.attr("set_result")(value);
+                } else {
+                    future.attr("set_exception")(py::module_::import("builtins").attr("RuntimeError")(error));
+                }
+            });
+        }
+    };
+    
+    UniversalDocumentParser parser;
+    std::unique_ptr<AsyncDocumentParser> async;
+    
+public:
+    PyAsyncParser(size_t maxInFlight, size_t threads, bool useIoUring) {
+        AsyncOptions options;
+        options.maxInFlight = maxInFlight;
+        options.parseThreads = threads;
+        options.useIoUring = useIoUring;
+        async = std::make_unique<AsyncDocumentParser>(parser, options);
+    }
+    
+    // Outstanding callbacks need the GIL, so wait for them without it
+    ~PyAsyncParser() {
+        py::gil_scoped_release release;
+        async.reset();
+    }
+    
+    py::object parse(const std::string& filename) {
+        py::object loop = py::module_::import("asyncio").attr("get_running_loop")();
+        auto pending = std::make_shared<Pending>();
+        pending->loop = loop;
+        pending->future = loop.attr("create_future")();
+        py::object future = pending->future;
+        async->parseAsync(filename, [pending](BatchResult&& result) { pending->resolve(std::move(result)); });
+        return future;
+    }
+    
+    void wait() {
+        py::gil_scoped_release release;
+        async->wait();
+    }
+    
+    std::string backend() const { return async->backend(); }
+};
+
+// Read-only view of one native column buffer, exposed through the buffer
+// protocol. Holding the table keeps the memory alive for as long as any
+// memoryview, numpy array or pyarrow buffer built on top of it.
+struct PyColumnBuffer {
+    std::shared_ptr<const CSVTable> table;
+    const void* data;
+    py::ssize_t count;
+    py::ssize_t itemsize;
+    std::string format;
+};
+
+template <typename T>
+PyColumnBuffer makeColumnBuffer(const std::shared_ptr<const CSVTable>& table,
+                                const std::vector<T>& values, const std::string& format) {
+    static const T empty{};
+    return PyColumnBuffer{table, values.empty() ? &empty : values.data(),
+                          static_cast<py::ssize_t>(values.size()),
+                          static_cast<py::ssize_t>(sizeof(T)), format};
+}
+
+// Column handle; buffers are returned without copying
+struct PyCSVColumn {
+    std::shared_ptr<const CSVTable> table;
+    size_t index;
+    
+    const CSVColumn& column() const { return table->columns[index]; }
+    
+    py::object values() const {
+        const CSVColumn& col = column();
+        switch (col.type) {
+            case ColumnType::Int64: return py::cast(makeColumnBuffer(table, col.intValues, "q"));
+            case ColumnType::Double: return py::cast(makeColumnBuffer(table, col.doubleValues, "d"));
+            case ColumnType::Bool: return py::cast(makeColumnBuffer(table, col.boolValues, "B"));
+            default: return py::none();
+        }
+    }
+    
+    py::object offsets() const {
+        const CSVColumn& col = column();
+        if (col.type != ColumnType::String) {
+            return py::none();
+        }
+        return py::cast(makeColumnBuffer(table, col.offsets, "q"));
+    }
+    
+    py::object data() const {
+        const CSVColumn& col = column();
+        if (col.type != ColumnType::String) {
+            return py::none();
+        }
+        static const char empty = 0;
+        return py::cast(PyColumnBuffer{table, col.data.empty() ? &empty : col.data.data(),
+                                       static_cast<py::ssize_t>(col.data.size()), 1, "B"});
+    }
+    
+    PyColumnBuffer validity() const {
+        return makeColumnBuffer(table, column().validity, "B");
+    }
+};
+
+struct PyCSVTable {
+    std::shared_ptr<const CSVTable> table;
+    
+    py::list columns() const {
+        py::list result;
+        for (size_t i = 0; i < table->columns.size(); ++i) {
+            result.append(PyCSVColumn{table, i});
+        }
         return result;
     }
+    
+    PyCSVColumn column(const std::string& name) const {
+        for (size_t i = 0; i < table->columns.size(); ++i) {
+            if (table->columns[i].name == name) {
+                return PyCSVColumn{table, i};
+            }
+        }
+        throw py::key_error(name);
+    }
 };
 
+// Materialize one JSON value (and only its subtree) as Python objects
+py::object jsonToPython(const JSONValue& value) {
+    switch (value.type()) {
+        case JSONType::Object: {
+            py::dict result;
+            value.forEachMember([&](const std::string& key, const JSONValue& member) {
+                result[utf8Str(key)] = jsonToPython(member);
+            });
+            return std::move(result);
+        }
+        case JSONType::Array: {
+            py::list result;
+            value.forEachElement([&](const JSONValue& element) {
+                result.append(jsonToPython(element));
+            });
+            return std::move(result);
+        }
+        case JSONType::String: return utf8Str(value.asString());
+        case JSONType::Number:
+            if (value.isInteger()) {
+                return py::int_(value.asInt64());
+            }
+            return py::float_(value.asDouble());
+        case JSONType::Bool: return py::bool_(value.asBool());
+        default: return py::none();
+    }
+}
+
+// Shared by the module-level helpers. Intentionally leaked so it outlives
+// any thread still running at interpreter shutdown.
+const PyDocumentParser& sharedParser() {
+    static const PyDocumentParser* instance = new PyDocumentParser();
+    return *instance;
+}
+
+// Backs parse_file_async(); created on first use and leaked like sharedParser()
+PyAsyncParser& sharedAsyncParser() {
+    static PyAsyncParser* instance = new PyAsyncParser(AsyncOptions().maxInFlight, 0, true);
+    return *instance;
+}
+
 PYBIND11_MODULE(docparser, m) {
     m.doc() = "Universal Document Parser - Parse any document format";
     
     // Bind the Document struct
-    py::class_<Document>(m, "Document")
+    py::class_<PyContentBuffer>(m, "ContentBuffer", py::buffer_protocol())
+        .def_buffer([](PyContentBuffer& buf) {
+            const auto& content = buf.doc->content;
+            return py::buffer_info(const_cast<char*>(content.data()), 1, "B", 1,
+                                   {static_cast<py::ssize_t>(content.size())}, {1}, true);
+        })
+        .def("__len__", [](const PyContentBuffer& buf) { return buf.doc->content.size(); });
+    
+    py::class_<PyPageIterator>(m, "PageIterator")
+        .def("__iter__", [](PyPageIterator& it) -> PyPageIterator& { return it; },
+             py::return_value_policy::reference_internal)
+        .def("__next__", &PyPageIterator::next);
+    
+    py::class_<PyMetadata>(m, "Metadata")
+        .def("__getitem__", [](const PyMetadata& m, const std::string& key) {
+            return metadataValue(m.get(), key);
+        }, py::arg("key"))
+        .def("get", [](const PyMetadata& m, const std::string& key, py::object fallback) {
+            return m.get().contains(key) ? metadataValue(m.get(), key) : fallback;
+        }, py::arg("key"), py::arg("default") = py::none())
+        .def("__contains__", [](const PyMetadata& m, const std::string& key) { return m.get().contains(key); })
+        .def("__len__", [](const PyMetadata& m) { return m.get().keys().size(); })
+        .def("__iter__", [](const PyMetadata& m) { return py::iter(py::cast(m.get().keys())); })
+        .def("keys", [](const PyMetadata& m) { return m.get().keys(); })
+        .def("values", [](const PyMetadata& m) { return metadataToDict(m.get()).attr("values")(); })
+        .def("items", [](const PyMetadata& m) { return metadataToDict(m.get()).attr("items")(); })
+        .def("to_dict", [](const PyMetadata& m) { return metadataToDict(m.get()); },
+             "Copy into a plain dict")
+        .def("__eq__", [](const PyMetadata& m, const py::object& other) {
+            return metadataToDict(m.get()).equal(other);
+        })
+        .def("__repr__", [](const PyMetadata& m) {
+            return py::repr(metadataToDict(m.get())).cast<std::string>();
+        });
+    
+    py::class_<PyDocument>(m, "Document")
         .def(py::init<>())
-        .def(py::init<const std::string&, const std::string&>())
-        .def_readwrite("content", &Document::content)
-        .def_readwrite("metadata", &Document::metadata)
-        .def_readwrite("format", &Document::format)
-        .def_readwrite("pages", &Document::pages);
+        .def(py::init([](const std::string& content, const std::string& format) {
+            return PyDocument(std::make_shared<Document>(content, format));
+        }), py::arg("content"), py::arg("format"))
+        .def_property("content", &PyDocument::content,
+                      [](PyDocument& d, const std::string& value) { d.mutableDocument().content = value; },
+                      "Content decoded as str on each access")
+        .def_property_readonly("content_view", [](const PyDocument& d) {
+            return py::memoryview(py::cast(PyContentBuffer{d.shared()}));
+        }, "Zero-copy read-only memoryview of the UTF-8 content")
+        .def_property_readonly("content_bytes", [](const PyDocument& d) {
+            return py::bytes(d.get().content.data(), d.get().content.size());
+        })
+        .def_property("metadata",
+                      [](const PyDocument& d) { return PyMetadata{d.shared()}; },
+                      [](PyDocument& d, const py::dict& value) {
+                          assignMetadata(d.mutableDocument().metadata, value);
+                      },
+                      "Mapping of metadata; lines, rows, columns and size are int, has_tags is bool")
+        .def_property("format",
+                      [](const PyDocument& d) { return d.item("format"); },
+                      [](PyDocument& d, const std::string& value) { d.mutableDocument().format = value; })
+        .def_property("pages",
+                      [](const PyDocument& d) { return d.item("pages"); },
+                      [](PyDocument& d, const std::vector<std::string>& value) {
+                          auto& pages = d.mutableDocument().pages;
+                          pages.assign(value.begin(), value.end());
+                      },
+                      "Every page as a list of str; prefer page() or iter_pages() on large documents")
+        .def_property_readonly("page_count", [](const PyDocument& d) { return d.get().pageCount(); })
+        .def("page", [](const PyDocument& d, size_t index) { return pageText(d.get(), index); },
+             "Text of one page, decoded on demand", py::arg("index"))
+        .def("iter_pages", [](const PyDocument& d) { return PyPageIterator{d.shared()}; },
+             "Iterate over the pages without building them all at once")
+        .def_property_readonly("page_ranges", [](const PyDocument& d) {
+            py::list ranges;
+            for (const PageRange& range : d.get().pageRanges) {
+                ranges.append(py::make_tuple(range.offset, range.length));
+            }
+            return ranges;
+        }, "(offset, length) of each page in the UTF-8 content, e.g. for slicing content_view")
+        .def_property_readonly("structure", [](const PyDocument& d) { return structureList(d.get()); },
+             "Headings, code blocks, lists, list items, block quotes, links and images (Markdown) as "
+             "dicts with kind, level, offset and length in the UTF-8 content, source offset in the "
+             "input, text and attribute (link target, code language, list start)")
+        .def("__getitem__", &PyDocument::item, py::arg("key"))
+        .def("__contains__", [](const PyDocument&, const std::string& key) {
+            const auto& keys = PyDocument::keys();
+            return std::find(keys.begin(), keys.end(), key) != keys.end();
+        })
+        .def("keys", [](const PyDocument&) { return PyDocument::keys(); })
+        .def("get", [](const PyDocument& d, const std::string& key, py::object fallback) {
+            const auto& keys = PyDocument::keys();
+            return std::find(keys.begin(), keys.end(), key) != keys.end() ? d.item(key) : fallback;
+        }, py::arg("key"), py::arg("default") = py::none())
+        .def("to_dict", [](const PyDocument& d) { return documentToDict(d.get()); },
+             "Copy everything into a plain dict")
+        .def("__repr__", [](const PyDocument& d) {
+            return "<Document format='" + std::string(d.get().format) + "' content=" +
+                   std::to_string(d.get().content.size()) + " bytes>";
+        });
     
     // Bind the main parser class
     py::class_<PyDocumentParser>(m, "DocumentParser")
         .def(py::init<>())
+        .def(py::init<size_t, bool>(),
+             "Parser with an LRU cache of parsed documents of up to cache_bytes, keyed on "
+             "path, size and mtime, or on a content hash when hash_content is set",
+             py::arg("cache_bytes"), py::arg("hash_content") = false)
         .def("parse_document", &PyDocumentParser::parse_document, 
-             "Parse a document file and return its content and metadata",
-             py::arg("filename"))
-        .def("parse_text", &PyDocumentParser::parse_text_content,
-             "Parse text content directly with specified format",
-             py::arg("content"), py::arg("format"))
+             "Parse a document file and return its content and metadata; outputs limits the "
+             "work to some of 'metadata', 'raw', 'content', 'pages' and 'structure'",
+             py::arg("filename"), py::arg("outputs") = std::vector<std::string>())
+        .def("parse_batch", &PyDocumentParser::parse_batch,
+             "Parse many files in parallel without holding the GIL; per-file errors are reported, not raised",
+             py::arg("filenames"), py::arg("threads") = 0, py::arg("ordered") = true,
+             py::arg("outputs") = std::vector<std::string>())
+        .def("parse_directory",
+             [](const PyDocumentParser& self, const std::string& root,
+                const std::vector<std::string>& extensions, const std::vector<std::string>& include,
+                const std::vector<std::string>& exclude, uintmax_t min_size, uintmax_t max_size,
+                bool include_hidden, size_t threads, size_t read_threads, size_t queue_depth) {
+                 return self.parse_directory(root,
+                                             directoryFilters(extensions, include, exclude,
+                                                              min_size, max_size, include_hidden),
+                                             directoryOptions(threads, read_threads, queue_depth));
+             },
+             "Iterate over result dicts (filename, ok, error, document) for every parseable file "
+             "under root, in completion order; enumeration, reads and parsing run ahead in "
+             "native threads",
+             py::arg("root"), py::arg("extensions") = std::vector<std::string>(),
+             py::arg("include") = std::vector<std::string>(),
+             py::arg("exclude") = std::vector<std::string>(), py::arg("min_size") = 0,
+             py::arg("max_size") = 0, py::arg("include_hidden") = false, py::arg("threads") = 0,
+             py::arg("read_threads") = DirectoryOptions().readThreads,
+             py::arg("queue_depth") = DirectoryOptions().queueDepth,
+             py::keep_alive<0, 1>())
+        .def("parse_buffer", &PyDocumentParser::parse_buffer,
+             "Parse bytes, bytearray, memoryview or str content without copying it; `format` is an "
+             "extension or format name ('csv', 'md', 'JSON'), empty to detect it from the content",
+             py::arg("data"), py::arg("format") = "")
+        .def("parse_text", &PyDocumentParser::parse_buffer,
+             "Alias of parse_buffer(content, format)",
+             py::arg("content"), py::arg("format") = "")
         .def("get_supported_formats", &PyDocumentParser::get_supported_formats,
              "Get list of supported document formats")
         .def("can_parse", &PyDocumentParser::can_parse,
              "Check if a file can be parsed",
-             py::arg("filename"));
+             py::arg("filename"))
+        .def("cache_stats", &PyDocumentParser::cache_stats,
+             "Hit, miss and eviction counters plus current entries and bytes of the document cache")
+        .def("clear_cache", &PyDocumentParser::clear_cache,
+             "Drop every cached document")
+        .def("stats", &PyDocumentParser::stats,
+             "Per-parser document, byte and allocation counts and stage-time histograms "
+             "(empty unless built with DOCPARSER_ENABLE_STATS)")
+        .def("stats_prometheus", &PyDocumentParser::stats_prometheus,
+             "stats() in Prometheus text exposition format");
+    
+    // Streaming CSV rows
+    py::class_<PyCSVRowIterator>(m, "CSVRowIterator")
+        .def("__iter__", [](PyCSVRowIterator& it) -> PyCSVRowIterator& { return it; },
+             py::return_value_policy::reference_internal)
+        .def("__next__", &PyCSVRowIterator::next);
+    
+    // Directory crawl results
+    py::class_<PyDirectoryIterator>(m, "DirectoryIterator")
+        .def("__iter__", [](PyDirectoryIterator& it) -> PyDirectoryIterator& { return it; },
+             py::return_value_policy::reference_internal)
+        .def("__next__", &PyDirectoryIterator::next)
+        .def_property_readonly("stats", &PyDirectoryIterator::stats,
+                               "Directories listed, files seen, files accepted and unreadable "
+                               "directories so far");
+    
+    // Streaming XML/HTML events
+    py::class_<PyXMLEventIterator>(m, "XMLEventIterator")
+        .def("__iter__", [](PyXMLEventIterator& it) -> PyXMLEventIterator& { return it; },
+             py::return_value_policy::reference_internal)
+        .def("__next__", &PyXMLEventIterator::next);
+    
+    // Incremental parsing of growing files
+    py::class_<PyTailParser>(m, "TailParser")
+        .def(py::init<const std::string&>(), py::arg("filename"))
+        .def("poll", &PyTailParser::poll,
+             "Parse what was appended since the last poll; starts over (metadata reset='true') "
+             "if the file was truncated or replaced")
+        .def_property_readonly("offset", &PyTailParser::offset,
+                               "End of the last complete line or row parsed")
+        .def_property_readonly("count", &PyTailParser::count,
+                               "Complete lines (text) or rows (CSV) parsed so far")
+        .def("reset", &PyTailParser::reset, "Forget the checkpoint and start from the beginning");
+    
+    // asyncio-awaitable parsing
+    py::class_<PyAsyncParser>(m, "AsyncParser")
+        .def(py::init<size_t, size_t, bool>(),
+             py::arg("max_in_flight") = AsyncOptions().maxInFlight, py::arg("threads") = 0,
+             py::arg("use_io_uring") = true)
+        .def("parse", &PyAsyncParser::parse,
+             "Start parsing a file; returns an asyncio future resolving to a Document. "
+             "Must be called from a running event loop",
+             py::arg("filename"))
+        .def("wait", &PyAsyncParser::wait, "Block until every started parse has finished")
+        .def_property_readonly("backend", &PyAsyncParser::backend,
+                               "'io_uring' or 'threads', whichever reads the files");
+    
+    // Columnar CSV results
+    py::class_<PyColumnBuffer>(m, "ColumnBuffer", py::buffer_protocol())
+        .def_buffer([](PyColumnBuffer& buf) {
+            return py::buffer_info(const_cast<void*>(buf.data), buf.itemsize, buf.format, 1,
+                                   {buf.count}, {buf.itemsize}, true);
+        })
+        .def("__len__", [](const PyColumnBuffer& buf) { return buf.count; });
+    
+    py::class_<PyCSVColumn>(m, "CSVColumn")
+        .def_property_readonly("name", [](const PyCSVColumn& c) { return c.column().name; })
+        .def_property_readonly("type", [](const PyCSVColumn& c) { return columnTypeName(c.column().type); })
+        .def_property_readonly("length", [](const PyCSVColumn& c) { return c.column().length; })
+        .def_property_readonly("null_count", [](const PyCSVColumn& c) { return c.column().nullCount; })
+        .def_property_readonly("validity", &PyCSVColumn::validity,
+                               "Arrow validity bitmap, LSB first")
+        .def_property_readonly("values", &PyCSVColumn::values,
+                               "int64, double or bit-packed bool values; None for strings")
+        .def_property_readonly("offsets", &PyCSVColumn::offsets,
+                               "int64 string offsets (Arrow large_utf8); None for other types")
+        .def_property_readonly("data", &PyCSVColumn::data,
+                               "UTF-8 string data; None for other types");
+    
+    py::class_<PyCSVTable>(m, "CSVTable")
+        .def_property_readonly("num_rows", [](const PyCSVTable& t) { return t.table->rows; })
+        .def_property_readonly("columns", &PyCSVTable::columns)
+        .def("column", &PyCSVTable::column, py::arg("name"))
+        .def("__len__", [](const PyCSVTable& t) { return t.table->rows; });
+    
+    // Lazy JSON access
+    py::class_<JSONDocument>(m, "JSONDocument")
+        .def("get", [](const JSONDocument& doc, const std::string& path, py::object fallback) {
+            JSONValue value = doc.at(path);
+            return value.isValid() ? jsonToPython(value) : fallback;
+        }, "Materialize the value at a path such as 'a.b[3].c'",
+           py::arg("path"), py::arg("default") = py::none())
+        .def("raw", [](const JSONDocument& doc, const std::string& path) {
+            std::string_view raw = doc.at(path).raw();
+            return utf8Str(raw);
+        }, "Source text of the value at a path", py::arg("path"))
+        .def("type", [](const JSONDocument& doc, const std::string& path) {
+            return JSONParser::typeName(doc.at(path).type());
+        }, py::arg("path") = "")
+        .def("pretty", &JSONDocument::pretty, py::arg("indent") = 2,
+             py::call_guard<py::gil_scoped_release>());
     
     // Convenience functions
-    m.def("parse_file", [](const std::string& filename) {
-        PyDocumentParser parser;
-        return parser.parse_document(filename);
-    }, "Quick function to parse a single file", py::arg("filename"));
+    m.def("parse_file", [](const std::string& filename, const std::vector<std::string>& outputs) {
+        return sharedParser().parse_document(filename, outputs);
+    }, "Quick function to parse a single file", py::arg("filename"),
+       py::arg("outputs") = std::vector<std::string>());
+    
+    m.def("parse_buffer", [](const py::object& data, const std::string& format) {
+        return sharedParser().parse_buffer(data, format);
+    }, "Parse in-memory bytes or str without a temporary file", py::arg("data"), py::arg("format") = "");
+    
+    m.def("parse_delimited", [](const std::string& filename, const std::string& delimiter,
+                                const std::string& escape, bool header) {
+        if (delimiter.size() > 1 || escape.size() > 1) {
+            throw std::runtime_error("delimiter and escape must be single characters");
+        }
+        CSVDialectOptions options;
+        options.delimiter = delimiter.empty() ? '\0' : delimiter[0];
+        options.escape = escape.empty() ? '\0' : escape[0];
+        options.header = header;
+        DelimitedTextParser parser(options);
+        std::shared_ptr<Document> doc;
+        {
+            py::gil_scoped_release release;
+            doc = std::make_shared<Document>(parser.parse(filename));
+        }
+        return PyDocument(std::move(doc));
+    }, "Parse CSV, TSV or other delimited text; an empty delimiter is sniffed from the content",
+       py::arg("filename"), py::arg("delimiter") = "", py::arg("escape") = "", py::arg("header") = false);
+    
+    m.def("parse_file_async", [](const std::string& filename) {
+        return sharedAsyncParser().parse(filename);
+    }, "Awaitable parse_file(): reads and parses off the event loop", py::arg("filename"));
+    
+    m.def("parse_batch", [](const std::vector<std::string>& filenames, size_t threads, bool ordered,
+                            const std::vector<std::string>& outputs) {
+        return sharedParser().parse_batch(filenames, threads, ordered, outputs);
+    }, "Parse many files in parallel", py::arg("filenames"), py::arg("threads") = 0,
+       py::arg("ordered") = true, py::arg("outputs") = std::vector<std::string>());
+    
+    m.def("parse_directory", [](const std::string& root, const std::vector<std::string>& extensions,
+                                const std::vector<std::string>& include,
+                                const std::vector<std::string>& exclude, uintmax_t min_size,
+                                uintmax_t max_size, bool include_hidden, size_t threads,
+                                size_t read_threads, size_t queue_depth) {
+        return sharedParser().parse_directory(root,
+                                              directoryFilters(extensions, include, exclude,
+                                                               min_size, max_size, include_hidden),
+                                              directoryOptions(threads, read_threads, queue_depth));
+    }, "Crawl a directory tree and yield result dicts as files finish parsing; patterns are "
+       "globs ('*.csv', 'logs/**') on the path relative to root",
+       py::arg("root"), py::arg("extensions") = std::vector<std::string>(),
+       py::arg("include") = std::vector<std::string>(),
+       py::arg("exclude") = std::vector<std::string>(), py::arg("min_size") = 0,
+       py::arg("max_size") = 0, py::arg("include_hidden") = false, py::arg("threads") = 0,
+       py::arg("read_threads") = DirectoryOptions().readThreads,
+       py::arg("queue_depth") = DirectoryOptions().queueDepth);
+    
+    m.attr("stats_enabled") = kStatsEnabled;
+    
+    m.def("parse_stats", []() {
+        return sharedParser().stats();
+    }, "stats() of the parser behind parse_file and parse_batch");
+    
+    m.def("parse_stats_prometheus", []() {
+        return sharedParser().stats_prometheus();
+    }, "parse_stats() in Prometheus text exposition format");
     
     m.def("supported_formats", []() {
-        PyDocumentParser parser;
-        return parser.get_supported_formats();
+        return sharedParser().get_supported_formats();
     }, "Get list of supported formats");
     
     m.def("can_parse_file", [](const std::string& filename) {
-        PyDocumentParser parser;
-        return parser.can_parse(filename);
+        return sharedParser().can_parse(filename);
     }, "Check if file can be parsed", py::arg("filename"));
+    
+    m.def("iter_csv", [](const std::string& filename, size_t chunk_size) {
+        return std::make_unique<PyCSVRowIterator>(filename, chunk_size);
+    }, "Iterate over the rows of a CSV file with bounded memory",
+       py::arg("filename"), py::arg("chunk_size") = CSVRowReader::kDefaultChunkSize);
+    
+    m.def("iter_xml", [](const std::string& filename, const std::string& select, py::object html,
+                         size_t chunk_size) {
+        XMLStreamOptions options;
+        options.select = select;
+        options.chunkSize = chunk_size;
+        if (html.is_none()) {
+            size_t dot = filename.find_last_of('.');
+            std::string ext = dot == std::string::npos ? "" : filename.substr(dot + 1);
+            for (char& c : ext) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            options.html = ext == "html" || ext == "htm";
+        } else {
+            options.html = html.cast<bool>();
+        }
+        return std::make_unique<PyXMLEventIterator>(filename, options);
+    }, "Stream (kind, ...) events from an XML/HTML file with bounded memory; `select` is an "
+       "XPath-lite filter such as '/feed/entry/title' or \"//div[@class='body']\"",
+       py::arg("filename"), py::arg("select") = "", py::arg("html") = py::none(),
+       py::arg("chunk_size") = XMLStreamOptions().chunkSize);
+    
+    m.def("parse_csv_columnar", [](const std::string& filename, bool header, bool infer_types) {
+        CSVTableOptions options;
+        options.header = header;
+        options.inferTypes = infer_types;
+        CSVParser parser;
+        std::shared_ptr<const CSVTable> table;
+        {
+            py::gil_scoped_release release;
+            table = std::make_shared<const CSVTable>(parser.parseColumnar(filename, options));
+        }
+        return PyCSVTable{table};
+    }, "Parse a CSV file into typed, Arrow-layout column buffers",
+       py::arg("filename"), py::arg("header") = true, py::arg("infer_types") = true);
+    
+    m.def("load_json", [](const std::string& filename) {
+        JSONParser parser;
+        return parser.load(filename);
+    }, "Index a JSON file for lazy path lookups", py::arg("filename"),
+       py::call_guard<py::gil_scoped_release>());
 }
\ No newline at end of file
@@ -0,0 +1,2475 @@
+// Tests for the docparser headers, also built as test_docparser_stats
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <random>
+#include <regex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "async_parser.h"
+#include "document_parser.h"
+
+// Count every heap allocation made by the process
+static std::atomic<size_t> heapAllocations{0};
+
+// These replacements pair malloc() and aligned_alloc() with free(); GCC
+// assumes operator new memory is never passed to free() and warns
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    noteAllocation(size);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// std::pmr::new_delete_resource() goes through the aligned forms
+void* operator new(size_t size, std::align_val_t align) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    size_t alignment = static_cast<size_t>(align);
+    size_t rounded = (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment;
+    if (void* p = std::aligned_alloc(alignment, rounded)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+// Forwards to the default resource and totals what passes through it
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t allocations = 0;
+    size_t bytes = 0;
+    size_t liveBytes = 0;
+
+private:
+    void* do_allocate(size_t size, size_t alignment) override {
+        ++allocations;
+        bytes += size;
+        liveBytes += size;
+        return std::pmr::new_delete_resource()->allocate(size, alignment);
+    }
+
+    void do_deallocate(void* p, size_t size, size_t alignment) override {
+        liveBytes -= size;
+        std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+struct Sample {
+    const char* name;
+    std::unique_ptr<DocumentParser> parser;
+    std::string filename;
+};
+
+std::vector<Sample> samples() {
+    std::vector<Sample> list;
+    list.push_back({"text", std::make_unique<TextParser>(), "input.txt"});
+    list.push_back({"csv", std::make_unique<CSVParser>(), "input.csv"});
+    list.push_back({"json", std::make_unique<JSONParser>(), "input.json"});
+    list.push_back({"html", std::make_unique<XMLParser>(), "input.html"});
+    list.push_back({"xml", std::make_unique<XMLParser>(), "input.xml"});
+    list.push_back({"markdown", std::make_unique<MarkdownParser>(), "input.md"});
+    return list;
+}
+
+// `records` rows, lines, elements or sections of the sample's format
+std::string makeInput(const std::string& name, size_t records) {
+    std::string out;
+    if (name == "csv") {
+        out += "id,name,comment\n";
+    } else if (name == "json") {
+        out += "[";
+    } else if (name == "html") {
+        out += "<html><body>\n";
+    } else if (name == "xml") {
+        out += "<items>\n";
+    }
+    for (size_t i = 0; i < records; ++i) {
+        std::string n = std::to_string(i);
+        if (name == "text") {
+            out += "line " + n + " of plain text\n";
+            if (i % 50 == 49) out += "\f";
+        } else if (name == "csv") {
+            out += n + ",item" + n + ",\"quoted, with a comma\"\n";
+        } else if (name == "json") {
+            out += (i > 0 ? ", " : "") + std::string("{\"id\": ") + n + ", \"tags\": [\"a\", \"b\"]}";
+        } else if (name == "html") {
+            out += "<p>paragraph <b>" + n + "</b> text</p>\n";
+        } else if (name == "xml") {
+            out += "<item id=\"" + n + "\">value " + n + "</item>\n";
+        } else {
+            out += "## Section " + n + "\n\nSome **bold** text and a [link](https://example.com).\n\n";
+        }
+    }
+    if (name == "json") {
+        out += "]";
+    } else if (name == "html") {
+        out += "</body></html>\n";
+    } else if (name == "xml") {
+        out += "</items>\n";
+    }
+    return out;
+}
+
+// Written on construction, removed on destruction
+struct TempFile {
+    std::string path;
+    TempFile(const std::string& name, const std::string& contents)
+        : path(testing::TempDir() + name) {
+        std::ofstream(path, std::ios::binary) << contents;
+    }
+    ~TempFile() { std::remove(path.c_str()); }
+};
+
+const ParserStatsSnapshot* findStats(const std::vector<ParserStatsSnapshot>& stats, const std::string& parser) {
+    for (const auto& s : stats) {
+        if (s.parser == parser) return &s;
+    }
+    return nullptr;
+}
+
+size_t heapAllocationsDuring(const std::function<void()>& body) {
+    size_t before = heapAllocations.load();
+    body();
+    return heapAllocations.load() - before;
+}
+
+}  // namespace
+
+TEST(FileBuffer, MapsRegularFilesAndReadsEverythingElse) {
+    std::string text = makeInput("text", 100);
+    TempFile file("buffer.txt", text);
+    FileBuffer mapped(file.path);
+    EXPECT_TRUE(mapped.isMapped());
+    EXPECT_EQ(mapped.view(), text);
+    EXPECT_NE(mapped.fileId(), 0u);
+    FileBuffer buffered(file.path, false);
+    EXPECT_FALSE(buffered.isMapped());
+    EXPECT_EQ(buffered.view(), text);
+    EXPECT_EQ(buffered.fileId(), mapped.fileId());
+
+    TempFile other("buffer2.txt", text);
+    EXPECT_NE(FileBuffer(other.path).fileId(), mapped.fileId());
+
+    FileBuffer moved = std::move(mapped);
+    EXPECT_TRUE(moved.isMapped());
+    EXPECT_EQ(moved.view(), text);
+    moved.removePrefix(5);
+    EXPECT_EQ(moved.view(), text.substr(5));
+
+    TempFile empty("buffer_empty.txt", "");
+    FileBuffer none(empty.path);
+    EXPECT_FALSE(none.isMapped());
+    EXPECT_TRUE(none.view().empty());
+    EXPECT_EQ(TextParser().parse(empty.path).content, "");
+
+    try {
+        FileBuffer missing(testing::TempDir() + "buffer_missing.txt");
+        FAIL() << "opened a missing file";
+    } catch (const std::runtime_error& e) {
+        EXPECT_NE(std::string(e.what()).find("Cannot open file"), std::string::npos);
+    }
+#ifndef _WIN32
+    // Special files report no size and are read to end of file
+    EXPECT_FALSE(FileBuffer("/dev/null").isMapped());
+    EXPECT_TRUE(FileBuffer("/dev/null").view().empty());
+    if (FILE* proc = std::fopen("/proc/self/status", "rb")) {
+        std::fclose(proc);
+        FileBuffer status("/proc/self/status");
+        EXPECT_FALSE(status.isMapped());
+        EXPECT_NE(status.view().find("Name:"), std::string_view::npos);
+    }
+
+    // A FIFO is opened once and read as its writer produces it
+    std::string fifo = testing::TempDir() + "buffer.fifo";
+    std::remove(fifo.c_str());
+    ASSERT_EQ(::mkfifo(fifo.c_str(), 0600), 0);
+    std::string large = makeInput("text", 20000);
+    std::thread writer([&] { std::ofstream(fifo, std::ios::binary) << large; });
+    FileBuffer piped(fifo);
+    writer.join();
+    EXPECT_FALSE(piped.isMapped());
+    EXPECT_EQ(piped.view(), large);
+    std::remove(fifo.c_str());
+#endif
+}
+
+TEST(Allocation, ContentIsAllocatedOnceAtFinalSize) {
+    for (auto& sample : samples()) {
+        SCOPED_TRACE(sample.name);
+        std::string input = makeInput(sample.name, 2000);
+        CountingResource resource;
+        Document doc = sample.parser->parseContent(input, sample.filename, &resource);
+
+        // Content, page ranges, structure and a few metadata extras; a
+        // regrown content buffer would add at least half its size again
+        size_t expected = doc.content.capacity() + 1 + doc.pageRanges.capacity() * sizeof(PageRange) +
+                          doc.structure.heapBytes();
+        EXPECT_GT(doc.content.size(), 0u);
+        EXPECT_LE(resource.bytes, expected + 4096);
+    }
+}
+
+TEST(Allocation, HeapAllocationsDoNotGrowWithInput) {
+    for (auto& sample : samples()) {
+        SCOPED_TRACE(sample.name);
+        std::string small = makeInput(sample.name, 1000);
+        std::string large = makeInput(sample.name, 16000);
+
+        size_t smallCount = heapAllocationsDuring([&] {
+            Document doc = sample.parser->parseContent(small, sample.filename);
+            EXPECT_GT(doc.pageCount(), 0u);
+        });
+        size_t largeCount = heapAllocationsDuring([&] {
+            Document doc = sample.parser->parseContent(large, sample.filename);
+            EXPECT_GT(doc.pageCount(), 0u);
+        });
+
+        // Vectors that double as they fill account for a few more; anything
+        // per record would add thousands
+        EXPECT_LE(largeCount, smallCount + 32);
+    }
+}
+
+TEST(Allocation, ParallelSlicesAllocatePerSliceNotPerRow) {
+    ParallelOptions options;
+    options.threads = 4;
+    options.minChunkBytes = 4096;
+    CSVParser parser(options);
+    std::string small = makeInput("csv", 4000);
+    std::string large = makeInput("csv", 64000);
+
+    size_t smallCount = heapAllocationsDuring([&] { parser.parseContent(small, "input.csv"); });
+    size_t largeCount = heapAllocationsDuring([&] { parser.parseContent(large, "input.csv"); });
+    EXPECT_LE(largeCount, smallCount + 64);
+}
+
+TEST(Allocation, ParseContextReachesZeroAllocations) {
+    UniversalDocumentParser universal;
+    for (auto& sample : samples()) {
+        SCOPED_TRACE(sample.name);
+        TempFile file("context_" + sample.filename, makeInput(sample.name, 2000));
+        ParseContext context;
+        for (int i = 0; i < 2; ++i) {
+            sample.parser->parse(file.path, context);
+            universal.parseDocument(file.path, context);
+        }
+
+        size_t count = heapAllocationsDuring([&] {
+            sample.parser->parse(file.path, context);
+            universal.parseDocument(file.path, context);
+        });
+        EXPECT_EQ(count, 0u);
+        EXPECT_EQ(context.document().content, sample.parser->parse(file.path).content);
+        EXPECT_EQ(std::string_view(context.document().metadata.filename), file.path);
+    }
+}
+
+TEST(Allocation, ParseContextTrimsToHighWaterMark) {
+    TempFile file("context_large.txt", makeInput("text", 20000));
+    TextParser parser;
+    ParseContext bounded(4096);
+    ParseContext unbounded;
+    parser.parse(file.path, bounded);
+    parser.parse(file.path, unbounded);
+    parser.parse(file.path, bounded);
+    parser.parse(file.path, unbounded);
+    EXPECT_LE(bounded.retainedBytes(), 4096u);
+    EXPECT_GT(unbounded.retainedBytes(), file.path.size() + 4096);
+}
+
+TEST(Allocation, ArenaDocumentsAllocateFromTheArenaUntilReleased) {
+    // The arena's chunks come from the default resource of the moment
+    CountingResource heap;
+    std::pmr::memory_resource* previous = std::pmr::set_default_resource(&heap);
+    {
+        DocumentArena arena;
+        std::pmr::set_default_resource(previous);
+        TempFile csv("arena.csv", makeInput("csv", 4000));
+        TempFile markdown("arena.md", makeInput("markdown", 500));
+        UniversalDocumentParser parser;
+        BatchOptions options;
+        options.arena = &arena;
+
+        size_t peak = 0;
+        for (int round = 0; round < 5; ++round) {
+            SCOPED_TRACE(round);
+            {
+                std::vector<BatchResult> results = parser.parseDocuments({csv.path, markdown.path}, options);
+                for (const BatchResult& result : results) {
+                    ASSERT_TRUE(result.ok) << result.error;
+                    EXPECT_EQ(result.document.get_allocator().resource(), arena.resource());
+                    EXPECT_EQ(result.document.content.get_allocator().resource(), arena.resource());
+                }
+                // Both contents and their structure live in the arena's chunks
+                EXPECT_GE(heap.liveBytes, results[0].document.content.size() + results[1].document.content.size());
+                // The first rounds settle the chunk sizes; after that a
+                // released arena never needs more
+                if (round < 2) {
+                    peak = std::max(peak, heap.liveBytes);
+                } else {
+                    EXPECT_LE(heap.liveBytes, peak);
+                }
+            }
+            arena.release();
+            EXPECT_EQ(heap.liveBytes, 0u);
+        }
+    }
+    EXPECT_EQ(heap.liveBytes, 0u);
+}
+
+TEST(Allocation, RecyclingResourceRoundTripsSizeClasses) {
+    CountingResource upstream;
+    RecyclingResource recycling(&upstream);
+    const size_t sizes[] = {1, 16, 17, 32, 100, 4096, 5000};
+    const size_t rounded[] = {16, 16, 32, 32, 128, 4096, 8192};
+    size_t total = 0;
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < std::size(sizes); ++i) {
+        blocks.push_back(recycling.allocate(sizes[i]));
+        total += rounded[i];
+    }
+    EXPECT_EQ(upstream.allocations, std::size(sizes));
+    EXPECT_EQ(upstream.liveBytes, total);
+
+    for (size_t i = 0; i < std::size(sizes); ++i) {
+        recycling.deallocate(blocks[i], sizes[i]);
+    }
+    EXPECT_EQ(recycling.cachedBytes(), total);
+    EXPECT_EQ(upstream.liveBytes, total);
+
+    // Any size of the same class gets a cached block back, newest first
+    EXPECT_EQ(recycling.allocate(20), blocks[3]);
+    EXPECT_EQ(recycling.allocate(32), blocks[2]);
+    EXPECT_EQ(recycling.allocate(8000), blocks[6]);
+    EXPECT_EQ(recycling.allocate(128), blocks[4]);
+    EXPECT_EQ(upstream.allocations, std::size(sizes));
+    EXPECT_EQ(recycling.cachedBytes(), 16u + 16u + 4096u);
+    recycling.deallocate(blocks[3], 20);
+    recycling.deallocate(blocks[2], 32);
+    recycling.deallocate(blocks[6], 8000);
+    recycling.deallocate(blocks[4], 128);
+
+    // Over-aligned blocks bypass the free lists
+    void* aligned = recycling.allocate(64, 256);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 256, 0u);
+    recycling.deallocate(aligned, 64, 256);
+    EXPECT_EQ(recycling.cachedBytes(), total);
+
+    // trim() frees the largest blocks first
+    recycling.trim(4096 + 256);
+    EXPECT_EQ(recycling.cachedBytes(), 4096u + 128u + 32u + 32u + 16u + 16u);
+    EXPECT_EQ(upstream.liveBytes, recycling.cachedBytes());
+    recycling.trim(0);
+    EXPECT_EQ(upstream.liveBytes, 0u);
+}
+
+TEST(MoveSemantics, MovingDocumentsDoesNotAllocate) {
+    std::string input = makeInput("csv", 500);
+    Document doc = CSVParser().parseContent(input, "input.csv");
+    const char* content = doc.content.data();
+
+    size_t count = heapAllocationsDuring([&] {
+        Document moved(std::move(doc));
+        Document assigned;
+        assigned = std::move(moved);
+        Document sameResource(std::move(assigned), assigned.get_allocator());
+        EXPECT_EQ(sameResource.content.data(), content);
+    });
+    EXPECT_EQ(count, 0u);
+}
+
+TEST(MoveSemantics, BatchResultsMoveWithoutCopying) {
+    std::string input = makeInput("text", 500);
+    BatchResult result;
+    result.filename = "input.txt";
+    result.document = TextParser().parseContent(input, result.filename);
+    result.ok = true;
+    const char* content = result.document.content.data();
+
+    std::vector<BatchResult> results;
+    results.reserve(1);
+    size_t count = heapAllocationsDuring([&] { results.push_back(std::move(result)); });
+    EXPECT_EQ(count, 0u);
+    EXPECT_EQ(results[0].document.content.data(), content);
+}
+
+TEST(MoveSemantics, ExtendedMoveAcrossResourcesCopiesOnce) {
+    std::string input = makeInput("markdown", 500);
+    Document doc = MarkdownParser().parseContent(input, "input.md");
+    CountingResource resource;
+    Document copy(std::move(doc), &resource);
+
+    EXPECT_EQ(copy.get_allocator().resource(), &resource);
+    size_t expected = copy.content.capacity() + 1 + copy.pageRanges.capacity() * sizeof(PageRange) +
+                      copy.structure.heapBytes();
+    EXPECT_LE(resource.bytes, expected + 4096);
+}
+
+TEST(Parallel, QuotedNewlinesAcrossSlicesMatchSerial) {
+    // Nearly every byte sits inside a quoted field, so the slice cuts land
+    // between quotes and must move forward to the next real row start
+    std::string csv = "id,note\r\n";
+    for (int i = 0; i < 300; ++i) {
+        csv += std::to_string(i) + ",\"first line\r\nsecond \"\"quoted\"\"\nthird, " + std::to_string(i) + "\"\r\n";
+    }
+    size_t cutsInQuotes = 0;
+    for (size_t i = 1; i < 4; ++i) {
+        size_t cut = ParallelOptions::sliceStart(csv.size(), i, 4);
+        cutsInQuotes += std::count(csv.begin(), csv.begin() + cut, '"') % 2;
+    }
+    ASSERT_GT(cutsInQuotes, 0u);
+
+    ParallelOptions serial;
+    serial.threads = 1;
+    ParallelOptions sliced;
+    sliced.threads = 4;
+    sliced.minChunkBytes = 64;
+    ASSERT_EQ(sliced.chunksFor(csv.size()), 4u);
+    Document expected = CSVParser(serial).parseContent(csv, "input.csv");
+    Document doc = CSVParser(sliced).parseContent(csv, "input.csv");
+    EXPECT_EQ(doc.content, expected.content);
+    EXPECT_EQ(doc.metadata.rows, expected.metadata.rows);
+    EXPECT_EQ(doc.metadata.columns, expected.metadata.columns);
+    EXPECT_EQ(doc.pageRanges.size(), expected.pageRanges.size());
+}
+
+TEST(Parallel, PoolWorkersParseOnOneThread) {
+    ParallelOptions options;
+    options.threads = 8;
+    options.minChunkBytes = 1;
+    EXPECT_EQ(options.chunksFor(1 << 20), 8u);
+    std::atomic<size_t> nested{0};
+    {
+        WorkStealingPool pool(2);
+        pool.submit([&] { nested += options.chunksFor(1 << 20); });
+        pool.wait();
+    }
+    EXPECT_EQ(nested.load(), 1u);
+    // A single-worker pool is the only parse running, so it still splits
+    WorkStealingPool single(1);
+    single.submit([&] { nested = options.chunksFor(1 << 20); });
+    single.wait();
+    EXPECT_EQ(nested.load(), 8u);
+}
+
+TEST(Parallel, IdleWorkersStealFromABlockedOne) {
+    // The outer task fills its own deque and then blocks until the tasks
+    // have run, which only another worker stealing them can do
+    WorkStealingPool pool(2);
+    constexpr size_t kTasks = 64;
+    std::atomic<size_t> ran{0};
+    std::atomic<size_t> onBlockedWorker{0};
+    std::atomic<bool> allStolen{false};
+    pool.submit([&] {
+        std::thread::id blocked = std::this_thread::get_id();
+        for (size_t i = 0; i < kTasks; ++i) {
+            pool.submit([&, blocked] {
+                if (std::this_thread::get_id() == blocked) ++onBlockedWorker;
+                ++ran;
+            });
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (ran.load() < kTasks && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        allStolen = ran.load() == kTasks;
+    });
+    pool.wait();
+    EXPECT_TRUE(allStolen.load());
+    EXPECT_EQ(ran.load(), kTasks);
+    EXPECT_EQ(onBlockedWorker.load(), 0u);
+
+    // wait() covers tasks submitted by tasks, and the pool is reusable
+    ran = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        pool.submit([&] {
+            for (size_t j = 0; j < 8; ++j) {
+                pool.submit([&] { ++ran; });
+            }
+        });
+    }
+    pool.wait();
+    EXPECT_EQ(ran.load(), 64u);
+}
+
+TEST(Parallel, SlicesReuseOneProcessWidePool) {
+    std::mutex lock;
+    std::set<std::thread::id> threads;
+    for (int call = 0; call < 20; ++call) {
+        std::vector<int> hits(6, 0);
+        parallelFor(hits.size(), [&](size_t i) {
+            ++hits[i];
+            std::lock_guard<std::mutex> guard(lock);
+            threads.insert(std::this_thread::get_id());
+        });
+        EXPECT_EQ(std::count(hits.begin(), hits.end(), 1), 6);
+    }
+    threads.erase(std::this_thread::get_id());
+    EXPECT_GE(threads.size(), 1u);
+    EXPECT_LE(threads.size(), slicePool().size());
+
+    // Errors surface after every slice ran, and a slice may split again
+    std::atomic<size_t> ran{0};
+    EXPECT_THROW(parallelFor(4, [&](size_t i) {
+                     parallelFor(3, [&](size_t) { ++ran; });
+                     if (i == 2) throw std::runtime_error("slice failed");
+                 }),
+                 std::runtime_error);
+    EXPECT_EQ(ran.load(), 12u);
+}
+
+TEST(Parallel, BatchResultsKeepInputOrderWithPerFileErrors) {
+    TempFile csv("batch.csv", makeInput("csv", 200));
+    TempFile text("batch.txt", makeInput("text", 200));
+    TempFile markdown("batch.md", makeInput("markdown", 50));
+    // Gzip magic followed by garbage fails inside the parse
+    TempFile corrupt("batch_corrupt.csv.gz", std::string("\x1f\x8b\x08\x00", 4) + std::string(64, 'x'));
+    std::string missing = testing::TempDir() + "batch_missing.csv";
+    std::vector<std::string> files = {csv.path, missing, text.path, corrupt.path, markdown.path};
+
+    UniversalDocumentParser parser;
+    for (bool largestFirst : {false, true}) {
+        BatchOptions options;
+        options.threads = 3;
+        options.largestFirst = largestFirst;
+        std::vector<BatchResult> results = parser.parseDocuments(files, options);
+        ASSERT_EQ(results.size(), files.size());
+        for (size_t i = 0; i < files.size(); ++i) {
+            EXPECT_EQ(results[i].filename, files[i]);
+        }
+        EXPECT_TRUE(results[0].ok);
+        EXPECT_EQ(results[0].document.metadata.rows, 201u);
+        EXPECT_EQ(results[0].document.content, parser.parseDocument(csv.path).content);
+        EXPECT_FALSE(results[1].ok);
+        EXPECT_NE(results[1].error.find("Cannot open file: " + missing), std::string::npos) << results[1].error;
+        EXPECT_TRUE(results[2].ok);
+        EXPECT_EQ(results[2].document.metadata.parser, "Plain Text");
+        EXPECT_FALSE(results[3].ok);
+        EXPECT_NE(results[3].error.find("Failed to parse " + corrupt.path), std::string::npos) << results[3].error;
+        EXPECT_TRUE(results[4].ok);
+        EXPECT_EQ(results[4].document.metadata.parser, "Markdown");
+        for (size_t i : {1, 3}) {
+            EXPECT_TRUE(results[i].document.content.empty());
+        }
+    }
+
+    // Every index arrives exactly once and no two callbacks overlap
+    std::vector<std::string> many;
+    for (size_t i = 0; i < 40; ++i) {
+        many.push_back(i % 5 == 1 ? missing : files[i % 5]);
+    }
+    BatchOptions options;
+    options.threads = 4;
+    std::vector<int> seen(many.size(), 0);
+    std::atomic<int> inside{0};
+    std::atomic<int> overlapped{0};
+    parser.parseDocuments(many, options, [&](size_t index, BatchResult&& result) {
+        if (inside.fetch_add(1) != 0) ++overlapped;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        ++seen[index];
+        EXPECT_EQ(result.filename, many[index]);
+        EXPECT_EQ(result.ok, index % 5 != 1 && index % 5 != 3);
+        inside.fetch_sub(1);
+    });
+    EXPECT_EQ(overlapped.load(), 0);
+    EXPECT_EQ(std::count(seen.begin(), seen.end(), 1), static_cast<long>(many.size()));
+}
+
+TEST(Async, BothBackendsMatchSynchronousParses) {
+    std::vector<std::unique_ptr<TempFile>> files;
+    std::vector<std::string> paths;
+    auto all = samples();
+    for (size_t i = 0; i < 40; ++i) {
+        const Sample& sample = all[i % all.size()];
+        files.push_back(std::make_unique<TempFile>("async" + std::to_string(i) + "_" + sample.filename,
+                                                   makeInput(sample.name, 50 + i * 20)));
+        paths.push_back(files.back()->path);
+    }
+    TempFile empty("async_empty.txt", "");
+    std::string missing = testing::TempDir() + "async_missing.csv";
+    UniversalDocumentParser parser;
+
+    for (bool useIoUring : {true, false}) {
+        AsyncOptions options;
+        options.maxInFlight = 4;
+        options.parseThreads = 2;
+        options.useIoUring = useIoUring;
+        AsyncDocumentParser async(parser, options);
+        SCOPED_TRACE(async.backend());
+        if (!useIoUring) {
+            EXPECT_STREQ(async.backend(), "threads");
+        }
+
+        // Ten times maxInFlight: the rest queue without blocking the caller
+        std::vector<std::future<Document>> futures;
+        for (const auto& path : paths) {
+            futures.push_back(async.parseAsync(path));
+        }
+        for (size_t i = 0; i < paths.size(); ++i) {
+            Document expected = parser.parseDocument(paths[i]);
+            Document doc = futures[i].get();
+            EXPECT_EQ(doc.content, expected.content) << paths[i];
+            EXPECT_EQ(doc.format, expected.format);
+            EXPECT_EQ(std::string_view(doc.metadata.filename), paths[i]);
+        }
+
+        EXPECT_TRUE(async.parseAsync(empty.path).get().content.empty());
+        EXPECT_EQ(async.parseAsync("/proc/self/status").get().metadata.parser, "Plain Text");
+        try {
+            async.parseAsync(missing).get();
+            ADD_FAILURE() << "missing file parsed";
+        } catch (const std::runtime_error& e) {
+            EXPECT_NE(std::string(e.what()).find("Cannot open file: " + missing), std::string::npos) << e.what();
+        }
+
+        // Failures reach the callback too, on a parse worker rather than
+        // the reader's thread
+        std::mutex lock;
+        std::vector<BatchResult> results;
+        std::atomic<size_t> offWorkers{0};
+        for (const std::string& path : {missing, paths[0], missing}) {
+            async.parseAsync(path, [&](BatchResult&& result) {
+                if (!onParallelWorker()) ++offWorkers;
+                std::lock_guard<std::mutex> guard(lock);
+                results.push_back(std::move(result));
+            });
+        }
+        async.wait();
+        ASSERT_EQ(results.size(), 3u);
+        EXPECT_EQ(std::count_if(results.begin(), results.end(), [](const BatchResult& r) { return r.ok; }), 1);
+        for (const auto& result : results) {
+            EXPECT_EQ(result.ok, result.filename == paths[0]);
+            EXPECT_EQ(result.ok, result.error.empty()) << result.error;
+        }
+        EXPECT_EQ(offWorkers.load(), 0u);
+    }
+}
+
+TEST(Async, PipesDoNotStallOtherReads) {
+    std::string fifo = testing::TempDir() + "async_fifo.csv";
+    std::remove(fifo.c_str());
+    ASSERT_EQ(::mkfifo(fifo.c_str(), 0600), 0);
+    TempFile regular("async_regular.csv", makeInput("csv", 100));
+    UniversalDocumentParser parser;
+
+    for (bool useIoUring : {true, false}) {
+        AsyncOptions options;
+        options.maxInFlight = 8;
+        options.parseThreads = 2;
+        options.useIoUring = useIoUring;
+        AsyncDocumentParser async(parser, options);
+        SCOPED_TRACE(async.backend());
+
+        // The pipe has no writer until the regular files are through, or
+        // until a timeout if its read holds them up
+        std::future<Document> piped = async.parseAsync(fifo);
+        std::atomic<size_t> delivered{0};
+        for (int i = 0; i < 6; ++i) {
+            async.parseAsync(regular.path, [&](BatchResult&& result) {
+                EXPECT_TRUE(result.ok) << result.error;
+                ++delivered;
+            });
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (delivered.load() < 6 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_EQ(delivered.load(), 6u);
+        std::ofstream(fifo, std::ios::binary) << "a,b\n1,2\n";
+        Document doc = piped.get();
+        EXPECT_EQ(doc.metadata.rows, 2u);
+    }
+    std::remove(fifo.c_str());
+}
+
+TEST(Stats, AggregatesPerParser) {
+    if (!kStatsEnabled) {
+        EXPECT_TRUE(UniversalDocumentParser().parseStats().empty());
+        GTEST_SKIP() << "built without DOCPARSER_ENABLE_STATS";
+    }
+    TempFile csv("stats.csv", makeInput("csv", 1000));
+    TempFile md("stats.md", makeInput("markdown", 100));
+    UniversalDocumentParser parser;
+    Document first = parser.parseDocument(csv.path);
+    parser.parseDocument(csv.path);
+    parser.parseDocument(md.path);
+    EXPECT_THROW(parser.parseDocument(testing::TempDir() + "missing.csv"), std::runtime_error);
+
+    std::vector<ParserStatsSnapshot> stats = parser.parseStats();
+    const ParserStatsSnapshot* csvStats = findStats(stats, "CSV");
+    ASSERT_NE(csvStats, nullptr);
+    EXPECT_EQ(csvStats->documents, 3u);
+    EXPECT_EQ(csvStats->failures, 1u);
+    EXPECT_EQ(csvStats->bytes, 2 * makeInput("csv", 1000).size());
+    EXPECT_GE(csvStats->peakBufferBytes, first.content.capacity());
+    EXPECT_GT(csvStats->allocations, 0u);
+    for (const auto& stage : csvStats->stages) {
+        EXPECT_EQ(stage.count, 3u);
+        uint64_t bucketed = 0;
+        for (uint64_t n : stage.buckets) bucketed += n;
+        EXPECT_EQ(bucketed, 3u);
+    }
+
+    const ParserStatsSnapshot* mdStats = findStats(stats, "Markdown");
+    ASSERT_NE(mdStats, nullptr);
+    EXPECT_EQ(mdStats->documents, 1u);
+    EXPECT_EQ(mdStats->failures, 0u);
+    EXPECT_EQ(findStats(stats, "JSON")->documents, 0u);
+}
+
+TEST(Stats, ListenerSeesEachDocument) {
+    if (!kStatsEnabled) GTEST_SKIP() << "built without DOCPARSER_ENABLE_STATS";
+    UniversalDocumentParser parser;
+    std::vector<DocumentStats> seen;
+    parser.setStatsListener([&seen](const DocumentStats& stats) { seen.push_back(stats); });
+
+    std::string input = makeInput("json", 200);
+    parser.parseContent("inline.json", input);
+    ASSERT_EQ(seen.size(), 1u);
+    EXPECT_EQ(seen[0].filename, "inline.json");
+    EXPECT_EQ(seen[0].parser, "JSON");
+    EXPECT_TRUE(seen[0].ok);
+    EXPECT_EQ(seen[0].bytes, input.size());
+    // In-memory input is never read from disk
+    EXPECT_EQ(seen[0].stageNanos[static_cast<size_t>(ParseStage::Read)], 0u);
+    EXPECT_GT(seen[0].stageNanos[static_cast<size_t>(ParseStage::Parse)], 0u);
+}
+
+TEST(Stats, ListenerCanBeReplacedWhileParsing) {
+    if (!kStatsEnabled) GTEST_SKIP() << "built without DOCPARSER_ENABLE_STATS";
+    UniversalDocumentParser parser;
+    std::atomic<size_t> calls{0};
+    std::atomic<bool> done{false};
+    std::thread swapper([&] {
+        while (!done.load()) {
+            parser.setStatsListener([&calls](const DocumentStats&) { calls.fetch_add(1); });
+            parser.setStatsListener(nullptr);
+        }
+    });
+    std::string input = makeInput("text", 10);
+    for (int i = 0; i < 2000; ++i) {
+        parser.parseContent("swap.txt", input);
+    }
+    done.store(true);
+    swapper.join();
+
+    calls = 0;
+    parser.setStatsListener([&calls](const DocumentStats&) { calls.fetch_add(1); });
+    parser.parseContent("swap.txt", input);
+    EXPECT_EQ(calls.load(), 1u);
+}
+
+TEST(Stats, PrometheusExport) {
+    if (!kStatsEnabled) GTEST_SKIP() << "built without DOCPARSER_ENABLE_STATS";
+    UniversalDocumentParser parser;
+    std::string input = makeInput("text", 100);
+    parser.parseContent("a.txt", input);
+    parser.parseContent("b.txt", input);
+
+    std::string text = parser.parseStatsPrometheus();
+    EXPECT_NE(text.find("# TYPE docparser_documents_total counter\n"), std::string::npos);
+    EXPECT_NE(text.find("docparser_documents_total{parser=\"Plain Text\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("docparser_bytes_total{parser=\"Plain Text\"} " + std::to_string(2 * input.size())),
+              std::string::npos);
+    EXPECT_NE(text.find("docparser_stage_seconds_bucket{parser=\"Plain Text\",stage=\"parse\",le=\"+Inf\"} 2\n"),
+              std::string::npos);
+    EXPECT_NE(text.find("docparser_stage_seconds_count{parser=\"CSV\",stage=\"detect\"} 0\n"),
+              std::string::npos);
+}
+
+TEST(InMemory, ParsesBuffersByFormatOrContent) {
+    UniversalDocumentParser parser;
+    std::string csv = makeInput("csv", 10);
+
+    Document byExtension = parser.parse(csv, "csv");
+    EXPECT_EQ(byExtension.format, "csv");
+    EXPECT_EQ(byExtension.metadata.get("source"), "memory");
+    EXPECT_FALSE(byExtension.metadata.contains("filename"));
+    EXPECT_EQ(byExtension.content, CSVParser().parseContent(csv, "x.csv").content);
+
+    EXPECT_EQ(parser.parse("{\"a\": 1}", "JSON").format, "json");
+    EXPECT_EQ(parser.parse("plain words", "text").metadata.parser, "Plain Text");
+    EXPECT_EQ(parser.parse("<p>x</p>", ".html").format, "html");
+    // A format name rather than an extension leaves XML vs HTML to the content
+    EXPECT_EQ(parser.parse("<!DOCTYPE html><p>x</p>", "XML/HTML").format, "html");
+
+    Document sniffed = parser.parse("# Title\n\nBody text\n");
+    EXPECT_EQ(sniffed.format, "markdown");
+    EXPECT_EQ(sniffed.metadata.get("detected_by"), "content");
+
+    EXPECT_THROW(parser.parse("data", "docx"), std::runtime_error);
+}
+
+namespace {
+
+// Events flattened to one string; adjacent text events are merged, since
+// where a run is split depends on the chunk size
+std::string xmlEvents(XMLStreamReader reader) {
+    std::string out;
+    bool inText = false;
+    reader.parse([&](const XMLEvent& event) {
+        if (event.type == XMLEventType::Text) {
+            out += inText ? "" : "'";
+            out += event.text;
+            inText = true;
+            return;
+        }
+        out += inText ? "'" : "";
+        inText = false;
+        out += event.type == XMLEventType::StartElement ? "<" : "</";
+        out += std::string(event.name) + ">";
+    });
+    return out + (inText ? "'" : "");
+}
+
+}  // namespace
+
+TEST(Sniffer, NamesTheFormatOfTheHead) {
+    auto sniff = [](std::string_view head) { return std::string(FormatSniffer::sniff(head, false)); };
+    EXPECT_EQ(sniff("  {\"a\": [1, 2]}"), "json");
+    EXPECT_EQ(sniff("\n[{\"id\": 1}]"), "json");
+    EXPECT_EQ(sniff("[-1.5, 2]"), "json");
+    EXPECT_EQ(sniff("\xEF\xBB\xBF{\"bom\": true}"), "json");
+    EXPECT_EQ(sniff("<?xml version=\"1.0\"?><items/>"), "xml");
+    EXPECT_EQ(sniff("<!DOCTYPE HTML><p>x</p>"), "html");
+    EXPECT_EQ(sniff("<Html><body/></Html>"), "html");
+    EXPECT_EQ(sniff("# Title\n\nBody\n"), "md");
+    EXPECT_EQ(sniff("Title\n=====\n\nBody\n"), "md");
+    EXPECT_EQ(sniff("```\ncode\n```\n"), "md");
+    // A bracketed first word is neither a JSON array nor a link
+    EXPECT_NE(sniff("[section]\nkey=value\n"), "json");
+    EXPECT_NE(sniff("[link](https://example.com) text\n"), "json");
+    EXPECT_EQ(sniff(makeInput("csv", 20)), "csv");
+    EXPECT_EQ(sniff("a\tb\tc\n1\t2\t3\n"), "tsv");
+    EXPECT_EQ(sniff("a|b|c\n1|2|3\n"), "psv");
+    EXPECT_EQ(sniff("a;b;c\n1;2;3\n"), "dsv");
+    EXPECT_EQ(sniff("just some words\nover two lines\n"), "txt");
+    EXPECT_EQ(sniff(" \n\t\n"), "txt");
+    // UTF-16 carries NULs but is text; other NULs mean binary
+    EXPECT_EQ(sniff(std::string("\xFF\xFEh\0i\0", 6)), "txt");
+    EXPECT_EQ(sniff(std::string("\x89PNG\r\n\x1a\n\0\0\0\rIHDR", 16)), "");
+    EXPECT_EQ(sniff(std::string("{\"a\": \0}", 9)), "");
+}
+
+TEST(Sniffer, RoutesByExtensionThenContent) {
+    UniversalDocumentParser parser;
+    struct Case {
+        const char* name;
+        std::string contents;
+        const char* format;
+        bool byContent;
+    };
+    std::vector<Case> cases = {
+        {"noext_json", "{\"id\": 1, \"tags\": [\"a\"]}", "json", true},
+        {"noext_html", "<!doctype html><html><body><p>hi</p></body></html>", "html", true},
+        {"noext_csv", makeInput("csv", 20), "csv", true},
+        {"noext_md", makeInput("markdown", 3), "markdown", true},
+        // The name suggests JSON but the extension is unknown, so the
+        // content decides
+        {"export.json.bak", makeInput("csv", 20), "csv", true},
+        {"feed.dat", "<?xml version=\"1.0\"?><rss><item>x</item></rss>", "xml", true},
+        // Known extensions in any case skip sniffing
+        {"UPPER.CSV", makeInput("csv", 20), "csv", false},
+        {"Notes.Md", makeInput("markdown", 3), "markdown", false},
+        {"Page.HTML", "<p>x</p>", "html", false},
+    };
+    for (const Case& c : cases) {
+        SCOPED_TRACE(c.name);
+        TempFile file(c.name, c.contents);
+        Document doc = parser.parseDocument(file.path);
+        EXPECT_EQ(doc.format, c.format);
+        EXPECT_EQ(doc.metadata.get("detected_by") == "content", c.byContent);
+    }
+
+    TempFile binary("noext_blob", std::string("\x7f" "ELF\x02\x01\x01\0\0\0", 10));
+    EXPECT_FALSE(parser.canParseFile(binary.path));
+    EXPECT_THROW(parser.parseDocument(binary.path), std::runtime_error);
+
+    ParserRegistry registry = ParserRegistry::withDefaults();
+    ASSERT_NE(registry.findByName("a.json"), nullptr);
+    ASSERT_NE(registry.findByName("x.md"), nullptr);
+    ASSERT_NE(registry.findByName("report.csv"), nullptr);
+    EXPECT_EQ(registry.findByName("A.JSON"), registry.findByName("a.json"));
+    EXPECT_EQ(registry.findByName("dir/Report.Csv.GZ"), registry.findByName("report.csv"));
+    EXPECT_EQ(registry.findByName("x.Markdown"), registry.findByName("x.md"));
+    EXPECT_EQ(registry.findByFormat("JSON"), registry.findByName("a.json"));
+    EXPECT_EQ(registry.findByName("noext"), nullptr);
+}
+
+// The text extraction XMLParser had before the linear scanner: drop
+// tags, a '>' becoming a space, then collapse whitespace with a regex
+std::string regexTextFromXML(const std::string& xml) {
+    std::string result;
+    bool inTag = false;
+    for (char c : xml) {
+        if (c == '<') {
+            inTag = true;
+        } else if (c == '>') {
+            inTag = false;
+            result += ' ';
+        } else if (!inTag) {
+            result += c;
+        }
+    }
+    return std::regex_replace(result, std::regex("\\s+"), " ");
+}
+
+TEST(XMLStream, TextMatchesTheRegexExtractionItReplaced) {
+    // Well-formed XML without entities, comments or CDATA, which the regex
+    // version left undecoded; every kind of ASCII whitespace, tags with
+    // attributes and self-closing tags, runs of spaces across tags
+    std::mt19937 random(20080);
+    const std::string words[] = {"a", "word", "x.y", "42", "\xC3\xA9t\xC3\xA9", ";", "=", "\"q\"", "'"};
+    const char spaces[] = {' ', '\t', '\n', '\r', '\v', '\f'};
+    const std::string tags[] = {"item", "b", "p", "row"};
+    for (int round = 0; round < 20000; ++round) {
+        std::string xml;
+        std::vector<std::string> open;
+        int pieces = static_cast<int>(random() % 24);
+        for (int i = 0; i < pieces; ++i) {
+            switch (random() % 6) {
+                case 0:
+                case 1:
+                    xml += words[random() % std::size(words)];
+                    break;
+                case 2:
+                    for (unsigned n = random() % 4 + 1; n > 0; --n) xml += spaces[random() % std::size(spaces)];
+                    break;
+                case 3: {
+                    const std::string& tag = tags[random() % std::size(tags)];
+                    xml += "<" + tag + (random() % 2 ? " id=\"" + std::to_string(i) + "\"" : "") + ">";
+                    open.push_back(tag);
+                    break;
+                }
+                case 4:
+                    if (!open.empty()) {
+                        xml += "</" + open.back() + ">";
+                        open.pop_back();
+                    }
+                    break;
+                default:
+                    xml += random() % 2 ? "<br/>" : "<hr />";
+            }
+        }
+        while (!open.empty()) {
+            xml += "</" + open.back() + ">";
+            open.pop_back();
+        }
+        SCOPED_TRACE(xml);
+        Document doc = XMLParser().parseContent(xml, "input.xml");
+        ASSERT_EQ(std::string(doc.content), regexTextFromXML(xml));
+    }
+}
+
+TEST(XMLStream, DecodesEntitiesAndSkipsMarkup) {
+    std::string xml = "<?xml version=\"1.0\"?><!DOCTYPE r [<!ENTITY e \"x\">]>"
+                      "<r><!-- a <b> comment --><a t='1>0'>x &amp; &lt;y&gt; &#x41;&#66; &bogus;</a>"
+                      "<c><![CDATA[<raw> &amp;]]></c><e/></r>";
+    EXPECT_EQ(xmlEvents(XMLStreamReader::fromBuffer(xml)),
+              "<r><a>'x & <y> AB &bogus;'</a><c>'<raw> &amp;'</c><e></e></r>");
+}
+
+TEST(XMLStream, SkipsScriptAndStyleInHTML) {
+    XMLStreamOptions options;
+    options.html = true;
+    std::string html = "<HTML><body><p>a<br>b<SCRIPT>if (x </b) {}</script><style>p {}</style>c"
+                       "<li>one<li>two</body>";
+    EXPECT_EQ(xmlEvents(XMLStreamReader::fromBuffer(html, options)),
+              "<html><body><p>'a'<br></br>'b'<script></script><style></style>'c'"
+              "<li>'one'</li><li>'two'</li></p></body></html>");
+}
+
+TEST(XMLStream, ChunkedFileMatchesBuffer) {
+    std::string xml = makeInput("xml", 200) + "<x><![CDATA[split ]] here]]>&amp;&#x263A;<!-- - -- --></x>";
+    TempFile file("stream.xml", xml);
+    std::string expected = xmlEvents(XMLStreamReader::fromBuffer(xml));
+    for (size_t chunk : {1, 2, 3, 7, 64, 4096}) {
+        SCOPED_TRACE(chunk);
+        XMLStreamOptions options;
+        options.chunkSize = chunk;
+        EXPECT_EQ(xmlEvents(XMLStreamReader::fromFile(file.path, options)), expected);
+    }
+}
+
+TEST(XMLStream, SelectKeepsMatchingSubtrees) {
+    std::string xml = "<feed><entry id='1'><title>One</title><body>skip</body></entry>"
+                      "<entry id='2'><title>Two &amp; more</title></entry><title>outside</title></feed>";
+    XMLStreamOptions options;
+    options.select = "/feed/entry/title";
+    EXPECT_EQ(xmlEvents(XMLStreamReader::fromBuffer(xml, options)),
+              "<title>'One'</title><title>'Two & more'</title>");
+    options.select = "//entry[@id='2']";
+    EXPECT_EQ(xmlEvents(XMLStreamReader::fromBuffer(xml, options)),
+              "<entry><title>'Two & more'</title></entry>");
+    options.select = "title";
+    EXPECT_EQ(XMLParser(options).parseContent(xml, "feed.xml").content, " One Two & more outside ");
+    EXPECT_THROW(XMLPath("/feed/[@id]"), std::runtime_error);
+}
+
+// Fields of every row, joined as "a|b;c|d;"
+template <typename Reader>
+std::string csvRows(Reader reader) {
+    std::string out;
+    std::vector<std::string_view> fields;
+    while (reader.next(fields)) {
+        for (size_t i = 0; i < fields.size(); ++i) {
+            out += (i > 0 ? "|" : "") + std::string(fields[i]);
+        }
+        out += ";";
+    }
+    return out;
+}
+
+TEST(CSVDialect, DoubledQuotesAndCRLF) {
+    std::string csv = "a,\"say \"\"hi\"\"\",\"\"\r\n\"two\r\nlines\",\"\"\"\",x\r\nlast,row\r";
+    EXPECT_EQ(csvRows(CSVRowReader::fromBuffer(csv)), "a|say \"hi\"|;two\r\nlines|\"|x;last|row;");
+    TempFile file("dialect.csv", csv);
+    EXPECT_EQ(csvRows(CSVRowReader::fromFile(file.path, 3)), csvRows(CSVRowReader::fromBuffer(csv)));
+    EXPECT_EQ(csvRows(BasicCSVRowReader<CSVDialect<',', '"', '\0', false, false>>::fromBuffer("a,b\r\n")),
+              "a|b\r;");
+}
+
+TEST(CSVDialect, ChunkBoundariesMatchWholeBuffer) {
+    // Quoted delimiters, doubled quotes, CRLF inside and after quoted
+    // fields, and fields longer than the chunks
+    std::string csv;
+    for (int i = 0; i < 12; ++i) {
+        std::string n = std::to_string(i);
+        csv += n + ",\"say \"\"" + n + "\"\", then\r\nmore\",plain" + n + "\r\n";
+        csv += "\"\"\"\"," + std::string(40 + i, 'x') + ",\"a,\"\"b\"\"\r\n\"\n";
+    }
+    csv += "last,\"open\r\n";  // unterminated quote at the very end
+    TempFile file("chunked.csv", csv);
+
+    using Escaped = BasicCSVRowReader<CSVDialect<',', '"', '\\'>>;
+    using KeepCR = BasicCSVRowReader<CSVDialect<',', '"', '\0', false, false>>;
+    std::string whole = csvRows(CSVRowReader::fromBuffer(csv, SimdLevel::Scalar));
+    std::string escaped = csvRows(Escaped::fromBuffer(csv));
+    std::string keepCR = csvRows(KeepCR::fromBuffer(csv));
+    EXPECT_EQ(whole.substr(0, 80), "0|say \"0\", then\r\nmore|plain0;\"|" + std::string(40, 'x') + "|a,\"b\"\r\n;");
+    EXPECT_EQ(csvRows(CSVRowReader::fromBuffer(csv)), whole);
+    for (size_t chunk = 1; chunk <= 80; ++chunk) {
+        SCOPED_TRACE(chunk);
+        EXPECT_EQ(csvRows(CSVRowReader::fromFile(file.path, chunk)), whole);
+        EXPECT_EQ(csvRows(CSVRowReader::fromFile(file.path, chunk, SimdLevel::Scalar)), whole);
+        EXPECT_EQ(csvRows(Escaped::fromFile(file.path, chunk)), escaped);
+        EXPECT_EQ(csvRows(KeepCR::fromFile(file.path, chunk)), keepCR);
+    }
+}
+
+TEST(CSVDialect, ParseStreamDeliversEachRowUntilStopped) {
+    std::string csv = makeInput("csv", 500);
+    TempFile file("streamed.csv", csv);
+    std::vector<std::string> rows;
+    size_t delivered = CSVParser().parseStream(file.path, [&](const std::vector<std::string_view>& fields) {
+        EXPECT_EQ(fields.size(), 3u);
+        rows.push_back(std::string(fields[0]) + "|" + std::string(fields[1]) + "|" + std::string(fields[2]));
+        return true;
+    }, 64);
+    EXPECT_EQ(delivered, 501u);
+    ASSERT_EQ(rows.size(), 501u);
+    EXPECT_EQ(rows[0], "id|name|comment");
+    EXPECT_EQ(rows[500], "499|item499|quoted, with a comma");
+
+    size_t seen = 0;
+    delivered = CSVParser().parseStream(file.path, [&](const std::vector<std::string_view>&) {
+        return ++seen < 10;
+    });
+    EXPECT_EQ(seen, 10u);
+    EXPECT_EQ(delivered, 10u);
+
+    seen = 0;
+    auto throwing = [&](const std::vector<std::string_view>& fields) -> bool {
+        if (fields[0] == "42") throw std::runtime_error("row 42");
+        ++seen;
+        return true;
+    };
+    EXPECT_THROW(CSVParser().parseStream(file.path, throwing, 16), std::runtime_error);
+    EXPECT_EQ(seen, 43u);
+    EXPECT_THROW(CSVParser().parseStream(testing::TempDir() + "streamed_missing.csv", throwing),
+                 std::runtime_error);
+}
+
+TEST(Columnar, InfersTypesAndKeepsArrowLayout) {
+    std::string csv = "id,price,flag,name,mixed\n";
+    for (int i = 0; i < 20; ++i) {
+        std::string n = std::to_string(i);
+        csv += n + "," + (i == 9 ? "" : n + ".5") + "," + (i % 3 ? "true" : "FALSE") + ",";
+        csv += (i == 17 ? "" : "n" + n) + "," + (i < 19 ? n : "1e3") + "\n";
+    }
+    csv += "20,-1,True,,x,extra\n";
+    TempFile file("columnar.csv", csv);
+    CSVTable table = CSVParser().parseColumnar(file.path);
+    ASSERT_EQ(table.rows, 21u);
+    ASSERT_EQ(table.columns.size(), 6u);
+
+    const CSVColumn* id = table.column("id");
+    ASSERT_NE(id, nullptr);
+    EXPECT_EQ(id->type, ColumnType::Int64);
+    EXPECT_EQ(id->intValues.size(), 21u);
+    EXPECT_EQ(id->intValues[20], 20);
+    EXPECT_EQ(id->nullCount, 0u);
+    EXPECT_TRUE(id->offsets.empty());
+    EXPECT_TRUE(id->data.empty());
+
+    // Nulls past the first validity byte
+    const CSVColumn* price = table.column("price");
+    EXPECT_EQ(price->type, ColumnType::Double);
+    EXPECT_EQ(price->validity.size(), 3u);
+    EXPECT_EQ(price->validity[1], 0xFD);
+    EXPECT_FALSE(price->isValid(9));
+    EXPECT_TRUE(price->isValid(20));
+    EXPECT_EQ(price->nullCount, 1u);
+    EXPECT_DOUBLE_EQ(price->doubleValues[8], 8.5);
+    EXPECT_DOUBLE_EQ(price->doubleValues[20], -1.0);
+
+    // Bit-packed like the validity bitmap
+    const CSVColumn* flag = table.column("flag");
+    EXPECT_EQ(flag->type, ColumnType::Bool);
+    EXPECT_EQ(flag->boolValues.size(), 3u);
+    EXPECT_EQ(flag->boolValues[0], 0xB6);
+    EXPECT_EQ(flag->boolValues[2] & 0x10, 0x10);
+
+    // 64-bit offsets, a null taking no bytes
+    const CSVColumn* name = table.column("name");
+    EXPECT_EQ(name->type, ColumnType::String);
+    ASSERT_EQ(name->offsets.size(), 22u);
+    EXPECT_EQ(name->offsets[0], 0);
+    EXPECT_EQ(name->offsets[17], name->offsets[18]);
+    EXPECT_FALSE(name->isValid(17));
+    EXPECT_EQ(name->nullCount, 2u);
+    EXPECT_EQ(name->stringAt(16), "n16");
+    EXPECT_EQ(name->stringAt(18), "n18");
+    EXPECT_EQ(name->data.size(), static_cast<size_t>(name->offsets[21]));
+
+    // Integers until "1e3", then "x" leaves only text
+    EXPECT_EQ(table.column("mixed")->type, ColumnType::String);
+    EXPECT_EQ(table.column("mixed")->stringAt(19), "1e3");
+
+    // A column the header doesn't name is null for the rows before it
+    const CSVColumn& late = table.columns[5];
+    EXPECT_EQ(late.name, "column_5");
+    EXPECT_EQ(late.type, ColumnType::String);
+    EXPECT_EQ(late.nullCount, 20u);
+    EXPECT_EQ(late.stringAt(20), "extra");
+}
+
+TEST(Columnar, WidensAndLeavesNonFiniteWordsAsText) {
+    auto build = [](const std::vector<std::vector<std::string_view>>& rows, CSVTableOptions options) {
+        CSVTableBuilder builder(options);
+        for (const auto& row : rows) builder.addRow(row);
+        return builder.finish();
+    };
+    CSVTable widened = build({{"a", "b", "c", "d"}, {"1", "nan", "", "1"}, {"2.5", "inf", "", "x"},
+                              {"3", "-infinity", "", "2"}}, CSVTableOptions());
+    EXPECT_EQ(widened.column("a")->type, ColumnType::Double);
+    EXPECT_DOUBLE_EQ(widened.column("a")->doubleValues[0], 1.0);
+    EXPECT_EQ(widened.column("b")->type, ColumnType::String);
+    EXPECT_EQ(widened.column("b")->stringAt(1), "inf");
+    // All null: no value to infer from
+    EXPECT_EQ(widened.column("c")->type, ColumnType::String);
+    EXPECT_EQ(widened.column("c")->nullCount, 3u);
+    EXPECT_EQ(widened.column("d")->type, ColumnType::String);
+
+    CSVTableOptions plain;
+    plain.header = false;
+    plain.inferTypes = false;
+    CSVTable raw = build({{"1", "2"}, {"3", "4"}}, plain);
+    EXPECT_EQ(raw.rows, 2u);
+    EXPECT_EQ(raw.columns[0].name, "column_0");
+    EXPECT_EQ(raw.columns[1].type, ColumnType::String);
+    EXPECT_EQ(raw.columns[1].stringAt(1), "4");
+
+    // Out of range for int64, but a finite double
+    CSVTable big = build({{"n"}, {"99999999999999999999"}}, CSVTableOptions());
+    EXPECT_EQ(big.column("n")->type, ColumnType::Double);
+}
+
+TEST(CSVDialect, EscapesAndHeader) {
+    using Dialect = CSVDialect<'|', '"', '\\', true>;
+    std::string psv = "id|note\r\n1|pipe \\| and \\\"quote\\\"\n2|\"quoted | pipe\"\n";
+    EXPECT_EQ(csvRows(BasicCSVRowReader<Dialect>::fromBuffer(psv)),
+              "id|note;1|pipe | and \"quote\";2|quoted | pipe;");
+    Document doc = BasicCSVParser<Dialect>().parseContent(psv, "x.psv");
+    EXPECT_EQ(doc.format, "psv");
+    EXPECT_EQ(doc.content, "1 | pipe | and \"quote\"\n2 | quoted | pipe\n");
+    EXPECT_EQ(doc.metadata.get("header"), "id | note");
+    EXPECT_EQ(doc.metadata.rows, 2u);
+    EXPECT_EQ(doc.metadata.columns, 2u);
+}
+
+TEST(CSVScanner, AgreesWithScalarAtEverySimdLevel) {
+    std::vector<CSVScanner> scanners = {CSVScanner(SimdLevel::Scalar), CSVScanner()};
+    for (SimdLevel level : {SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::NEON}) {
+        if (CSVScanner(level).level() == level) scanners.emplace_back(level);
+    }
+    // Byte at a time: delimiters and newlines outside quotes
+    auto expected = [](std::string_view text, char delimiter, bool& inQuotes) {
+        std::vector<uint32_t> offsets;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] == '"') {
+                inQuotes = !inQuotes;
+            } else if (!inQuotes && (text[i] == delimiter || text[i] == '\n')) {
+                offsets.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        return offsets;
+    };
+    // Scanned whole and in two calls split at `cut`, carrying the quote state
+    auto check = [&](const std::string& text, char delimiter, size_t cut) {
+        bool wantQuotes = false;
+        std::vector<uint32_t> want = expected(text, delimiter, wantQuotes);
+        for (const CSVScanner& scanner : scanners) {
+            bool inQuotes = false;
+            std::vector<uint32_t> got;
+            scanner.scan(text.data(), text.size(), delimiter, '"', inQuotes, got);
+            EXPECT_EQ(got, want) << simdLevelName(scanner.level()) << " " << text;
+            EXPECT_EQ(inQuotes, wantQuotes) << simdLevelName(scanner.level()) << " " << text;
+
+            inQuotes = false;
+            std::vector<uint32_t> first;
+            std::vector<uint32_t> second;
+            scanner.scan(text.data(), cut, delimiter, '"', inQuotes, first);
+            scanner.scan(text.data() + cut, text.size() - cut, delimiter, '"', inQuotes, second);
+            for (uint32_t offset : second) first.push_back(static_cast<uint32_t>(offset + cut));
+            EXPECT_EQ(first, want) << simdLevelName(scanner.level()) << " cut " << cut << " " << text;
+            EXPECT_EQ(inQuotes, wantQuotes);
+        }
+    };
+
+    // Quotes, doubled quotes, CRLF and delimiters at every position around
+    // the 64-byte blocks
+    for (const char* piece : {",", "\"", "\"\"", "\r\n", "\"a,b\"", "\"x\r\ny\",", "a\"\"b\",\"c\n"}) {
+        for (size_t pad = 0; pad < 140; ++pad) {
+            std::string text = std::string(pad, 'a') + piece + ",z\r\n" + std::string(70, 'b') + ",\"q\"\n";
+            check(text, ',', pad + 1);
+        }
+    }
+    // Random mixes heavy in structural bytes, for each delimiter
+    std::mt19937 random(7);
+    const char alphabet[] = {'a', 'b', ',', ';', '\t', '"', '"', '\r', '\n'};
+    for (char delimiter : {',', ';', '\t'}) {
+        for (int round = 0; round < 300; ++round) {
+            std::string text(random() % 400, '\0');
+            for (char& c : text) c = alphabet[random() % sizeof(alphabet)];
+            check(text, delimiter, text.empty() ? 0 : random() % text.size());
+        }
+    }
+}
+
+TEST(CSVDialect, DispatcherSniffsOrUsesConfiguredDialect) {
+    Document tsv = DelimitedTextParser().parseContent("a\tb\tc,d\n1\t2\t3,4\n", "data.txt");
+    EXPECT_EQ(tsv.format, "tsv");
+    EXPECT_EQ(tsv.content, "a | b | c,d\n1 | 2 | 3,4\n");
+
+    CSVDialectOptions options;
+    options.delimiter = ';';
+    options.header = true;
+    Document dsv = DelimitedTextParser(options).parseContent("x;y\n1,5;2,5\n", "data.dsv");
+    EXPECT_EQ(dsv.content, "1,5 | 2,5\n");
+    EXPECT_EQ(dsv.metadata.get("delimiter"), ";");
+    EXPECT_EQ(dsv.metadata.get("header"), "x | y");
+
+    options.delimiter = ':';
+    EXPECT_THROW(DelimitedTextParser{options}, std::runtime_error);
+
+    UniversalDocumentParser parser;
+    EXPECT_EQ(parser.parse(std::string_view("a;b;c\n1;2;3\n")).metadata.get("delimiter"), ";");
+    EXPECT_EQ(parser.parse(std::string_view("a|b\n1|2\n"), "psv").format, "psv");
+    EXPECT_EQ(parser.parse(std::string_view("a|b\n1|2\n")).format, "psv");
+    EXPECT_EQ(parser.parse(std::string_view("a;b\n1;2\n"), "dsv").format, "dsv");
+}
+
+TEST(Directory, BoundedQueueBlocksWhenFullAndDrainsAfterClose) {
+    BoundedQueue<int> queue(2);
+    int value = 1;
+    EXPECT_TRUE(queue.tryPush(value));
+    value = 2;
+    EXPECT_TRUE(queue.tryPush(value));
+    value = 3;
+    EXPECT_FALSE(queue.tryPush(value));
+
+    std::thread producer([&queue] { EXPECT_TRUE(queue.push(3)); });
+    int popped = 0;
+    EXPECT_TRUE(queue.pop(popped));
+    EXPECT_EQ(popped, 1);
+    producer.join();
+
+    queue.close();
+    EXPECT_FALSE(queue.push(4));
+    EXPECT_TRUE(queue.pop(popped));
+    EXPECT_EQ(popped, 2);
+    EXPECT_TRUE(queue.pop(popped));
+    EXPECT_EQ(popped, 3);
+    EXPECT_FALSE(queue.pop(popped));
+}
+
+TEST(Directory, BoundedQueueSleepersWakeForItemsRoomAndClose) {
+    // Producers and consumers outnumber a two-slot queue, so both sides
+    // keep running out of spins and sleeping
+    BoundedQueue<int> queue(2);
+    constexpr int kPerProducer = 2000;
+    std::vector<std::atomic<int>> seen(4 * kPerProducer);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < 4; ++p) {
+        threads.emplace_back([&queue, p] {
+            for (int i = 0; i < kPerProducer; ++i) {
+                EXPECT_TRUE(queue.push(p * kPerProducer + i));
+                if (i % 500 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        });
+    }
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < 3; ++c) {
+        consumers.emplace_back([&queue, &seen] {
+            int value = 0;
+            while (queue.pop(value)) {
+                ++seen[value];
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    queue.close();
+    for (auto& thread : consumers) {
+        thread.join();
+    }
+    for (auto& count : seen) {
+        EXPECT_EQ(count.load(), 1);
+    }
+
+    // close() wakes a sleeping popper and a sleeping pusher
+    BoundedQueue<int> empty(2);
+    BoundedQueue<int> full(2);
+    ASSERT_TRUE(full.push(1));
+    ASSERT_TRUE(full.push(2));
+    std::thread popper([&empty] {
+        int value = 0;
+        EXPECT_FALSE(empty.pop(value));
+    });
+    std::thread pusher([&full] { EXPECT_FALSE(full.push(3)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    empty.close();
+    full.close();
+    popper.join();
+    pusher.join();
+}
+
+TEST(Directory, CrawlsNestedTreeThroughFilters) {
+    namespace fs = std::filesystem;
+    fs::path root = fs::path(testing::TempDir()) / "docparser_crawl";
+    fs::remove_all(root);
+    std::set<std::string> expected;
+    for (int branch = 0; branch < 3; ++branch) {
+        fs::path dir = root / ("b" + std::to_string(branch));
+        for (int depth = 0; depth < 40; ++depth) {
+            dir /= "n";
+        }
+        fs::create_directories(dir);
+        for (int i = 0; i < 5; ++i) {
+            fs::path file = dir / ("r" + std::to_string(i) + ".csv");
+            std::ofstream(file) << "a,b\n" << i << ",x\n";
+            expected.insert(file.string());
+        }
+        std::ofstream(dir / "big.txt") << std::string(4096, 'x');
+        std::ofstream(dir / "blob.bin") << std::string("\0\1\2", 3);
+    }
+    fs::create_directories(root / ".cache");
+    std::ofstream(root / ".cache" / "hidden.csv") << "a,b\n";
+    fs::create_directories(root / "vendor");
+    std::ofstream(root / "vendor" / "skip.csv") << "a,b\n";
+
+    UniversalDocumentParser parser;
+    DirectoryFilters filters;
+    filters.exclude = {"vendor"};
+    filters.maxBytes = 1024;
+    DirectoryOptions options;
+    options.queueDepth = 2;  // keep every stage blocking on its neighbours
+    std::set<std::string> seen;
+    size_t delivered = parser.parseDirectory(root.string(), filters, options, [&](BatchResult&& result) {
+        EXPECT_TRUE(result.ok) << result.error;
+        EXPECT_EQ(result.document.format, "csv");
+        EXPECT_TRUE(seen.insert(result.filename).second);
+        return true;
+    });
+    EXPECT_EQ(delivered, expected.size());
+    EXPECT_EQ(seen, expected);
+
+    filters = DirectoryFilters();
+    filters.include = {"b1/**/r[0-2].csv", "b2/**/r?.csv"};
+    EXPECT_EQ(parser.parseDirectory(root.string(), filters).size(), 8u);
+    filters.include = {"**/*.txt"};
+    EXPECT_EQ(parser.parseDirectory(root.string(), filters).size(), 3u);
+    filters = DirectoryFilters();
+    filters.extensions = {"CSV"};
+    filters.includeHidden = true;
+    EXPECT_EQ(parser.parseDirectory(root.string(), filters).size(), expected.size() + 2);
+
+    EXPECT_EQ(parser.parseDirectory(root.string(), DirectoryFilters(), options,
+                                    [](BatchResult&&) { return false; }),
+              1u);
+    EXPECT_THROW(parser.crawlDirectory((root / "missing").string()), std::runtime_error);
+    fs::remove_all(root);
+}
+
+TEST(Compression, DetectsByMagicAndLooksThroughExtensions) {
+    EXPECT_EQ(detectCompression(std::string_view("\x1f\x8b\x08\x00", 4)), Compression::Gzip);
+    EXPECT_EQ(detectCompression("\x28\xB5\x2F\xFD...."), Compression::Zstd);
+    EXPECT_EQ(detectCompression("id,name\n"), Compression::None);
+    EXPECT_EQ(compressionFromName("logs/rows.CSV.GZ"), Compression::Gzip);
+    EXPECT_EQ(compressionFromName("a.json.zst"), Compression::Zstd);
+    EXPECT_EQ(compressionFromName("archive.gz/rows.csv"), Compression::None);
+    EXPECT_EQ(innerName("logs/rows.csv.gz"), "logs/rows.csv");
+    EXPECT_EQ(innerName("rows.csv"), "rows.csv");
+    EXPECT_EQ(CSVParser().getExtensions().front(), "csv");
+    EXPECT_TRUE(CSVParser().canParse("rows.csv.gz"));
+    EXPECT_FALSE(CSVParser().canParse("rows.json.zst"));
+}
+
+#ifdef DOCPARSER_HAVE_ZLIB
+// gzip member of `text`; `members` > 1 concatenates that many pieces
+std::string gzipped(std::string_view text, size_t members = 1) {
+    std::string out;
+    for (size_t i = 0; i < members; ++i) {
+        std::string_view piece = text.substr(text.size() * i / members,
+                                             text.size() * (i + 1) / members - text.size() * i / members);
+        z_stream stream{};
+        deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        std::string member(deflateBound(&stream, static_cast<uLong>(piece.size())), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(piece.data()));
+        stream.avail_in = static_cast<uInt>(piece.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&member[0]);
+        stream.avail_out = static_cast<uInt>(member.size());
+        deflate(&stream, Z_FINISH);
+        member.resize(stream.total_out);
+        deflateEnd(&stream);
+        out += member;
+    }
+    return out;
+}
+
+// One BGZF block of `text`: a gzip member whose "BC" extra field holds its size
+std::string bgzfBlock(std::string_view text) {
+    z_stream stream{};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::string body(deflateBound(&stream, static_cast<uLong>(text.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    stream.avail_in = static_cast<uInt>(text.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&body[0]);
+    stream.avail_out = static_cast<uInt>(body.size());
+    deflate(&stream, Z_FINISH);
+    body.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    auto le = [](std::string& out, uint32_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; ++i) out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    };
+    std::string block("\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0", 16);
+    le(block, static_cast<uint32_t>(18 + body.size() + 8 - 1), 2);
+    block += body;
+    le(block, static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(text.data()),
+                                          static_cast<uInt>(text.size()))), 4);
+    le(block, static_cast<uint32_t>(text.size()), 4);
+    return block;
+}
+
+TEST(Compression, DeclaredSizesAreNotTrusted) {
+    std::string text;
+    for (int i = 0; i < 2000; ++i) text += "row " + std::to_string(i) + "\n";
+    std::string blocks = bgzfBlock(std::string_view(text).substr(0, 6000)) +
+                         bgzfBlock(std::string_view(text).substr(6000));
+    EXPECT_EQ(Decompressor::decompress(blocks, Compression::Gzip), text);
+
+    // A block or member claiming ~4 GiB is decoded by streaming, which
+    // fails on the mismatch instead of allocating the claimed size
+    for (std::string input : {blocks, gzipped(text)}) {
+        input.replace(input.size() - 4, 4, "\xf0\xff\xff\xff");
+        EXPECT_THROW(Decompressor::decompress(input, Compression::Gzip), std::runtime_error);
+    }
+}
+
+TEST(Compression, GzipFilesParseLikeTheirContent) {
+    std::string csv = "id,note\n";
+    for (int i = 0; i < 5000; ++i) {
+        csv += std::to_string(i) + ",\"row, " + std::to_string(i) + "\"\n";
+    }
+    TempFile plain("plain_rows.csv", csv);
+    TempFile packed("packed_rows.csv.gz", gzipped(csv, 3));
+    TempFile unnamed("packed_rows", gzipped(csv));
+
+    UniversalDocumentParser parser;
+    Document expected = parser.parseDocument(plain.path);
+    for (const auto* file : {&packed, &unnamed}) {
+        ASSERT_TRUE(parser.canParseFile(file->path));
+        Document doc = parser.parseDocument(file->path);
+        EXPECT_EQ(doc.content, expected.content);
+        EXPECT_EQ(doc.metadata.get("compression"), "gzip");
+    }
+
+    // Streamed in small chunks straight out of the decoder
+    CSVRowReader reader = CSVRowReader::fromFile(packed.path, 512);
+    std::vector<std::string_view> fields;
+    size_t rows = 0;
+    while (reader.next(fields)) {
+        ASSERT_EQ(fields.size(), 2u);
+        ++rows;
+    }
+    EXPECT_EQ(rows, 5001u);
+
+    std::string bytes = gzipped(csv);
+    EXPECT_EQ(parser.parse(bytes).content, expected.content);
+    EXPECT_THROW(parser.parse(std::string_view(bytes).substr(0, bytes.size() / 2), "csv"),
+                 std::runtime_error);
+}
+
+TEST(Compression, SequentialFormatsStreamOutOfTheDecoder) {
+    std::string csv = "id,note\n";
+    for (int i = 0; i < 100000; ++i) {
+        csv += std::to_string(i) + ",\"a quoted note, row " + std::to_string(i) + "\"\n";
+    }
+    std::string text = makeInput("text", 20000) + "\fsecond page\n";
+    std::string xml = makeInput("xml", 2000);
+    std::string tsv = "a\tb\n1\t2\n3\t4\n";
+    struct Case { std::string name; std::string content; };
+    UniversalDocumentParser parser;
+    for (const Case& c : {Case{"stream.csv", csv}, Case{"stream.txt", text}, Case{"stream.xml", xml},
+                          Case{"stream.tsv", tsv}, Case{"stream_rows", csv}}) {
+        SCOPED_TRACE(c.name);
+        TempFile plain(c.name, c.content);
+        TempFile packed(c.name + ".gz", gzipped(c.content));
+        Document expected = parser.parseDocument(plain.path);
+        Document doc = parser.parseDocument(packed.path);
+        EXPECT_EQ(doc.content, expected.content);
+        EXPECT_EQ(doc.pageCount(), expected.pageCount());
+        EXPECT_EQ(doc.metadata.lines, expected.metadata.lines);
+        EXPECT_EQ(doc.metadata.rows, expected.metadata.rows);
+        EXPECT_EQ(doc.metadata.get("delimiter"), expected.metadata.get("delimiter"));
+        EXPECT_EQ(doc.metadata.encoding, expected.metadata.encoding);
+        EXPECT_EQ(doc.metadata.get("compression"), "gzip");
+    }
+
+    // Counting rows holds a chunk at a time, never the whole inflated file
+    TempFile packed("counted.csv.gz", gzipped(csv));
+    threadAllocations().largest = 0;
+    EXPECT_EQ(CSVParser().parse(packed.path, ParseOutput::Metadata).metadata.rows, 100001u);
+    EXPECT_LT(threadAllocations().largest, csv.size());
+}
+#endif
+
+#ifdef DOCPARSER_HAVE_ZSTD
+// A single-segment zstd frame holding `text` as one raw block, whose header
+// claims `contentSize` bytes
+std::string zstdRawFrame(std::string_view text, unsigned long long contentSize) {
+    std::string frame("\x28\xB5\x2F\xFD\xE0", 5);
+    for (int i = 0; i < 8; ++i) frame += static_cast<char>((contentSize >> (8 * i)) & 0xFF);
+    uint32_t header = 1 | (static_cast<uint32_t>(text.size()) << 3);  // last block, raw
+    for (int i = 0; i < 3; ++i) frame += static_cast<char>((header >> (8 * i)) & 0xFF);
+    frame += text;
+    return frame;
+}
+
+TEST(Compression, ZstdFrameSizesAreNotTrusted) {
+    EXPECT_EQ(Decompressor::decompress(zstdRawFrame("hello ", 6) + zstdRawFrame("world", 5),
+                                       Compression::Zstd),
+              "hello world");
+    // A terabyte claim, and claims whose sum overflows
+    EXPECT_THROW(Decompressor::decompress(zstdRawFrame("hello", 1ULL << 40), Compression::Zstd),
+                 std::runtime_error);
+    std::string frames;
+    for (int i = 0; i < 4; ++i) frames += zstdRawFrame("x", ~0ULL >> 2);
+    EXPECT_THROW(Decompressor::decompress(frames, Compression::Zstd), std::runtime_error);
+}
+#endif
+
+TEST(Incremental, FollowsAppendsTruncationAndRotation) {
+    TempFile log("tail.txt", "one\ntwo\nthr");
+    auto append = [&](const std::string& text) {
+        std::ofstream(log.path, std::ios::binary | std::ios::app) << text;
+    };
+    TextParser parser;
+    ParseCheckpoint checkpoint;
+
+    Document doc = parser.parseIncremental(log.path, checkpoint);
+    EXPECT_EQ(doc.content, "one\ntwo\n");
+    EXPECT_EQ(doc.metadata.lines, 2u);
+    EXPECT_EQ(checkpoint.offset, 8u);
+
+    append("ee\nfour\n");
+    doc = parser.parseIncremental(log.path, checkpoint);
+    EXPECT_EQ(doc.content, "three\nfour\n");
+    EXPECT_EQ(doc.metadata.lines, 4u);
+    EXPECT_EQ(doc.metadata.get("offset"), "8");
+    EXPECT_EQ(doc.metadata.get("reset"), "false");
+
+    // Nothing new
+    EXPECT_EQ(parser.parseIncremental(log.path, checkpoint).content, "");
+
+    // Truncated in place
+    std::ofstream(log.path, std::ios::binary | std::ios::trunc) << "new\n";
+    doc = parser.parseIncremental(log.path, checkpoint);
+    EXPECT_EQ(doc.content, "new\n");
+    EXPECT_EQ(doc.metadata.lines, 1u);
+    EXPECT_EQ(doc.metadata.get("reset"), "true");
+
+    // Rotated: a longer file moved over the old name
+    TempFile rotated("tail.txt.next", "rotated one\nrotated two\n");
+    ASSERT_EQ(std::rename(rotated.path.c_str(), log.path.c_str()), 0);
+    doc = parser.parseIncremental(log.path, checkpoint);
+    EXPECT_EQ(doc.content, "rotated one\nrotated two\n");
+    EXPECT_EQ(doc.metadata.lines, 2u);
+    EXPECT_EQ(doc.metadata.get("reset"), "true");
+}
+
+TEST(Incremental, DecodesOnlyCompleteCharactersOfTheNewBytes) {
+    // A poll that lands between the two bytes of an é must not take the
+    // file for Latin-1 or see its prefix change
+    TempFile log("tail_utf8.txt", "caf\xC3\xA9\nna\xC3");
+    TextParser parser;
+    ParseCheckpoint checkpoint;
+    EXPECT_EQ(parser.parseIncremental(log.path, checkpoint).content, "caf\xC3\xA9\n");
+    std::ofstream(log.path, std::ios::binary | std::ios::app) << "\xAFve\n";
+    Document doc = parser.parseIncremental(log.path, checkpoint);
+    EXPECT_EQ(doc.content, "na\xC3\xAFve\n");
+    EXPECT_EQ(doc.metadata.get("reset"), "false");
+    EXPECT_EQ(doc.metadata.encoding, "utf-8");
+    EXPECT_EQ(checkpoint.encoding, TextEncoding::UTF8);
+
+    // UTF-16 keeps its encoding and offsets in file bytes across polls
+    auto utf16 = [](std::u16string_view text) {
+        std::string out;
+        for (char16_t c : text) {
+            out += static_cast<char>(c & 0xFF);
+            out += static_cast<char>(c >> 8);
+        }
+        return out;
+    };
+    TempFile wide("tail_utf16.csv", "\xFF\xFE" + utf16(u"id,note\n1,\"two\nlines\"\n2,\"op"));
+    CSVParser csv;
+    ParseCheckpoint wideCheckpoint;
+    doc = csv.parseIncremental(wide.path, wideCheckpoint);
+    EXPECT_EQ(doc.metadata.rows, 2u);
+    EXPECT_EQ(doc.metadata.encoding, "utf-16le");
+    EXPECT_EQ(wideCheckpoint.offset, 2 + 2 * std::u16string_view(u"id,note\n1,\"two\nlines\"\n").size());
+    std::ofstream(wide.path, std::ios::binary | std::ios::app) << utf16(u"ené\"\n");
+    doc = csv.parseIncremental(wide.path, wideCheckpoint);
+    EXPECT_EQ(doc.metadata.rows, 3u);
+    EXPECT_EQ(doc.metadata.get("reset"), "false");
+    EXPECT_NE(doc.content.find("open\xC3\xA9"), std::string::npos);
+}
+
+TEST(ParseOutput, MetadataOnlyMatchesFullParseWithoutOutput) {
+    for (auto& sample : samples()) {
+        SCOPED_TRACE(sample.name);
+        std::string input = makeInput(sample.name, 4000);
+        Document full = sample.parser->parseContent(input, sample.filename);
+
+        CountingResource resource;
+        Document doc = sample.parser->parseContent(input, sample.filename, ParseOutput::Metadata, &resource);
+        EXPECT_TRUE(doc.content.empty());
+        EXPECT_EQ(doc.pageCount(), 0u);
+        EXPECT_EQ(doc.format, full.format);
+        EXPECT_EQ(doc.metadata, full.metadata);
+        // Counts are plain fields, so text and CSV allocate nothing at all;
+        // the others a few metadata extras, nothing the size of the input
+        std::string_view name = sample.name;
+        if (name == "text" || name == "csv") {
+            EXPECT_EQ(resource.allocations, 0u);
+        }
+        EXPECT_LT(resource.bytes, 1024u);
+    }
+}
+
+TEST(ParseOutput, CountingScansDoNotAllocatePerRecord) {
+    ParallelOptions options;
+    options.threads = 4;
+    options.minChunkBytes = 4096;
+    CSVParser parallel(options);
+    CSVParser serial;
+    TextParser text;
+    std::string csv = makeInput("csv", 64000);
+    std::string lines = makeInput("text", 64000);
+
+    ParseOptions metadata(ParseOutput::Metadata);
+    size_t serialCount = heapAllocationsDuring([&] {
+        EXPECT_EQ(serial.parseContent(csv, "input.csv", metadata).metadata.rows, 64001u);
+    });
+    size_t textCount = heapAllocationsDuring([&] {
+        EXPECT_EQ(text.parseContent(lines, "input.txt", metadata).metadata.lines, 64001u);
+    });
+    EXPECT_LE(serialCount, 32u);
+    EXPECT_LE(textCount, 32u);
+
+    Document doc = parallel.parseContent(csv, "input.csv", metadata);
+    EXPECT_EQ(doc.metadata.rows, 64001u);
+    EXPECT_EQ(doc.metadata.columns, 3u);
+    EXPECT_TRUE(doc.content.empty());
+}
+
+TEST(ParseOutput, RawContentAndPagesThroughUniversalParser) {
+    std::string csv = makeInput("csv", 500);
+    TempFile file("outputs.csv", csv);
+    UniversalDocumentParser parser{DocumentCacheOptions{size_t(1) << 20}};
+
+    Document raw = parser.parseDocument(file.path, ParseOutput::RawContent);
+    EXPECT_EQ(std::string_view(raw.content), csv);
+    EXPECT_EQ(raw.pageCount(), 0u);
+    EXPECT_FALSE(raw.metadata.rows);
+    EXPECT_EQ(raw.metadata.parser, "CSV");
+
+    // Pages bring the formatted text they index into
+    Document paged = parser.parseDocument(file.path, ParseOutput::Pages);
+    Document full = parser.parseDocument(file.path);
+    EXPECT_EQ(paged.content, full.content);
+    EXPECT_EQ(paged.pageCount(), full.pageCount());
+    EXPECT_FALSE(paged.metadata.rows);
+
+    // Only the full parse went into the cache
+    EXPECT_EQ(parser.cacheStats().entries, 1u);
+    EXPECT_EQ(parser.cacheStats().hits, 0u);
+
+    BatchOptions options;
+    options.outputs = ParseOutput::Metadata;
+    std::vector<BatchResult> results = parser.parseDocuments({file.path}, options);
+    ASSERT_TRUE(results[0].ok);
+    EXPECT_EQ(results[0].document.metadata.rows, 501u);
+    EXPECT_TRUE(results[0].document.content.empty());
+}
+
+// Counts the parses that were asked for metadata only
+class OutputsProbe : public DocumentParser {
+public:
+    std::atomic<size_t>* calls;
+    std::atomic<size_t>* metadataOnly;
+
+    OutputsProbe(std::atomic<size_t>* callCount, std::atomic<size_t>* metadataCount)
+        : calls(callCount), metadataOnly(metadataCount) {}
+
+    std::vector<std::string> getExtensions() const override { return {"probe"}; }
+
+    using DocumentParser::parseContent;
+
+    Document parseContent(std::string_view content, const std::string&, const ParseOptions& options,
+                          const Document::allocator_type& alloc = {}) override {
+        calls->fetch_add(1);
+        if (options.outputs == ParseOutput::Metadata) metadataOnly->fetch_add(1);
+        Document doc(alloc);
+        doc.format = "probe";
+        doc.content.assign(content.data(), content.size());
+        return doc;
+    }
+
+    std::string getFormatName() const override { return "Probe"; }
+};
+
+TEST(ParseOutput, OptionsReachCustomParsersOnEveryThread) {
+    namespace fs = std::filesystem;
+    fs::path root = fs::path(testing::TempDir()) / "probe_tree";
+    fs::remove_all(root);
+    fs::create_directories(root);
+    std::vector<std::string> paths;
+    for (int i = 0; i < 12; ++i) {
+        paths.push_back((root / ("f" + std::to_string(i) + ".probe")).string());
+        std::ofstream(paths.back(), std::ios::binary) << "probe " << i << "\n";
+    }
+
+    std::atomic<size_t> calls{0};
+    std::atomic<size_t> metadataOnly{0};
+    ParserRegistry registry = ParserRegistry::withDefaults();
+    registry.add(std::make_unique<OutputsProbe>(&calls, &metadataOnly));
+    UniversalDocumentParser parser(std::move(registry));
+    auto expectMetadataOnly = [](const BatchResult& result) {
+        ASSERT_TRUE(result.ok) << result.error;
+        EXPECT_TRUE(result.document.content.empty());
+        EXPECT_EQ(result.document.metadata.parser, "Probe");
+    };
+
+    BatchOptions batch;
+    batch.threads = 3;
+    batch.outputs = ParseOutput::Metadata;
+    for (const BatchResult& result : parser.parseDocuments(paths, batch)) {
+        expectMetadataOnly(result);
+    }
+
+    DirectoryOptions directory;
+    directory.parseThreads = 3;
+    directory.outputs = ParseOutput::Metadata;
+    std::vector<BatchResult> crawled = parser.parseDirectory(root.string(), DirectoryFilters(), directory);
+    EXPECT_EQ(crawled.size(), paths.size());
+    for (const BatchResult& result : crawled) {
+        expectMetadataOnly(result);
+    }
+
+    AsyncOptions async;
+    async.parseThreads = 3;
+    async.outputs = ParseOutput::Metadata;
+    {
+        AsyncDocumentParser reader(parser, async);
+        for (const auto& path : paths) {
+            reader.parseAsync(path, [&](BatchResult&& result) { expectMetadataOnly(result); });
+        }
+    }
+
+    EXPECT_EQ(calls.load(), 3 * paths.size());
+    EXPECT_EQ(metadataOnly.load(), calls.load());
+    EXPECT_EQ(parser.parseDocument(paths[0]).content, "probe 0\n");
+    fs::remove_all(root);
+}
+
+TEST(Cache, HashedMissParsesTheBytesItHashed) {
+    // A parse takes the premapped bytes it is given instead of the file
+    TempFile file("premapped.txt", "on disk\n");
+    FileBuffer premapped = FileBuffer::fromBytes("hashed\n");
+    ParseOptions premappedOptions;
+    premappedOptions.premapped = &premapped;
+    EXPECT_EQ(TextParser().parse(file.path, premappedOptions).content, "hashed\n");
+    EXPECT_EQ(TextParser().parse(file.path).content, "on disk\n");
+
+    DocumentCacheOptions options;
+    options.capacityBytes = size_t(1) << 20;
+    options.hashContent = true;
+    UniversalDocumentParser parser(options);
+    std::string csv = makeInput("csv", 200);
+    TempFile rows("hashed.csv", csv);
+    Document first = parser.parseDocument(rows.path);
+    EXPECT_EQ(first.content, UniversalDocumentParser().parseDocument(rows.path).content);
+    EXPECT_EQ(parser.parseDocument(rows.path).content, first.content);
+    EXPECT_EQ(parser.cacheStats().hits, 1u);
+
+    // Same size, new bytes: a miss that parses the new bytes
+    csv.replace(csv.find("item1"), 5, "ITEM1");
+    std::ofstream(rows.path, std::ios::binary | std::ios::trunc) << csv;
+    EXPECT_NE(parser.parseDocument(rows.path).content.find("ITEM1"), std::string::npos);
+    EXPECT_EQ(parser.cacheStats().misses, 2u);
+#ifdef DOCPARSER_HAVE_ZLIB
+    TempFile packed("hashed.csv.gz", gzipped(csv));
+    Document unpacked = parser.parseDocument(packed.path);
+    EXPECT_NE(unpacked.content.find("ITEM1"), std::string::npos);
+    EXPECT_EQ(unpacked.metadata.get("compression"), "gzip");
+#endif
+}
+
+TEST(Cache, EvictsLeastRecentlyUsedWithinTheByteBudget) {
+    using Cache = BasicDocumentCache<std::string>;
+    auto key = [](const char* path) { return Cache::Key{path, 1, 1}; };
+    auto value = [](const char* text) { return std::make_shared<const std::string>(text); };
+    Cache cache(100);
+    cache.insert(key("a"), value("a"), 40);
+    cache.insert(key("b"), value("b"), 40);
+    ASSERT_NE(cache.find(key("a")), nullptr);
+    cache.insert(key("c"), value("c"), 40);
+    EXPECT_EQ(cache.find(key("b")), nullptr);
+    EXPECT_EQ(*cache.find(key("a")), "a");
+    EXPECT_EQ(*cache.find(key("c")), "c");
+    EXPECT_EQ(cache.stats().evictions, 1u);
+    EXPECT_EQ(cache.stats().bytes, 80u);
+
+    // Another version of a path is another key; re-inserting a key
+    // replaces its size
+    EXPECT_EQ(cache.find(Cache::Key{"a", 2, 1}), nullptr);
+    cache.insert(key("a"), value("a2"), 10);
+    EXPECT_EQ(*cache.find(key("a")), "a2");
+    EXPECT_EQ(cache.stats().bytes, 50u);
+    cache.insert(key("huge"), value("huge"), 101);
+    EXPECT_EQ(cache.find(key("huge")), nullptr);
+    EXPECT_EQ(cache.stats().entries, 2u);
+    cache.insert(key("d"), value("d"), 60);
+    EXPECT_EQ(cache.find(key("c")), nullptr);
+    EXPECT_EQ(cache.stats().bytes, 70u);
+}
+
+TEST(Cache, ChargesDocumentHeapBytesAndInvalidatesOnChange) {
+    std::vector<std::unique_ptr<TempFile>> files;
+    for (int i = 0; i < 3; ++i) {
+        files.push_back(std::make_unique<TempFile>("cached" + std::to_string(i) + ".md", makeInput("markdown", 100)));
+    }
+    size_t one = 0;
+    {
+        DocumentCacheOptions options;
+        options.capacityBytes = size_t(1) << 24;
+        UniversalDocumentParser probe(options);
+        Document doc = probe.parseDocument(files[0]->path);
+        one = probe.cacheStats().bytes;
+        EXPECT_GE(one, doc.content.capacity() + doc.metadata.heapBytes() + doc.structure.heapBytes());
+    }
+
+    // Room for two of the three same-shaped documents
+    DocumentCacheOptions options;
+    options.capacityBytes = one * 2 + one / 2;
+    UniversalDocumentParser parser(options);
+    for (auto& file : files) {
+        parser.parseDocument(file->path);
+    }
+    DocumentCacheStats stats = parser.cacheStats();
+    EXPECT_EQ(stats.entries, 2u);
+    EXPECT_EQ(stats.evictions, 1u);
+    EXPECT_LE(stats.bytes, options.capacityBytes);
+    auto first = parser.parseShared(files[2]->path);
+    EXPECT_EQ(parser.parseShared(files[2]->path), first);
+    EXPECT_EQ(parser.cacheStats().hits, 2u);
+
+    // A new mtime at the same size, then a new size, each parse again
+    const std::string& path = files[2]->path;
+    std::string edited = makeInput("markdown", 100);
+    edited.replace(edited.find("Section 7"), 9, "Chapter 7");
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << edited;
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(5));
+    auto touched = parser.parseShared(path);
+    EXPECT_NE(touched, first);
+    EXPECT_NE(touched->content.find("Chapter 7"), std::string::npos);
+    std::ofstream(path, std::ios::binary | std::ios::app) << "## Appendix\n";
+    auto grown = parser.parseShared(path);
+    EXPECT_NE(grown, touched);
+    EXPECT_NE(grown->content.find("Appendix"), std::string::npos);
+    EXPECT_EQ(parser.parseShared(path), grown);
+    EXPECT_EQ(parser.cacheStats().misses, 5u);
+}
+
+TEST(Cache, ConcurrentParseSharedOfOneFile) {
+    TempFile file("shared.csv", makeInput("csv", 2000));
+    DocumentCacheOptions options;
+    options.capacityBytes = size_t(1) << 24;
+    UniversalDocumentParser parser(options);
+    Document expected = UniversalDocumentParser().parseDocument(file.path);
+
+    std::vector<std::shared_ptr<const Document>> docs(8);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < docs.size(); ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 20; ++i) {
+                docs[t] = parser.parseShared(file.path);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& doc : docs) {
+        EXPECT_EQ(doc->content, expected.content);
+    }
+    DocumentCacheStats stats = parser.cacheStats();
+    EXPECT_EQ(stats.entries, 1u);
+    EXPECT_EQ(stats.hits + stats.misses, 160u);
+    EXPECT_EQ(parser.parseShared(file.path), parser.parseShared(file.path));
+}
+
+TEST(Metadata, TypedFieldsWithMapStyleAccess) {
+    DocumentMetadata metadata;
+    metadata.rows = 42;
+    metadata.hasTags = true;
+    metadata.filename = "rows.csv";
+    metadata.set("delimiter", ";");
+    metadata.set("columns", "7");
+
+    EXPECT_EQ(metadata.get("rows"), "42");
+    EXPECT_EQ(metadata.get("has_tags"), "true");
+    EXPECT_EQ(metadata.columns, 7u);
+    EXPECT_EQ(metadata.get("delimiter"), ";");
+    EXPECT_FALSE(metadata.get("lines"));
+    EXPECT_EQ(metadata.keys(), (std::vector<std::string_view>{"filename", "rows", "columns", "has_tags",
+                                                               "delimiter"}));
+    EXPECT_THROW(metadata.set("rows", "many"), std::invalid_argument);
+    EXPECT_THROW(metadata.set("has_tags", "yes"), std::invalid_argument);
+
+    EXPECT_TRUE(metadata.erase("delimiter"));
+    EXPECT_TRUE(metadata.erase("rows"));
+    EXPECT_FALSE(metadata.erase("rows"));
+    EXPECT_FALSE(metadata.contains("delimiter"));
+
+    // Copies into another resource keep every field
+    CountingResource resource;
+    DocumentMetadata copy(metadata, &resource);
+    EXPECT_EQ(copy, metadata);
+    copy.clear();
+    EXPECT_TRUE(copy.empty());
+}
+
+TEST(JSONIndex, FollowsTheRFC8259Grammar) {
+    for (std::string_view json : {"1.2.3", "-", "01", "-01", "1e", "1e+", "1.", ".5", "+1", "[1,]",
+                                  "\"\\q\"", "\"\\u12g4\"", "\"a\x01b\"", "\"tab\there\"", "\"open"}) {
+        SCOPED_TRACE(std::string(json));
+        EXPECT_THROW(JSONDocument{std::string(json)}, std::runtime_error);
+    }
+    for (std::string_view json : {"0", "-0", "-0.5e-3", "10E+2", "1.25", "\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\"",
+                                  "[0,1,-2.5e3]", "{\"a\":null}"}) {
+        SCOPED_TRACE(std::string(json));
+        EXPECT_NO_THROW(JSONDocument{std::string(json)});
+    }
+    EXPECT_DOUBLE_EQ(JSONDocument("[-0.5e-3]").at("[0]").asDouble(), -0.5e-3);
+
+    // load() reads through the same decode stage as the parsers
+    std::string utf16 = "\xFF\xFE";
+    for (char16_t c : std::u16string_view(u"{\"name\": \"café\"}")) {
+        utf16 += static_cast<char>(c & 0xFF);
+        utf16 += static_cast<char>(c >> 8);
+    }
+    TempFile file("utf16.json", utf16);
+    auto doc = JSONParser().load(file.path);
+    EXPECT_EQ(doc->at("name").asString(), "caf\xC3\xA9");
+}
+
+// Stage-1 offsets and escapes by a byte-at-a-time state machine. A backslash escapes
+// the next byte inside or outside strings, as in the vectorized scanner;
+// outside strings either is an error later anyway.
+std::vector<uint32_t> jsonStructurals(std::string_view json, size_t& control, std::vector<uint32_t>& escapes) {
+    std::vector<uint32_t> out;
+    bool inString = false, escaped = false, inScalar = false;
+    control = json.size();
+    for (size_t i = 0; i < json.size(); ++i) {
+        char c = json[i];
+        bool wasEscaped = escaped;
+        escaped = !wasEscaped && c == '\\';
+        if (inString) {
+            if (!wasEscaped && c == '"') {
+                out.push_back(static_cast<uint32_t>(i));
+                inString = false;
+            } else if (escaped) {
+                escapes.push_back(static_cast<uint32_t>(i));
+            } else if (static_cast<unsigned char>(c) < 0x20 && control == json.size()) {
+                control = i;
+            }
+            continue;
+        }
+        bool quote = c == '"' && !wasEscaped;
+        bool op = std::string_view("{}[]:,").find(c) != std::string_view::npos;
+        bool space = c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        if (quote || op || (!space && !inScalar)) {
+            out.push_back(static_cast<uint32_t>(i));
+        }
+        inScalar = !quote && !op && !space;
+        inString = quote;
+    }
+    return out;
+}
+
+TEST(JSONIndex, ScannerAgreesWithByteLoopAtEverySimdLevel) {
+    std::mt19937 rng(20240607);
+    // Backslashes and quotes weighted up so runs cross block boundaries
+    const std::string alphabet = "{}[]:,\"\"\"\\\\\\\\ \n\t\rab1-.e\x01\x0b\x0c;=Z|)*<\x7f\xc3\xa9";
+    std::vector<std::string> inputs = {"", "\\\\\\\"", std::string(200, '\\') + "\"x\""};
+    for (int n = 0; n < 2000; ++n) {
+        std::string json(rng() % 300, ' ');
+        for (char& c : json) c = alphabet[rng() % alphabet.size()];
+        inputs.push_back(json);
+    }
+    for (const std::string& json : inputs) {
+        size_t expectedControl;
+        std::vector<uint32_t> expectedEscapes;
+        std::vector<uint32_t> expected = jsonStructurals(json, expectedControl, expectedEscapes);
+        for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::NEON}) {
+            JSONScanner scanner(level);
+            if (scanner.level() != level) continue;
+            SCOPED_TRACE(std::string(simdLevelName(level)) + " on " + json);
+            std::vector<uint32_t> offsets, escapes;
+            JSONScanner::State state;
+            EXPECT_EQ(scanner.scan(json.data(), json.size(), state, offsets, escapes), expectedControl);
+            EXPECT_EQ(offsets, expected);
+            EXPECT_EQ(escapes, expectedEscapes);
+
+            // Split at a block boundary, the state carrying across
+            size_t split = json.size() / 2 / JSONScanner::kBlockSize * JSONScanner::kBlockSize;
+            std::vector<uint32_t> halves, halfEscapes;
+            JSONScanner::State carried;
+            size_t control = scanner.scan(json.data(), split, carried, halves, halfEscapes);
+            std::vector<uint32_t> rest, restEscapes;
+            size_t restControl = scanner.scan(json.data() + split, json.size() - split, carried, rest, restEscapes);
+            for (uint32_t offset : rest) halves.push_back(static_cast<uint32_t>(offset + split));
+            for (uint32_t offset : restEscapes) halfEscapes.push_back(static_cast<uint32_t>(offset + split));
+            EXPECT_EQ(halfEscapes, expectedEscapes);
+            if (control == split) control = split + restControl;
+            EXPECT_EQ(halves, expected);
+            EXPECT_EQ(control, expectedControl);
+        }
+    }
+
+    // Whole documents: the same tokens, or the same error, at every level
+    for (const std::string& json : inputs) {
+        std::string reference;
+        std::vector<std::pair<size_t, size_t>> referenceTokens;
+        try {
+            JSONIndex index(json, SimdLevel::Scalar);
+            for (const auto& token : index.tokens()) referenceTokens.emplace_back(token.start, token.next);
+        } catch (const std::runtime_error& e) {
+            reference = e.what();
+        }
+        JSONIndex best;
+        std::string error;
+        try {
+            best = JSONIndex(json);
+        } catch (const std::runtime_error& e) {
+            error = e.what();
+        }
+        EXPECT_EQ(error, reference) << json;
+        if (error.empty()) {
+            ASSERT_EQ(best.tokens().size(), referenceTokens.size());
+            for (size_t i = 0; i < referenceTokens.size(); ++i) {
+                EXPECT_EQ(best.tokens()[i].start, referenceTokens[i].first);
+                EXPECT_EQ(best.tokens()[i].next, referenceTokens[i].second);
+            }
+        }
+    }
+}
+
+TEST(JSONIndex, ErrorsAndStringsAcrossBlocksAndWindows) {
+    // Backslash runs ending at every position around a block boundary
+    for (size_t pad = 50; pad < 70; ++pad) {
+        for (size_t run = 1; run <= 5; ++run) {
+            std::string json = "[\"" + std::string(pad, 'x') + std::string(run, '\\') + "\"]";
+            SCOPED_TRACE(std::to_string(pad) + "+" + std::to_string(run));
+            if (run % 2 == 0) {
+                JSONDocument doc(json);
+                EXPECT_EQ(doc.at("[0]").asString(), std::string(pad, 'x') + std::string(run / 2, '\\'));
+            } else {
+                EXPECT_THROW(JSONDocument{json}, std::runtime_error);
+            }
+        }
+    }
+
+    // A string longer than the scanner's window, and a control byte late in it
+    std::string longText(200000, 'y');
+    longText[100000] = '\\';
+    longText[100001] = '"';
+    longText[140000] = '\\';
+    longText[140001] = 'n';
+    JSONDocument big("{\"k\": \"" + longText + "\", \"after\": true}");
+    EXPECT_EQ(big.at("k").asString().size(), longText.size() - 2);
+    EXPECT_TRUE(big.at("after").asBool());
+    longText[150000] = '\n';
+    try {
+        JSONDocument bad("{\"k\": \"" + longText + "\"}");
+        FAIL() << "accepted a raw newline in a string";
+    } catch (const std::runtime_error& e) {
+        EXPECT_NE(std::string(e.what()).find("control character in string at offset 150007"), std::string::npos)
+            << e.what();
+    }
+
+    for (const std::string& json : std::vector<std::string>{"truex", "[1x]", "nul", "[true false]", "{\"a\" 1}", "[1,2]]", "\"a\"b",
+                                  "[\"\\\"]", "{\"a\":1,}", "1 2", "[1\\]", std::string("[1\0]", 4)}) {
+        SCOPED_TRACE(json);
+        EXPECT_THROW(JSONDocument{json}, std::runtime_error);
+    }
+    EXPECT_NO_THROW(JSONDocument(" \r\n\t[ true , false,null ,{ } ] \n"));
+}
+
+TEST(JSONIndex, PathLookupSkipsSubtrees) {
+    JSONDocument doc(R"({"skip": {"deep": [[1, [2, {"x": 3}]], {"y": [4]}]},
+        "a": {"b": [10, {"c": "found"}, [], {}, 14]},
+        "esc\"aped": 1, "unié": 2, "n": -12, "f": 2.5e1, "t": true, "z": null})");
+    EXPECT_EQ(doc.at("a.b[1].c").asString(), "found");
+    EXPECT_EQ(doc.at("a.b[4]").asInt64(), 14);
+    EXPECT_EQ(doc.at("a.b").size(), 5u);
+    EXPECT_EQ(doc.at("a.b[2]").size(), 0u);
+    EXPECT_EQ(doc.at("a.b[3]").type(), JSONType::Object);
+    EXPECT_EQ(doc.at("skip.deep[0][1][1].x").asInt64(), 3);
+    EXPECT_EQ(doc.root().size(), 8u);
+    EXPECT_EQ(doc.at("").type(), JSONType::Object);
+    EXPECT_EQ(doc.at("esc\"aped").asInt64(), 1);
+    EXPECT_EQ(doc.at("uni\xC3\xA9").asInt64(), 2);
+    EXPECT_EQ(doc.at("n").asInt64(), -12);
+    EXPECT_TRUE(doc.at("n").isInteger());
+    EXPECT_FALSE(doc.at("f").isInteger());
+    EXPECT_DOUBLE_EQ(doc.at("f").asDouble(), 25.0);
+    EXPECT_EQ(doc.at("t").type(), JSONType::Bool);
+    EXPECT_EQ(doc.at("z").type(), JSONType::Null);
+    EXPECT_EQ(doc.at("a.b[1]").raw(), "{\"c\": \"found\"}");
+
+    for (std::string_view missing : {"nope", "a.b[5]", "a.b[x]", "a.b[1", "a.b.c", "n.x", "a[0]"}) {
+        SCOPED_TRACE(std::string(missing));
+        EXPECT_FALSE(doc.at(missing).isValid());
+        EXPECT_EQ(doc.at(missing).type(), JSONType::Invalid);
+    }
+
+    // Each container's `next` is the token after its closing bracket
+    const auto& tokens = doc.structure().tokens();
+    EXPECT_EQ(tokens[0].next, tokens.size());
+    EXPECT_EQ(doc.structure().source()[tokens[tokens[2].next - 1].start], '}');
+
+    std::vector<std::string> keys;
+    doc.root().forEachMember([&](const std::string& key, JSONValue) { keys.push_back(key); });
+    EXPECT_EQ(keys, (std::vector<std::string>{"skip", "a", "esc\"aped", "uni\xC3\xA9", "n", "f", "t", "z"}));
+    size_t elements = 0;
+    doc.at("skip.deep").forEachElement([&](JSONValue) { ++elements; });
+    EXPECT_EQ(elements, 2u);
+}
+
+TEST(JSONIndex, UnescapesSurrogatePairs) {
+    JSONDocument doc(R"(["😀", "é中", "\ud83d", "\ude00x", "a\/b\tc"])");
+    EXPECT_EQ(doc.at("[0]").asString(), "\xF0\x9F\x98\x80");
+    EXPECT_EQ(doc.at("[1]").asString(), "\xC3\xA9\xE4\xB8\xAD");
+    // Unpaired surrogates are kept as their three-byte form
+    EXPECT_EQ(doc.at("[2]").asString(), "\xED\xA0\xBD");
+    EXPECT_EQ(doc.at("[3]").asString(), "\xED\xB8\x80x");
+    EXPECT_EQ(doc.at("[4]").asString(), "a/b\tc");
+    EXPECT_EQ(JSONValue::unescape("\\uD83D\\uDE00"), "\xF0\x9F\x98\x80");
+}
+
+TEST(JSONIndex, PrettyPrintsWithElementRanges) {
+    JSONDocument doc(R"({"a":[1,{"b":null}],"c":{},"d":[]})");
+    EXPECT_EQ(doc.pretty(),
+              "{\n"
+              "  \"a\": [\n"
+              "    1,\n"
+              "    {\n"
+              "      \"b\": null\n"
+              "    }\n"
+              "  ],\n"
+              "  \"c\": {},\n"
+              "  \"d\": []\n"
+              "}");
+    EXPECT_EQ(JSONDocument("[ 1 ,\"x\" ]").pretty(4), "[\n    1,\n    \"x\"\n]");
+    EXPECT_EQ(JSONDocument(" 42 ").pretty(), "42");
+
+    JSONIndex index(R"([{"k": 1}, "two", [3]])");
+    std::pmr::string out;
+    std::pmr::vector<std::pair<size_t, size_t>> elements;
+    prettyPrintJSON(index, out, 2, &elements);
+    ASSERT_EQ(elements.size(), 3u);
+    EXPECT_EQ(out.substr(elements[0].first, elements[0].second - elements[0].first), "{\n    \"k\": 1\n  }");
+    EXPECT_EQ(out.substr(elements[1].first, elements[1].second - elements[1].first), "\"two\"");
+    EXPECT_EQ(out.substr(elements[2].first, elements[2].second - elements[2].first), "[\n    3\n  ]");
+
+    // The document keeps its owner's bytes alive
+    auto bytes = std::make_shared<std::string>("{\"v\": [1, 2]}");
+    JSONDocument shared(*bytes, bytes);
+    std::weak_ptr<std::string> weak = bytes;
+    bytes.reset();
+    EXPECT_FALSE(weak.expired());
+    EXPECT_EQ(shared.at("v[1]").asInt64(), 2);
+}
+
+TEST(Markdown, IndexesBlocksAndInlines) {
+    std::string md =
+        "# Title #\n"
+        "Intro with *em*, **strong**, `co*de` and a [link](https://example.com/a\\_b \"t\").\n"
+        "\n"
+        "Setext heading\n"
+        "--------------\n"
+        "\n"
+        "> quoted ![logo](logo.png)\n"
+        "\n"
+        "1. first\n"
+        "2. second\n"
+        "   - nested\n"
+        "\n"
+        "```cpp\n"
+        "int x = 1;\n"
+        "```\n"
+        "#hashtag is no heading\n";
+    Document doc = MarkdownParser().parseContent(md, "input.md");
+
+    EXPECT_EQ(std::string_view(doc.content),
+              "Title\n"
+              "Intro with em, strong, co*de and a link.\n"
+              "\n"
+              "Setext heading\n"
+              "\n"
+              "quoted logo\n"
+              "\n"
+              "first\n"
+              "second\n"
+              "nested\n"
+              "\n"
+              "int x = 1;\n"
+              "#hashtag is no heading\n");
+
+    std::vector<std::tuple<ElementKind, int, std::string, std::string>> found;
+    for (const DocumentElement& element : doc.structure.elements) {
+        found.emplace_back(element.kind, element.level, std::string(doc.text(element)),
+                           std::string(doc.structure.attribute(element)));
+    }
+    using T = std::tuple<ElementKind, int, std::string, std::string>;
+    EXPECT_EQ(found, (std::vector<T>{
+        T{ElementKind::Heading, 1, "Title", ""},
+        T{ElementKind::Link, 0, "link", "https://example.com/a_b"},
+        T{ElementKind::Heading, 2, "Setext heading", ""},
+        T{ElementKind::BlockQuote, 1, "quoted logo", ""},
+        T{ElementKind::Image, 0, "logo", "logo.png"},
+        T{ElementKind::List, 1, "first\nsecond\nnested", "1"},
+        T{ElementKind::ListItem, 1, "first", ""},
+        T{ElementKind::ListItem, 1, "second\nnested", ""},
+        T{ElementKind::List, 2, "nested", ""},
+        T{ElementKind::ListItem, 2, "nested", ""},
+        T{ElementKind::CodeBlock, 0, "int x = 1;", "cpp"},
+    }));
+    EXPECT_EQ(doc.structure.elements[2].source, md.find("Setext"));
+    EXPECT_EQ(doc.structure.elements[1].source, md.find("[link]"));
+
+    // Headings start the pages
+    ASSERT_EQ(doc.pageCount(), 2u);
+    EXPECT_EQ(doc.page(1).substr(0, 14), "Setext heading");
+
+    // Structure can be asked for on its own, or left out
+    Document structureOnly = MarkdownParser().parseContent(md, "input.md", ParseOutput::Structure);
+    EXPECT_EQ(structureOnly.structure.size(), doc.structure.size());
+    EXPECT_EQ(structureOnly.pageCount(), 0u);
+    EXPECT_TRUE(MarkdownParser().parseContent(md, "input.md", ParseOutput::Pages).structure.empty());
+}
+
+TEST(Markdown, UnmatchedMarkersStayLinear) {
+    // Each of these is quadratic for a tokenizer that searches ahead for
+    // a closer from every opener
+    std::string md;
+    for (const char* unit : {"*a ", "_a ", "[a ", "![a ", "[a](b \"", "<a:b "}) {
+        for (int i = 0; i < 20000; ++i) md += unit;
+        md += "end\n\n";
+    }
+    Document doc = MarkdownParser().parseContent(md, "input.md");
+    EXPECT_EQ(doc.content.size(), md.size());
+    EXPECT_TRUE(doc.structure.empty());
+}
+
+TEST(Markdown, NestedContainersOnOneLineStayLinear) {
+    // Best of three runs at n and 4n markers: linear work grows about 4x,
+    // anything rescanning the stack or the line per marker about 16x
+    auto seconds = [](const std::string& unit, size_t n) {
+        std::string md;
+        for (size_t i = 0; i < n; ++i) md += unit;
+        md += "end\n";
+        double best = 1e9;
+        for (int run = 0; run < 3; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            Document doc = MarkdownParser().parseContent(md, "input.md");
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            EXPECT_FALSE(doc.structure.empty());
+        }
+        return best;
+    };
+    for (const char* unit : {"- ", "* ", "1. ", "> ", "> - "}) {
+        SCOPED_TRACE(unit);
+        double small = seconds(unit, 5000);
+        double large = seconds(unit, 20000);
+        EXPECT_LT(large, small * 10 + 0.05);
+    }
+}
+
+TEST(Encoding, ValidatorAgreesAtEverySimdLevel) {
+    std::vector<UTF8Validator> validators = {UTF8Validator(SimdLevel::Scalar), UTF8Validator()};
+    for (SimdLevel level : {SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::NEON}) {
+        if (UTF8Validator(level).level() == level) validators.emplace_back(level);
+    }
+    const std::pair<const char*, bool> cases[] = {
+        {"plain", true},       {"\xC3\xA9", true},        {"\xE2\x82\xAC", true},
+        {"\xF0\x9F\x98\x80", true}, {"\xF4\x8F\xBF\xBF", true}, {"\xED\x9F\xBF", true},
+        {"\x80", false},       {"\xC0\xAF", false},       {"\xC1\xBF", false},
+        {"\xE0\x9F\xBF", false}, {"\xED\xA0\x80", false}, {"\xF0\x8F\xBF\xBF", false},
+        {"\xF4\x90\x80\x80", false}, {"\xF5\x80\x80\x80", false}, {"\xFF", false},
+        {"\xC3", false},       {"\xE2\x82", false},       {"\xF0\x9F\x98", false},
+        {"\xC3\xA9\xA9", false}, {"\xE2\x82\xAC\x80", false}};
+    // Each case at every position around the 64-byte blocks, and with
+    // more text after it
+    for (const auto& [sequence, valid] : cases) {
+        for (size_t pad = 0; pad < 140; ++pad) {
+            for (const char* after : {"", "z"}) {
+                std::string text = std::string(pad, 'a') + sequence + after;
+                for (const UTF8Validator& validator : validators) {
+                    EXPECT_EQ(validator.validate(text), valid)
+                        << simdLevelName(validator.level()) << " pad " << pad << " " << text;
+                }
+            }
+        }
+    }
+    EXPECT_TRUE(isValidUTF8(""));
+}
+
+TEST(Encoding, DetectsBOMsAndLegacyEncodings) {
+    size_t bom = 0;
+    EXPECT_EQ(detectEncoding("\xEF\xBB\xBFhi", &bom), TextEncoding::UTF8);
+    EXPECT_EQ(bom, 3u);
+    EXPECT_EQ(detectEncoding(std::string_view("\xFF\xFEh\0", 4), &bom), TextEncoding::UTF16LE);
+    EXPECT_EQ(bom, 2u);
+    EXPECT_EQ(detectEncoding(std::string_view("\xFE\xFF\0h", 4), &bom), TextEncoding::UTF16BE);
+    EXPECT_EQ(detectEncoding("caf\xC3\xA9", &bom), TextEncoding::UTF8);
+    EXPECT_EQ(bom, 0u);
+    EXPECT_EQ(detectEncoding("caf\xE9"), TextEncoding::Latin1);
+    EXPECT_EQ(detectEncoding("\x93quoted\x94 caf\xE9"), TextEncoding::Windows1252);
+    // A sequence cut off by the end of a partial head is not an error
+    EXPECT_EQ(detectEncoding("caf\xC3", nullptr, false), TextEncoding::UTF8);
+    EXPECT_EQ(detectEncoding("caf\xC3", nullptr, true), TextEncoding::Latin1);
+
+    std::string out;
+    EXPECT_EQ(Transcoder::toUTF8("caf\xE9", TextEncoding::Latin1, out), 4u);
+    EXPECT_EQ(out, "caf\xC3\xA9");
+    out.clear();
+    Transcoder::toUTF8("\x80\x81\x9F", TextEncoding::Windows1252, out);
+    EXPECT_EQ(out, "\xE2\x82\xAC\xC2\x81\xC5\xB8");
+    out.clear();
+    // Surrogate pair, then a lone low surrogate and an odd trailing byte
+    Transcoder::toUTF8(std::string_view("A\0\x3D\xD8\x00\xDE\x00\xDCz", 9), TextEncoding::UTF16LE, out);
+    EXPECT_EQ(out, "A\xF0\x9F\x98\x80\xEF\xBF\xBD\xEF\xBF\xBD");
+    out.clear();
+    // Malformed UTF-8 is repaired, one U+FFFD per maximal bad sequence
+    Transcoder::toUTF8("a\xE2\x82z\xFF", TextEncoding::UTF8, out);
+    EXPECT_EQ(out, "a\xEF\xBF\xBDz\xEF\xBF\xBD");
+    out.clear();
+    // Not final: an incomplete tail is left for the next call
+    EXPECT_EQ(Transcoder::toUTF8("ab\xE2\x82", TextEncoding::UTF8, out, false), 2u);
+    EXPECT_EQ(Transcoder::toUTF8(std::string_view("a\0\x3D", 3), TextEncoding::UTF16LE, out, false), 2u);
+}
+
+TEST(Encoding, AllParsersSeeUTF8AndRecordTheSource) {
+    UniversalDocumentParser parser;
+    // UTF-16 with a BOM, through a file and from memory
+    std::string utf16 = "\xFF\xFE";
+    for (char16_t unit : std::u16string(u"name,city\nZoë,Köln\n")) {
+        utf16 += static_cast<char>(unit & 0xFF);
+        utf16 += static_cast<char>(unit >> 8);
+    }
+    TempFile csv("encoding_utf16.csv", utf16);
+    Document fromFile = parser.parseDocument(csv.path);
+    EXPECT_EQ(fromFile.metadata.encoding, "utf-16le");
+    EXPECT_NE(fromFile.content.find("K\xC3\xB6ln"), std::string::npos);
+    EXPECT_EQ(fromFile.metadata.rows, 2u);
+    Document fromMemory = parser.parse(utf16, "csv");
+    EXPECT_EQ(fromMemory.content, fromFile.content);
+    EXPECT_EQ(fromMemory.metadata.encoding, "utf-16le");
+
+    // The streaming readers decode too
+    EXPECT_EQ(csvRows(CSVRowReader::fromFile(csv.path, 7)), "name|city;Zo\xC3\xAB|K\xC3\xB6ln;");
+
+    // Windows-1252 text, and a UTF-8 BOM that must not reach the parser
+    TempFile text("encoding_cp1252.txt", "\x93quoted\x94 caf\xE9\n");
+    Document legacy = parser.parseDocument(text.path);
+    EXPECT_EQ(legacy.metadata.encoding, "windows-1252");
+    EXPECT_EQ(legacy.content, "\xE2\x80\x9Cquoted\xE2\x80\x9D caf\xC3\xA9\n");
+    Document bom = parser.parse(std::string("\xEF\xBB\xBF{\"a\": 1}"), "json");
+    EXPECT_EQ(bom.metadata.encoding, "utf-8");
+    EXPECT_EQ(bom.content.find("\xEF\xBB\xBF"), std::string::npos);
+
+    // Valid UTF-8 stays mapped: the pre-parse stage only validates
+    TempFile plain("encoding_plain.txt", "caf\xC3\xA9\n");
+    EXPECT_EQ(parser.parseDocument(plain.path).metadata.encoding, "utf-8");
+    EXPECT_EQ(parser.parseDocument(plain.path).content, "caf\xC3\xA9\n");
+}
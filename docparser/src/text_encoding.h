@@ -0,0 +1,642 @@
+#ifndef TEXT_ENCODING_H
+#define TEXT_ENCODING_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "compressed_input.h"
+#include "csv_scanner.h"
+
+// Encodings the pre-parse stage decodes; parsers only ever see UTF-8
+enum class TextEncoding : uint8_t {
+    UTF8,
+    UTF16LE,
+    UTF16BE,
+    Latin1,
+    Windows1252
+};
+
+inline const char* encodingName(TextEncoding encoding) {
+    switch (encoding) {
+        case TextEncoding::UTF8: return "utf-8";
+        case TextEncoding::UTF16LE: return "utf-16le";
+        case TextEncoding::UTF16BE: return "utf-16be";
+        case TextEncoding::Latin1: return "iso-8859-1";
+        case TextEncoding::Windows1252: return "windows-1252";
+    }
+    return "unknown";
+}
+
+// Vectorized UTF-8 validation with the lookup algorithm of Keiser and
+// Lemire (as in simdutf). Each byte is checked against the one before it
+// through three 16-entry tables indexed by nibbles, whose AND flags every
+// two-byte error: overlong forms, surrogates, code points above U+10FFFF,
+// missing or stray continuation bytes. Third and fourth bytes are checked
+// by shifting the input by two and three. Blocks of pure ASCII skip all of
+// it, so typical text validates at memory speed. The scalar fallback
+// checks sequences one at a time.
+class UTF8Validator {
+public:
+    static constexpr size_t kBlockSize = 64;
+
+    explicit UTF8Validator(SimdLevel level = CSVScanner::detectLevel()) : simdLevel(level) {
+        switch (level) {
+#if defined(DOCPARSER_SCANNER_X86) && defined(__GNUC__)
+            case SimdLevel::AVX2: check = &validateAVX2; break;
+            case SimdLevel::SSE42: check = &validateSSE42; break;
+#endif
+#if defined(DOCPARSER_SCANNER_NEON)
+            case SimdLevel::NEON: check = &validateNEON; break;
+#endif
+            default:
+                check = &validateScalar;
+                simdLevel = SimdLevel::Scalar;
+                break;
+        }
+    }
+
+    SimdLevel level() const { return simdLevel; }
+
+    bool validate(std::string_view text) const {
+        return check(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+    }
+
+    // Length of the UTF-8 sequence starting at p[0, avail) if it is valid;
+    // otherwise minus the length of its longest valid prefix (at least 1),
+    // which a decoder replaces with a single U+FFFD
+    static int sequenceAt(const uint8_t* p, size_t avail) {
+        uint8_t lead = p[0];
+        if (lead < 0x80) {
+            return 1;
+        }
+        int length = 0;
+        uint8_t low = 0x80;
+        uint8_t high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) low = 0xA0;        // overlong
+            if (lead == 0xED) high = 0x9F;       // surrogates
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) low = 0x90;        // overlong
+            if (lead == 0xF4) high = 0x8F;       // above U+10FFFF
+        } else {
+            return -1;
+        }
+        for (int i = 1; i < length; ++i) {
+            if (static_cast<size_t>(i) >= avail) {
+                return -i;
+            }
+            uint8_t byte = p[i];
+            if (i == 1 ? (byte < low || byte > high) : (byte < 0x80 || byte > 0xBF)) {
+                return -i;
+            }
+        }
+        return length;
+    }
+
+private:
+    using CheckFn = bool (*)(const uint8_t* data, size_t length);
+
+    SimdLevel simdLevel;
+    CheckFn check;
+
+    // Error bits of the lookup tables: each names a pair of bytes that
+    // cannot follow one another
+    static constexpr uint8_t kTooShort = 1 << 0;     // lead byte, then no continuation
+    static constexpr uint8_t kTooLong = 1 << 1;      // ASCII, then a continuation
+    static constexpr uint8_t kOverlong3 = 1 << 2;    // E0 80..9F
+    static constexpr uint8_t kTooLarge = 1 << 3;     // F4 90..BF, F5..FF
+    static constexpr uint8_t kSurrogate = 1 << 4;    // ED A0..BF
+    static constexpr uint8_t kOverlong2 = 1 << 5;    // C0 or C1 lead
+    static constexpr uint8_t kTooLarge1000 = 1 << 6; // F5..FF 80..8F
+    static constexpr uint8_t kOverlong4 = 1 << 6;    // F0 80..8F
+    static constexpr uint8_t kTwoConts = 1 << 7;     // continuation after continuation
+    static constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+    // By the high nibble of the previous byte
+    static constexpr uint8_t kByte1High[16] = {
+        kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+        kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+        kTooShort | kOverlong2,
+        kTooShort,
+        kTooShort | kOverlong3 | kSurrogate,
+        kTooShort | kTooLarge | kTooLarge1000 | kOverlong4};
+    // By the low nibble of the previous byte
+    static constexpr uint8_t kByte1Low[16] = {
+        kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+        kCarry | kOverlong2,
+        kCarry,
+        kCarry,
+        kCarry | kTooLarge,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000};
+    // By the high nibble of the current byte
+    static constexpr uint8_t kByte2High[16] = {
+        kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 | kOverlong4,
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+        kTooShort, kTooShort, kTooShort, kTooShort};
+    // A block ends inside a sequence when one of its last three bytes is a
+    // lead byte needing more than the bytes left; the tail of this table
+    // lines up with the end of a vector
+    static constexpr uint8_t kIncompleteMax[32] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xF0 - 1, 0xE0 - 1, 0xC0 - 1};
+
+    static bool validateScalar(const uint8_t* data, size_t length) {
+        size_t i = 0;
+        while (i < length) {
+            if (i + 8 <= length) {
+                uint64_t word;
+                std::memcpy(&word, data + i, sizeof(word));
+                if ((word & 0x8080808080808080ULL) == 0) {
+                    i += 8;
+                    continue;
+                }
+            }
+            int step = sequenceAt(data + i, length - i);
+            if (step < 0) {
+                return false;
+            }
+            i += static_cast<size_t>(step);
+        }
+        return true;
+    }
+
+#if defined(DOCPARSER_SCANNER_X86) && defined(__GNUC__)
+    __attribute__((target("sse4.2")))
+    static __m128i errorsSSE42(__m128i input, __m128i prev) {
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        const __m128i byte1High = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte1High));
+        const __m128i byte1Low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte1Low));
+        const __m128i byte2High = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte2High));
+
+        __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+        __m128i special = _mm_and_si128(
+            _mm_and_si128(_mm_shuffle_epi8(byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                          _mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, nibble))),
+            _mm_shuffle_epi8(byte2High, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+        // Bytes two and three after a three- or four-byte lead must be
+        // continuations, which the tables flagged as kTwoConts
+        __m128i third = _mm_subs_epu8(_mm_alignr_epi8(input, prev, 14), _mm_set1_epi8(char(0xE0 - 0x80)));
+        __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(input, prev, 13), _mm_set1_epi8(char(0xF0 - 0x80)));
+        __m128i mustContinue = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(char(0x80)));
+        return _mm_xor_si128(mustContinue, special);
+    }
+
+    __attribute__((target("sse4.2")))
+    static bool validateSSE42(const uint8_t* data, size_t length) {
+        const __m128i incompleteMax = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kIncompleteMax + 16));
+        __m128i error = _mm_setzero_si128();
+        __m128i prev = _mm_setzero_si128();
+        __m128i incomplete = _mm_setzero_si128();
+        uint8_t tail[kBlockSize];
+
+        for (size_t offset = 0; offset < length; offset += kBlockSize) {
+            const uint8_t* block = data + offset;
+            if (length - offset < kBlockSize) {
+                // Zero padding is ASCII, so a sequence cut off by the end
+                // of the input shows up as kTooShort
+                std::memset(tail, 0, sizeof(tail));
+                std::memcpy(tail, block, length - offset);
+                block = tail;
+            }
+            __m128i v[4];
+            for (int i = 0; i < 4; ++i) {
+                v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16));
+            }
+            __m128i any = _mm_or_si128(_mm_or_si128(v[0], v[1]), _mm_or_si128(v[2], v[3]));
+            if (_mm_movemask_epi8(any) == 0) {
+                error = _mm_or_si128(error, incomplete);
+                incomplete = _mm_setzero_si128();
+            } else {
+                for (int i = 0; i < 4; ++i) {
+                    error = _mm_or_si128(error, errorsSSE42(v[i], prev));
+                    prev = v[i];
+                }
+                incomplete = _mm_subs_epu8(v[3], incompleteMax);
+            }
+            prev = v[3];
+        }
+        error = _mm_or_si128(error, incomplete);
+        return _mm_testz_si128(error, error);
+    }
+
+    // The 32 bytes ending `n` bytes before the end of `input`
+    template <int N>
+    __attribute__((target("avx2")))
+    static __m256i previousAVX2(__m256i input, __m256i prev) {
+        return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i errorsAVX2(__m256i input, __m256i prev) {
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        const __m256i byte1High = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte1High)));
+        const __m256i byte1Low = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte1Low)));
+        const __m256i byte2High = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte2High)));
+
+        __m256i prev1 = previousAVX2<1>(input, prev);
+        __m256i special = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                _mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, nibble))),
+            _mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+        __m256i third = _mm256_subs_epu8(previousAVX2<2>(input, prev), _mm256_set1_epi8(char(0xE0 - 0x80)));
+        __m256i fourth = _mm256_subs_epu8(previousAVX2<3>(input, prev), _mm256_set1_epi8(char(0xF0 - 0x80)));
+        __m256i mustContinue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+        return _mm256_xor_si256(mustContinue, special);
+    }
+
+    __attribute__((target("avx2")))
+    static bool validateAVX2(const uint8_t* data, size_t length) {
+        const __m256i incompleteMax = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kIncompleteMax));
+        __m256i error = _mm256_setzero_si256();
+        __m256i prev = _mm256_setzero_si256();
+        __m256i incomplete = _mm256_setzero_si256();
+        uint8_t tail[kBlockSize];
+
+        for (size_t offset = 0; offset < length; offset += kBlockSize) {
+            const uint8_t* block = data + offset;
+            if (length - offset < kBlockSize) {
+                std::memset(tail, 0, sizeof(tail));
+                std::memcpy(tail, block, length - offset);
+                block = tail;
+            }
+            __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+            __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+            if (_mm256_movemask_epi8(_mm256_or_si256(v0, v1)) == 0) {
+                error = _mm256_or_si256(error, incomplete);
+                incomplete = _mm256_setzero_si256();
+            } else {
+                error = _mm256_or_si256(error, errorsAVX2(v0, prev));
+                error = _mm256_or_si256(error, errorsAVX2(v1, v0));
+                incomplete = _mm256_subs_epu8(v1, incompleteMax);
+            }
+            prev = v1;
+        }
+        error = _mm256_or_si256(error, incomplete);
+        return _mm256_testz_si256(error, error);
+    }
+#endif
+
+#if defined(DOCPARSER_SCANNER_NEON)
+    static uint8x16_t errorsNEON(uint8x16_t input, uint8x16_t prev) {
+        const uint8x16_t nibble = vdupq_n_u8(0x0F);
+        uint8x16_t prev1 = vextq_u8(prev, input, 15);
+        uint8x16_t special = vandq_u8(
+            vandq_u8(vqtbl1q_u8(vld1q_u8(kByte1High), vshrq_n_u8(prev1, 4)),
+                     vqtbl1q_u8(vld1q_u8(kByte1Low), vandq_u8(prev1, nibble))),
+            vqtbl1q_u8(vld1q_u8(kByte2High), vshrq_n_u8(input, 4)));
+
+        uint8x16_t third = vqsubq_u8(vextq_u8(prev, input, 14), vdupq_n_u8(0xE0 - 0x80));
+        uint8x16_t fourth = vqsubq_u8(vextq_u8(prev, input, 13), vdupq_n_u8(0xF0 - 0x80));
+        uint8x16_t mustContinue = vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+        return veorq_u8(mustContinue, special);
+    }
+
+    static bool validateNEON(const uint8_t* data, size_t length) {
+        const uint8x16_t incompleteMax = vld1q_u8(kIncompleteMax + 16);
+        uint8x16_t error = vdupq_n_u8(0);
+        uint8x16_t prev = vdupq_n_u8(0);
+        uint8x16_t incomplete = vdupq_n_u8(0);
+        uint8_t tail[kBlockSize];
+
+        for (size_t offset = 0; offset < length; offset += kBlockSize) {
+            const uint8_t* block = data + offset;
+            if (length - offset < kBlockSize) {
+                std::memset(tail, 0, sizeof(tail));
+                std::memcpy(tail, block, length - offset);
+                block = tail;
+            }
+            uint8x16_t v[4] = {vld1q_u8(block), vld1q_u8(block + 16), vld1q_u8(block + 32),
+                               vld1q_u8(block + 48)};
+            uint8x16_t any = vorrq_u8(vorrq_u8(v[0], v[1]), vorrq_u8(v[2], v[3]));
+            if (vmaxvq_u8(any) < 0x80) {
+                error = vorrq_u8(error, incomplete);
+                incomplete = vdupq_n_u8(0);
+            } else {
+                for (int i = 0; i < 4; ++i) {
+                    error = vorrq_u8(error, errorsNEON(v[i], prev));
+                    prev = v[i];
+                }
+                incomplete = vqsubq_u8(v[3], incompleteMax);
+            }
+            prev = v[3];
+        }
+        error = vorrq_u8(error, incomplete);
+        return vmaxvq_u8(error) == 0;
+    }
+#endif
+};
+
+// Whether `text` is well-formed UTF-8, at the best level of the running CPU
+inline bool isValidUTF8(std::string_view text) {
+    static const UTF8Validator validator;
+    return validator.validate(text);
+}
+
+// Decoding to UTF-8. Malformed input never throws: each bad sequence
+// becomes U+FFFD, so parsers and the Python bindings always get valid text.
+class Transcoder {
+public:
+    // Decode `in` from `encoding`, appending UTF-8 to `out`, and return the
+    // bytes consumed. Unless `final`, a sequence cut off by the end of `in`
+    // is left for the next call.
+    static size_t toUTF8(std::string_view in, TextEncoding encoding, std::string& out, bool final = true) {
+        switch (encoding) {
+            case TextEncoding::UTF16LE:
+            case TextEncoding::UTF16BE:
+                out.reserve(out.size() + in.size() / 2 * 3);
+                return decodeUTF16(in, encoding == TextEncoding::UTF16BE, out, final);
+            case TextEncoding::Latin1:
+            case TextEncoding::Windows1252:
+                out.reserve(out.size() + in.size() + in.size() / 4);
+                decodeSingleByte(in, encoding == TextEncoding::Windows1252, out);
+                return in.size();
+            case TextEncoding::UTF8:
+                break;
+        }
+        std::string_view complete = final ? in : in.substr(0, completeUTF8Prefix(in));
+        if (isValidUTF8(complete)) {
+            out.append(complete.data(), complete.size());
+        } else {
+            repairUTF8(complete, out);
+        }
+        return complete.size();
+    }
+    
+    // Bytes of `in` before an incomplete sequence at its very end
+    static size_t completeUTF8Prefix(std::string_view in) {
+        size_t n = in.size();
+        for (size_t back = 1; back <= 3 && back <= n; ++back) {
+            uint8_t byte = static_cast<uint8_t>(in[n - back]);
+            if ((byte & 0xC0) == 0x80) {
+                continue;
+            }
+            if (byte >= 0xC0) {
+                size_t needed = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : 2;
+                if (needed > back) {
+                    return n - back;
+                }
+            }
+            break;
+        }
+        return n;
+    }
+
+private:
+    static constexpr uint32_t kReplacement = 0xFFFD;
+    
+    // Windows-1252 0x80-0x9F; the five unassigned bytes map to the C1
+    // controls of the same value, as in the WHATWG encoding standard
+    static constexpr uint16_t kWindows1252High[32] = {
+        0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+        0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+        0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+        0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178};
+    
+    static void appendCodePoint(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+    
+    static void repairUTF8(std::string_view in, std::string& out) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(in.data());
+        size_t i = 0;
+        while (i < in.size()) {
+            int step = UTF8Validator::sequenceAt(p + i, in.size() - i);
+            if (step > 0) {
+                out.append(in.data() + i, static_cast<size_t>(step));
+                i += static_cast<size_t>(step);
+            } else {
+                appendCodePoint(out, kReplacement);
+                i += static_cast<size_t>(-step);
+            }
+        }
+    }
+    
+    // Runs of ASCII are copied as they are
+    static void decodeSingleByte(std::string_view in, bool windows1252, std::string& out) {
+        size_t i = 0;
+        while (i < in.size()) {
+            size_t run = i;
+            while (run < in.size() && static_cast<uint8_t>(in[run]) < 0x80) ++run;
+            out.append(in.data() + i, run - i);
+            if (run == in.size()) {
+                break;
+            }
+            uint8_t byte = static_cast<uint8_t>(in[run]);
+            appendCodePoint(out, windows1252 && byte < 0xA0 ? kWindows1252High[byte - 0x80] : byte);
+            i = run + 1;
+        }
+    }
+    
+    // Lone surrogates and an odd trailing byte become U+FFFD
+    static size_t decodeUTF16(std::string_view in, bool bigEndian, std::string& out, bool final) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(in.data());
+        auto unitAt = [&](size_t i) -> uint32_t {
+            return bigEndian ? (uint32_t(p[i]) << 8 | p[i + 1]) : (uint32_t(p[i + 1]) << 8 | p[i]);
+        };
+        size_t i = 0;
+        size_t n = in.size();
+        while (i + 2 <= n) {
+            uint32_t unit = unitAt(i);
+            if (unit < 0xD800 || unit > 0xDFFF) {
+                appendCodePoint(out, unit);
+                i += 2;
+                continue;
+            }
+            if (unit <= 0xDBFF && i + 4 > n && !final) {
+                return i;
+            }
+            uint32_t low = unit <= 0xDBFF && i + 4 <= n ? unitAt(i + 2) : 0;
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                appendCodePoint(out, 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00));
+                i += 4;
+            } else {
+                appendCodePoint(out, kReplacement);
+                i += 2;
+            }
+        }
+        if (i < n && final) {
+            appendCodePoint(out, kReplacement);
+            i = n;
+        }
+        return i;
+    }
+};
+
+// Encoding of a text input from its first bytes. A byte order mark
+// decides, and its length goes to `bomLength`. Without one, valid UTF-8
+// is UTF-8; anything else is Windows-1252 if it uses the bytes 0x80-0x9F
+// (C1 controls in Latin-1, which real text never contains) and Latin-1
+// otherwise. `complete` says whether `head` is the whole input; if not, a
+// sequence cut off at its end does not count against UTF-8.
+inline TextEncoding detectEncoding(std::string_view head, size_t* bomLength = nullptr,
+                                   bool complete = true) {
+    size_t bom = 0;
+    TextEncoding encoding = TextEncoding::UTF8;
+    if (head.substr(0, 3) == "\xEF\xBB\xBF") {
+        bom = 3;
+    } else if (head.substr(0, 2) == "\xFF\xFE") {
+        bom = 2;
+        encoding = TextEncoding::UTF16LE;
+    } else if (head.substr(0, 2) == "\xFE\xFF") {
+        bom = 2;
+        encoding = TextEncoding::UTF16BE;
+    } else {
+        std::string_view checked = complete ? head : head.substr(0, Transcoder::completeUTF8Prefix(head));
+        if (!isValidUTF8(checked)) {
+            encoding = TextEncoding::Latin1;
+            for (char c : head) {
+                uint8_t byte = static_cast<uint8_t>(c);
+                if (byte >= 0x80 && byte < 0xA0) {
+                    encoding = TextEncoding::Windows1252;
+                    break;
+                }
+            }
+        }
+    }
+    if (bomLength) {
+        *bomLength = bom;
+    }
+    return encoding;
+}
+
+struct DecodedText {
+    std::string_view text;
+    TextEncoding encoding;
+};
+
+// The pre-parse stage of in-memory input: `bytes` as UTF-8 without a byte
+// order mark. Valid UTF-8 comes back as a view into `bytes`, so the common
+// case costs one validation pass and no copy; anything else is decoded
+// into `storage`.
+inline DecodedText decodeText(std::string_view bytes, std::string& storage) {
+    size_t bom = 0;
+    TextEncoding encoding = detectEncoding(bytes, &bom);
+    bytes.remove_prefix(bom);
+    // Without a BOM detectEncoding() already validated the bytes
+    if (encoding == TextEncoding::UTF8 && (bom == 0 || isValidUTF8(bytes))) {
+        return {bytes, encoding};
+    }
+    storage.clear();
+    Transcoder::toUTF8(bytes, encoding, storage);
+    return {storage, encoding};
+}
+
+// UTF-8 decoded from `source` as it is read: the pre-parse stage of the
+// streaming readers. The encoding is detected from the first block, so a
+// file that turns out not to be UTF-8 past it reads with U+FFFD in place
+// of the bad bytes.
+class TextInputStream : public InputStream {
+public:
+    static constexpr size_t kBlockSize = 1 << 16;
+
+    explicit TextInputStream(std::unique_ptr<InputStream> input) : source(std::move(input)) {
+        readMore();
+        size_t bom = 0;
+        textEncoding = detectEncoding(raw, &bom, finished);
+        raw.erase(0, bom);
+    }
+
+    TextEncoding encoding() const { return textEncoding; }
+
+    size_t read(char* data, size_t size) override {
+        size_t total = 0;
+        while (total < size) {
+            if (decodedPos == decoded.size() && !decodeMore()) {
+                break;
+            }
+            size_t count = std::min(size - total, decoded.size() - decodedPos);
+            std::memcpy(data + total, decoded.data() + decodedPos, count);
+            decodedPos += count;
+            total += count;
+        }
+        return total;
+    }
+
+private:
+    std::unique_ptr<InputStream> source;
+    TextEncoding textEncoding = TextEncoding::UTF8;
+    std::string raw;              // read but not yet decoded
+    std::string decoded;
+    size_t decodedPos = 0;
+    bool finished = false;
+
+    // Append up to a block of source bytes to `raw`
+    void readMore() {
+        size_t used = raw.size();
+        raw.resize(used + kBlockSize);
+        size_t got = 0;
+        while (got < kBlockSize) {
+            size_t n = source->read(&raw[used + got], kBlockSize - got);
+            if (n == 0) {
+                finished = true;
+                break;
+            }
+            got += n;
+        }
+        raw.resize(used + got);
+    }
+
+    bool decodeMore() {
+        decoded.clear();
+        decodedPos = 0;
+        while (decoded.empty()) {
+            if (raw.empty() && finished) {
+                return false;
+            }
+            if (!finished) {
+                readMore();
+            }
+            size_t consumed = Transcoder::toUTF8(raw, textEncoding, decoded, finished);
+            raw.erase(0, consumed);
+        }
+        return true;
+    }
+};
+
+// openInputStream() decoded to UTF-8; encoding() says from what
+inline std::unique_ptr<TextInputStream> openTextStream(const std::string& filename) {
+    return std::make_unique<TextInputStream>(openInputStream(filename));
+}
+
+#endif // TEXT_ENCODING_H
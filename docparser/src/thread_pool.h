@@ -0,0 +1,402 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// True on threads that already run one of several parses side by side:
+// the workers of a WorkStealingPool and the parser threads of a directory
+// pipeline. Splitting one input across cores (ParallelOptions, whole-buffer
+// decompression) stays on the calling thread there, so a batch of N large
+// files runs on N threads rather than N per core.
+inline bool& onParallelWorker() {
+    thread_local bool worker = false;
+    return worker;
+}
+
+// Fixed-size thread pool with one task deque per worker. Workers pop their
+// own deque LIFO and steal FIFO from the others when it runs dry, so one
+// worker stuck on a huge file never leaves queued small files waiting.
+// Tasks must not throw.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(size_t threadCount = 0) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < threadCount; ++i) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Tasks submitted from a worker go to its own deque, others round-robin
+    void submit(Task task) {
+        size_t target = currentWorker() == this ? currentIndex()
+                                                : nextQueue.fetch_add(1) % queues.size();
+        // Count the task before it becomes visible so a fast worker can't
+        // finish it before `pending` includes it
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            ++queued;
+            ++pending;
+        }
+        {
+            std::lock_guard<std::mutex> guard(queues[target]->lock);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Block until every submitted task has finished
+    void wait() {
+        std::unique_lock<std::mutex> guard(stateLock);
+        done.wait(guard, [this] { return pending == 0; });
+    }
+
+    size_t size() const { return workers.size(); }
+
+    // True when called from one of this pool's workers
+    bool isWorker() const { return currentWorker() == this; }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextQueue{0};
+
+    // queued: tasks sitting in deques; pending: queued or running
+    std::mutex stateLock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    size_t queued = 0;
+    size_t pending = 0;
+    bool stopping = false;
+
+    static WorkStealingPool*& currentWorker() {
+        static thread_local WorkStealingPool* pool = nullptr;
+        return pool;
+    }
+
+    static size_t& currentIndex() {
+        static thread_local size_t index = 0;
+        return index;
+    }
+
+    bool tryPop(size_t self, Task& task) {
+        {
+            Queue& own = *queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            Queue& victim = *queues[(self + offset) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t self) {
+        currentWorker() = this;
+        currentIndex() = self;
+        onParallelWorker() = queues.size() > 1;
+
+        while (true) {
+            Task task;
+            if (tryPop(self, task)) {
+                {
+                    std::lock_guard<std::mutex> guard(stateLock);
+                    --queued;
+                }
+                task();
+                std::lock_guard<std::mutex> guard(stateLock);
+                if (--pending == 0) {
+                    done.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(stateLock);
+            if (stopping && queued == 0) {
+                return;
+            }
+            wake.wait(guard, [this] { return queued > 0 || stopping; });
+            if (stopping && queued == 0) {
+                return;
+            }
+        }
+    }
+};
+
+// Spin-then-yield phase of a wait in a lock-free loop. Waits that outlast
+// it are usually a stage stalled on I/O or a slow consumer, so the caller
+// then blocks rather than polling.
+class Backoff {
+public:
+    // False once the spin and yield rounds are used up
+    bool pause() {
+        if (rounds >= 32) {
+            return false;
+        }
+        if (rounds++ >= 16) {
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+private:
+    int rounds = 0;
+};
+
+// Bounded multi-producer multi-consumer queue: a ring of cells stamped
+// with sequence numbers (Vyukov), so no operation takes a lock or
+// allocates while items flow. push/pop wait out a full/empty queue, which
+// is the backpressure between pipeline stages: they spin with Backoff,
+// then sleep on a condition variable until the other side makes room or
+// brings an item. After close() pushes fail and pops drain what is left,
+// then fail.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask = size - 1;
+        cells = std::make_unique<Cell[]>(size);
+        for (size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Moves from `value` only on success
+    bool tryPush(T& value) {
+        size_t position = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(position, position + 1,
+                                                     std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value) {
+        size_t position = dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(position, position + 1,
+                                                     std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.value = T();
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Blocks while full; false (and `value` untouched) once closed
+    bool push(T value) {
+        Backoff backoff;
+        while (!closed()) {
+            if (tryPush(value) ||
+                (!backoff.pause() && sleepUntil(sleepingPushers, notFull, [&] { return tryPush(value); }))) {
+                wake(sleepingPoppers, notEmpty);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Blocks while empty; false once closed and drained. Items pushed
+    // before close() are still seen: the queue is retried after the flag.
+    bool pop(T& value) {
+        Backoff backoff;
+        while (true) {
+            if (tryPop(value) ||
+                (!backoff.pause() && sleepUntil(sleepingPoppers, notEmpty, [&] { return tryPop(value); }))) {
+                wake(sleepingPushers, notFull);
+                return true;
+            }
+            if (closed()) {
+                if (!tryPop(value)) {
+                    return false;
+                }
+                wake(sleepingPushers, notFull);
+                return true;
+            }
+        }
+    }
+
+    void close() {
+        closedFlag.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> guard(sleepLock);
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    bool closed() const { return closedFlag.load(std::memory_order_acquire); }
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) std::atomic<size_t> dequeuePos{0};
+    alignas(64) std::atomic<bool> closedFlag{false};
+
+    // Only threads that ran out of spins touch these, besides the counts
+    alignas(64) std::atomic<size_t> sleepingPushers{0};
+    std::atomic<size_t> sleepingPoppers{0};
+    std::mutex sleepLock;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+
+    // Retry `attempt` until it succeeds or the queue closes, sleeping in
+    // between. Registering and wake()'s check are both read-modify-writes
+    // of `sleepers`: if wake() comes first, its release makes the other
+    // side's change visible to this attempt; otherwise it sees the sleeper.
+    template <typename Attempt>
+    bool sleepUntil(std::atomic<size_t>& sleepers, std::condition_variable& wakeup, Attempt attempt) {
+        std::unique_lock<std::mutex> guard(sleepLock);
+        sleepers.fetch_add(1, std::memory_order_acq_rel);
+        bool done = false;
+        while (!(done = attempt()) && !closed()) {
+            wakeup.wait(guard);
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+        return done;
+    }
+
+    // After a push or pop: wake one thread sleeping on the other side
+    void wake(std::atomic<size_t>& sleepers, std::condition_variable& wakeup) {
+        if (sleepers.fetch_add(0, std::memory_order_acq_rel) > 0) {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            wakeup.notify_one();
+        }
+    }
+};
+
+// Workers shared by every parallelFor() in the process, one per hardware
+// thread. Created on first use and never destroyed, so a parse that runs
+// during static destruction still has its workers.
+inline WorkStealingPool& slicePool() {
+    static WorkStealingPool* pool = new WorkStealingPool();
+    return *pool;
+}
+
+// Run body(0) .. body(count - 1) at once, the caller taking index 0 and
+// slicePool() the rest. Meant for a few large slices of one input; the
+// first exception thrown is rethrown once every slice has finished. Calls
+// from a slicePool() worker run every index on that worker, since waiting
+// there for the pool could deadlock it.
+inline void parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    std::vector<std::exception_ptr> errors(count);
+    auto guarded = [&body, &errors](size_t index) {
+        try {
+            body(index);
+        } catch (...) {
+            errors[index] = std::current_exception();
+        }
+    };
+    WorkStealingPool& pool = slicePool();
+    if (count > 1 && !pool.isWorker()) {
+        // Counts down as slices finish; the pool's own wait() would also
+        // wait for the slices of every other caller
+        std::mutex lock;
+        std::condition_variable finished;
+        size_t remaining = count - 1;
+        for (size_t i = 1; i < count; ++i) {
+            pool.submit([&, i] {
+                guarded(i);
+                std::lock_guard<std::mutex> guard(lock);
+                if (--remaining == 0) {
+                    finished.notify_one();
+                }
+            });
+        }
+        guarded(0);
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [&remaining] { return remaining == 0; });
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            guarded(i);
+        }
+    }
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+#endif // THREAD_POOL_H
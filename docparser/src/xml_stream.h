@@ -0,0 +1,771 @@
+#ifndef XML_STREAM_H
+#define XML_STREAM_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "compressed_input.h"
+#include "document_arena.h"
+#include "text_encoding.h"
+
+// Event-driven XML/HTML tokenizer. Input is a buffer or a file read in
+// fixed-size chunks, so memory stays bounded by the chunk size plus the
+// longest tag and the element depth. Comments, processing instructions and
+// DOCTYPE declarations are skipped, CDATA becomes text, entities in text
+// are decoded and, for HTML, the bodies of <script> and <style> are skipped.
+
+enum class XMLEventType { StartElement, EndElement, Text };
+
+// Views stay valid until the next call to XMLStreamReader::next()
+struct XMLEvent {
+    XMLEventType type = XMLEventType::Text;
+    std::string_view name;        // element name, lower case for HTML
+    std::string_view attributes;  // raw attribute text of a start tag; see forEachAttribute()
+    std::string_view text;        // decoded text; a long run may arrive as several events
+    size_t depth = 0;             // depth of the element, or of the text's parent; the root is 1
+};
+
+struct XMLStreamOptions {
+    bool html = false;            // case-insensitive names, void elements, script/style skipped
+    size_t chunkSize = 1 << 20;   // bytes read from a file at a time
+    size_t maxTagBytes = 1 << 20; // longest tag accepted before giving up
+    std::string select;           // XPath-lite filter (see XMLPath); empty keeps everything
+};
+
+// ASCII-only helpers; cheaper than <cctype>'s locale-aware calls in the
+// per-byte loops
+inline bool isXMLSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+inline char asciiLower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; }
+
+// Call `fn(name, rawValue)` for each attribute of a start tag. Values keep
+// their entities; pass them through decodeXMLEntities() when needed.
+template <typename Fn>
+void forEachAttribute(std::string_view attributes, Fn fn) {
+    size_t i = 0;
+    const size_t n = attributes.size();
+    auto space = [&](size_t at) { return isXMLSpace(attributes[at]); };
+    while (i < n) {
+        while (i < n && (space(i) || attributes[i] == '/')) ++i;
+        size_t nameStart = i;
+        while (i < n && !space(i) && attributes[i] != '=' && attributes[i] != '/') ++i;
+        if (i == nameStart) {
+            break;
+        }
+        std::string_view name = attributes.substr(nameStart, i - nameStart);
+        while (i < n && space(i)) ++i;
+        std::string_view value;
+        if (i < n && attributes[i] == '=') {
+            ++i;
+            while (i < n && space(i)) ++i;
+            if (i < n && (attributes[i] == '"' || attributes[i] == '\'')) {
+                char quote = attributes[i++];
+                size_t close = attributes.find(quote, i);
+                if (close == std::string_view::npos) close = n;
+                value = attributes.substr(i, close - i);
+                i = close < n ? close + 1 : n;
+            } else {
+                size_t valueStart = i;
+                while (i < n && !space(i)) ++i;
+                value = attributes.substr(valueStart, i - valueStart);
+            }
+        }
+        fn(name, value);
+    }
+}
+
+template <typename String>
+void appendUTF8(String& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Longest entity reference recognised, "&" and ";" included
+constexpr size_t kMaxEntityBytes = 32;
+
+// Append `text` to `out` with character references and the XML entities
+// (plus the common HTML ones) decoded; anything unrecognised is kept as is.
+// Decoded text is never longer than its source.
+template <typename String>
+void decodeXMLEntities(std::string_view text, String& out) {
+    static const std::pair<std::string_view, uint32_t> named[] = {
+        {"amp", '&'}, {"lt", '<'}, {"gt", '>'}, {"quot", '"'}, {"apos", '\''},
+        {"nbsp", 0xA0}, {"copy", 0xA9}, {"reg", 0xAE}, {"laquo", 0xAB}, {"raquo", 0xBB},
+        {"ndash", 0x2013}, {"mdash", 0x2014}, {"lsquo", 0x2018}, {"rsquo", 0x2019},
+        {"ldquo", 0x201C}, {"rdquo", 0x201D}, {"hellip", 0x2026}, {"euro", 0x20AC},
+        {"trade", 0x2122}};
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t amp = text.find('&', i);
+        if (amp == std::string_view::npos) {
+            out.append(text.data() + i, text.size() - i);
+            return;
+        }
+        out.append(text.data() + i, amp - i);
+        size_t semi = text.find(';', amp + 1);
+        bool decoded = false;
+        if (semi != std::string_view::npos && semi - amp < kMaxEntityBytes) {
+            std::string_view ref = text.substr(amp + 1, semi - amp - 1);
+            if (ref.size() > 1 && ref[0] == '#') {
+                bool hex = ref[1] == 'x' || ref[1] == 'X';
+                std::string_view digits = ref.substr(hex ? 2 : 1);
+                uint32_t cp = 0;
+                bool valid = !digits.empty() && digits.size() <= 8;
+                for (char c : digits) {
+                    int digit = std::isdigit(static_cast<unsigned char>(c)) ? c - '0'
+                              : hex && std::isxdigit(static_cast<unsigned char>(c))
+                                  ? std::tolower(static_cast<unsigned char>(c)) - 'a' + 10 : -1;
+                    if (digit < 0) {
+                        valid = false;
+                        break;
+                    }
+                    cp = cp * (hex ? 16 : 10) + static_cast<uint32_t>(digit);
+                }
+                if (valid && cp > 0 && cp <= 0x10FFFF && (cp < 0xD800 || cp > 0xDFFF)) {
+                    appendUTF8(out, cp);
+                    decoded = true;
+                }
+            } else {
+                for (const auto& entity : named) {
+                    if (ref == entity.first) {
+                        appendUTF8(out, entity.second);
+                        decoded = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (decoded) {
+            i = semi + 1;
+        } else {
+            out += '&';
+            i = amp + 1;
+        }
+    }
+}
+
+// XPath-lite element filter: steps separated by "/" (child) or "//"
+// (descendant), each an element name or "*" with an optional [@attr] or
+// [@attr='value'] predicate, e.g. "/mediawiki/page/revision/text" or
+// "//div[@class='content']". A path not starting with "/" may match at any
+// depth. Up to 64 steps.
+class XMLPath {
+public:
+    XMLPath() = default;
+
+    explicit XMLPath(std::string_view expression) {
+        size_t i = 0;
+        bool first = true;
+        while (i < expression.size()) {
+            Step step;
+            if (expression.compare(i, 2, "//") == 0) {
+                step.descendant = true;
+                i += 2;
+            } else if (expression[i] == '/') {
+                i += 1;
+            } else if (first) {
+                step.descendant = true;
+            } else {
+                fail(expression);
+            }
+            first = false;
+            size_t nameStart = i;
+            while (i < expression.size() && expression[i] != '/' && expression[i] != '[') ++i;
+            step.name = std::string(expression.substr(nameStart, i - nameStart));
+            if (step.name.empty()) {
+                fail(expression);
+            }
+            if (i < expression.size() && expression[i] == '[') {
+                size_t close = expression.find(']', i);
+                if (close == std::string_view::npos || expression.compare(i, 2, "[@") != 0) {
+                    fail(expression);
+                }
+                std::string_view predicate = expression.substr(i + 2, close - i - 2);
+                size_t eq = predicate.find('=');
+                step.attribute = std::string(predicate.substr(0, eq));
+                if (eq != std::string_view::npos) {
+                    std::string_view value = predicate.substr(eq + 1);
+                    if (value.size() < 2 || (value.front() != '\'' && value.front() != '"') ||
+                        value.back() != value.front()) {
+                        fail(expression);
+                    }
+                    step.value = std::string(value.substr(1, value.size() - 2));
+                    step.hasValue = true;
+                }
+                if (step.attribute.empty()) {
+                    fail(expression);
+                }
+                i = close + 1;
+            }
+            steps.push_back(std::move(step));
+        }
+        if (steps.size() > 64) {
+            throw std::runtime_error("XPath expression has more than 64 steps: " + std::string(expression));
+        }
+    }
+
+    bool empty() const { return steps.empty(); }
+
+    // Bit i is set if the element satisfies step i on its own
+    uint64_t stepMatches(std::string_view name, std::string_view attributes) const {
+        uint64_t mask = 0;
+        for (size_t i = 0; i < steps.size(); ++i) {
+            const Step& step = steps[i];
+            if (step.name != "*" && step.name != name) {
+                continue;
+            }
+            if (!step.attribute.empty()) {
+                bool found = false;
+                forEachAttribute(attributes, [&](std::string_view attr, std::string_view value) {
+                    if (found || attr != step.attribute) return;
+                    if (!step.hasValue) {
+                        found = true;
+                    } else {
+                        std::string decoded;
+                        decodeXMLEntities(value, decoded);
+                        found = decoded == step.value;
+                    }
+                });
+                if (!found) {
+                    continue;
+                }
+            }
+            mask |= uint64_t(1) << i;
+        }
+        return mask;
+    }
+
+    // Steps that end exactly at an element, given its own stepMatches(), its
+    // parent's result (`parentEnds`), the union over all its ancestors
+    // (`ancestorEnds`) and whether it is the root
+    uint64_t advance(uint64_t own, uint64_t parentEnds, uint64_t ancestorEnds, bool root) const {
+        uint64_t ends = 0;
+        for (size_t i = 0; i < steps.size(); ++i) {
+            if (!(own & (uint64_t(1) << i))) {
+                continue;
+            }
+            bool reachable;
+            if (i == 0) {
+                reachable = steps[0].descendant || root;
+            } else {
+                uint64_t previous = uint64_t(1) << (i - 1);
+                reachable = (steps[i].descendant ? ancestorEnds : parentEnds) & previous;
+            }
+            if (reachable) {
+                ends |= uint64_t(1) << i;
+            }
+        }
+        return ends;
+    }
+
+    // Whether `ends` (from advance) means the whole path matched
+    bool complete(uint64_t ends) const {
+        return !steps.empty() && (ends & (uint64_t(1) << (steps.size() - 1)));
+    }
+
+private:
+    struct Step {
+        bool descendant = false;
+        std::string name;
+        std::string attribute;
+        std::string value;
+        bool hasValue = false;
+    };
+    std::vector<Step> steps;
+
+    [[noreturn]] static void fail(std::string_view expression) {
+        throw std::runtime_error("Invalid XPath expression: " + std::string(expression));
+    }
+};
+
+// Pull tokenizer: call next() until it returns false, or hand parse() a
+// callback. Element events are balanced: elements still open at the end of
+// the input, or closed implicitly by an outer end tag, get their end event.
+class XMLStreamReader {
+public:
+    // Stream `filename` in chunks of options.chunkSize bytes, decompressing
+    // gzip or zstd input and decoding it to UTF-8 on the way
+    static XMLStreamReader fromFile(const std::string& filename, const XMLStreamOptions& options = {}) {
+        return fromStream(openTextStream(filename), options);
+    }
+
+    // Tokenize UTF-8 from `input` in chunks
+    static XMLStreamReader fromStream(std::unique_ptr<InputStream> input, const XMLStreamOptions& options = {}) {
+        XMLStreamReader reader(options);
+        reader.input = std::move(input);
+        reader.streaming = true;
+        reader.eof = false;
+        return reader;
+    }
+
+    // Tokenize a buffer in place; `data` must outlive the reader
+    static XMLStreamReader fromBuffer(std::string_view data, const XMLStreamOptions& options = {}) {
+        XMLStreamReader reader(options);
+        reader.source = data;
+        return reader;
+    }
+
+    // Read the next event. Returns false once the input is exhausted.
+    bool next(XMLEvent& event) {
+        for (;;) {
+            if (stack.size() > closeTo) {
+                size_t depth = stack.size();
+                bool visible = path.empty() || selectedDepth != 0;
+                endName.assign(nameOf(stack.back()));
+                names.resize(stack.back().nameStart);
+                stack.pop_back();
+                if (selectedDepth == depth) {
+                    selectedDepth = 0;
+                }
+                if (stack.size() == closeTo) {
+                    closeTo = kNone;
+                }
+                if (visible) {
+                    event = XMLEvent();
+                    event.type = XMLEventType::EndElement;
+                    event.name = endName;
+                    event.depth = depth;
+                    return true;
+                }
+                continue;
+            }
+
+            std::string_view w = window();
+            if (pos >= w.size()) {
+                if (!eof) {
+                    refill();
+                    continue;
+                }
+                if (!stack.empty()) {
+                    closeTo = 0;
+                    continue;
+                }
+                return false;
+            }
+
+            switch (mode) {
+                case Mode::Comment:
+                    skipUntil(w, "-->");
+                    continue;
+                case Mode::Instruction:
+                    skipUntil(w, "?>");
+                    continue;
+                case Mode::Declaration:
+                    skipDeclaration(w);
+                    continue;
+                case Mode::RawText:
+                    skipRawText(w);
+                    continue;
+                case Mode::CData:
+                    if (readCData(w, event)) return true;
+                    continue;
+                case Mode::Content:
+                    break;
+            }
+
+            if (w[pos] == '<') {
+                if (readMarkup(w, event)) return true;
+            } else {
+                if (readText(w, event)) return true;
+            }
+        }
+    }
+
+    // Feed every event to `onEvent(const XMLEvent&)`
+    template <typename Callback>
+    void parse(Callback&& onEvent) {
+        XMLEvent event;
+        while (next(event)) {
+            onEvent(static_cast<const XMLEvent&>(event));
+        }
+    }
+
+    // Bytes of input consumed so far
+    size_t offset() const { return consumed + pos; }
+
+    // Open elements, innermost last
+    size_t depth() const { return stack.size(); }
+
+private:
+    enum class Mode { Content, Comment, Instruction, Declaration, CData, RawText };
+    static constexpr size_t kNone = static_cast<size_t>(-1);
+
+    struct OpenElement {
+        size_t nameStart = 0;    // the name is names[nameStart, nameStart + nameLength)
+        size_t nameLength = 0;
+        uint64_t ends = 0;       // XMLPath steps ending at this element
+        uint64_t ancestors = 0;  // union of `ends` from the root down to here
+    };
+
+    XMLStreamOptions options;
+    XMLPath path;
+    std::unique_ptr<InputStream> input;
+    std::string buffer;
+    std::string_view source;
+    size_t pos = 0;
+    size_t consumed = 0;
+    bool streaming = false;
+    bool eof = true;
+
+    Mode mode = Mode::Content;
+    int declarationDepth = 0;
+    std::string rawTextEnd;  // "</script" or "</style" while skipping
+
+    // Working storage allocates from scratchResource(). Open element names
+    // sit back to back in `names`, so pushing one does not allocate.
+    std::pmr::vector<OpenElement> stack;
+    std::pmr::string names;
+    size_t closeTo = kNone;     // pop and report ends until the stack is this deep
+    size_t selectedDepth = 0;   // depth of the element that matched `select`, 0 if none
+    std::pmr::string endName;
+    std::pmr::string nameBuffer;
+    std::pmr::string scratch;
+
+    explicit XMLStreamReader(const XMLStreamOptions& streamOptions)
+        : options(streamOptions), path(streamOptions.select), stack(scratchResource()),
+          names(scratchResource()), endName(scratchResource()), nameBuffer(scratchResource()),
+          scratch(scratchResource()) {
+        if (options.chunkSize == 0) {
+            options.chunkSize = XMLStreamOptions().chunkSize;
+        }
+    }
+
+    std::string_view window() const {
+        return streaming ? std::string_view(buffer) : source;
+    }
+
+    std::string_view nameOf(const OpenElement& element) const {
+        return std::string_view(names).substr(element.nameStart, element.nameLength);
+    }
+
+    // Drop consumed bytes and append the next chunk; sets eof at the end
+    void refill() {
+        if (!streaming) {
+            eof = true;
+            return;
+        }
+        if (pos > 0) {
+            buffer.erase(0, pos);
+            consumed += pos;
+            pos = 0;
+        }
+        size_t old = buffer.size();
+        buffer.resize(old + options.chunkSize);
+        size_t got = input->read(&buffer[old], options.chunkSize);
+        buffer.resize(old + got);
+        if (got == 0) {
+            eof = true;
+        }
+    }
+
+    bool visible() const { return path.empty() || selectedDepth != 0; }
+
+    // Skip input up to and including `terminator`, keeping a possible
+    // partial terminator at the end of the window
+    void skipUntil(std::string_view w, std::string_view terminator) {
+        size_t found = w.find(terminator, pos);
+        if (found != std::string_view::npos) {
+            pos = found + terminator.size();
+            mode = Mode::Content;
+        } else if (eof) {
+            pos = w.size();
+        } else {
+            pos = std::max(pos, w.size() - std::min(w.size(), terminator.size() - 1));
+            refill();
+        }
+    }
+
+    // <!DOCTYPE ...> and friends, which may nest [...] internal subsets
+    void skipDeclaration(std::string_view w) {
+        while (pos < w.size()) {
+            char c = w[pos++];
+            if (c == '[') {
+                ++declarationDepth;
+            } else if (c == ']') {
+                --declarationDepth;
+            } else if (c == '>' && declarationDepth <= 0) {
+                mode = Mode::Content;
+                return;
+            }
+        }
+    }
+
+    // Skip a <script> or <style> body up to its end tag, which is then
+    // read as markup
+    void skipRawText(std::string_view w) {
+        const size_t length = rawTextEnd.size();
+        for (size_t lt = w.find("</", pos); lt != std::string_view::npos; lt = w.find("</", lt + 2)) {
+            if (lt + length > w.size()) {
+                break;
+            }
+            bool match = true;
+            for (size_t k = 2; k < length; ++k) {
+                if (asciiLower(w[lt + k]) != rawTextEnd[k]) {
+                    match = false;
+                    break;
+                }
+            }
+            if (match) {
+                pos = lt;
+                mode = Mode::Content;
+                return;
+            }
+        }
+        if (eof) {
+            pos = w.size();
+        } else {
+            pos = std::max(pos, w.size() - std::min(w.size(), length - 1));
+            refill();
+        }
+    }
+
+    bool readCData(std::string_view w, XMLEvent& event) {
+        size_t close = w.find("]]>", pos);
+        size_t end;
+        if (close != std::string_view::npos) {
+            end = close;
+        } else if (eof) {
+            end = w.size();
+        } else {
+            end = std::max(pos, w.size() - std::min(w.size(), size_t(2)));
+        }
+        std::string_view text = w.substr(pos, end - pos);
+        if (close != std::string_view::npos) {
+            pos = close + 3;
+            mode = Mode::Content;
+        } else {
+            pos = end;
+            if (text.empty() && !eof) {
+                refill();
+            }
+        }
+        if (text.empty() || !visible()) {
+            return false;
+        }
+        event = XMLEvent();
+        event.type = XMLEventType::Text;
+        event.text = text;
+        event.depth = stack.size();
+        return true;
+    }
+
+    bool readText(std::string_view w, XMLEvent& event) {
+        size_t lt = w.find('<', pos);
+        size_t end = lt == std::string_view::npos ? w.size() : lt;
+        if (lt == std::string_view::npos && !eof) {
+            // Hold back an entity reference the chunk boundary may have cut
+            size_t amp = w.rfind('&', end - 1);
+            if (amp != std::string_view::npos && amp >= pos && end - amp < kMaxEntityBytes &&
+                w.find(';', amp) == std::string_view::npos) {
+                end = amp;
+            }
+            if (end == pos) {
+                refill();
+                return false;
+            }
+        }
+        std::string_view raw = w.substr(pos, end - pos);
+        pos = end;
+        if (!visible()) {
+            return false;
+        }
+        event = XMLEvent();
+        event.type = XMLEventType::Text;
+        event.depth = stack.size();
+        if (raw.find('&') == std::string_view::npos) {
+            event.text = raw;
+        } else {
+            scratch.clear();
+            decodeXMLEntities(raw, scratch);
+            event.text = scratch;
+        }
+        return true;
+    }
+
+    static bool isNameStart(char c) {
+        return (asciiLower(c) >= 'a' && asciiLower(c) <= 'z') || c == '_' || c == ':' ||
+               static_cast<unsigned char>(c) >= 0x80;
+    }
+
+    static bool isVoidElement(std::string_view name) {
+        if (name.size() < 2 || name.size() > 6) return false;
+        static const std::string_view voids[] = {
+            "area", "base", "br", "col", "embed", "hr", "img", "input", "link", "meta",
+            "param", "source", "track", "wbr"};
+        for (std::string_view v : voids) {
+            if (name == v) return true;
+        }
+        return false;
+    }
+
+    // HTML elements whose start tag ends an open one of the same name
+    static bool closesItself(std::string_view name) {
+        if (name.empty() || name.size() > 6) return false;
+        static const std::string_view names[] = {"dd", "dt", "li", "option", "p", "td", "th", "tr"};
+        for (std::string_view n : names) {
+            if (name == n) return true;
+        }
+        return false;
+    }
+
+    // A tag, comment, CDATA section, declaration or stray '<' at `pos`
+    bool readMarkup(std::string_view w, XMLEvent& event) {
+        if (w.size() - pos < 9 && !eof) {
+            refill();
+            return false;
+        }
+        std::string_view rest = w.substr(pos);
+        if (rest.size() > 1 && (rest[1] == '!' || rest[1] == '?')) {
+            if (rest.compare(0, 4, "<!--") == 0) {
+                pos += 4;
+                mode = Mode::Comment;
+            } else if (rest.compare(0, 9, "<![CDATA[") == 0) {
+                pos += 9;
+                mode = Mode::CData;
+            } else if (rest[1] == '?') {
+                pos += 2;
+                mode = Mode::Instruction;
+            } else {
+                pos += 2;
+                declarationDepth = 0;
+                mode = Mode::Declaration;
+            }
+            return false;
+        }
+
+        bool closing = rest.size() > 1 && rest[1] == '/';
+        size_t nameAt = closing ? 2 : 1;
+        if (rest.size() <= nameAt || !isNameStart(rest[nameAt])) {
+            // Not a tag, e.g. "a < b" in HTML: the '<' is text
+            pos += 1;
+            if (!visible()) return false;
+            event = XMLEvent();
+            event.type = XMLEventType::Text;
+            event.text = "<";
+            event.depth = stack.size();
+            return true;
+        }
+
+        // Find the closing '>' outside quoted attribute values
+        size_t gt = rest.find_first_of("\"'>", 1);
+        while (gt != std::string_view::npos && rest[gt] != '>') {
+            size_t close = rest.find(rest[gt], gt + 1);
+            gt = close == std::string_view::npos ? close : rest.find_first_of("\"'>", close + 1);
+        }
+        if (gt == std::string_view::npos) {
+            if (eof) {
+                pos = w.size();  // unterminated tag at the end: dropped
+            } else if (rest.size() > options.maxTagBytes) {
+                throw std::runtime_error("XML tag longer than " + std::to_string(options.maxTagBytes) +
+                                         " bytes at offset " + std::to_string(offset()));
+            } else {
+                refill();
+            }
+            return false;
+        }
+
+        std::string_view tag = rest.substr(1, gt - 1);
+        size_t tagStart = pos;
+        pos += gt + 1;
+        if (closing) {
+            tag.remove_prefix(1);
+        }
+        size_t nameEnd = 0;
+        while (nameEnd < tag.size() && !isXMLSpace(tag[nameEnd]) &&
+               tag[nameEnd] != '/') {
+            ++nameEnd;
+        }
+        nameBuffer.assign(tag.data(), nameEnd);
+        if (options.html) {
+            for (char& c : nameBuffer) c = asciiLower(c);
+        }
+        std::string_view name = nameBuffer;
+
+        if (closing) {
+            // Close the innermost open element of that name and any left
+            // open inside it; stray end tags are ignored
+            for (size_t i = stack.size(); i-- > 0;) {
+                if (nameOf(stack[i]) == name) {
+                    closeTo = i;
+                    break;
+                }
+            }
+            return false;
+        }
+
+        if (options.html && !stack.empty() && nameOf(stack.back()) == name && closesItself(name)) {
+            // <li>one<li>two: end the open one first, then read this tag again
+            closeTo = stack.size() - 1;
+            pos = tagStart;
+            return false;
+        }
+        
+        std::string_view attributes = tag.substr(nameEnd);
+        bool selfClosing = !attributes.empty() && attributes.back() == '/';
+        if (selfClosing) attributes.remove_suffix(1);
+        while (!attributes.empty() && isXMLSpace(attributes.front()))
+            attributes.remove_prefix(1);
+        while (!attributes.empty() && isXMLSpace(attributes.back()))
+            attributes.remove_suffix(1);
+        if (options.html && isVoidElement(name)) {
+            selfClosing = true;
+        }
+
+        uint64_t ends = 0;
+        uint64_t ancestors = 0;
+        if (!path.empty()) {
+            uint64_t parentEnds = stack.empty() ? 0 : stack.back().ends;
+            ancestors = stack.empty() ? 0 : stack.back().ancestors;
+            ends = path.advance(path.stepMatches(name, attributes), parentEnds, ancestors, stack.empty());
+            ancestors |= ends;
+        }
+        stack.emplace_back();
+        stack.back().nameStart = names.size();
+        stack.back().nameLength = name.size();
+        names += name;
+        stack.back().ends = ends;
+        stack.back().ancestors = ancestors;
+        if (selectedDepth == 0 && path.complete(stack.back().ends)) {
+            selectedDepth = stack.size();
+        }
+        if (selfClosing) {
+            closeTo = stack.size() - 1;
+        } else if (options.html && (name == "script" || name == "style")) {
+            rawTextEnd.assign("</").append(name);
+            mode = Mode::RawText;
+        }
+
+        if (!visible()) {
+            return false;
+        }
+        event = XMLEvent();
+        event.type = XMLEventType::StartElement;
+        event.name = nameOf(stack.back());
+        event.attributes = attributes;
+        event.depth = stack.size();
+        return true;
+    }
+};
+
+#endif // XML_STREAM_H
@@ -1,6 +1,22 @@
+import os
+
 from setuptools import setup
 from pybind11.setup_helpers import Pybind11Extension, build_ext
 
+# DOCPARSER_ENABLE_STATS=1 pip install . compiles in the parse stats
+define_macros = []
+if os.environ.get("DOCPARSER_ENABLE_STATS", "0") not in ("", "0"):
+    define_macros.append(("DOCPARSER_ENABLE_STATS", "1"))
+
+# Compressed input: gzip needs zlib (on by default), zstd needs libzstd
+libraries = []
+if os.environ.get("DOCPARSER_WITH_ZLIB", "1") not in ("", "0"):
+    define_macros.append(("DOCPARSER_HAVE_ZLIB", "1"))
+    libraries.append("z")
+if os.environ.get("DOCPARSER_WITH_ZSTD", "0") not in ("", "0"):
+    define_macros.append(("DOCPARSER_HAVE_ZSTD", "1"))
+    libraries.append("zstd")
+
 ext_modules = [
     Pybind11Extension(
         "docparser",
@@ -10,6 +26,8 @@ ext_modules = [
         include_dirs=[
             "docparser/src",
         ],
+        define_macros=define_macros,
+        libraries=libraries,
         language='c++',
         cxx_std=17,
     ),